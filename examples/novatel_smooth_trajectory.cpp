@@ -0,0 +1,89 @@
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "novatel/novatel.h"
+#include "novatel/novatel_smoother.h"
+using namespace novatel;
+using namespace std;
+
+// Smooths a recorded INSPVAB, INSCOVB and BESTPOSB log file and writes
+// the smoothed trajectory as CSV
+
+TrajectorySmoother *smoother;
+ofstream output;
+
+void InsPvaHandler(InsPositionVelocityAttitude &pva, double &timestamp) {
+    smoother->AddInsPva(pva);
+}
+
+void InsCovarianceHandler(InsCovariance &cov, double &timestamp) {
+    smoother->AddInsCovariance(cov);
+}
+
+void BestPositionHandler(Position &pos, double &timestamp) {
+    smoother->AddPosition(pos);
+}
+
+void SmoothedEpochHandler(const SmoothedEpoch &epoch) {
+    output << epoch.gps_week << "," << setprecision(3) << fixed << epoch.gps_seconds << ","
+           << setprecision(9) << epoch.latitude << "," << epoch.longitude << ","
+           << setprecision(4) << epoch.height << ","
+           << sqrt(epoch.covariance[0]) << "," << sqrt(epoch.covariance[4]) << "," << sqrt(epoch.covariance[8]) << ","
+           << epoch.north_velocity << "," << epoch.east_velocity << "," << epoch.up_velocity << ","
+           << epoch.roll << "," << epoch.pitch << "," << epoch.azimuth << "," << epoch.status << endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        cerr << "Usage: novatel_smooth_trajectory <log file> <output csv> [threads] [segment length s] [overlap s]" << endl;
+        return 1;
+    }
+
+    SmootherConfig config;
+    if (argc > 3)
+        config.threads = atoi(argv[3]);
+    if (argc > 4)
+        config.segment_length = atof(argv[4]);
+    if (argc > 5)
+        config.overlap = atof(argv[5]);
+
+    ifstream input(argv[1], ios::in | ios::binary);
+    if (!input.good()) {
+        cerr << "File " << argv[1] << " did not open." << endl;
+        return 1;
+    }
+    output.open(argv[2]);
+    if (!output.good()) {
+        cerr << "File " << argv[2] << " did not open." << endl;
+        return 1;
+    }
+    output << "gps_week,gps_seconds,latitude,longitude,height,east_sigma,north_sigma,up_sigma,"
+              "north_velocity,east_velocity,up_velocity,roll,pitch,azimuth,ins_status" << endl;
+
+    smoother = new TrajectorySmoother(config);
+    smoother->set_smoothed_epoch_callback(&SmoothedEpochHandler);
+
+    Novatel rx1;
+    rx1.set_ins_position_velocity_attitude_callback(&InsPvaHandler);
+    rx1.set_ins_covariance_callback(&InsCovarianceHandler);
+    rx1.set_best_position_callback(&BestPositionHandler);
+
+    // the file is streamed so memory stays bounded however long the drive
+    unsigned char buffer[65536];
+    while (input.good()) {
+        input.read((char*)buffer, sizeof(buffer));
+        if (input.gcount() > 0)
+            rx1.ReadFromFile(buffer, input.gcount());
+    }
+    smoother->Finish();
+
+    SmootherStats stats = smoother->stats();
+    cout << "Smoothed " << stats.epochs << " epochs in " << stats.segments << " segments using "
+         << stats.fixes << " fixes (" << stats.fixes_dropped << " dropped)." << endl;
+    delete smoother;
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <string>
+#include <iostream>
+#include <sstream>
+
+#include "novatel/novatel.h"
+#include "novatel/novatel_coroutine.h"
+using namespace novatel;
+using namespace std;
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+// requests positions and waits for an RTK fixed solution, all driven by
+// the read thread
+ReceiverTask WaitForRtk(Novatel &gps) {
+    if (!co_await Command(gps, "LOG BESTPOSB ONTIME 1")) {
+        cout << "BESTPOSB was not acknowledged." << endl;
+        co_return;
+    }
+    cout << "Waiting for a narrow lane fix." << endl;
+    std::optional<Position> fix = co_await NextLog<BESTPOSB_LOG_TYPE>(gps,
+        [](const Position &pos) {return pos.position_type >= NARROW_INT;}, 300);
+    if (!fix) {
+        cout << "No fix within 5 minutes." << endl;
+        co_return;
+    }
+    cout << "Fixed: (" << fix->latitude << "," << fix->longitude << "," << fix->height << ")" << endl;
+    co_await Command(gps, "UNLOG BESTPOSB");
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3) {
+        std::cerr << "Usage: novatel_wait_for_rtk <serial port address> <baud rate>" << std::endl;
+        return 0;
+    }
+    std::string port(argv[1]);
+    int baudrate=115200;
+    istringstream(argv[2]) >> baudrate;
+
+    Novatel my_gps;
+    if (!my_gps.Connect(port,baudrate)) {
+        cout << "Failed to connect." << endl;
+        return 0;
+    }
+
+    WaitForRtk(my_gps).Wait();
+    my_gps.Disconnect();
+    return 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    std::cerr << "novatel_wait_for_rtk needs a C++20 compiler." << std::endl;
+    return 1;
+}
+
+#endif
@@ -41,6 +41,10 @@
 
 #include <string>
 #include <cstring> // for size_t
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
 
 // Structure definition headers
 #include "novatel/novatel_enums.h"
@@ -49,9 +53,24 @@
 #include <boost/function.hpp>
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
+#include <boost/atomic.hpp>
 //#include <boost/condition_variable.hpp>
-// Serial Headers
-#include "serial/serial.h"
+// Serial, network and file transports
+#include "novatel/novatel_transport.h"
+#include "novatel/novatel_rtcm.h"
+#include "novatel/novatel_demux.h"
+#include "novatel/novatel_decode.h"
+#include "novatel/novatel_encode.h"
+#include "novatel/novatel_recorder.h"
+#include "novatel/novatel_fanout.h"
+#include "novatel/novatel_flight_recorder.h"
+#include "novatel/novatel_batch.h"
+#include "novatel/novatel_executor.h"
+#include "novatel/novatel_latest.h"
+#include "novatel/novatel_waiters.h"
+#include "novatel/novatel_restart.h"
+#include "novatel/novatel_signals.h"
+#include "novatel/novatel_logging.h"
 
 namespace novatel {
 
@@ -59,17 +78,21 @@ namespace novatel {
 #define GRAD_A_RAD(g) ((g)*0.0174532925199433)
 #define CRC32_POLYNOMIAL 0xEDB88320L
 
-// Constants for unpacking RANGECMP
-#define CMP_MAX_VALUE         8388608.0
-#define CMP_GPS_WAVELENGTH_L1 0.1902936727984
-#define CMP_GPS_WAVELENGTH_L2 0.2442102134246
+// RANGECMP wavelengths come from the signal registry in novatel_signals.h,
+// GLONASS frequency numbers are kept for PRNs below this
+#define GLONASS_FREQUENCY_SLOTS 256
+//! glonass_frequency_ of a PRN not seen in RANGE yet
+#define GLONASS_FREQUENCY_NOT_SEEN -128
 
 typedef boost::function<double()> GetTimeCallback;
 typedef boost::function<void()> HandleAcknowledgementCallback;
 
 // Messaging callbacks
-typedef boost::function<void(const std::string&)> LogMsgCallback;
 typedef boost::function<void(unsigned char *)> RawMsgCallback;
+//! Called after the device is recovered with the length of the data gap in seconds
+typedef boost::function<void(double)> DeviceGapCallback;
+typedef boost::function<void(const std::string&, double&)> NmeaCallback;
+typedef boost::function<void(const std::string&, double&)> AsciiLogCallback;
 
 // INS Specific Callbacks
 typedef boost::function<void(InsPositionVelocityAttitude&, double&)> InsPositionVelocityAttitudeCallback;
@@ -102,11 +125,109 @@ typedef boost::function<void(SatelliteVisibility&, double&)> SatelliteVisibility
 typedef boost::function<void(TimeOffset&, double&)> TimeOffsetCallback;
 typedef boost::function<void(TrackStatus&, double&)> TrackingStatusCallback;
 typedef boost::function<void(ReceiverHardwareStatus&, double&)> ReceiverHardwareStatusCallback;
+typedef boost::function<void(RXStatus&, double&)> ReceiverStatusCallback;
 typedef boost::function<void(Position&, double&)> BestPositionCallback;
 typedef boost::function<void(Position&, double&)> BestPseudorangePositionCallback;
 typedef boost::function<void(Position&, double&)> RtkPositionCallback;
+typedef boost::function<void(rtkdatab_log&, double&)> RtkDataCallback;
 
+/*!
+ * Activity of a single binary log observed on the incoming data stream.
+ * Used to infer which logs a receiver that is already streaming has been
+ * configured to output.
+ */
+struct LogActivity {
+    BINARY_LOG_TYPE message_id; //!< binary message id
+    std::string name;           //!< log name (e.g. "BESTPOSB"), empty if unknown
+    uint32_t count;             //!< number of CRC-valid frames received
+    double period;              //!< logging period estimated from the GPS time tags [s]
+    double gps_seconds;         //!< GPS time of week of the most recent frame [s]
+    double last_timestamp;      //!< read timestamp of the most recent frame
+};
+
+/*!
+ * Scheduling options for the thread that reads and parses serial data.
+ * They are applied when reading starts, so set them before Connect() or
+ * Attach().  Real-time priorities and memory locking usually need
+ * CAP_SYS_NICE / CAP_IPC_LOCK; failures are reported as warnings.
+ */
+struct ThreadSchedulingConfig {
+    int cpu;              //!< core to pin the read thread to, -1 to leave it unpinned
+    int priority;         //!< SCHED_FIFO priority (1-99), 0 to keep the default scheduler
+    bool lock_memory;     //!< mlockall the process and prefault the read buffers and stack
+    bool measure_latency; //!< record the latency from wakeup to callback return of frames dispatched on the read thread
+    ThreadSchedulingConfig() : cpu(-1), priority(0), lock_memory(false), measure_latency(false) {}
+};
+
+/*!
+ * Time from the read thread waking up with new data to a frame from that
+ * data being dispatched to its callback.
+ */
+struct DispatchLatency {
+    uint64_t samples;   //!< number of frames measured
+    double mean_us;     //!< mean latency [microseconds]
+    double max_us;      //!< worst case latency [microseconds]
+};
+
+#define MAX_DEFERRED_LOGS 256 // low priority logs queued before new ones are dropped
+
+/*!
+ * How a binary log is dispatched once priorities are set.  High priority
+ * logs are parsed as soon as they are framed.  Normal priority logs are
+ * parsed on the read thread after everything in the same read has been
+ * framed, so they never delay a high priority log behind them.  Low
+ * priority logs are copied and parsed by a background worker, so a burst
+ * of bulky logs (almanacs, ephemerides, ranges) never delays the logs
+ * framed after it.  Callbacks of low priority logs run on the worker
+ * thread.
+ */
+enum LogPriority {
+    LOG_PRIORITY_HIGH,
+    LOG_PRIORITY_NORMAL,
+    LOG_PRIORITY_LOW
+};
+
+/*!
+ * What the stream server republishes from the receiver port, see
+ * StartStreamServer().  Raw mode serves every byte read, including ASCII
+ * and NMEA, exactly as the receiver sent it.  Otherwise only CRC checked
+ * binary frames are served, optionally limited to some message ids.
+ */
+struct StreamServerConfig {
+    bool raw;                           //!< serve the raw byte stream instead of frames
+    std::set<uint16_t> message_ids;     //!< binary frames to serve, empty for all
+    size_t ring_size;                   //!< bytes a client may fall behind before it is dropped
+    size_t max_clients;
+    StreamServerConfig() : raw(false), ring_size(1<<20), max_clients(32) {}
+};
 
+/*!
+ * Statistics for RTCM3 corrections forwarded to the receiver.  Latency is
+ * measured from the last byte of a frame being handed to
+ * InjectCorrections() to the write to the receiver port returning.
+ */
+struct CorrectionStats {
+    uint32_t frames_forwarded;  //!< frames written to the receiver
+    uint32_t crc_errors;        //!< frames dropped because of a bad CRC-24Q
+    uint32_t frames_dropped;    //!< frames dropped because the queue was full or the write failed
+    uint64_t bytes_forwarded;
+    double mean_latency_us;     //!< mean injection latency [microseconds]
+    double max_latency_us;      //!< worst case injection latency [microseconds]
+    double last_frame_age;      //!< time since the last frame was written [s], -1 if none
+};
+
+/*!
+ * Driver for NovAtel receivers.
+ *
+ * Once each log type has been seen, framing and dispatching a log on the
+ * read thread makes no heap allocations, whether logs are dispatched one
+ * at a time, in batches, by priority or through the callback executor, and
+ * neither does feeding the stream server, flight recorder and restart
+ * tracker (tests/novatel_allocation_tests.cpp checks this, and RtkMonitor
+ * too).  The queues of the callback executor and low priority worker grow
+ * to their busiest burst and then stop allocating.  Commands,
+ * configuration and error reporting may allocate.
+ */
 class Novatel
 {
 public:
@@ -118,20 +239,153 @@ public:
 	 *
 	 * @param port Defines which serial port to connect to in serial mode.
 	 * Examples: Linux - "/dev/ttyS0" Windows - "COM1"
+	 * A transport URL such as "tcp://192.168.1.10:3001" can be given instead,
+	 * see novatel_transport.h.  The baud rate search only applies to serial ports.
 	 *
 	 * @throws ConnectionFailedException connection attempt failed.
 	 * @throws UnknownErrorCodeException unknown error code returned.
 	 */
 	 bool Connect(std::string port, int baudrate=115200, bool search=true);
 
+    /*!
+     * Attaches to a receiver that is already streaming logs.
+     *
+     * Unlike Connect(), the receiver is not reconfigured: no UNLOGALL is
+     * sent and the port is not flushed or pinged.  The read thread is started
+     * immediately and the call returns as soon as a CRC-valid binary frame
+     * has been received, so dispatching resumes within one logging epoch.
+     * The logs that are active can then be queried with GetActiveLogs().
+     * Only logs requested with ConfigureLogs() are requested again if the
+     * receiver restarts while the device is lost.
+     *
+     * @param port serial port or transport URL the receiver is streaming on
+     * @param baudrate baud rate the receiver port is currently set to
+     * @param timeout_ms time to wait for the first valid frame
+     *
+     * @return True if valid frames were found, false otherwise.  On failure
+     * the port is closed again and Connect() should be used instead.
+     */
+    bool Attach(std::string port, int baudrate=115200, int timeout_ms=2000);
+
+    /*!
+     * Attaches to a receiver streaming on a user supplied transport.  The
+     * Novatel object takes ownership of the transport and deletes it when
+     * disconnecting or if attaching fails.
+     */
+    bool Attach(Transport *transport, int timeout_ms=2000);
+
    /*!
-    * Disconnects from the serial port
+    * Disconnects from the serial port.  All logging on the receiver port is
+    * stopped with UNLOGALL unless the connection was made with Attach() or
+    * set_unlog_on_disconnect(false) was called.
     */
     void Disconnect();
 
   //! Indicates if a connection to the receiver has been established.
   bool IsConnected() {return is_connected_;}
 
+  //! Sets whether Disconnect() sends UNLOGALL before closing the port
+  void set_unlog_on_disconnect(bool unlog) {unlog_on_disconnect_=unlog;}
+
+  /*!
+   * Returns the binary logs seen on the incoming stream since connecting,
+   * with their frame counts and estimated logging periods.
+   */
+  std::vector<LogActivity> GetActiveLogs();
+
+  /*!
+   * Checks if a log is already being received.
+   *
+   * @param log log name or log command, e.g. "BESTUTMB" or
+   * "BESTUTMB ONTIME 0.05".  Only the log name is used.
+   */
+  bool IsLogActive(std::string log);
+
+  //! Number of binary frames dropped because of a CRC mismatch
+  uint32_t crc_error_count() {return demux_.counters().novatel_binary.errors;}
+
+  /*!
+   * Frame and error counts for each protocol seen on the receiver port:
+   * NovAtel binary and ASCII logs, NMEA sentences and RTCM3 frames.
+   */
+  DemuxCounters GetDemuxCounters() {return demux_.counters();}
+
+  /*!
+   * Starts recording everything read from the receiver to a block
+   * compressed file that can be replayed with a "replay://" transport.
+   * Replaces any recording already in progress.
+   *
+   * @return false if the file could not be created
+   */
+  bool StartRecording(std::string path, RecorderConfig config = RecorderConfig());
+
+  //! Writes any buffered data and closes the recording
+  void StopRecording();
+
+  //! Byte and block counts for the current or last recording
+  RecorderStats GetRecorderStats();
+
+  /*!
+   * Republishes the receiver stream to local tools on the given
+   * tcp:// and unix:// endpoints (see FanoutServer), so they can share the
+   * receiver with this driver.  The read thread never waits on a client;
+   * clients that fall a ring behind are disconnected.  Replaces any
+   * stream server already running.
+   *
+   * @return false if an endpoint could not be opened
+   */
+  bool StartStreamServer(const std::vector<std::string> &endpoints,
+                         StreamServerConfig config = StreamServerConfig());
+  void StopStreamServer();
+
+  //! Client and byte counts of the stream server, zero if none is running
+  FanoutStats GetStreamServerStats();
+
+  /*!
+   * Keeps the last config.window seconds of data read from the receiver in
+   * memory and writes it to config.directory when one of the configured triggers
+   * fires (see FlightRecorderConfig).  Replaces any flight recorder
+   * already running.
+   *
+   * @return false if the configuration is invalid
+   */
+  bool StartFlightRecorder(const FlightRecorderConfig &config = FlightRecorderConfig());
+  //! Stops the flight recorder, after writing any dump already triggered
+  void StopFlightRecorder();
+
+  //! Dumps the flight recorder, false if it is not running or the trigger was ignored
+  bool TriggerFlightRecorder(FlightTrigger trigger = FLIGHT_TRIGGER_MANUAL);
+
+  FlightRecorderStats GetFlightRecorderStats();
+
+  //! Number of times the serial device was lost and recovered
+  uint32_t reconnect_count() {return reconnect_count_;}
+
+  //! Length in seconds of the last data gap caused by losing the device
+  double last_gap_duration() {return last_gap_duration_;}
+
+  /*!
+   * Sets the maximum time between attempts to reopen the serial device
+   * after it has been lost.  Attempts start at 100 ms and back off
+   * exponentially up to this limit.  On Linux a new device node appearing
+   * triggers an attempt immediately.
+   */
+  void set_max_reconnect_backoff(int milliseconds) {max_reconnect_backoff_ms_=milliseconds;}
+
+  //! Sets the scheduling of the read thread, see ThreadSchedulingConfig
+  void set_thread_scheduling(const ThreadSchedulingConfig &config) {scheduling_=config;}
+
+  /*!
+   * Returns the latency measured since the last reset, from the read
+   * thread waking with data to the frame's callback returning.  Frames
+   * handed to the callback executor or the low priority worker are not
+   * measured.
+   */
+  DispatchLatency GetDispatchLatency();
+
+  //! Clears the wakeup to dispatch latency statistics
+  void ResetDispatchLatency();
+
   /*!
 
      * Pings the GPS to determine if it is properly connected
@@ -162,10 +416,29 @@ public:
          this->time_handler_ = time_handler;
      }
 
-    void setLogDebugCallback(LogMsgCallback debug_callback){log_debug_=debug_callback;};
-    void setLogInfoCallback(LogMsgCallback info_callback){log_info_=info_callback;};
-    void setLogWarningCallback(LogMsgCallback warning_callback){log_warning_=warning_callback;};
-    void setLogErrorCallback(LogMsgCallback error_callback){log_error_=error_callback;};
+    //! Also enables debug messages, which are off by default, see set_log_level()
+    void setLogDebugCallback(LogMsgCallback debug_callback){
+        logger_.set_sink(LOG_LEVEL_DEBUG, debug_callback); logger_.set_level(LOG_LEVEL_DEBUG);};
+    void setLogInfoCallback(LogMsgCallback info_callback){logger_.set_sink(LOG_LEVEL_INFO, info_callback);};
+    void setLogWarningCallback(LogMsgCallback warning_callback){logger_.set_sink(LOG_LEVEL_WARNING, warning_callback);};
+    void setLogErrorCallback(LogMsgCallback error_callback){logger_.set_sink(LOG_LEVEL_ERROR, error_callback);};
+
+    /*!
+     * Messages below this level are dropped before they are formatted.
+     * Defaults to LOG_LEVEL_INFO.  Safe to change at any time.
+     */
+    void set_log_level(LogLevel level) {logger_.set_level(level);}
+
+    /*!
+     * Passes log messages to the log callbacks from a background thread,
+     * so a slow callback never stalls reading.  Messages beyond max_queued
+     * waiting are dropped.
+     */
+    void StartAsyncLogging(size_t max_queued=1024) {logger_.StartAsync(max_queued);}
+    //! Writes any queued messages and returns to calling the log callbacks directly
+    void StopAsyncLogging() {logger_.StopAsync();}
+    //! Log messages dropped because the background queue was full
+    uint32_t dropped_log_count() {return logger_.dropped_count();}
 
     /*!
      * Request the given list of logs from the receiver.
@@ -193,8 +466,39 @@ public:
     void SetBaudRate(int baudrate, std::string com_port="COM1");
 
     bool SendCommand(std::string cmd_msg, bool wait_for_ack=true);
+
+    /*!
+     * Writes raw bytes to the receiver port without waiting for an
+     * acknowledgement.
+     */
     bool SendMessage(uint8_t* msg_ptr, size_t length);
 
+    /*!
+     * Queues RTCM3 corrections to be written to the receiver port.  The data
+     * may be split anywhere; complete frames are checked with CRC-24Q and
+     * those that fail are dropped.  Returns immediately: frames are written
+     * by a separate thread without waiting for an acknowledgement, so this
+     * may be called from any thread, including data callbacks.
+     *
+     * The receiver port has to accept RTCM3 input, e.g. after
+     * ConfigureInterfaceMode("THISPORT", "AUTO", "NOVATEL") on OEM6.
+     */
+    void InjectCorrections(const unsigned char *data, size_t length);
+
+    /*!
+     * Starts a thread reading corrections from a transport URL and
+     * injecting them, e.g. "tcp://localhost:2101" for a local NTRIP proxy,
+     * "udp://:5000" or "file://corrections.rtcm3".  The source is reopened
+     * if the connection drops.
+     */
+    bool StartCorrectionSource(std::string url);
+
+    //! Stops the thread started by StartCorrectionSource()
+    void StopCorrectionSource();
+
+    //! Returns counts and latency of the corrections forwarded so far
+    CorrectionStats GetCorrectionStats();
+
     /*!
      * SetSvElevationCutoff
      * Sets the elevation cut-off angle. Svs below this angle
@@ -224,6 +528,7 @@ public:
 
     bool SetInitialPosition(double latitude, double longitude, double height);
     bool SetInitialTime(uint32_t gps_week, double gps_seconds);
+    //! Sends the almanac records in use as one ALMANACB message
     bool InjectAlmanac(Almanac almanac);
     /*!
      * SetL1CarrierSmoothing sets the amount of smoothing to be performed on
@@ -254,8 +559,23 @@ public:
      */
     bool ColdStartReset();
 
+    /*!
+     * Times a restart the driver did not send, e.g. a power cycle, from
+     * now.  Resets sent with the methods above are timed from the command.
+     */
+    void TrackRestart() {restart_tracker_.Start(RESET_EXTERNAL);}
+    //! Time from the latest reset to the banner, valid time, first fixes and INS alignment
+    RestartReport GetRestartReport() {return restart_tracker_.Report();}
+    //! Called on the read thread as each restart milestone is reached
+    void set_restart_milestone_callback(RestartMilestoneCallback handler) {
+        restart_milestone_callback_=handler;}
+
+    //! Sends the ephemerides with a PRN set, in a single write
     void SendRawEphemeridesToReceiver(RawEphemerides raw_ephemerides);
 
+    //! Writes every message in the encoder to the receiver at once
+    bool SendBinaryMessages(const BinaryEncoder &encoder);
+
     /*!
      * Requests version information from the receiver
      *
@@ -266,6 +586,20 @@ public:
      */
 	bool UpdateVersion();
 
+    /*!
+     * GLONASS frequency number of a PRN, used to unpack RANGECMP.  Learnt
+     * from RANGE, which carries it; 0 until then.
+     */
+    int glonass_frequency(uint16_t prn) const {
+        return glonass_frequency_known(prn) ? glonass_frequency_[prn].load(boost::memory_order_relaxed) : 0;}
+    //! True once RANGE has given the frequency number of a PRN
+    bool glonass_frequency_known(uint16_t prn) const {
+        return (prn < GLONASS_FREQUENCY_SLOTS) &&
+               (glonass_frequency_[prn].load(boost::memory_order_relaxed) != GLONASS_FREQUENCY_NOT_SEEN);}
+    void set_glonass_frequency(uint16_t prn, int frequency_number) {
+        if (prn < GLONASS_FREQUENCY_SLOTS)
+            glonass_frequency_[prn].store(frequency_number, boost::memory_order_relaxed);}
+
     bool ConvertLLaUTM(double Lat, double Long, double *northing, double *easting, int *zone, bool *north);
 
     void ReadFromFile(unsigned char* buffer, unsigned int length);
@@ -329,13 +663,131 @@ public:
         tracking_status_callback_=handler;};
     void set_receiver_hardware_status_callback(ReceiverHardwareStatusCallback handler){
         receiver_hardware_status_callback_=handler;};
+    void set_receiver_status_callback(ReceiverStatusCallback handler){
+        receiver_status_callback_=handler;};
     void set_best_pseudorange_position_callback(BestPseudorangePositionCallback handler){
         best_pseudorange_position_callback_=handler;};
     void set_rtk_position_callback(RtkPositionCallback handler){
         rtk_position_callback_=handler;};
+    void set_rtk_data_callback(RtkDataCallback handler){
+        rtk_data_callback_=handler;};
 
     void set_raw_msg_callback(RawMsgCallback handler) {
         raw_msg_callback_=handler;};
+    void set_device_gap_callback(DeviceGapCallback handler) {
+        device_gap_callback_=handler;};
+
+    //! Called with each NMEA sentence received, from '$' to the checksum
+    void set_nmea_callback(NmeaCallback handler) {
+        nmea_callback_=handler;};
+    //! Called with each NovAtel ASCII log received, from '#' to the CRC
+    void set_ascii_log_callback(AsciiLogCallback handler) {
+        ascii_log_callback_=handler;};
+    //! Called with each RTCM3 frame the receiver outputs, e.g. as a base station
+    void set_rtcm3_output_callback(Rtcm3FrameCallback handler) {
+        rtcm3_output_callback_=handler;};
+    /*!
+     * Delivers binary logs in batches instead of through the per log
+     * callbacks: every log framed from one read, or with window_us > 0
+     * every log framed within that many microseconds of the first, is
+     * passed to the handler in one FrameBatch.  An empty handler returns
+     * to per log callbacks.  Set before connecting.
+     */
+    void set_batch_callback(FrameBatchCallback handler, uint32_t window_us=0) {
+        batch_callback_=handler; batch_window_us_=window_us;};
+
+    /*!
+     * Sets the priority of a binary log, see LogPriority.  Logs are
+     * normal priority unless set otherwise.  Set before connecting.
+     */
+    void set_log_priority(BINARY_LOG_TYPE message_id, LogPriority priority);
+
+    /*!
+     * Makes position, velocity, attitude and IMU logs high priority and
+     * almanacs, ephemerides, ranges, satellite and tracking status logs
+     * low priority.
+     */
+    void UseDefaultLogPriorities();
+
+    /*!
+     * Blocks until every low priority log framed so far, and every log
+     * queued on the callback executor, has been dispatched
+     */
+    void WaitForDeferredLogs();
+
+    /*!
+     * Runs the callbacks of binary logs on a pool of threads instead of the
+     * read thread.  Logs of one type are dispatched in order, one at a
+     * time; different types run in parallel, so a slow callback only
+     * delays its own log.  High priority logs are still dispatched on the
+     * read thread.  Callbacks must be safe to run concurrently with each
+     * other.  Start before connecting.
+     *
+     * @param max_queued logs of one type that may wait before new ones are dropped
+     */
+    void StartCallbackExecutor(size_t threads, size_t max_queued=256);
+
+    //! Dispatches any queued logs and returns to dispatching on the read thread; safe while reading
+    void StopCallbackExecutor();
+
+    //! Queue depth and callback run time for each log type seen by the executor
+    std::vector<ExecutorStats> GetExecutorStats();
+
+    /*!
+     * Copies the most recent log with the given id, e.g.
+     * GetLatest<BESTPOSB_LOG_TYPE>(position, &age).  Safe to call from any
+     * thread and never holds up parsing.  The first call starts caching
+     * the log; use EnableLatest() to cache it from the start.
+     *
+     * @param age set to the seconds since the log was parsed
+     * @return false if the log has not been received since caching started
+     */
+    template <BINARY_LOG_TYPE Id>
+    bool GetLatest(typename BinaryLogTraits<Id>::Type &log, double *age=NULL) {
+        SeqLockValue<typename BinaryLogTraits<Id>::Type> &slot = latest_.Slot<Id>();
+        slot.Enable();
+        uint64_t received_us;
+        if (!slot.Load(log, NULL, &received_us))
+            return false;
+        if (age)
+            *age = (LatestLogCache::NowMicroseconds() - received_us)*1e-6;
+        return true;
+    }
+
+    //! Starts caching a log for GetLatest(), returns false if it can not be cached
+    bool EnableLatest(BINARY_LOG_TYPE message_id) {return latest_.Enable(message_id);}
+
+    /*!
+     * Calls completion, on the read thread, with the next log of the given
+     * type that passes the filter, or once timeout seconds have passed.
+     * Timeouts are checked after each read, so they resolve to the
+     * transport's read timeout, and every 50 ms while the device is lost.
+     * Waits still pending when reading stops end with WAIT_CANCELLED.
+     * No thread waits; novatel_coroutine.h wraps this for co_await.
+     *
+     * @param filter empty to take the next log of the type
+     * @param timeout seconds to wait, 0 or less to wait forever
+     * @return id for CancelWait().  The completion may run before this returns.
+     */
+    uint64_t AsyncWaitForLog(BINARY_LOG_TYPE message_id, FrameFilter filter,
+                             WaitCompletion completion, double timeout=0) {
+        return waiters_.AddFrameWaiter(message_id, filter, completion, timeout);}
+
+    /*!
+     * Sends a command without blocking and calls completion when it is
+     * acknowledged, rejected with an error reply (WAIT_REJECTED) or timeout
+     * seconds have passed.
+     *
+     * @return id for CancelWait(), or 0 if the command could not be sent,
+     * in which case completion is not called
+     */
+    uint64_t AsyncSendCommand(std::string cmd_msg, WaitCompletion completion, double timeout=2.0);
+
+    //! Ends a wait with WAIT_CANCELLED, returns false if it had already ended
+    bool CancelWait(uint64_t waiter_id) {return waiters_.Cancel(waiter_id);}
+
+    //! Low priority logs dropped because the background worker fell behind
+    uint32_t deferred_dropped_count() {return deferred_dropped_count_;}
     RawEphemerides test_ephems_;
 private:
 
@@ -369,15 +821,109 @@ private:
 	 */
 	void ReadSerialPort();
 
+	/*!
+	 * Called by the read thread when the serial device fails.  Hands the
+	 * port to the supervisor thread and blocks until the device has been
+	 * reopened or reading is stopped.
+	 */
+	void ParkReadThread();
+
+	//! Passes the pending batch to the batch callback and empties it
+	void FlushBatch();
+
+	//! Passes the bytes of one read, in the order they arrived, to the recorder
+	void RecordData(const unsigned char *framed, size_t framed_length,
+	                const unsigned char *buffered, size_t buffered_length);
+	//! Passes the bytes of one read to the stream server in raw mode
+	void ServeRawData(const unsigned char *framed, size_t framed_length,
+	                  const unsigned char *buffered, size_t buffered_length);
+	//! Passes the bytes of one read, corrupt frames and all, to the flight recorder
+	void FlightRecordData(const unsigned char *framed, size_t framed_length,
+	                      const unsigned char *buffered, size_t buffered_length);
+	//! Passes a CRC checked binary frame to the stream server if it is selected
+	void ServeFrame(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id);
+	void OnFlightRecorderDump(FlightTrigger trigger, const std::string &path, bool written);
+
+	/*!
+	 * Method run in a seperate thread alongside ReadSerialPort.  Sleeps
+	 * until the read thread reports the device lost, then reopens the
+	 * port with backoff, requests the logs set up with ConfigureLogs again
+	 * if the receiver is no longer streaming, and reports the length of
+	 * the gap.
+	 */
+	void SuperviseSerialPort();
+
+	//! Tries to reopen the lost device until it succeeds or reading stops
+	bool ReopenSerialPort();
+
+	//! Waits up to timeout_ms for a new CRC-valid frame after start_count
+	bool WaitForValidFrame(uint32_t start_count, int timeout_ms);
+
+	//! Applies scheduling_ to the calling thread and prefaults its buffers
+	void ApplyThreadScheduling();
+
+	//! Adds the time since read_wakeup_us_ to the latency statistics, once per frame dispatched
+	void RecordDispatchLatency(uint64_t frames = 1);
+
+	//! Writes to the receiver port, serialized between threads
+	size_t WriteToPort(const unsigned char *data, size_t length);
+	size_t WriteToPort(const std::string &data);
+	/*!
+	 * Writes a command and waits for the reply to it.  Replies are matched
+	 * to commands in the order sent, so a reply to an AsyncSendCommand()
+	 * is never taken.
+	 *
+	 * @param reply set to the receiver's error for WAIT_REJECTED
+	 */
+	WaitResult WriteCommandAndWait(const std::string &command, std::string &reply, double timeout=2.0);
+
+	//! Called by rtcm_framer_ for each valid correction frame
+	void QueueCorrection(const unsigned char *frame, size_t length);
+
+	//! Method run in a seperate thread that writes queued corrections
+	void WriteCorrections();
+
+	//! Method run in a seperate thread that reads the correction source
+	void ReadCorrectionSource();
+
+	//! Stops the correction source and writer threads
+	void StopCorrections();
+
 	void BufferIncomingData(unsigned char *message, unsigned int length);
 
+	//////////////////////////////////////////////////////
+	// Frames from demux_
+	//////////////////////////////////////////////////////
+	friend class FrameDemultiplexer<Novatel>;
+	void OnNovatelBinary(unsigned char *frame, size_t length);
+	void OnNovatelAscii(const char *sentence, size_t length);
+	void OnNmea(const char *sentence, size_t length);
+	void OnRtcm3(const unsigned char *frame, size_t length);
+	void OnAcknowledgement();
+	void OnCommandError(const char *reply, size_t length);
+	void OnPrompt(const char *prompt, size_t length);
+	//! Logs each restart milestone and passes it on
+	void OnRestartMilestone(RestartMilestone milestone, PositionType type, double seconds);
+
 	/*!
 	 * Parses a packet of data from the GPS.  The
 	 */
-	void ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE message_id);
+	void ParseBinary(const unsigned char *message, size_t length, BINARY_LOG_TYPE message_id, double timestamp);
+
+	//! Queues a low priority log for the background worker, starting it if needed
+	void DeferLog(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id);
+	//! Parses each log in a batch, copying it into frame first
+	void DispatchLogs(const FrameBatch &logs, std::vector<unsigned char> &frame, bool measure_latency = false);
+	//! Method run in a seperate thread that parses low priority logs
+	void DispatchDeferredLogs();
+	//! Dispatches any queued low priority logs and stops the worker
+	void StopDeferredWorker();
 
 	bool ParseVersion(std::string packet);
 
+	//! Records that a valid frame of the given type has been received
+	void UpdateLogActivity(unsigned char *message, BINARY_LOG_TYPE message_id);
+
 	void UnpackCompressedRangeData(const CompressedRangeData &cmp,
 	                                     RangeData           &rng);
 
@@ -387,7 +933,7 @@ private:
 	    const CompressedRangeData &cmp,
 	    const double              &uncmpPsr) const;
 
-    bool SendBinaryDataToReceiver(uint8_t* msg_ptr, size_t length);
+    bool SendBinaryDataToReceiver(const uint8_t* msg_ptr, size_t length);
 
     unsigned long CRC32Value(int i);
     unsigned long CalculateBlockCRC32 ( unsigned long ulCount, /* Number of bytes in the data block */
@@ -396,20 +942,69 @@ private:
     //////////////////////////////////////////////////////
     // Serial port reading members
     //////////////////////////////////////////////////////
-	//! Serial port object for communicating with sensor
-	serial::Serial *serial_port_;
+	//! Serial port, socket or file the receiver data is read from
+	Transport *transport_;
 	//! shared pointer to Boost thread for listening for data from novatel
 	boost::shared_ptr<boost::thread> read_thread_ptr_;
 	bool reading_status_;  //!< True if the read thread is running, false otherwise.
+	std::string port_name_; //!< port or URL the receiver was connected on, for log messages
+
+    //////////////////////////////////////////////////////
+    // Device loss supervision
+    //////////////////////////////////////////////////////
+	boost::shared_ptr<boost::thread> supervisor_thread_ptr_;
+	boost::mutex supervisor_mutex_;
+	boost::condition_variable supervisor_condition_;
+	bool device_lost_;     //!< true while the read thread is parked waiting for the device
+	int max_reconnect_backoff_ms_;
+	boost::atomic<uint32_t> reconnect_count_;	//!< written by the supervisor thread, read by any
+	boost::atomic<double> last_gap_duration_;	//!< written by the supervisor thread, read by any
+	DeviceGapCallback device_gap_callback_;
+	boost::mutex configured_logs_mutex_;
+	std::vector<std::string> configured_logs_; //!< logs requested with ConfigureLogs, restored after a reconnect
+
+    //////////////////////////////////////////////////////
+    // Read thread scheduling and latency measurement
+    //////////////////////////////////////////////////////
+	ThreadSchedulingConfig scheduling_;
+	uint64_t read_wakeup_us_;   //!< monotonic time the current read returned [microseconds]
+	boost::mutex latency_mutex_;
+	uint64_t latency_samples_;
+	uint64_t latency_total_us_;
+	uint64_t latency_max_us_;
+
+    //////////////////////////////////////////////////////
+    // Correction injection
+    //////////////////////////////////////////////////////
+	//! A correction frame waiting to be written
+	struct QueuedCorrection {
+		std::vector<unsigned char> data;
+		uint64_t received_us;   //!< monotonic time the frame was completed [microseconds]
+	};
+	boost::mutex write_mutex_;      //!< keeps commands and corrections from interleaving on the port
+	boost::mutex inject_mutex_;     //!< protects rtcm_framer_
+	Rtcm3Framer rtcm_framer_;
+	boost::mutex correction_mutex_;
+	boost::condition_variable correction_condition_;
+	std::deque<QueuedCorrection> correction_queue_;
+	bool writing_corrections_;
+	boost::shared_ptr<boost::thread> correction_writer_ptr_;
+	boost::atomic<bool> reading_corrections_;	//!< cleared by StopCorrectionSource, polled by the source thread
+	Transport *correction_source_;
+	boost::shared_ptr<boost::thread> correction_source_ptr_;
+	CorrectionStats correction_stats_;
+	uint64_t correction_latency_total_us_;
+	uint64_t last_correction_us_;
 
     //////////////////////////////////////////////////////
     // Diagnostic Callbacks
     //////////////////////////////////////////////////////
     HandleAcknowledgementCallback handle_acknowledgement_;
-    LogMsgCallback log_debug_;
-    LogMsgCallback log_info_;
-    LogMsgCallback log_warning_;
-    LogMsgCallback log_error_;
+    Logger logger_;
+    LogChannel<LOG_LEVEL_DEBUG> log_debug_;
+    LogChannel<LOG_LEVEL_INFO> log_info_;
+    LogChannel<LOG_LEVEL_WARNING> log_warning_;
+    LogChannel<LOG_LEVEL_ERROR> log_error_;
 
     GetTimeCallback time_handler_; //!< Function pointer to callback function for timestamping
 
@@ -418,6 +1013,9 @@ private:
     // New Data Callbacks
     //////////////////////////////////////////////////////
     RawMsgCallback raw_msg_callback_;
+    NmeaCallback nmea_callback_;
+    AsciiLogCallback ascii_log_callback_;
+    Rtcm3FrameCallback rtcm3_output_callback_;
 
     BestGpsPositionCallback best_gps_position_callback_;
     BestLeverArmCallback best_lever_arm_callback_;
@@ -450,36 +1048,69 @@ private:
     TimeOffsetCallback time_offset_callback_;
     TrackingStatusCallback tracking_status_callback_;
     ReceiverHardwareStatusCallback receiver_hardware_status_callback_;
+    ReceiverStatusCallback receiver_status_callback_;
     BestPseudorangePositionCallback best_pseudorange_position_callback_;
     RtkPositionCallback rtk_position_callback_;
+    RtkDataCallback rtk_data_callback_;
 
 
 
 	//////////////////////////////////////////////////////
 	// Incoming data buffers
 	//////////////////////////////////////////////////////
-	unsigned char data_buffer_[MAX_NOUT_SIZE];	//!< data currently being buffered to read
-	unsigned char* data_read_;		//!< used only in BufferIncomingData - declared here for speed
-	size_t bytes_remaining_;	//!< bytes remaining to be read in the current message
-	size_t buffer_index_;		//!< index into data_buffer_
-	size_t header_length_;	//!< length of the current header being read
-	bool reading_acknowledgement_;	//!< true if an acknowledgement is being received
-    bool reading_reset_complete_;   //!< true if an {COM#} message confirming receiver reset if complete
+	FrameDemultiplexer<Novatel> demux_;	//!< frames everything read from the receiver
 	double read_timestamp_; 		//!< time stamp when last serial port read completed
 	double parse_timestamp_;		//!< time stamp when last parse began
-	BINARY_LOG_TYPE message_id_;	//!< message id of message currently being buffered
+	std::string sentence_;			//!< reused for each ASCII log and NMEA sentence passed to callbacks
+	boost::atomic<Recorder*> recorder_;	//!< records raw receiver data, NULL when not recording; checked by the read thread without the lock
+	boost::mutex recorder_mutex_;
+	RecorderStats recorder_stats_;	//!< stats of the last recording after it is stopped
+	boost::atomic<FanoutServer*> stream_server_;	//!< republishes receiver data, NULL when not serving; checked by the read thread without the lock
+	StreamServerConfig stream_config_;
+	boost::mutex stream_server_mutex_;
+	boost::atomic<FlightRecorder*> flight_recorder_;	//!< recent reads kept for incident dumps, NULL when not running; checked by the read thread without the lock
+	boost::mutex flight_recorder_mutex_;
+	FrameBatchCallback batch_callback_;
+	uint32_t batch_window_us_;		//!< longest a batch collects logs for, 0 for one batch per read
+	FrameBatch batch_;				//!< logs waiting for the batch callback
+	uint64_t batch_start_us_;		//!< monotonic time the first log in batch_ arrived
+
+	//////////////////////////////////////////////////////
+	// Priority lanes
+	//////////////////////////////////////////////////////
+	std::map<BINARY_LOG_TYPE, LogPriority> log_priorities_; //!< logs that are not normal priority
+	FrameBatch normal_logs_;		//!< normal priority logs from the current read
+	std::vector<unsigned char> lane_frame_;	//!< full size buffer normal priority logs are parsed from
+	FrameBatch deferred_logs_;		//!< low priority logs waiting for the worker
+	boost::mutex deferred_mutex_;
+	boost::condition_variable deferred_condition_;
+	boost::thread deferred_thread_;
+	bool deferred_running_;			//!< true while the worker should wait for more logs
+	bool deferred_busy_;			//!< true while the worker is dispatching logs it has taken
+	boost::atomic<uint32_t> deferred_dropped_count_;	//!< written by the read thread, read by any
+	CallbackExecutor *executor_;	//!< runs callbacks on a thread pool, NULL to run them on the read thread
+	boost::mutex executor_mutex_;	//!< guards executor_ against the read thread
+	LatestLogCache latest_;			//!< latest value of each log read with GetLatest()
+	WaiterList waiters_;			//!< callers waiting for a log or acknowledgement
+	RestartTracker restart_tracker_;	//!< milestones of the latest receiver restart
+	RestartMilestoneCallback restart_milestone_callback_;
 
     //////////////////////////////////////////////////////
     // Mutex's
     //////////////////////////////////////////////////////
-    boost::condition_variable ack_condition_;
-    boost::mutex ack_mutex_;
-    bool ack_received_;     //!< true if an acknowledgement has been received from the GPS
     boost::condition_variable reset_condition_;
     boost::mutex reset_mutex_;
     bool waiting_for_reset_complete_;     //!< true if GPS has finished resetting and is ready for input
 
     bool is_connected_; //!< indicates if a connection to the receiver has been established
+    bool unlog_on_disconnect_; //!< send UNLOGALL when disconnecting
+
+    //////////////////////////////////////////////////////
+    // Incoming log activity
+    //////////////////////////////////////////////////////
+    boost::mutex log_activity_mutex_;
+    std::map<uint16_t, LogActivity> log_activity_; //!< activity of each log received, keyed by message id
+    boost::atomic<uint32_t> valid_frame_count_; //!< number of CRC-valid binary frames received, written by the read thread
 	//////////////////////////////////////////////////////
     // Receiver information and capabilities
 	//////////////////////////////////////////////////////
@@ -493,6 +1124,7 @@ private:
 	bool raw_capable_; //!< Can the receiver output raw measurements?
 	bool rtk_capable_; //!< Can the receiver compute RT2 and/or RT20 positions?
 	bool glonass_capable_; //!< Can the receiver receive GLONASS frequencies?
+	boost::atomic<int8_t> glonass_frequency_[GLONASS_FREQUENCY_SLOTS]; //!< by PRN, written by the read thread
 	bool span_capable_;  //!< Is the receiver a SPAN unit?
 
 
@@ -0,0 +1,137 @@
+/*!
+ * \file novatel/novatel_batch.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Batches of binary logs delivered in one callback, so consumers can take
+ * a lock or publish once per read instead of once per log.
+ *
+ */
+
+#ifndef NOVATEL_BATCH_H
+#define NOVATEL_BATCH_H
+
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/function.hpp>
+
+#include "novatel/novatel_decode.h"
+
+namespace novatel {
+
+/*!
+ * Binary frames framed from one read, or from every read within a time
+ * window, copied back to back into one arena.  The arena and index keep
+ * their capacity between batches, so a steady stream of batches does not
+ * allocate.  Frames are only decoded when a consumer asks for them.
+ */
+class FrameBatch {
+public:
+    FrameBatch() {
+        arena_.reserve(16*1024);
+        entries_.reserve(64);
+    }
+
+    size_t size() const {return entries_.size();}
+    bool empty() const {return entries_.empty();}
+
+    BINARY_LOG_TYPE id(size_t index) const {return entries_[index].id;}
+    //! Complete frame, header to CRC
+    const unsigned char* frame(size_t index) const {return &arena_[entries_[index].offset];}
+    size_t length(size_t index) const {return entries_[index].length;}
+    //! Time stamp of the read the frame arrived in
+    double timestamp(size_t index) const {return entries_[index].timestamp;}
+
+    /*!
+     * Decodes a frame into its structure, e.g.
+     * batch.Decode(ii, position) for a BESTPOSB frame.  The caller checks
+     * id() first; the structure must be the one BinaryLogTraits gives.
+     */
+    template <class T>
+    bool Decode(size_t index, T &log) const {
+        if (length(index) >= sizeof(T))
+            return DecodeBinaryLog(frame(index), length(index), log);
+        // the decoders may copy a whole structure, so a frame shorter than
+        // its structure is zero padded rather than read past its end
+        unsigned char padded[sizeof(T)];
+        memcpy(padded, frame(index), length(index));
+        memset(padded+length(index), 0, sizeof(T)-length(index));
+        return DecodeBinaryLog(padded, length(index), log);
+    }
+
+    //! Number of frames with the given id
+    size_t Count(BINARY_LOG_TYPE id) const {
+        size_t count = 0;
+        for (size_t ii=0; ii<entries_.size(); ii++)
+            if (entries_[ii].id == id)
+                count++;
+        return count;
+    }
+
+    void Add(const unsigned char *frame, size_t length, BINARY_LOG_TYPE id, double timestamp) {
+        Entry entry;
+        entry.id = id;
+        entry.offset = arena_.size();
+        entry.length = length;
+        entry.timestamp = timestamp;
+        arena_.insert(arena_.end(), frame, frame+length);
+        entries_.push_back(entry);
+    }
+
+    //! Total length of the frames [bytes]
+    size_t bytes() const {return arena_.size();}
+
+    //! Exchanges contents with another batch, keeping both allocations
+    void Swap(FrameBatch &other) {
+        arena_.swap(other.arena_);
+        entries_.swap(other.entries_);
+    }
+
+    void Clear() {
+        arena_.clear();
+        entries_.clear();
+    }
+
+private:
+    struct Entry {
+        BINARY_LOG_TYPE id;
+        size_t offset;      //!< start of the frame in arena_
+        size_t length;
+        double timestamp;
+    };
+
+    std::vector<unsigned char> arena_;
+    std::vector<Entry> entries_;
+};
+
+typedef boost::function<void(const FrameBatch&)> FrameBatchCallback;
+
+}
+
+#endif
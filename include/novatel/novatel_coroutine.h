@@ -0,0 +1,217 @@
+/*!
+ * \file novatel/novatel_coroutine.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * C++20 coroutine wrappers for waiting on receiver logs and command
+ * acknowledgements, so configuration sequences read as straight line
+ * code:
+ *
+ *   ReceiverTask Configure(Novatel &gps) {
+ *       if (!co_await Command(gps, "LOG BESTPOSB ONTIME 1"))
+ *           co_return;
+ *       std::optional<Position> fix = co_await NextLog<BESTPOSB_LOG_TYPE>(gps,
+ *           [](const Position &p) {return p.position_type >= NARROW_INT;}, 60);
+ *   }
+ *
+ * Coroutines resume on the read thread, like callbacks, and no thread
+ * is used per waiter.  Only available when compiled as C++20.
+ *
+ */
+
+#ifndef NOVATEL_COROUTINE_H
+#define NOVATEL_COROUTINE_H
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "novatel/novatel.h"
+
+namespace novatel {
+
+/*!
+ * Awaits the next log of type Id passing a filter, yielding the decoded
+ * log or std::nullopt on timeout or cancellation.
+ */
+template <BINARY_LOG_TYPE Id>
+class NextLogAwaiter {
+public:
+    typedef typename BinaryLogTraits<Id>::Type Log;
+    //! Runs on the read thread while waiters are locked, must not call into the driver
+    typedef std::function<bool(const Log&)> Filter;
+
+    NextLogAwaiter(Novatel &gps, Filter filter, double timeout)
+        : gps_(gps), filter_(filter), timeout_(timeout), timestamp_(0) {}
+
+    bool await_ready() const noexcept {return false;}
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        FrameFilter frame_filter;
+        if (filter_) {
+            Filter filter = filter_;
+            frame_filter = [filter](const unsigned char *frame, size_t length) {
+                Log log;
+                DecodeBinaryLog(frame, length, log);
+                return filter(log);
+            };
+        }
+        // the completion may resume the coroutine on the read thread before
+        // this returns, so nothing here touches the awaiter afterwards
+        gps_.AsyncWaitForLog(Id, frame_filter,
+            [this](WaitResult result, const unsigned char *frame, size_t length, double timestamp) {
+                if (result == WAIT_MATCHED) {
+                    log_.emplace();
+                    DecodeBinaryLog(frame, length, *log_);
+                    timestamp_ = timestamp;
+                }
+                handle_.resume();
+            }, timeout_);
+    }
+
+    std::optional<Log> await_resume() {return std::move(log_);}
+
+    //! Read time stamp of the log, valid once it has been awaited
+    double timestamp() const {return timestamp_;}
+
+private:
+    Novatel &gps_;
+    Filter filter_;
+    double timeout_;
+    std::coroutine_handle<> handle_;
+    std::optional<Log> log_;
+    double timestamp_;
+};
+
+//! Awaits an acknowledgement of a command, yielding false if none arrives in time
+class CommandAwaiter {
+public:
+    CommandAwaiter(Novatel &gps, std::string command, double timeout)
+        : gps_(gps), command_(command), timeout_(timeout), acknowledged_(false) {}
+
+    bool await_ready() const noexcept {return false;}
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        uint64_t waiter = gps_.AsyncSendCommand(command_,
+            [this](WaitResult result, const unsigned char*, size_t, double) {
+                acknowledged_ = (result == WAIT_MATCHED);
+                handle_.resume();
+            }, timeout_);
+        // not sent, so the completion never ran and the coroutine carries on
+        return waiter != 0;
+    }
+
+    bool await_resume() const noexcept {return acknowledged_;}
+
+private:
+    Novatel &gps_;
+    std::string command_;
+    double timeout_;
+    std::coroutine_handle<> handle_;
+    bool acknowledged_;
+};
+
+/*!
+ * co_await NextLog<BESTPOSB_LOG_TYPE>(gps, filter, timeout)
+ *
+ * @param filter empty to take the next log of the type
+ * @param timeout seconds to wait, 0 or less to wait forever
+ */
+template <BINARY_LOG_TYPE Id>
+NextLogAwaiter<Id> NextLog(Novatel &gps, typename NextLogAwaiter<Id>::Filter filter = nullptr,
+                           double timeout = 0) {
+    return NextLogAwaiter<Id>(gps, filter, timeout);
+}
+
+//! co_await Command(gps, "LOG BESTPOSB ONTIME 1"), true once acknowledged
+inline CommandAwaiter Command(Novatel &gps, std::string command, double timeout = 2.0) {
+    return CommandAwaiter(gps, command, timeout);
+}
+
+/*!
+ * Coroutine type for receiver sequences.  Starts running as soon as it is
+ * called and carries on on the read thread after each co_await; the
+ * returned object can be used to wait for it to finish.
+ */
+class ReceiverTask {
+private:
+    struct State {
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done = false;
+        std::exception_ptr exception;
+    };
+
+public:
+    struct promise_type {
+        std::shared_ptr<State> state = std::make_shared<State>();
+
+        ReceiverTask get_return_object() {return ReceiverTask(state);}
+        std::suspend_never initial_suspend() noexcept {return {};}
+        std::suspend_never final_suspend() noexcept {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->done = true;
+            state->condition.notify_all();
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() {state->exception = std::current_exception();}
+    };
+
+    bool done() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->done;
+    }
+
+    /*!
+     * Blocks until the coroutine finishes, rethrowing anything it threw.
+     * Never call from a callback, the read thread is what resumes it.
+     */
+    void Wait() {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->condition.wait(lock, [this] {return state_->done;});
+        if (state_->exception)
+            std::rethrow_exception(state_->exception);
+    }
+
+private:
+    explicit ReceiverTask(std::shared_ptr<State> state) : state_(state) {}
+    std::shared_ptr<State> state_;
+};
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+/*!
+ * \file novatel/novatel_decode.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Decoding of binary logs from a complete, CRC checked frame into the
+ * structures in novatel_structures.h, shared by Novatel::ParseBinary() and
+ * BasicNovatel.
+ *
+ * Logs with a repeated block only copy as many records as are present in
+ * the frame and fit in the structure; the count field is adjusted to match.
+ *
+ */
+
+#ifndef NOVATEL_DECODE_H
+#define NOVATEL_DECODE_H
+
+#include <cstring> // for size_t, memcpy
+#include <algorithm>
+#include <stdint.h>
+
+#include "novatel/novatel_enums.h"
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+/*!
+ * Binary logs that can be decoded and the structure each decodes into:
+ * X(log id, structure)
+ */
+#define NOVATEL_BINARY_LOG_TYPES(X) \
+    X(BESTGPSPOS_LOG_TYPE, Position) \
+    X(BESTLEVERARM_LOG_TYPE, BestLeverArm) \
+    X(BESTPOSB_LOG_TYPE, Position) \
+    X(BESTUTMB_LOG_TYPE, UtmPosition) \
+    X(BESTVELB_LOG_TYPE, Velocity) \
+    X(BESTXYZB_LOG_TYPE, PositionEcef) \
+    X(INSPVA_LOG_TYPE, InsPositionVelocityAttitude) \
+    X(INSPVAS_LOG_TYPE, InsPositionVelocityAttitudeShort) \
+    X(VEHICLEBODYROTATION_LOG_TYPE, VehicleBodyRotation) \
+    X(INSSPD_LOG_TYPE, InsSpeed) \
+    X(RAWIMU_LOG_TYPE, RawImu) \
+    X(RAWIMUS_LOG_TYPE, RawImuShort) \
+    X(INSCOV_LOG_TYPE, InsCovariance) \
+    X(INSCOVS_LOG_TYPE, InsCovarianceShort) \
+    X(PSRDOPB_LOG_TYPE, Dop) \
+    X(RTKDOPB_LOG_TYPE, Dop) \
+    X(BSLNXYZ_LOG_TYPE, BaselineEcef) \
+    X(IONUTCB_LOG_TYPE, IonosphericModel) \
+    X(RANGEB_LOG_TYPE, RangeMeasurements) \
+    X(RANGECMPB_LOG_TYPE, CompressedRangeMeasurements) \
+    X(GPSEPHEMB_LOG_TYPE, GpsEphemeris) \
+    X(RAWEPHEMB_LOG_TYPE, RawEphemeris) \
+    X(RAWALMB_LOG_TYPE, RawAlmanac) \
+    X(ALMANACB_LOG_TYPE, Almanac) \
+    X(SATXYZB_LOG_TYPE, SatellitePositions) \
+    X(SATVISB_LOG_TYPE, SatelliteVisibility) \
+    X(TIMEB_LOG_TYPE, TimeOffset) \
+    X(TRACKSTATB_LOG_TYPE, TrackStatus) \
+    X(RXHWLEVELSB_LOG_TYPE, ReceiverHardwareStatus) \
+    X(RXSTATUSB_LOG_TYPE, RXStatus) \
+    X(PSRPOSB_LOG_TYPE, Position) \
+    X(RTKPOSB_LOG_TYPE, Position) \
+    X(RTKDATAB_LOG_TYPE, rtkdatab_log)
+
+//! Structure a binary log decodes into, BinaryLogTraits<BESTPOSB_LOG_TYPE>::Type is Position
+template <BINARY_LOG_TYPE Id> struct BinaryLogTraits;
+#define NOVATEL_BINARY_LOG_TRAITS(id, type) \
+    template <> struct BinaryLogTraits<id> {typedef type Type;};
+NOVATEL_BINARY_LOG_TYPES(NOVATEL_BINARY_LOG_TRAITS)
+#undef NOVATEL_BINARY_LOG_TRAITS
+
+inline size_t BinaryHeaderLength(const unsigned char *message) {
+    return message[3];
+}
+
+inline size_t BinaryPayloadLength(const unsigned char *message) {
+    return (message[9] << 8) | message[8];
+}
+
+/*!
+ * Copies the records of a repeated block starting at offset bytes into the
+ * frame.  Returns the number copied, which is limited by both the frame
+ * length and capacity.
+ */
+inline uint32_t CopyRecords(void *records, size_t record_size, size_t capacity, uint32_t count,
+                            const unsigned char *message, size_t offset) {
+    size_t end = BinaryHeaderLength(message) + BinaryPayloadLength(message);
+    size_t available = (end > offset) ? (end - offset)/record_size : 0;
+    size_t copied = std::min((size_t)count, std::min(capacity, available));
+    memcpy(records, message+offset, copied*record_size);
+    return (uint32_t)copied;
+}
+
+//! Copies the CRC that follows the payload
+inline void CopyCrc(uint8_t *crc, const unsigned char *message) {
+    memcpy(crc, message + BinaryHeaderLength(message) + BinaryPayloadLength(message), CHECKSUM_SIZE);
+}
+
+//! Logs with a fixed layout are copied as is
+template <class T>
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, T &log) {
+    memcpy(&log, message, sizeof(log));
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, Dop &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+28);
+    log.number_of_prns = CopyRecords(log.prn, sizeof(log.prn[0]), MAX_CHAN,
+                                     log.number_of_prns, message, header_length+28);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, RangeMeasurements &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+4);
+    log.number_of_observations = CopyRecords(log.range_data, sizeof(log.range_data[0]), MAX_CHAN,
+                                             log.number_of_observations, message, header_length+4);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, CompressedRangeMeasurements &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+4);
+    log.number_of_observations = CopyRecords(log.range_data, sizeof(log.range_data[0]), MAX_CHAN,
+                                             log.number_of_observations, message, header_length+4);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+//! GPSEPHEM is dropped if the frame is longer than the structure
+inline bool DecodeBinaryLog(const unsigned char *message, size_t length, GpsEphemeris &log) {
+    if (length > sizeof(log))
+        return false;
+    memcpy(&log, message, sizeof(log));
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, RawAlmanac &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+12);
+    log.num_of_subframes = CopyRecords(&log.subframe_data, sizeof(log.subframe_data), 1,
+                                       log.num_of_subframes, message, header_length+12);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, Almanac &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+4);
+    log.number_of_prns = CopyRecords(log.data, sizeof(log.data[0]), MAX_NUM_SAT,
+                                     log.number_of_prns, message, header_length+4);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, SatellitePositions &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+12);
+    log.number_of_satellites = CopyRecords(log.data, sizeof(log.data[0]), MAX_CHAN,
+                                           log.number_of_satellites, message, header_length+12);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, SatelliteVisibility &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+12);
+    log.number_of_satellites = CopyRecords(log.data, sizeof(log.data[0]), MAX_CHAN,
+                                           log.number_of_satellites, message, header_length+12);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, TrackStatus &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+16);
+    log.number_of_channels = CopyRecords(log.data, sizeof(log.data[0]), MAX_CHAN,
+                                         log.number_of_channels, message, header_length+16);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+inline bool DecodeBinaryLog(const unsigned char *message, size_t /*length*/, rtkdatab_log &log) {
+    size_t header_length = BinaryHeaderLength(message);
+    memcpy(&log, message, header_length+RTKDATA_RECORDS_OFFSET);
+    log.header.num_svs = CopyRecords(log.data, sizeof(log.data[0]), MAX_NUM_SAT,
+                                     std::max(log.header.num_svs, 0), message,
+                                     header_length+RTKDATA_RECORDS_OFFSET);
+    CopyCrc(log.crc, message);
+    return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,399 @@
+/*!
+ * \file novatel/novatel_demux.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Single pass demultiplexer for receiver ports that carry more than one
+ * protocol.  Each byte is classified by the frame it starts or continues:
+ *
+ *  - NovAtel binary: 0xAA 0x44 0x12, header, body, CRC-32
+ *  - NovAtel ASCII:  '#' ... '*' 8 hex digit CRC-32 of the bytes between them
+ *  - NMEA 0183:      '$' ... '*' 2 hex digit XOR of the bytes between them
+ *  - RTCM3:          0xD3, CRC-24Q (see novatel_rtcm.h)
+ *  - "<OK" command acknowledgements, "<ERROR:..." command errors up to the
+ *    end of the line and "[COM1]" port prompts
+ *
+ * Complete frames are handed to a sink class and counted per protocol.  A
+ * frame that turns out to be invalid part way through (bad sync, bad CRC,
+ * binary data inside a sentence, ...) is dropped and the bytes after its
+ * first byte are scanned again, so a false start never hides a real frame.
+ *
+ */
+
+#ifndef NOVATEL_DEMUX_H
+#define NOVATEL_DEMUX_H
+
+#include <cstring> // for size_t
+#include <stdint.h>
+
+#include "novatel/novatel_structures.h"
+#include "novatel/novatel_rtcm.h"
+
+namespace novatel {
+
+//! 256 entry lookup table for the NovAtel CRC-32 (polynomial 0xEDB88320)
+struct Crc32Table {
+    uint32_t value[256];
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; j++)
+                crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+            value[i] = crc;
+        }
+    }
+};
+
+//! NovAtel CRC-32 of a block of data, as used by binary and ASCII logs
+inline uint32_t CalculateCrc32(const unsigned char *data, size_t length) {
+    static const Crc32Table table;
+    uint32_t crc = 0;
+    while (length-- != 0)
+        crc = (crc >> 8) ^ table.value[(crc ^ *data++) & 0xFF];
+    return crc;
+}
+
+#define NMEA_MAX_SENTENCE_SIZE 128 // 82 by the standard, with room for proprietary sentences
+#define PROMPT_MAX_SIZE 16 // "[COM1]", "[USB1]", "[ICOM1]", ...
+#define COMMAND_ERROR_MAX_SIZE 128 // "<ERROR:Invalid Message. Field = 1", ...
+
+//! Frame and error counts for one protocol
+struct ProtocolCounters {
+    uint32_t frames;    //!< valid frames delivered
+    uint32_t errors;    //!< frames dropped because of a bad checksum or length
+};
+
+//! Counts kept by FrameDemultiplexer
+struct DemuxCounters {
+    ProtocolCounters novatel_binary;
+    ProtocolCounters novatel_ascii;
+    ProtocolCounters nmea;
+    ProtocolCounters rtcm3;
+    uint32_t acknowledgements;  //!< "<OK" replies
+    uint32_t command_errors;    //!< "<ERROR:" replies
+    uint32_t prompts;           //!< "[COMn]" prompts
+    uint64_t unknown_bytes;     //!< bytes outside any valid frame, not counting line endings
+};
+
+/*!
+ * Splits a mixed stream into frames and hands each to Sink, which must
+ * provide:
+ *
+ *  void OnNovatelBinary(unsigned char *frame, size_t length);
+ *  void OnNovatelAscii(const char *sentence, size_t length);
+ *  void OnNmea(const char *sentence, size_t length);
+ *  void OnRtcm3(const unsigned char *frame, size_t length);
+ *  void OnAcknowledgement();
+ *  void OnCommandError(const char *reply, size_t length);
+ *  void OnPrompt(const char *prompt, size_t length);
+ *
+ * Binary and RTCM3 frames include their CRC, sentences run from the '#' or
+ * '$' to the last checksum digit, prompts from '[' to ']' and command
+ * errors from '<' to the last character before the line ending.  The frame
+ * pointer is only valid for the duration of the call.
+ */
+template <class Sink>
+class FrameDemultiplexer {
+public:
+    FrameDemultiplexer(Sink &sink) : sink_(sink) {
+        memset(&counters_, 0, sizeof(counters_));
+        Reset();
+    }
+
+    //! Adds data to the demultiplexer, calling the sink for each complete frame
+    void AddData(const unsigned char *data, size_t length) {
+        for (size_t ii=0; ii<length; ii++) {
+            AddByte(data[ii]);
+            // bytes handed back by a false start come before the next input byte
+            while (pending_index_ < pending_length_)
+                AddByte(pending_[pending_index_++]);
+            pending_index_ = 0;
+            pending_length_ = 0;
+        }
+    }
+
+    //! Discards any partial frame
+    void Reset() {
+        protocol_ = NONE;
+        buffer_index_ = 0;
+        frame_length_ = 0;
+        checksum_index_ = 0;
+        pending_index_ = 0;
+        pending_length_ = 0;
+    }
+
+    /*!
+     * Number of bytes of the current binary frame that can be written
+     * straight to direct_fill_buffer() and passed to DirectFilled() instead
+     * of AddData().  Always stops short of the last byte of the frame, so
+     * completing a frame still goes through AddData().
+     */
+    size_t direct_fill_size() const {
+        if ((protocol_ != NOVATEL_BINARY) || (frame_length_ == 0))
+            return 0;
+        return frame_length_ - buffer_index_ - 1;
+    }
+    unsigned char *direct_fill_buffer() {return buffer_ + buffer_index_;}
+    void DirectFilled(size_t length) {buffer_index_ += length;}
+
+    const DemuxCounters &counters() const {return counters_;}
+
+private:
+    enum Protocol {NONE, NOVATEL_BINARY, NOVATEL_ASCII, NMEA, RTCM3, ACKNOWLEDGEMENT, PROMPT};
+
+    void AddByte(unsigned char byte) {
+        if (protocol_ == NONE) {
+            StartFrame(byte);
+            return;
+        }
+        buffer_[buffer_index_++] = byte;
+        switch (protocol_) {
+            case NOVATEL_BINARY: AddBinaryByte(); break;
+            case NOVATEL_ASCII: AddSentenceByte(byte, MAX_NOUT_SIZE, 8); break;
+            case NMEA: AddSentenceByte(byte, NMEA_MAX_SENTENCE_SIZE, 2); break;
+            case RTCM3: AddRtcm3Byte(); break;
+            case ACKNOWLEDGEMENT: AddAcknowledgementByte(byte); break;
+            case PROMPT: AddPromptByte(byte); break;
+            default: break;
+        }
+    }
+
+    void StartFrame(unsigned char byte) {
+        switch (byte) {
+            case NOVATEL_SYNC_BYTE_1: protocol_ = NOVATEL_BINARY; break;
+            case '#': protocol_ = NOVATEL_ASCII; break;
+            case '$': protocol_ = NMEA; break;
+            case RTCM3_PREAMBLE: protocol_ = RTCM3; break;
+            case NOVATEL_ACK_BYTE_1: protocol_ = ACKNOWLEDGEMENT; break;
+            case NOVATEL_RESET_BYTE_1: protocol_ = PROMPT; break;
+            case '\r': case '\n': return;
+            default: counters_.unknown_bytes++; return;
+        }
+        buffer_[0] = byte;
+        buffer_index_ = 1;
+        frame_length_ = 0;
+        checksum_index_ = 0;
+    }
+
+    void AddBinaryByte() {
+        if (buffer_index_ == 2) {
+            if (buffer_[1] != NOVATEL_SYNC_BYTE_2)
+                Resynchronise();
+        } else if (buffer_index_ == 3) {
+            if (buffer_[2] != NOVATEL_SYNC_BYTE_3)
+                Resynchronise();
+        } else if (buffer_index_ == 10) {
+            // header length is in byte 3 and message length in bytes 8-9,
+            // the header must at least cover the length field
+            size_t header_length = buffer_[3];
+            frame_length_ = header_length + ((buffer_[9] << 8) | buffer_[8]) + CHECKSUM_SIZE;
+            if ((header_length < 10) || (frame_length_ > MAX_NOUT_SIZE)) {
+                counters_.novatel_binary.errors++;
+                Resynchronise();
+            }
+        } else if (buffer_index_ == frame_length_) {
+            uint32_t crc = CalculateCrc32(buffer_, frame_length_-CHECKSUM_SIZE);
+            unsigned char *received = buffer_ + frame_length_ - CHECKSUM_SIZE;
+            uint32_t received_crc = ((uint32_t)received[3] << 24) | ((uint32_t)received[2] << 16) |
+                                    ((uint32_t)received[1] << 8) | (uint32_t)received[0];
+            if (crc != received_crc) {
+                counters_.novatel_binary.errors++;
+                Resynchronise();
+                return;
+            }
+            counters_.novatel_binary.frames++;
+            size_t length = frame_length_;
+            EndFrame();
+            sink_.OnNovatelBinary(buffer_, length);
+        }
+    }
+
+    /*!
+     * NovAtel ASCII and NMEA sentences: printable characters up to '*',
+     * then a fixed number of hex checksum digits.
+     */
+    void AddSentenceByte(unsigned char byte, size_t max_length, size_t checksum_digits) {
+        if (checksum_index_ == 0) {
+            if (byte == '*') {
+                checksum_index_ = buffer_index_;
+            } else if ((byte < 0x20) || (byte > 0x7E) || (byte == '$') || (byte == '#')
+                       || (buffer_index_ + checksum_digits >= max_length)) {
+                // truncated sentence or not a sentence at all, the byte that
+                // broke it is rescanned and may well start the next frame
+                Resynchronise();
+            }
+            return;
+        }
+        if (HexValue(byte) < 0) {
+            Resynchronise();
+            return;
+        }
+        if (buffer_index_ < checksum_index_ + checksum_digits)
+            return;
+
+        uint32_t received = 0;
+        for (size_t ii=checksum_index_; ii<buffer_index_; ii++)
+            received = (received << 4) | HexValue(buffer_[ii]);
+        size_t body_length = checksum_index_ - 2;   // between the start character and '*'
+        ProtocolCounters &counters = (protocol_ == NMEA) ? counters_.nmea : counters_.novatel_ascii;
+        uint32_t calculated = 0;
+        if (protocol_ == NMEA) {
+            for (size_t ii=1; ii<=body_length; ii++)
+                calculated ^= buffer_[ii];
+        } else {
+            calculated = CalculateCrc32(buffer_+1, body_length);
+        }
+        if (calculated != received) {
+            counters.errors++;
+            Resynchronise();
+            return;
+        }
+        counters.frames++;
+        Protocol protocol = protocol_;
+        size_t length = buffer_index_;
+        EndFrame();
+        if (protocol == NMEA)
+            sink_.OnNmea((const char*)buffer_, length);
+        else
+            sink_.OnNovatelAscii((const char*)buffer_, length);
+    }
+
+    void AddRtcm3Byte() {
+        if (buffer_index_ == RTCM3_HEADER_SIZE) {
+            // the 6 bits after the preamble are reserved and always zero
+            if (buffer_[1] & 0xFC)
+                Resynchronise();
+            else
+                frame_length_ = RTCM3_HEADER_SIZE + Rtcm3PayloadLength(buffer_) + RTCM3_CRC_SIZE;
+        } else if ((frame_length_ > 0) && (buffer_index_ == frame_length_)) {
+            size_t crc_offset = frame_length_ - RTCM3_CRC_SIZE;
+            uint32_t crc = (buffer_[crc_offset] << 16) | (buffer_[crc_offset+1] << 8) | buffer_[crc_offset+2];
+            if (crc != CalculateCrc24q(buffer_, crc_offset)) {
+                counters_.rtcm3.errors++;
+                Resynchronise();
+                return;
+            }
+            counters_.rtcm3.frames++;
+            size_t length = frame_length_;
+            EndFrame();
+            sink_.OnRtcm3(buffer_, length);
+        }
+    }
+
+    /*!
+     * Command replies: "<OK", or "<ERROR:" and the reason up to the end of
+     * the line.  Anything else starting with '<' is not a reply.
+     */
+    void AddAcknowledgementByte(unsigned char byte) {
+        if (buffer_[1] == NOVATEL_ACK_BYTE_2) {
+            if (buffer_index_ == 2)
+                return;
+            if ((buffer_index_ == 3) && (byte == NOVATEL_ACK_BYTE_3)) {
+                counters_.acknowledgements++;
+                EndFrame();
+                sink_.OnAcknowledgement();
+                return;
+            }
+            Resynchronise();
+            return;
+        }
+        static const char error_prefix[] = "<ERROR:";
+        if (buffer_index_ < sizeof(error_prefix)) {
+            if (byte != (unsigned char)error_prefix[buffer_index_-1])
+                Resynchronise();
+            return;
+        }
+        if ((byte == '\r') || (byte == '\n')) {
+            counters_.command_errors++;
+            size_t length = buffer_index_ - 1;
+            EndFrame();
+            sink_.OnCommandError((const char*)buffer_, length);
+        } else if ((byte < 0x20) || (byte > 0x7E) || (buffer_index_ >= COMMAND_ERROR_MAX_SIZE)) {
+            Resynchronise();
+        }
+    }
+
+    void AddPromptByte(unsigned char byte) {
+        if (byte == NOVATEL_RESET_BYTE_6) {
+            counters_.prompts++;
+            size_t length = buffer_index_;
+            EndFrame();
+            sink_.OnPrompt((const char*)buffer_, length);
+        } else if ((byte < 0x20) || (byte > 0x7E) || (buffer_index_ >= PROMPT_MAX_SIZE)) {
+            Resynchronise();
+        }
+    }
+
+    static int HexValue(unsigned char c) {
+        if ((c >= '0') && (c <= '9'))
+            return c - '0';
+        if ((c >= 'A') && (c <= 'F'))
+            return c - 'A' + 10;
+        if ((c >= 'a') && (c <= 'f'))
+            return c - 'a' + 10;
+        return -1;
+    }
+
+    //! Finishes the current frame, leaving it in buffer_ for the sink
+    void EndFrame() {
+        protocol_ = NONE;
+        buffer_index_ = 0;
+        frame_length_ = 0;
+        checksum_index_ = 0;
+    }
+
+    //! Drops the current start byte and queues the bytes after it to be scanned again
+    void Resynchronise() {
+        // the buffered bytes were read before anything still pending, so
+        // they go in front of it.  Every byte is either in buffer_ or pending_
+        // and each rescan drops one, so the two together never exceed the
+        // size of one frame.
+        size_t requeue = buffer_index_ - 1;
+        size_t unread = pending_length_ - pending_index_;
+        memmove(pending_ + requeue, pending_ + pending_index_, unread);
+        memcpy(pending_, buffer_ + 1, requeue);
+        pending_index_ = 0;
+        pending_length_ = requeue + unread;
+        counters_.unknown_bytes++;
+        EndFrame();
+    }
+
+    Sink &sink_;
+    Protocol protocol_;         //!< protocol of the frame being buffered, NONE while searching
+    unsigned char buffer_[MAX_NOUT_SIZE];
+    size_t buffer_index_;       //!< bytes of the current frame in buffer_
+    size_t frame_length_;       //!< total length of a binary or RTCM3 frame, 0 until its header is complete
+    size_t checksum_index_;     //!< offset of the first checksum digit of a sentence, 0 until the '*'
+    unsigned char pending_[MAX_NOUT_SIZE]; //!< bytes to rescan after a false start
+    size_t pending_index_;
+    size_t pending_length_;
+    DemuxCounters counters_;
+};
+
+}
+
+#endif
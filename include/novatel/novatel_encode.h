@@ -0,0 +1,159 @@
+/*!
+ * \file novatel/novatel_encode.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Encoding of the structures in novatel_structures.h into binary messages
+ * for the receiver: the reverse of novatel_decode.h.  Only the records in
+ * use are sent, each message gets a fresh header and CRC, and several
+ * messages can be collected for a single write.
+ *
+ */
+
+#ifndef NOVATEL_ENCODE_H
+#define NOVATEL_ENCODE_H
+
+#include <cstring> // for size_t, memcpy
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+#include "novatel/novatel_decode.h"
+#include "novatel/novatel_demux.h" // for CalculateCrc32
+
+namespace novatel {
+
+//! Bytes from the start of a repeated block to the end of its used records
+inline size_t RecordsLength(size_t offset, int64_t count, size_t capacity, size_t record_size) {
+    size_t used = (count > 0) ? std::min((size_t)count, capacity) : 0;
+    return offset + used*record_size;
+}
+
+//! Payload length of a log with a fixed layout
+template <class T>
+inline size_t EncodedPayloadLength(const T &/*log*/) {
+    return sizeof(T) - sizeof(Oem4BinaryHeader) - CHECKSUM_SIZE;
+}
+
+inline size_t EncodedPayloadLength(const Dop &log) {
+    return RecordsLength(28, log.number_of_prns, MAX_CHAN, sizeof(log.prn[0]));
+}
+
+inline size_t EncodedPayloadLength(const RangeMeasurements &log) {
+    return RecordsLength(4, log.number_of_observations, MAX_CHAN, sizeof(log.range_data[0]));
+}
+
+inline size_t EncodedPayloadLength(const CompressedRangeMeasurements &log) {
+    return RecordsLength(4, log.number_of_observations, MAX_CHAN, sizeof(log.range_data[0]));
+}
+
+inline size_t EncodedPayloadLength(const RawAlmanac &log) {
+    return RecordsLength(12, log.num_of_subframes, 1, sizeof(log.subframe_data));
+}
+
+inline size_t EncodedPayloadLength(const Almanac &log) {
+    return RecordsLength(4, log.number_of_prns, MAX_NUM_SAT, sizeof(log.data[0]));
+}
+
+inline size_t EncodedPayloadLength(const SatellitePositions &log) {
+    return RecordsLength(12, log.number_of_satellites, MAX_CHAN, sizeof(log.data[0]));
+}
+
+inline size_t EncodedPayloadLength(const SatelliteVisibility &log) {
+    return RecordsLength(12, log.number_of_satellites, MAX_CHAN, sizeof(log.data[0]));
+}
+
+inline size_t EncodedPayloadLength(const TrackStatus &log) {
+    return RecordsLength(16, log.number_of_channels, MAX_CHAN, sizeof(log.data[0]));
+}
+
+inline size_t EncodedPayloadLength(const rtkdatab_log &log) {
+    return RecordsLength(RTKDATA_RECORDS_OFFSET, log.header.num_svs, MAX_NUM_SAT, sizeof(log.data[0]));
+}
+
+/*!
+ * Builds binary messages for the receiver into one buffer, e.g.
+ *
+ *   BinaryEncoder encoder;
+ *   encoder.Add<ALMANACB_LOG_TYPE>(almanac);
+ *   gps.SendBinaryMessages(encoder);
+ *
+ * The header of the structure passed in is ignored.
+ */
+class BinaryEncoder {
+public:
+    BinaryEncoder() : messages_(0) {}
+
+    template <BINARY_LOG_TYPE Id>
+    void Add(const typename BinaryLogTraits<Id>::Type &log) {
+        AddMessage(Id, reinterpret_cast<const unsigned char*>(&log) + sizeof(Oem4BinaryHeader),
+                   EncodedPayloadLength(log));
+    }
+
+    //! Appends a message with the given payload, adding the header and CRC
+    void AddMessage(BINARY_LOG_TYPE message_id, const unsigned char *payload, size_t length) {
+        Oem4BinaryHeader header;
+        memset(&header, 0, sizeof(header));
+        header.sync1 = NOVATEL_SYNC_BYTE_1;
+        header.sync2 = NOVATEL_SYNC_BYTE_2;
+        header.sync3 = NOVATEL_SYNC_BYTE_3;
+        header.header_length = sizeof(header);
+        header.message_id = message_id;
+        header.message_type.format = BINARY;
+        header.message_type.response = ORIGINAL_MESSAGE;
+        header.port_address = THISPORT;
+        header.message_length = (uint16_t)length;
+
+        size_t start = buffer_.size();
+        buffer_.resize(start + sizeof(header) + length + CHECKSUM_SIZE);
+        unsigned char *message = &buffer_[start];
+        memcpy(message, &header, sizeof(header));
+        memcpy(message + sizeof(header), payload, length);
+        uint32_t crc = CalculateCrc32(message, sizeof(header) + length);
+        unsigned char *crc_bytes = message + sizeof(header) + length;
+        for (int ii=0; ii<CHECKSUM_SIZE; ii++)
+            crc_bytes[ii] = (crc >> (8*ii)) & 0xFF;  // least significant byte first
+        messages_++;
+    }
+
+    const unsigned char* data() const {return buffer_.empty() ? NULL : &buffer_[0];}
+    size_t size() const {return buffer_.size();}
+    //! Number of messages added
+    size_t messages() const {return messages_;}
+    bool empty() const {return messages_ == 0;}
+
+    void Clear() {
+        buffer_.clear();
+        messages_ = 0;
+    }
+
+private:
+    std::vector<unsigned char> buffer_;
+    size_t messages_;
+};
+
+}
+
+#endif
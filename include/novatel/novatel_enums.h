@@ -364,6 +364,7 @@ enum BINARY_LOG_TYPE
   RXCONFIGB_LOG_TYPE = 128,
   RANGECMPB_LOG_TYPE = 140,
   RTKPOSB_LOG_TYPE = 141,
+  RTKDATAB_LOG_TYPE = 215,
   RTKDOPB_LOG_TYPE = 952,
   NAVIGATEB_LOG_TYPE = 161,
   AVEPOSB_LOG_TYPE = 172,
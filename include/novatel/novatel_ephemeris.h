@@ -0,0 +1,94 @@
+/*!
+ * \file novatel/novatel_ephemeris.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Per-PRN store of the latest GPS ephemerides with change detection, so
+ * consumers only see an ephemeris when the satellite uploads a new one
+ * rather than every time the receiver repeats it.
+ *
+ */
+
+#ifndef NOVATEL_EPHEMERIS_H
+#define NOVATEL_EPHEMERIS_H
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+/*!
+ * Latest GPSEPHEM for each PRN.  An ephemeris counts as changed when its
+ * IODE, reference week or time of ephemeris (TOE), or the satellite health
+ * differ from the one stored.  Safe to update from the read thread while
+ * another thread takes snapshots.
+ */
+class EphemerisStore {
+public:
+    EphemerisStore();
+
+    /*!
+     * Stores an ephemeris if it is new or changed.
+     *
+     * @return true if the stored set changed
+     */
+    bool Update(const GpsEphemeris &ephemeris);
+
+    //! Gets the stored ephemeris for a PRN, returns false if there is none
+    bool Get(uint32_t prn, GpsEphemeris &ephemeris);
+
+    //! Copies all stored ephemerides, ordered by PRN
+    std::vector<GpsEphemeris> Snapshot();
+
+    //! Incremented every time the stored set changes
+    uint32_t version();
+
+    //! Number of ephemerides received, changed or not
+    uint32_t update_count();
+
+    //! Number of PRNs with an ephemeris
+    size_t size();
+
+    void Clear();
+
+private:
+    static bool SameEphemeris(const GpsEphemeris &a, const GpsEphemeris &b);
+
+    boost::mutex mutex_;
+    std::map<uint32_t, GpsEphemeris> ephemerides_; //!< latest ephemeris, keyed by PRN
+    uint32_t version_;
+    uint32_t update_count_;
+};
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*!
+ * \file novatel/novatel_executor.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * A small thread pool that runs frame handlers, serially for frames of
+ * the same type and in parallel for frames of different types.
+ *
+ */
+
+#ifndef NOVATEL_EXECUTOR_H
+#define NOVATEL_EXECUTOR_H
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/circular_buffer.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "novatel/novatel_batch.h"
+
+namespace novatel {
+
+//! Called with a copy of the frame in a buffer of the executor's frame buffer size
+typedef boost::function<void(const unsigned char*, size_t, BINARY_LOG_TYPE, double)> FrameHandler;
+
+//! Queue and run time statistics for one message type
+struct ExecutorStats {
+    BINARY_LOG_TYPE message_id;
+    uint64_t executed;      //!< frames handled
+    uint64_t dropped;       //!< frames dropped because the queue was full
+    uint32_t queued;        //!< frames waiting now
+    uint32_t max_queued;    //!< most frames ever waiting at once
+    double mean_us;         //!< mean handler run time [microseconds]
+    double max_us;          //!< longest handler run time [microseconds]
+};
+
+/*!
+ * Runs a frame handler on a pool of threads.  Frames are queued per
+ * message type and each type is handled by at most one thread at a time,
+ * so frames of one type are handled in the order they were posted while
+ * different types run in parallel.  A slow handler for one type only
+ * delays that type.
+ */
+class CallbackExecutor {
+public:
+    /*!
+     * @param frame_buffer_size each frame is copied to the start of a
+     * buffer this large before the handler is called
+     * @param max_queued frames of one type that may wait before new ones
+     * are dropped
+     */
+    CallbackExecutor(FrameHandler handler, size_t threads, size_t frame_buffer_size, size_t max_queued = 256);
+    //! Handles every queued frame, then stops the threads
+    ~CallbackExecutor();
+
+    //! Copies a frame into its type's queue, returns false if it was dropped
+    bool Post(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id, double timestamp);
+
+    //! Blocks until every frame posted so far has been handled
+    void Wait();
+
+    std::vector<ExecutorStats> stats();
+
+private:
+    struct Strand {
+        FrameBatch pending;     //!< frames posted and not yet taken by a thread
+        FrameBatch taken;       //!< frames being run, swapped with pending so both keep their allocations
+        bool scheduled;         //!< true while queued in ready_ or being run
+        uint32_t running;       //!< frames taken by the thread running the strand
+        ExecutorStats stats;
+        double total_us;
+    };
+
+    //! Method run by each pool thread
+    void Run();
+
+    FrameHandler handler_;
+    size_t frame_buffer_size_;
+    size_t max_queued_;
+    boost::mutex mutex_;
+    boost::condition_variable work_condition_;  //!< signalled when a strand becomes ready
+    boost::condition_variable idle_condition_;  //!< signalled when a strand finishes its frames
+    std::map<BINARY_LOG_TYPE, Strand> strands_;
+    //! strands with frames and no thread, never more than there are strands
+    boost::circular_buffer<BINARY_LOG_TYPE> ready_;
+    bool running_;
+    boost::thread_group threads_;
+};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*!
+ * \file novatel/novatel_fanout.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Serves one byte stream to many local clients.  Published data is copied
+ * once into a shared ring and written to each TCP client straight from the
+ * ring at that client's own position, so a slow client costs no copies and
+ * never blocks the publisher: if it falls a whole ring behind it is
+ * disconnected.  UDP destinations get one datagram per published message.
+ *
+ * Endpoints are given as URLs:
+ *   tcp://:2101               listen on all interfaces
+ *   tcp://127.0.0.1:2101      listen on one address
+ *   unix:///tmp/novatel.sock  listen on a Unix domain socket, replacing a stale one
+ *   udp://192.168.1.20:2102   send datagrams to a host
+ *
+ */
+
+#ifndef NOVATEL_FANOUT_H
+#define NOVATEL_FANOUT_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+namespace novatel {
+
+//! Counters of a FanoutServer
+struct FanoutStats {
+    size_t clients;             //!< connected stream clients
+    uint64_t accepted;          //!< stream clients accepted since Start()
+    uint64_t rejected;          //!< stream clients refused because max_clients were connected
+    uint64_t dropped_clients;   //!< stream clients disconnected for falling a ring behind
+    uint64_t messages;          //!< messages published
+    uint64_t bytes;             //!< bytes published
+    uint64_t bytes_sent;        //!< bytes written to all stream clients
+    uint64_t max_backlog;       //!< bytes the furthest behind client had still to be sent, at the last pass
+    uint64_t datagram_errors;   //!< UDP sends that failed or would have blocked
+};
+
+//! Called from the server thread when a client connects (true) or disconnects (false)
+typedef boost::function<void(const std::string&, bool)> FanoutClientCallback;
+
+/*!
+ * Fans published messages out to TCP and Unix socket clients and UDP
+ * destinations.  Each stream client only costs its socket and a ring
+ * position, whatever its backlog.
+ * Publish() may be called from any thread; clients are served by a
+ * thread started with Start().
+ */
+class FanoutServer {
+public:
+    //! ring_size is rounded up to a power of two and bounds how far a client may fall behind
+    FanoutServer(size_t ring_size = 1<<20, size_t max_clients = 64);
+    ~FanoutServer();
+
+    /*!
+     * Adds a TCP or Unix listening socket or UDP destination.  Must be called
+     * before Start().  Throws std::exception if the URL is invalid or the
+     * socket cannot be opened.
+     */
+    void AddEndpoint(const std::string &url);
+
+    void Start();
+    void Stop();
+    bool running() const {return running_;}
+
+    //! Queues a message for every client, without blocking on any of them
+    void Publish(const unsigned char *data, size_t length);
+
+    FanoutStats Stats();
+
+    void set_client_callback(FanoutClientCallback handler) {client_callback_=handler;}
+
+private:
+    struct Client {
+        int fd;
+        uint64_t cursor;        //!< absolute ring position of the next byte to send
+        std::string name;
+    };
+    struct Listener {
+        int fd;
+        std::string url;
+        std::string unix_path;  //!< removed when the server is destroyed
+    };
+    struct Destination {
+        int fd;
+        struct sockaddr_storage address;
+        socklen_t address_length;
+    };
+
+    void AddUnixListener(const std::string &url, const std::string &path);
+    void Run();
+    void AcceptClients(const Listener &listener);
+    //! Sends from the client's cursor up to head, false if it must be dropped
+    bool SendToClient(Client &client, uint64_t head);
+    void RemoveClient(size_t index, bool dropped);
+    void Wake();
+
+    std::vector<unsigned char> ring_;
+    size_t ring_mask_;
+    uint64_t head_;             //!< bytes ever published, protected by mutex_
+    size_t max_clients_;
+
+    std::vector<Listener> listeners_;
+    std::vector<Destination> destinations_;
+    std::vector<Client> clients_;   //!< only used by the server thread
+    FanoutClientCallback client_callback_;
+
+    int wake_pipe_[2];
+    boost::atomic<bool> wake_pending_;
+    boost::atomic<bool> running_;
+    boost::thread thread_;
+    boost::mutex mutex_;
+    FanoutStats stats_;         //!< protected by mutex_
+};
+
+}
+
+#endif
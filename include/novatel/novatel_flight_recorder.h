@@ -0,0 +1,183 @@
+/*!
+ * \file novatel/novatel_flight_recorder.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * A flight recorder for receiver data: the last few seconds of bytes read
+ * from the receiver are kept in a fixed size ring in memory, with the host
+ * time each read arrived, and written out as a recording when something
+ * goes wrong.  The bytes are kept as read, so a dump also holds the
+ * corrupt frames behind a CRC storm.
+ * Dumps use the Recorder file format, so an incident can be replayed
+ * with a "replay://" transport or decoded with ReadFromFile.
+ *
+ */
+
+#ifndef NOVATEL_FLIGHT_RECORDER_H
+#define NOVATEL_FLIGHT_RECORDER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/circular_buffer.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "novatel/novatel_recorder.h"
+
+namespace novatel {
+
+//! Why a flight recorder dump was written
+enum FlightTrigger {
+    FLIGHT_TRIGGER_MANUAL,
+    FLIGHT_TRIGGER_CRC_STORM,       //!< crc_storm_errors CRC errors within crc_storm_window
+    FLIGHT_TRIGGER_SOLUTION_NONE,   //!< BESTPOS or BESTUTM position type dropped to NONE
+    FLIGHT_TRIGGER_INS_DEGRADED,    //!< INSPVA or INSPVAS status left INS_SOLUTION_GOOD
+    FLIGHT_TRIGGER_ACK_TIMEOUT      //!< the receiver did not acknowledge a command
+};
+
+//! Short name of a trigger, also used in dump file names
+const char* FlightTriggerName(FlightTrigger trigger);
+
+struct FlightRecorderConfig {
+    double window;              //!< data older than this is discarded [s]
+    size_t max_bytes;           //!< memory for data, older reads are discarded to stay within it
+    size_t max_reads;
+    std::string directory;      //!< dumps are written here
+    RecordCodec codec;
+    double post_trigger;        //!< data received this long after a trigger is included in its dump [s]
+    double holdoff;             //!< triggers this soon after the last dump are counted but ignored [s]
+    uint32_t crc_storm_errors;  //!< 0 to not trigger on CRC errors
+    double crc_storm_window;    //!< [s]
+    bool trigger_solution_none;
+    bool trigger_ins_degraded;
+    bool trigger_ack_timeout;
+
+    FlightRecorderConfig() : window(30.0), max_bytes(8*1024*1024), max_reads(65536), directory("."),
+        codec(RECORD_CODEC_NONE), post_trigger(2.0), holdoff(30.0), crc_storm_errors(10),
+        crc_storm_window(1.0), trigger_solution_none(true), trigger_ins_degraded(true),
+        trigger_ack_timeout(true) {}
+};
+
+struct FlightRecorderStats {
+    uint64_t frames;            //!< frames checked for triggers
+    size_t reads_buffered;      //!< reads currently in the ring
+    size_t bytes_buffered;
+    uint32_t triggers;          //!< triggers seen, including ignored ones
+    uint32_t suppressed;        //!< triggers ignored because of a pending dump or the holdoff
+    uint32_t dumps;             //!< dumps written
+    uint32_t write_errors;      //!< dumps that could not be written
+    std::string last_dump;      //!< path of the last dump written
+
+    FlightRecorderStats() : frames(0), reads_buffered(0), bytes_buffered(0), triggers(0), suppressed(0),
+        dumps(0), write_errors(0) {}
+};
+
+//! Called from the dump thread with the trigger and path of each dump, and whether it was written
+typedef boost::function<void(FlightTrigger, const std::string&, bool)> FlightDumpCallback;
+
+/*!
+ * Keeps recent data in memory and dumps it to disk when triggered.
+ * AddData() copies each read into a preallocated ring and CheckFrame()
+ * looks at the frames framed from it for triggers; dumps are copied out
+ * and written by a separate thread, so the read thread never waits for
+ * the disk.
+ */
+class FlightRecorder {
+public:
+    //! Throws std::invalid_argument if the configuration can not hold a full size frame
+    FlightRecorder(const FlightRecorderConfig &config = FlightRecorderConfig());
+    //! Writes any pending dump before returning
+    ~FlightRecorder();
+
+    //! Adds bytes as read from the receiver, stamped with the current host time
+    void AddData(const unsigned char *data, size_t length);
+
+    //! Checks a CRC checked frame, already added with AddData(), for a solution or INS status change
+    void CheckFrame(const unsigned char *frame, size_t length, uint16_t message_id);
+
+    //! Updates the CRC error count with the framer's running total
+    void AddCrcErrors(uint64_t total_errors);
+
+    /*!
+     * Schedules a dump of the ring, including post_trigger seconds of
+     * data still to come.  Ack timeouts are ignored unless
+     * trigger_ack_timeout is set.
+     *
+     * @return false if the trigger was ignored
+     */
+    bool Trigger(FlightTrigger trigger);
+
+    //! Writes the data in the ring to path now.  Throws std::exception on failure.
+    void Dump(const std::string &path);
+
+    FlightRecorderStats stats();
+
+    void set_dump_callback(FlightDumpCallback handler) {dump_callback_=handler;}
+
+private:
+    struct Entry {
+        uint64_t offset;        //!< absolute ring position of the first byte
+        uint32_t length;
+        uint64_t timestamp;     //!< host time received [us since epoch]
+    };
+
+    //! Drops reads that are too old or in the way of length new bytes, called with mutex_ held
+    void Evict(uint64_t now, size_t length);
+    bool TriggerLocked(FlightTrigger trigger, uint64_t now);
+    //! Copies the ring out, called with mutex_ held
+    void Snapshot(std::vector<unsigned char> &data, std::vector<Entry> &entries);
+    void WriteDump(const std::string &path, const std::vector<unsigned char> &data,
+                   const std::vector<Entry> &entries);
+    //! Method run in a seperate thread that writes dumps once their post trigger time has passed
+    void DumpThread();
+
+    FlightRecorderConfig config_;
+    boost::mutex mutex_;
+    boost::condition_variable condition_;
+    std::vector<unsigned char> ring_;
+    uint64_t head_;                         //!< bytes ever added
+    boost::circular_buffer<Entry> entries_;
+    int32_t last_position_type_;            //!< -1 until a position is seen
+    int32_t last_ins_status_;               //!< -1 until an INS solution is seen
+    uint64_t crc_errors_;                   //!< last total from AddCrcErrors, all ones before the first
+    uint64_t crc_window_start_;             //!< [us]
+    uint32_t crc_window_errors_;
+    bool dump_pending_;
+    FlightTrigger pending_trigger_;
+    uint64_t dump_deadline_;                //!< [us]
+    uint64_t last_trigger_time_;            //!< [us], 0 before the first dump
+    bool running_;
+    boost::thread dump_thread_;
+    FlightRecorderStats stats_;
+    FlightDumpCallback dump_callback_;
+};
+
+}
+
+#endif
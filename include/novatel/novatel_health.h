@@ -0,0 +1,225 @@
+/*!
+ * \file novatel/novatel_health.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Receiver health and signal quality monitoring from RXHWLEVELS, TRACKSTAT
+ * and RXSTATUS.  Keeps sliding window statistics with constant time
+ * updates and raises events when a value crosses its threshold, giving
+ * early warning of antenna faults, power problems and jamming without
+ * having to stream the logs themselves off the vehicle.
+ *
+ */
+
+#ifndef NOVATEL_HEALTH_H
+#define NOVATEL_HEALTH_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/circular_buffer.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+/*!
+ * Mean, standard deviation, minimum and maximum of the last size samples.
+ * Add() is O(1): the sums are kept running and the extremes in monotonic
+ * queues.  The sums are recomputed once per pass through the window so
+ * rounding errors do not build up.
+ */
+class SlidingWindow {
+public:
+    SlidingWindow(size_t size = 60);
+
+    //! Changes the window length, discarding all samples
+    void Resize(size_t size);
+    void Clear();
+    void Add(double value);
+
+    size_t count() const {return count_;}
+    double last() const {return last_;}
+    double mean() const {return count_ ? sum_/count_ : 0;}
+    double stddev() const;
+    double min() const {return count_ ? minimum_.front().second : 0;}
+    double max() const {return count_ ? maximum_.front().second : 0;}
+
+private:
+    std::vector<double> values_;    //!< ring buffer of the samples in the window
+    size_t next_;                   //!< slot the next sample is written to
+    size_t count_;
+    uint64_t index_;                //!< number of samples ever added
+    double sum_;
+    double sum_squares_;
+    double last_;
+    //! (sample index, value) pairs with increasing values, the front is the minimum
+    boost::circular_buffer<std::pair<uint64_t, double> > minimum_;
+    //! (sample index, value) pairs with decreasing values, the front is the maximum
+    boost::circular_buffer<std::pair<uint64_t, double> > maximum_;
+};
+
+//! Slots used to count TRACKSTAT reject codes, codes above NOTUSED share the last two
+#define REJECT_CODE_SLOTS 20
+inline size_t RejectCodeSlot(RangeRejectCode code) {
+    if ((code >= GOOD) && (code <= NOTUSED))
+        return code;
+    return (code == NA) ? 18 : 19;
+}
+
+enum HealthEventType {
+    HEALTH_BOARD_TEMPERATURE,   //!< board temperature above its limit
+    HEALTH_SUPPLY_VOLTAGE,      //!< supply voltage outside its limits
+    HEALTH_ANTENNA_CURRENT,     //!< antenna current outside its limits, an open or shorted feed
+    HEALTH_ANTENNA_OPEN,        //!< RXSTATUS antenna open flag
+    HEALTH_ANTENNA_SHORTED,     //!< RXSTATUS antenna shorted flag
+    HEALTH_ANTENNA_POWER,       //!< RXSTATUS antenna power flag
+    HEALTH_RF_AGC,              //!< RXSTATUS RF AGC flags, usually interference or jamming
+    HEALTH_RECEIVER_ERROR,      //!< RXSTATUS error word not zero
+    HEALTH_RECEIVER_WARNING,    //!< RXSTATUS temperature or supply voltage flags
+    HEALTH_LOW_CNO,             //!< mean C/N0 of the tracked channels below its limit
+    HEALTH_RANGE_REJECTS,       //!< too many observations rejected by the pseudorange filter
+    HEALTH_EVENT_COUNT
+};
+
+//! Short name of an event type, e.g. "LOW_CNO"
+const char* HealthEventName(HealthEventType type);
+
+struct HealthEvent {
+    HealthEventType type;
+    bool active;        //!< true when the condition starts, false when it clears
+    double value;       //!< value that triggered the change
+    double threshold;   //!< limit it crossed, 0 for receiver flags
+    double timestamp;   //!< time stamp of the log the change was seen in
+};
+
+typedef boost::function<void(const HealthEvent&)> HealthEventCallback;
+
+struct HealthThresholds {
+    size_t window_size;             //!< logs each statistic is computed over
+    double max_board_temperature;   //!< [C]
+    double min_supply_voltage;      //!< [V]
+    double max_supply_voltage;      //!< [V]
+    double min_antenna_current;     //!< below this the antenna is probably disconnected [A]
+    double max_antenna_current;     //!< above this the feed is probably shorted [A]
+    double min_mean_cno;            //!< mean C/N0 of tracked channels [dB-Hz]
+    double max_reject_fraction;     //!< fraction of tracked observations rejected
+    double hysteresis;              //!< fraction of a threshold a value must move back before its event clears
+
+    HealthThresholds() : window_size(10), max_board_temperature(85.0),
+        min_supply_voltage(4.5), max_supply_voltage(36.0),
+        min_antenna_current(0.005), max_antenna_current(0.1),
+        min_mean_cno(30.0), max_reject_fraction(0.5), hysteresis(0.05) {}
+};
+
+//! Compact snapshot of the monitored values, for low rate diagnostics
+struct HealthSummary {
+    double board_temperature;       //!< window mean [C]
+    double max_board_temperature;   //!< window maximum [C]
+    double supply_voltage;          //!< window mean [V]
+    double min_supply_voltage;      //!< window minimum [V]
+    double antenna_current;         //!< window mean [A]
+    double lna_voltage;             //!< window mean [V]
+    double mean_cno;                //!< window mean of the mean C/N0 of each TRACKSTAT [dB-Hz]
+    double min_channel_cno;         //!< lowest window mean C/N0 of any tracked channel [dB-Hz]
+    uint32_t tracked_channels;      //!< channels tracking in the last TRACKSTAT
+    double reject_fraction;         //!< fraction of observations in the window that were rejected
+    uint32_t reject_counts[REJECT_CODE_SLOTS]; //!< observations in the window with each reject code
+    uint32_t receiver_error;        //!< last RXSTATUS error word
+    uint32_t receiver_status;       //!< last RXSTATUS status word
+    uint32_t active_events;         //!< bit (1 << HealthEventType) set for each active condition
+    uint32_t event_count;           //!< events raised since the monitor was created
+};
+
+//! One line "key=value" rendering of a summary
+std::string FormatHealthSummary(const HealthSummary &summary);
+
+/*!
+ * Collects health statistics from the receiver's status logs and raises
+ * an event each time a condition starts or clears.  The Add methods are
+ * meant to be called from the receiver callbacks; Summary() may be called
+ * from another thread.  The event callback is called on the thread that
+ * added the log, without the monitor locked.
+ */
+class HealthMonitor {
+public:
+    HealthMonitor(const HealthThresholds &thresholds = HealthThresholds());
+
+    void set_event_callback(HealthEventCallback handler) {event_callback_=handler;}
+    void set_thresholds(const HealthThresholds &thresholds);
+
+    void AddHardwareLevels(const ReceiverHardwareStatus &levels, double timestamp);
+    void AddTrackStatus(const TrackStatus &status, double timestamp);
+    void AddReceiverStatus(const RXStatus &status, double timestamp);
+
+    HealthSummary Summary();
+    bool IsActive(HealthEventType type);
+
+private:
+    /*!
+     * Updates the state of an event, queueing a HealthEvent if it changed.
+     * Called with mutex_ held.
+     */
+    void SetCondition(HealthEventType type, bool active, double value, double threshold, double timestamp);
+    //! True while above the threshold, with hysteresis once active
+    bool Above(HealthEventType type, double value, double threshold);
+    //! True while below the threshold, with hysteresis once active
+    bool Below(HealthEventType type, double value, double threshold);
+    //! Passes queued events to the callback, called without mutex_ held
+    void DispatchEvents(HealthEvent *events, size_t count);
+
+    boost::mutex mutex_;
+    HealthThresholds thresholds_;
+    HealthEventCallback event_callback_;
+
+    SlidingWindow board_temperature_;
+    SlidingWindow supply_voltage_;
+    SlidingWindow antenna_current_;
+    SlidingWindow lna_voltage_;
+    SlidingWindow mean_cno_;
+    std::vector<SlidingWindow> channel_cno_;    //!< per TRACKSTAT channel
+    std::vector<uint16_t> channel_prn_;         //!< satellite whose C/N0 is in channel_cno_
+    uint32_t tracked_channels_;
+
+    //! reject code counts of each TRACKSTAT in the window
+    boost::circular_buffer<std::vector<uint32_t> > reject_history_;
+    uint32_t reject_totals_[REJECT_CODE_SLOTS];     //!< sum of reject_history_
+
+    uint32_t receiver_error_;
+    uint32_t receiver_status_;
+    uint32_t active_events_;
+    uint32_t event_count_;
+    HealthEvent pending_[HEALTH_EVENT_COUNT];   //!< changes found by the current Add call
+    size_t pending_count_;
+};
+
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*!
+ * \file novatel/novatel_latest.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Latest value of each binary log, readable from any thread without
+ * locking out the thread that parses the logs.
+ *
+ */
+
+#ifndef NOVATEL_LATEST_H
+#define NOVATEL_LATEST_H
+
+#include <cstring>
+#include <stdint.h>
+#include <time.h>
+
+#include <boost/atomic.hpp>
+
+#include "novatel/novatel_decode.h"
+
+namespace novatel {
+
+/*!
+ * A value guarded by a sequence lock.  The single writer never waits;
+ * readers copy the value and retry if a write overlapped the copy, so
+ * they never block the writer or each other.  Writes only happen once
+ * the value has been enabled, so a log nobody reads costs one atomic
+ * load per frame.
+ */
+template <class T>
+class SeqLockValue {
+public:
+    SeqLockValue() : sequence_(0), enabled_(false), timestamp_(0), received_us_(0) {}
+
+    void Enable() {enabled_.store(true, boost::memory_order_relaxed);}
+    bool enabled() const {return enabled_.load(boost::memory_order_relaxed);}
+
+    //! Decodes a frame into the value, only called by the writer thread
+    void StoreFrame(const unsigned char *message, size_t length, double timestamp, uint64_t received_us) {
+        uint32_t sequence = sequence_.load(boost::memory_order_relaxed);
+        sequence_.store(sequence+1, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        DecodeBinaryLog(message, length, value_);
+        timestamp_ = timestamp;
+        received_us_ = received_us;
+        sequence_.store(sequence+2, boost::memory_order_release);
+    }
+
+    /*!
+     * Copies the latest value.
+     *
+     * @return false if no value has been stored yet
+     */
+    bool Load(T &value, double *timestamp = NULL, uint64_t *received_us = NULL) const {
+        uint32_t before, after;
+        double stamp;
+        uint64_t received;
+        do {
+            before = sequence_.load(boost::memory_order_acquire);
+            if (before == 0)
+                return false;
+            if (before & 1)
+                continue;   // a write is in progress
+            memcpy(&value, (const void*)&value_, sizeof(T));
+            stamp = timestamp_;
+            received = received_us_;
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            after = sequence_.load(boost::memory_order_relaxed);
+        } while ((before & 1) || (before != after));
+        if (timestamp)
+            *timestamp = stamp;
+        if (received_us)
+            *received_us = received;
+        return true;
+    }
+
+private:
+    boost::atomic<uint32_t> sequence_;  //!< odd while a write is in progress, 0 until the first
+    boost::atomic<bool> enabled_;
+    T value_;
+    double timestamp_;          //!< read time stamp of the frame
+    uint64_t received_us_;      //!< monotonic time the frame was parsed [us]
+};
+
+/*!
+ * A SeqLockValue for every log in NOVATEL_BINARY_LOG_TYPES, keyed by log
+ * id since several logs share a structure (e.g. BESTPOSB, PSRPOSB and
+ * RTKPOSB are all Position).
+ */
+class LatestLogCache {
+public:
+    template <BINARY_LOG_TYPE Id>
+    SeqLockValue<typename BinaryLogTraits<Id>::Type>& Slot();
+
+    //! Enables caching of a log, returns false if the log is not cached
+    bool Enable(BINARY_LOG_TYPE message_id) {
+        switch (message_id) {
+#define NOVATEL_LATEST_ENABLE(id, type) \
+            case id: id##_latest_.Enable(); return true;
+NOVATEL_BINARY_LOG_TYPES(NOVATEL_LATEST_ENABLE)
+#undef NOVATEL_LATEST_ENABLE
+            default: return false;
+        }
+    }
+
+    //! Stores a frame if its log is enabled
+    void Store(const unsigned char *message, size_t length, BINARY_LOG_TYPE message_id, double timestamp) {
+        switch (message_id) {
+#define NOVATEL_LATEST_STORE(id, type) \
+            case id: \
+                if (id##_latest_.enabled()) \
+                    id##_latest_.StoreFrame(message, length, timestamp, NowMicroseconds()); \
+                break;
+NOVATEL_BINARY_LOG_TYPES(NOVATEL_LATEST_STORE)
+#undef NOVATEL_LATEST_STORE
+            default: break;
+        }
+    }
+
+    //! Monotonic clock the cached values are stamped with [us]
+    static uint64_t NowMicroseconds() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+    }
+
+private:
+#define NOVATEL_LATEST_MEMBER(id, type) SeqLockValue<type> id##_latest_;
+NOVATEL_BINARY_LOG_TYPES(NOVATEL_LATEST_MEMBER)
+#undef NOVATEL_LATEST_MEMBER
+};
+
+#define NOVATEL_LATEST_SLOT(id, type) \
+    template <> inline SeqLockValue<type>& LatestLogCache::Slot<id>() {return id##_latest_;}
+NOVATEL_BINARY_LOG_TYPES(NOVATEL_LATEST_SLOT)
+#undef NOVATEL_LATEST_SLOT
+
+}
+
+#endif
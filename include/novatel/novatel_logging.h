@@ -0,0 +1,201 @@
+/*!
+ * \file novatel/novatel_logging.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Driver logging: levels checked before a message is formatted, rate
+ * limiting per log statement and an optional background sink, so a
+ * disabled or noisy message never holds up the read thread.
+ *
+ *   NOVATEL_LOG(log_debug_, "Read " << length << " bytes");
+ *   NOVATEL_LOG_THROTTLE(log_warning_, 5.0, "Dropped frame " << id);
+ *
+ * Levels below NOVATEL_MIN_LOG_LEVEL are compiled out.
+ *
+ */
+
+#ifndef NOVATEL_LOGGING_H
+#define NOVATEL_LOGGING_H
+
+#include <deque>
+#include <sstream>
+#include <string>
+#include <stdint.h>
+#include <time.h>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+namespace novatel {
+
+enum LogLevel {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO = 1,
+    LOG_LEVEL_WARNING = 2,
+    LOG_LEVEL_ERROR = 3,
+    LOG_LEVEL_NONE = 4      //!< as a threshold, disables logging
+};
+
+//! Lowest level compiled in, e.g. -DNOVATEL_MIN_LOG_LEVEL=1 removes debug messages
+#ifndef NOVATEL_MIN_LOG_LEVEL
+#define NOVATEL_MIN_LOG_LEVEL 0
+#endif
+
+//! Receives a formatted log message
+typedef boost::function<void(const std::string&)> LogMsgCallback;
+
+//! Parses "debug", "info", "warning", "error" or "none", throws std::invalid_argument otherwise
+LogLevel LogLevelFromString(const std::string &name);
+
+/*!
+ * Passes messages at or above a runtime level to one sink per level,
+ * either directly or through a bounded queue drained by a background
+ * thread.
+ */
+class Logger {
+public:
+    Logger();
+    //! Writes any queued messages before returning
+    ~Logger();
+
+    //! Sets where messages of a level go, set before logging starts
+    void set_sink(LogLevel level, LogMsgCallback sink);
+
+    //! Messages below this level are dropped before they are formatted
+    void set_level(LogLevel level) {level_.store(level, boost::memory_order_relaxed);}
+    LogLevel level() const {return LogLevel(level_.load(boost::memory_order_relaxed));}
+    bool Enabled(LogLevel level) const {return level >= level_.load(boost::memory_order_relaxed);}
+
+    void Write(LogLevel level, const std::string &message);
+
+    /*!
+     * Hands messages to a background thread that calls the sinks, so a
+     * slow sink never blocks the caller.  Messages arriving while max_queued
+     * are waiting are dropped.
+     */
+    void StartAsync(size_t max_queued=1024);
+
+    //! Writes any queued messages and returns to calling the sinks directly
+    void StopAsync();
+
+    //! Messages dropped because the background queue was full
+    uint32_t dropped_count() const {return dropped_count_;}
+
+private:
+    //! Method run in a seperate thread that writes queued messages
+    void WriteQueued();
+
+    LogMsgCallback sinks_[LOG_LEVEL_NONE];
+    boost::atomic<int> level_;
+    boost::mutex mutex_;
+    boost::condition_variable condition_;
+    std::deque<std::pair<LogLevel, std::string> > queue_;
+    size_t max_queued_;
+    bool async_;                    //!< true while messages go through queue_
+    boost::thread thread_;
+    uint32_t dropped_count_;
+};
+
+/*!
+ * One level of a Logger, called like a LogMsgCallback.  Checking
+ * enabled() first skips formatting entirely; for levels below
+ * NOVATEL_MIN_LOG_LEVEL it is false at compile time.
+ */
+template <LogLevel Level>
+class LogChannel {
+public:
+    explicit LogChannel(Logger &logger) : logger_(logger) {}
+
+    bool enabled() const {return (Level >= NOVATEL_MIN_LOG_LEVEL) && logger_.Enabled(Level);}
+
+    void operator()(const std::string &message) const {
+        if (enabled())
+            logger_.Write(Level, message);
+    }
+
+private:
+    Logger &logger_;
+};
+
+/*!
+ * Lets a log statement through at most once per period and counts the
+ * messages it held back.  Safe to share between threads.
+ */
+class LogRateLimiter {
+public:
+    LogRateLimiter() : last_us_(0), suppressed_(0) {}
+
+    /*!
+     * @param suppressed set to the messages held back since the last one let through
+     * @return true if the message should be logged
+     */
+    bool Allow(double period, uint32_t &suppressed) {
+        struct timespec now_ts;
+        clock_gettime(CLOCK_MONOTONIC, &now_ts);
+        // offset so a first call right after boot is not mistaken for "never"
+        uint64_t now = (uint64_t)now_ts.tv_sec*1000000 + now_ts.tv_nsec/1000 + 1;
+        uint64_t last = last_us_.load(boost::memory_order_relaxed);
+        if (((last != 0) && (now - last < (uint64_t)(period*1e6))) ||
+            !last_us_.compare_exchange_strong(last, now, boost::memory_order_relaxed)) {
+            suppressed_.fetch_add(1, boost::memory_order_relaxed);
+            return false;
+        }
+        suppressed = suppressed_.exchange(0, boost::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    boost::atomic<uint64_t> last_us_;
+    boost::atomic<uint32_t> suppressed_;
+};
+
+}
+
+//! Formats and logs a message only if the channel's level is enabled
+#define NOVATEL_LOG(channel, message) \
+    do { \
+        if ((channel).enabled()) { \
+            std::ostringstream novatel_log_stream; \
+            novatel_log_stream << message; \
+            (channel)(novatel_log_stream.str()); \
+        } \
+    } while (0)
+
+//! As NOVATEL_LOG, but this statement logs at most once per period seconds
+#define NOVATEL_LOG_THROTTLE(channel, period, message) \
+    do { \
+        static novatel::LogRateLimiter novatel_log_limiter; \
+        uint32_t novatel_log_suppressed = 0; \
+        if ((channel).enabled() && novatel_log_limiter.Allow(period, novatel_log_suppressed)) { \
+            std::ostringstream novatel_log_stream; \
+            novatel_log_stream << message; \
+            if (novatel_log_suppressed > 0) \
+                novatel_log_stream << " (" << novatel_log_suppressed << " similar messages suppressed)"; \
+            (channel)(novatel_log_stream.str()); \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,253 @@
+/*!
+ * \file novatel/novatel_recorder.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Recording of raw receiver data in independently compressed blocks, and
+ * replay of those recordings through a Transport.
+ *
+ * File layout: an 8 byte file header ("NVTLREC" and a format version)
+ * followed by blocks, each with a RECORD_BLOCK_HEADER_SIZE byte header:
+ *
+ *   uint32 magic       RECORD_BLOCK_MAGIC
+ *   uint8  codec       RecordCodec the payload is stored with
+ *   uint8  reserved[3]
+ *   uint32 raw_length  bytes of receiver data in the block
+ *   uint32 length      bytes of payload following the header
+ *   uint32 crc         NovAtel CRC-32 of the receiver data
+ *   uint64 timestamp   time the first byte was recorded [us since epoch]
+ *
+ * all little endian.  Every block can be decompressed on its own, so a
+ * recording cut short by a power loss is readable up to its last complete
+ * block, and a damaged block only loses its own data.
+ *
+ * LZ4 and zstd are used when the library is built with NOVATEL_HAVE_LZ4
+ * and NOVATEL_HAVE_ZSTD; uncompressed recording is always available.
+ *
+ */
+
+#ifndef NOVATEL_RECORDER_H
+#define NOVATEL_RECORDER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/thread.hpp>
+
+#include "novatel/novatel_transport.h"
+
+namespace novatel {
+
+#define RECORD_FILE_HEADER_SIZE 8
+#define RECORD_BLOCK_HEADER_SIZE 28
+#define RECORD_BLOCK_MAGIC 0x4B4C424E // "NBLK"
+#define RECORD_MAX_BLOCK_SIZE (16*1024*1024)
+
+enum RecordCodec {
+    RECORD_CODEC_NONE = 0,
+    RECORD_CODEC_LZ4 = 1,
+    RECORD_CODEC_ZSTD = 2
+};
+
+//! True if this build can write and read the codec
+bool RecordCodecAvailable(RecordCodec codec);
+
+//! Parses "none", "lz4" or "zstd", throws std::invalid_argument otherwise
+RecordCodec RecordCodecFromString(const std::string &name);
+
+struct RecorderConfig {
+    RecordCodec codec;
+    size_t block_size;          //!< receiver data per block before it is compressed [bytes]
+    double max_flush_latency;   //!< longest time data waits in memory before it is written and synced [s]
+    int compression_level;      //!< codec specific, 0 for the codec's default
+    size_t max_queued_blocks;   //!< blocks waiting for the disk before new data is dropped
+
+    RecorderConfig() : codec(RECORD_CODEC_NONE), block_size(64*1024), max_flush_latency(1.0),
+        compression_level(0), max_queued_blocks(64) {}
+};
+
+struct RecorderStats {
+    uint64_t bytes_recorded;    //!< receiver data written
+    uint64_t bytes_written;     //!< file size including headers
+    uint64_t bytes_dropped;     //!< receiver data dropped because the disk fell behind
+    uint32_t blocks;
+    uint32_t write_errors;
+};
+
+/*!
+ * Records receiver data to a block compressed file.  Write() only copies
+ * into the current block; compression and disk writes happen on a
+ * separate thread so they never hold up the read thread.  A block is
+ * written when it is full or when its oldest data is max_flush_latency
+ * old, and synced to disk after each write, which bounds the data lost on
+ * a power cut.
+ */
+class Recorder {
+public:
+    Recorder();
+    ~Recorder();
+
+    //! Creates the file and starts the writer thread.  Throws std::exception on failure.
+    void Open(const std::string &path, const RecorderConfig &config = RecorderConfig());
+
+    //! Writes everything recorded so far and closes the file
+    void Close();
+
+    bool IsOpen() {return fd_ >= 0;}
+
+    void Write(const unsigned char *data, size_t length);
+
+    RecorderStats stats();
+
+private:
+    struct Block {
+        std::vector<unsigned char> data;
+        uint64_t timestamp;
+    };
+
+    //! Queues the current block for writing, called with mutex_ held
+    void SealBlock();
+    //! Method run in a seperate thread that compresses and writes blocks
+    void WriteBlocks();
+    void WriteBlock(Block &block, std::vector<unsigned char> &buffer);
+
+    int fd_;
+    std::string path_;
+    RecorderConfig config_;
+    boost::mutex mutex_;
+    boost::condition_variable condition_;
+    Block block_;               //!< block being filled
+    std::deque<Block> queue_;   //!< sealed blocks waiting for the writer
+    bool writing_;              //!< true while the writer thread should run
+    boost::thread writer_thread_;
+    RecorderStats stats_;
+};
+
+/*!
+ * Writes a whole recording from the calling thread, one block per call
+ * with the caller's timestamp, and syncs it once when it is closed.  Used
+ * where the data already exists, such as flight recorder dumps.
+ */
+class RecordingWriter {
+public:
+    RecordingWriter();
+    ~RecordingWriter();
+
+    //! Creates the file, throws std::exception on failure
+    void Open(const std::string &path, RecordCodec codec = RECORD_CODEC_NONE, int compression_level = 0);
+
+    //! Writes data as one block, throws std::exception on failure
+    void WriteBlock(const unsigned char *data, size_t length, uint64_t timestamp);
+
+    //! Syncs and closes the file, throws std::exception if the sync fails
+    void Close();
+
+    uint64_t bytes_written() {return bytes_written_;}
+
+private:
+    int fd_;
+    std::string path_;
+    RecordCodec codec_;
+    int compression_level_;
+    std::vector<unsigned char> data_;
+    std::vector<unsigned char> buffer_;
+    uint64_t bytes_written_;
+};
+
+/*!
+ * Reads the blocks of a recording in order, skipping damaged blocks and
+ * stopping at a truncated one.
+ */
+class RecordingReader {
+public:
+    RecordingReader();
+    ~RecordingReader();
+
+    //! Opens a recording, throws std::exception if it can not be read
+    void Open(const std::string &path);
+    void Close();
+
+    /*!
+     * Decompresses the next block into data.
+     *
+     * @return false at the end of the recording
+     */
+    bool ReadBlock(std::vector<unsigned char> &data, uint64_t *timestamp = NULL);
+
+    //! Blocks skipped because their header, payload or CRC was bad
+    uint32_t damaged_blocks() {return damaged_blocks_;}
+
+private:
+    std::string path_;
+    unsigned char *file_;   //!< memory mapped recording
+    size_t size_;
+    size_t position_;
+    uint32_t damaged_blocks_;
+};
+
+/*!
+ * Replays a recording as if it came from a receiver.  Blocks are
+ * decompressed on a separate thread, a few blocks ahead of the reader, so
+ * decompression overlaps with framing and decoding.  Created for
+ * "replay://path" URLs.
+ */
+class ReplayTransport : public Transport {
+public:
+    ReplayTransport(std::string path, size_t read_ahead=4);
+    ~ReplayTransport();
+    void Open();
+    void Close();
+    bool IsOpen() {return reader_thread_.joinable();}
+    size_t Read(unsigned char *buffer, size_t size);
+    size_t ReadV(const struct iovec *iov, int count);
+    size_t Write(const unsigned char *data, size_t length);
+    std::string name() {return "replay://" + path_;}
+    //! True once every block has been read
+    bool AtEnd();
+
+private:
+    //! Method run in a seperate thread that decompresses blocks ahead of Read()
+    void ReadBlocks();
+
+    std::string path_;
+    size_t read_ahead_;
+    RecordingReader reader_;
+    boost::mutex mutex_;
+    boost::condition_variable condition_;
+    std::deque<std::vector<unsigned char> > blocks_;    //!< decompressed blocks not yet read
+    bool reading_;          //!< true while the reader thread should run
+    bool finished_;         //!< true once the reader thread has queued the last block
+    boost::thread reader_thread_;
+    std::vector<unsigned char> current_;    //!< block being returned by Read()
+    size_t position_;       //!< next byte of current_
+};
+
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*!
+ * \file novatel/novatel_restart.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Times a receiver restart: from the reset command to the port banner,
+ * valid GPS time, the first solution of each position type and INS
+ * alignment.  Used to compare how aiding shortens time to first fix.
+ *
+ */
+
+#ifndef NOVATEL_RESTART_H
+#define NOVATEL_RESTART_H
+
+#include <map>
+#include <string>
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "novatel/novatel_enums.h"
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+enum ResetType {
+    RESET_HARDWARE,     //!< RESET
+    RESET_HOT,          //!< RESET with ephemeris, almanac, position and time kept
+    RESET_WARM,         //!< FRESET keeping ephemeris and almanac
+    RESET_COLD,         //!< FRESET STANDARD
+    RESET_EXTERNAL      //!< power cycle or reset not sent by the driver
+};
+
+enum RestartMilestone {
+    RESTART_BANNER,         //!< port prompt sent once the receiver is back up
+    RESTART_COARSE_TIME,    //!< first log with time status COARSE or better
+    RESTART_FINE_TIME,      //!< first log with time status FINE or better
+    RESTART_FIRST_FIX,      //!< first solution of a position type
+    RESTART_INS_ALIGNED     //!< first INS solution with alignment complete or a good solution
+};
+
+//! Called with the milestone, the position type for RESTART_FIRST_FIX and seconds since the reset
+typedef boost::function<void(RestartMilestone, PositionType, double)> RestartMilestoneCallback;
+
+/*!
+ * Seconds from the reset to each milestone, -1 for milestones not
+ * reached yet.
+ */
+struct RestartReport {
+    ResetType reset_type;
+    bool started;               //!< false if no restart has been tracked
+    double elapsed;             //!< seconds since the reset
+    double banner;
+    double coarse_time;
+    double fine_time;
+    double ins_aligned;
+    std::map<PositionType, double> first_fix;  //!< first solution of each position type seen
+
+    //! Seconds to the first solution of the given type, -1 if not seen
+    double FirstFix(PositionType type) const {
+        std::map<PositionType, double>::const_iterator it = first_fix.find(type);
+        return (it == first_fix.end()) ? -1 : it->second;
+    }
+};
+
+//! Name of a position type, "UNKNOWN" for values not in the enum
+const char* PositionTypeName(PositionType type);
+
+//! One line key=value summary, e.g. "reset=cold banner=1.20 time=35.10 ... fix.SINGLE=38.00"
+std::string FormatRestartReport(const RestartReport &report);
+
+/*!
+ * Tracks the milestones of the latest restart from the frames read.
+ * Once every milestone that can be reached has been, a frame costs a
+ * switch on its id and a compare; nothing is tracked before Start().
+ */
+class RestartTracker {
+public:
+    RestartTracker();
+
+    void set_milestone_callback(RestartMilestoneCallback handler) {milestone_callback_=handler;}
+
+    /*!
+     * Starts timing a restart from now, forgetting any earlier one.  For a
+     * reset sent by the driver, frames are ignored until the banner since
+     * logs from before the reset may still be in flight.
+     */
+    void Start(ResetType type);
+    //! Forgets the current restart, e.g. when the reset command could not be sent
+    void Stop();
+    bool active() const {return active_.load(boost::memory_order_relaxed);}
+
+    //! Called with the port prompt
+    void AddBanner();
+    //! Called with each CRC checked binary frame
+    void AddFrame(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id);
+
+    RestartReport Report();
+
+private:
+    //! Marks a milestone reached, called with mutex_ held, returns false if it already was
+    bool Reach(RestartMilestone milestone, double &seconds, uint64_t now);
+    void Notify(RestartMilestone milestone, PositionType type, double seconds);
+
+    boost::mutex mutex_;
+    boost::atomic<bool> active_;
+    boost::atomic<bool> awaiting_banner_;   //!< frames still predate the reset
+    RestartReport report_;
+    uint64_t start_us_;             //!< monotonic time the reset was sent
+    boost::atomic<uint32_t> reached_;       //!< bit per RestartMilestone reached, so repeats skip the lock
+    boost::atomic<bool> seen_types_[256];   //!< position types already reported, so repeats skip the lock
+    RestartMilestoneCallback milestone_callback_;
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+/*!
+ * \file novatel/novatel_rtcm.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * RTCM version 3 framing: CRC-24Q and a stream framer that pulls complete,
+ * CRC checked frames out of arbitrarily split input.
+ *
+ * Frame layout: preamble 0xD3, 6 reserved bits, 10 bit payload length,
+ * payload, 24 bit CRC-24Q over everything before it.
+ *
+ */
+
+#ifndef NOVATEL_RTCM_H
+#define NOVATEL_RTCM_H
+
+#include <cstring> // for size_t
+#include <stdint.h>
+
+#include <boost/function.hpp>
+
+namespace novatel {
+
+#define RTCM3_PREAMBLE 0xD3
+#define RTCM3_HEADER_SIZE 3
+#define RTCM3_CRC_SIZE 3
+#define RTCM3_MAX_PAYLOAD_SIZE 1023
+#define RTCM3_MAX_FRAME_SIZE (RTCM3_HEADER_SIZE+RTCM3_MAX_PAYLOAD_SIZE+RTCM3_CRC_SIZE)
+
+//! 256 entry lookup table for CRC-24Q (polynomial 0x1864CFB)
+struct Crc24qTable {
+    uint32_t value[256];
+    Crc24qTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i << 16;
+            for (int j = 0; j < 8; j++) {
+                crc <<= 1;
+                if (crc & 0x1000000)
+                    crc ^= 0x1864CFB;
+            }
+            value[i] = crc & 0xFFFFFF;
+        }
+    }
+};
+
+//! CRC-24Q as used by RTCM3
+inline uint32_t CalculateCrc24q(const unsigned char *data, size_t length) {
+    static const Crc24qTable table;
+    uint32_t crc = 0;
+    while (length-- != 0)
+        crc = ((crc << 8) & 0xFFFFFF) ^ table.value[((crc >> 16) ^ *data++) & 0xFF];
+    return crc;
+}
+
+//! Payload length from the header of an RTCM3 frame
+inline uint16_t Rtcm3PayloadLength(const unsigned char *frame) {
+    return ((frame[1] & 0x03) << 8) | frame[2];
+}
+
+//! Message number from the first 12 bits of the payload
+inline uint16_t Rtcm3MessageNumber(const unsigned char *frame) {
+    return (frame[3] << 4) | (frame[4] >> 4);
+}
+
+//! Reads length bits (at most 32) starting position bits into data, most significant bit first
+inline uint32_t Rtcm3GetBits(const unsigned char *data, size_t position, int length) {
+    uint32_t value = 0;
+    for (size_t ii = position; ii < position+length; ii++)
+        value = (value << 1) | ((data[ii/8] >> (7 - ii%8)) & 1);
+    return value;
+}
+
+//! Reads a two's complement field of length bits
+inline int32_t Rtcm3GetSignedBits(const unsigned char *data, size_t position, int length) {
+    uint32_t value = Rtcm3GetBits(data, position, length);
+    if ((length < 32) && (value & (1u << (length-1))))
+        return (int32_t)(value | (~0u << length));
+    return (int32_t)value;
+}
+
+//! Called with each complete frame, including header and CRC
+typedef boost::function<void(const unsigned char*, size_t)> Rtcm3FrameCallback;
+
+/*!
+ * Extracts RTCM3 frames from a byte stream.  Frames with a bad CRC are
+ * dropped and the stream is rescanned from the byte after their preamble.
+ */
+class Rtcm3Framer {
+public:
+    Rtcm3Framer();
+
+    void set_frame_callback(Rtcm3FrameCallback handler) {frame_callback_=handler;}
+
+    //! Adds data to the framer, calling the frame callback for each valid frame
+    void AddData(const unsigned char *data, size_t length);
+
+    //! Discards any partial frame
+    void Reset() {buffer_index_=0; frame_length_=0; pending_index_=0; pending_length_=0;}
+
+    uint32_t frame_count() {return frame_count_;}
+    uint32_t crc_error_count() {return crc_error_count_;}
+
+private:
+    void AddByte(unsigned char byte);
+    //! Handles a complete frame in buffer_, resynchronising if its CRC is bad
+    void CompleteFrame();
+    //! Drops the current preamble and queues the bytes after it to be scanned again
+    void Resynchronise();
+
+    Rtcm3FrameCallback frame_callback_;
+    unsigned char buffer_[RTCM3_MAX_FRAME_SIZE];
+    size_t buffer_index_;   //!< bytes of the current frame in buffer_
+    size_t frame_length_;   //!< total length of the current frame, 0 until the header is complete
+    unsigned char pending_[2*RTCM3_MAX_FRAME_SIZE]; //!< bytes to rescan after a false preamble
+    size_t pending_index_;
+    size_t pending_length_;
+    uint32_t frame_count_;
+    uint32_t crc_error_count_;
+};
+
+}
+
+#endif
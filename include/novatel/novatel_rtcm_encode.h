@@ -0,0 +1,159 @@
+/*!
+ * \file novatel/novatel_rtcm_encode.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * RTCM version 3 encoding of receiver observations: MSM4 and MSM7
+ * messages for each constellation from RANGE (or unpacked RANGECMP) and
+ * the 1005 station position, so a base receiver's own logs can feed
+ * rovers without configuring RTCM output on a receiver port.
+ *
+ */
+
+#ifndef NOVATEL_RTCM_ENCODE_H
+#define NOVATEL_RTCM_ENCODE_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "novatel/novatel_rtcm.h"
+#include "novatel/novatel_signals.h"
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+//! Pseudorange of one millisecond of light travel [m]
+#define RTCM3_RANGE_MS (SPEED_OF_LIGHT*0.001)
+//! MSM satellite and signal masks are 64 and 32 bits, with at most 64 cells
+#define MSM_MAX_SATELLITES 64
+#define MSM_MAX_SIGNALS 32
+#define MSM_MAX_CELLS 64
+
+enum MsmType {
+    MSM4 = 4,   //!< full pseudorange, phase range, lock time and CNR
+    MSM7 = 7    //!< MSM4 plus Doppler, at extended resolution
+};
+
+/*!
+ * Writes bit fields most significant bit first into the payload of one
+ * RTCM3 frame.
+ */
+class Rtcm3BitWriter {
+public:
+    Rtcm3BitWriter() {Clear();}
+
+    void Clear() {position_ = 0; memset(frame_, 0, sizeof(frame_));}
+    //! Appends the low length bits of value, length at most 64
+    void AddBits(uint64_t value, int length);
+    //! Appends a two's complement field
+    void AddSignedBits(int64_t value, int length) {AddBits((uint64_t)value, length);}
+    size_t bits() const {return position_;}
+    //! Pads to a byte and appends the header, payload and CRC to output
+    void Finish(std::vector<unsigned char> &output);
+
+private:
+    unsigned char frame_[RTCM3_MAX_FRAME_SIZE];
+    size_t position_;   //!< bits written to the payload
+};
+
+/*!
+ * Encodes observations and the reference station position as RTCM3.
+ * Frames are appended to a caller owned vector, so an encoder and a
+ * cleared vector reused each epoch encode without allocating.
+ */
+class Rtcm3Encoder {
+public:
+    Rtcm3Encoder(uint16_t station_id = 0, MsmType msm_type = MSM4);
+
+    void set_station_id(uint16_t station_id) {station_id_ = station_id & 0xFFF;}
+    void set_msm_type(MsmType msm_type) {msm_type_ = msm_type;}
+    //! GPS minus UTC, used for GLONASS epoch times [s]
+    void set_leap_seconds(int leap_seconds) {leap_seconds_ = leap_seconds;}
+    //! Antenna reference point in WGS84 ECEF [m]
+    void set_reference_position_ecef(double x, double y, double z);
+    //! Antenna reference point from WGS84 latitude, longitude [deg] and ellipsoidal height [m]
+    void set_reference_position(double latitude, double longitude, double height);
+    bool has_reference_position() const {return has_reference_position_;}
+
+    //! Appends a 1005 station position frame, false if no position has been set
+    bool EncodeStationPosition(std::vector<unsigned char> &output);
+
+    /*!
+     * Appends the MSM frames for one epoch of observations: one per
+     * constellation, or more if its satellites and signals need more than
+     * 64 cells.  All but the last carry the multiple message bit.
+     * Observations of unknown signals or satellites are skipped, as are
+     * GLONASS observations without a frequency number, whose wavelength
+     * is unknown.
+     *
+     * @return number of frames appended
+     */
+    size_t EncodeObservations(const RangeMeasurements &ranges, std::vector<unsigned char> &output);
+    //! GLONASS observations the last EncodeObservations() skipped for want of a frequency number
+    size_t unknown_glonass_frequency_count() const {return unknown_glonass_frequency_count_;}
+
+private:
+    //! Satellites of one constellation that fit in one message
+    struct MsmGroup {
+        uint8_t system;
+        uint8_t first_satellite;    //!< index into satellites_
+        uint8_t satellite_count;
+        uint32_t signal_mask;       //!< bit (id-1) set for each signal in the group
+    };
+
+    //! Fills cells_ with the observations of one constellation and splits its satellites into groups_
+    void GroupSatellites(uint8_t system);
+    void EncodeMsm(const MsmGroup &group, const Oem4BinaryHeader &header, bool more,
+                   std::vector<unsigned char> &output);
+    //! Epoch time field of an MSM header for the constellation
+    uint32_t EpochTime(uint8_t system, const Oem4BinaryHeader &header) const;
+
+    uint16_t station_id_;
+    MsmType msm_type_;
+    int leap_seconds_;
+    bool has_reference_position_;
+    double reference_ecef_[3];
+    uint8_t iods_;              //!< issue of data station, bumped when the position changes
+
+    const RangeMeasurements *ranges_;
+    int16_t cells_[MSM_MAX_SATELLITES][MSM_MAX_SIGNALS]; //!< observation of each satellite and signal, -1 for none
+    uint8_t satellites_[MSM_MAX_SATELLITES];    //!< satellite ids in the current constellation, ascending
+    uint8_t satellite_count_;
+    uint32_t satellite_signals_[MSM_MAX_SATELLITES]; //!< signal mask of each satellite id
+    MsmGroup groups_[MSM_MAX_SATELLITES];
+    size_t group_count_;
+    size_t unknown_glonass_frequency_count_;
+    Rtcm3BitWriter writer_;
+};
+
+//! MSM satellite id (1 to 64) of a receiver PRN, 0 if it has none
+uint8_t MsmSatelliteId(uint8_t satellite_system, uint16_t prn);
+
+//! Base MSM message number of a constellation (1070 for GPS), 0 if it has none
+uint16_t MsmMessageBase(uint8_t satellite_system);
+
+}
+
+#endif
@@ -0,0 +1,179 @@
+/*!
+ * \file novatel/novatel_rtk_monitor.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * RTK performance analytics from RTKDATA: time to fix, fix losses,
+ * searcher state transitions and per satellite double difference
+ * residual statistics.  Each epoch is a constant amount of work and the
+ * state a fixed size, so it can run on every vehicle and report only the
+ * summary.
+ *
+ */
+
+#ifndef NOVATEL_RTK_MONITOR_H
+#define NOVATEL_RTK_MONITOR_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "novatel/novatel_structures.h"
+#include "novatel/novatel_health.h" // for SlidingWindow
+
+namespace novatel {
+
+//! Searcher states counted in transitions, HANDOFF_COMPLETE is the last
+#define RTK_SEARCHER_STATES 5
+//! PRNs tracked per satellite, larger PRNs are ignored
+#define RTK_MAX_PRN 256
+
+//! True for position types with integer ambiguities
+inline bool IsRtkFixed(PositionType type) {
+    return (type == L1_INT) || (type == WIDE_INT) || (type == NARROW_INT) ||
+           (type == RTK_DIRECT_INS) || (type == INS_RTKFIXED);
+}
+
+//! True for ambiguity types resolved to integers
+inline bool IsIntegerAmbiguity(AMBIGUITY_TYPE type) {
+    return (type == INT_L1) || (type == INT_WIDE) || (type == INT_NARROW) || (type == IONOFREE_DISCRETE);
+}
+
+enum RtkEventType {
+    RTK_FIX_ACQUIRED,       //!< value is the time to fix [s]
+    RTK_FIX_LOST,           //!< value is how long the fix was held [s]
+    RTK_SEARCHER_CHANGED    //!< value is the new SEARCHER_TYPE
+};
+
+//! Short name of an event type, e.g. "FIX_LOST"
+const char* RtkEventName(RtkEventType type);
+
+struct RtkEvent {
+    RtkEventType type;
+    double value;
+    double gps_time;    //!< GPS seconds of the epoch the change was seen in
+    double timestamp;   //!< time stamp of the log the change was seen in
+};
+
+typedef boost::function<void(const RtkEvent&)> RtkEventCallback;
+
+//! Residual statistics of one satellite since the monitor was reset
+struct RtkSatelliteStats {
+    uint32_t prn;
+    uint32_t epochs;            //!< epochs the satellite was in RTKDATA
+    uint32_t integer_epochs;    //!< epochs with its ambiguity resolved to an integer
+    AMBIGUITY_TYPE ambiguity_type;  //!< in the latest epoch
+    double last_residual;       //!< [m]
+    double mean_residual;       //!< [m]
+    double stddev_residual;     //!< [m]
+    double rms_residual;        //!< [m]
+    double max_abs_residual;    //!< [m]
+};
+
+struct RtkSummary {
+    uint32_t epochs;
+    uint32_t fixed_epochs;
+    uint32_t float_epochs;      //!< epochs with a float RTK solution
+    bool fixed;                 //!< fixed in the latest epoch
+    double state_duration;      //!< time in the current fixed or not fixed state [s]
+    uint32_t fix_count;         //!< times a fix was acquired
+    uint32_t fix_loss_count;
+    double last_time_to_fix;    //!< [s], -1 until the first fix
+    double mean_time_to_fix;    //!< window mean [s]
+    double max_time_to_fix;     //!< window maximum [s]
+    double mean_fix_duration;   //!< window mean of how long fixes were held [s]
+    SEARCHER_TYPE searcher_type;    //!< in the latest epoch
+    uint32_t lane_combinations;     //!< in the latest epoch
+    uint32_t searcher_transitions[RTK_SEARCHER_STATES][RTK_SEARCHER_STATES]; //!< [from][to]
+    double mean_residual_rms;   //!< mean of the residual rms of the satellites in the latest epoch [m]
+    std::vector<RtkSatelliteStats> satellites;  //!< satellites seen, by PRN
+};
+
+//! One line "key=value" rendering of a summary, without the per satellite statistics
+std::string FormatRtkSummary(const RtkSummary &summary);
+
+/*!
+ * Follows the RTK engine through RTKDATA.  AddRtkData() is meant to be
+ * called from the receiver callback and does work proportional to the
+ * satellites in the log only; Summary() may be called from another thread.
+ * Events are called on the thread that added the log, without the monitor
+ * locked.
+ */
+class RtkMonitor {
+public:
+    //! window is the number of fixes and losses the time to fix statistics are computed over
+    RtkMonitor(size_t window = 20);
+
+    void set_event_callback(RtkEventCallback handler) {event_callback_=handler;}
+
+    void AddRtkData(const rtkdatab_log &data, double timestamp);
+
+    RtkSummary Summary();
+    //! Forgets everything seen so far
+    void Reset();
+
+private:
+    struct SatelliteState {
+        uint32_t epochs;
+        uint32_t integer_epochs;
+        AMBIGUITY_TYPE ambiguity_type;
+        double last_residual;
+        double mean;            //!< running mean (Welford)
+        double m2;              //!< running sum of squared differences from the mean
+        double sum_squares;
+        double max_abs;
+    };
+
+    //! Called with mutex_ held
+    void ResetLocked();
+
+    boost::mutex mutex_;
+    RtkEventCallback event_callback_;
+
+    uint32_t epochs_;
+    uint32_t fixed_epochs_;
+    uint32_t float_epochs_;
+    bool fixed_;
+    double state_start_;        //!< GPS seconds the current fixed or not fixed state started, -1 before the first epoch
+    double last_gps_time_;
+    uint32_t fix_count_;
+    uint32_t fix_loss_count_;
+    double last_time_to_fix_;
+    SlidingWindow time_to_fix_;
+    SlidingWindow fix_duration_;
+    SEARCHER_TYPE searcher_type_;
+    bool searcher_seen_;
+    uint32_t lane_combinations_;
+    uint32_t searcher_transitions_[RTK_SEARCHER_STATES][RTK_SEARCHER_STATES];
+    double mean_residual_rms_;
+    SatelliteState satellites_[RTK_MAX_PRN];
+};
+
+}
+
+#endif
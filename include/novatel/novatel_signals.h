@@ -0,0 +1,178 @@
+/*!
+ * \file novatel/novatel_signals.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Registry of the signals reported in the channel tracking status of
+ * RANGE, RANGECMP and TRACKSTAT: carrier frequency, wavelength and a
+ * readable name for each (satellite system, signal type) pair, with
+ * GLONASS frequencies offset by the satellite's frequency number.
+ *
+ */
+
+#ifndef NOVATEL_SIGNALS_H
+#define NOVATEL_SIGNALS_H
+
+#include <cstddef>
+#include <stdint.h>
+
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+#define SPEED_OF_LIGHT 299792458.0
+//! GLONASS frequency numbers run from -7 to +6
+#define GLONASS_MIN_FREQUENCY_NUMBER -7
+#define GLONASS_MAX_FREQUENCY_NUMBER 6
+//! RangeData glonass_frequency of an unpacked RANGECMP observation whose frequency number is not known yet
+#define GLONASS_FREQUENCY_UNKNOWN 0xFFFF
+//! Largest RANGECMP ADR before it rolls over [cycles]
+#define CMP_MAX_VALUE         8388608.0
+
+//! ChannelStatus satellite_sys values
+enum SatelliteSystem {
+    SATSYS_GPS = 0,
+    SATSYS_GLONASS = 1,
+    SATSYS_SBAS = 2,
+    SATSYS_GALILEO = 3,
+    SATSYS_BEIDOU = 4,
+    SATSYS_QZSS = 5
+};
+
+//! Carrier band a signal is in, so signals of different systems can be grouped
+enum FrequencyBand {
+    BAND_L1,        //!< GPS/QZSS/SBAS L1, GLONASS G1, Galileo E1, BeiDou B1
+    BAND_L2,        //!< GPS/QZSS L2, GLONASS G2
+    BAND_L5,        //!< GPS/QZSS/SBAS L5, Galileo E5a
+    BAND_E5B,       //!< Galileo E5b, BeiDou B2
+    BAND_E5         //!< Galileo E5 AltBOC
+};
+
+struct SignalInfo {
+    uint8_t satellite_sys;      //!< SatelliteSystem
+    uint8_t signal_type;        //!< ChannelStatus signal_type
+    FrequencyBand band;
+    double frequency;           //!< carrier frequency, GLONASS frequency number 0 [Hz]
+    double frequency_step;      //!< added per GLONASS frequency number, 0 for CDMA signals [Hz]
+    const char *id;             //!< e.g. "GPS L1CA"
+    uint8_t msm_signal_id;      //!< RTCM3 MSM signal mask position, 1 to 32
+};
+
+/*!
+ * Signals the driver knows about.  Signal types are from the channel
+ * tracking status table, MSM signal ids from the RTCM 10403 signal tables
+ * (e.g. GPS 2 = 1C, 15 = 2S, 23 = 5Q).
+ */
+static constexpr SignalInfo signal_registry[] = {
+    {SATSYS_GPS, 0, BAND_L1, 1575.42e6, 0, "GPS L1CA", 2},
+    {SATSYS_GPS, 5, BAND_L2, 1227.60e6, 0, "GPS L2P", 9},
+    {SATSYS_GPS, 9, BAND_L2, 1227.60e6, 0, "GPS L2P codeless", 10},
+    {SATSYS_GPS, 14, BAND_L5, 1176.45e6, 0, "GPS L5Q", 23},
+    {SATSYS_GPS, 17, BAND_L2, 1227.60e6, 0, "GPS L2C", 15},
+    {SATSYS_GLONASS, 0, BAND_L1, 1602.0e6, 0.5625e6, "GLONASS L1CA", 2},
+    {SATSYS_GLONASS, 1, BAND_L2, 1246.0e6, 0.4375e6, "GLONASS L2CA", 8},
+    {SATSYS_GLONASS, 5, BAND_L2, 1246.0e6, 0.4375e6, "GLONASS L2P", 9},
+    {SATSYS_SBAS, 0, BAND_L1, 1575.42e6, 0, "SBAS L1CA", 2},
+    {SATSYS_SBAS, 1, BAND_L1, 1575.42e6, 0, "SBAS L1", 2},  // reported by older firmware
+    {SATSYS_SBAS, 6, BAND_L5, 1176.45e6, 0, "SBAS L5I", 22},
+    {SATSYS_GALILEO, 1, BAND_L1, 1575.42e6, 0, "Galileo E1", 2},
+    {SATSYS_GALILEO, 2, BAND_L1, 1575.42e6, 0, "Galileo E1C", 2},
+    {SATSYS_GALILEO, 12, BAND_L5, 1176.45e6, 0, "Galileo E5aQ", 23},
+    {SATSYS_GALILEO, 17, BAND_E5B, 1207.14e6, 0, "Galileo E5bQ", 15},
+    {SATSYS_GALILEO, 20, BAND_E5, 1191.795e6, 0, "Galileo E5 AltBOC", 19},
+    {SATSYS_BEIDOU, 0, BAND_L1, 1561.098e6, 0, "BeiDou B1 D1", 2},
+    {SATSYS_BEIDOU, 1, BAND_E5B, 1207.14e6, 0, "BeiDou B2 D1", 14},
+    {SATSYS_BEIDOU, 4, BAND_L1, 1561.098e6, 0, "BeiDou B1 D2", 2},
+    {SATSYS_BEIDOU, 5, BAND_E5B, 1207.14e6, 0, "BeiDou B2 D2", 14},
+    {SATSYS_QZSS, 0, BAND_L1, 1575.42e6, 0, "QZSS L1CA", 2},
+    {SATSYS_QZSS, 14, BAND_L5, 1176.45e6, 0, "QZSS L5Q", 23},
+    {SATSYS_QZSS, 17, BAND_L2, 1227.60e6, 0, "QZSS L2C", 15}
+};
+
+static constexpr size_t SIGNAL_REGISTRY_SIZE = sizeof(signal_registry)/sizeof(signal_registry[0]);
+
+//! Registry entry for a signal, NULL if unknown.  Usable in constant expressions.
+constexpr const SignalInfo* FindSignal(unsigned int satellite_sys, unsigned int signal_type, size_t index = 0) {
+    return (index >= SIGNAL_REGISTRY_SIZE) ? NULL :
+           ((signal_registry[index].satellite_sys == satellite_sys) &&
+            (signal_registry[index].signal_type == signal_type)) ? &signal_registry[index] :
+           FindSignal(satellite_sys, signal_type, index+1);
+}
+
+//! Carrier frequency for a GLONASS frequency number, which CDMA signals ignore [Hz]
+constexpr double SignalFrequency(const SignalInfo &signal, int glonass_frequency = 0) {
+    return signal.frequency + glonass_frequency*signal.frequency_step;
+}
+
+//! [m]
+constexpr double SignalWavelength(const SignalInfo &signal, int glonass_frequency = 0) {
+    return SPEED_OF_LIGHT/SignalFrequency(signal, glonass_frequency);
+}
+
+//! Registry entries indexed by satellite system and signal type
+struct SignalTable {
+    const SignalInfo *entry[8*32];
+    SignalTable() {
+        for (size_t ii=0; ii<8*32; ii++)
+            entry[ii] = NULL;
+        for (size_t ii=0; ii<SIGNAL_REGISTRY_SIZE; ii++)
+            entry[(signal_registry[ii].satellite_sys << 5) | signal_registry[ii].signal_type] = &signal_registry[ii];
+    }
+};
+
+//! Registry entry for the signal a channel is tracking, NULL if unknown
+inline const SignalInfo* LookupSignal(const ChannelStatus &status) {
+    static const SignalTable table;
+    return table.entry[(status.satellite_sys << 5) | status.signal_type];
+}
+
+/*!
+ * Full accumulated Doppler from the 32 bit RANGECMP value, which rolls
+ * over every CMP_MAX_VALUE cycles.  The number of roll overs is
+ * recovered from the pseudorange, so the wavelength of the signal must be
+ * right to well within one roll over.  Returns the value unchanged if the
+ * signal is not in the registry.
+ *
+ * @param glonass_frequency frequency number of a GLONASS satellite, -7 to +6
+ * @return accumulated Doppler [cycles]
+ */
+inline double UnpackCompressedAdr(const CompressedRangeData &cmp, double pseudorange,
+                                  int glonass_frequency = 0) {
+    double scaled_adr = (double)cmp.range_record.accumulated_doppler / 256.0;
+    const SignalInfo *signal = LookupSignal(cmp.channel_status);
+    if (!signal)
+        return scaled_adr;
+
+    double adr_rolls = (pseudorange/SignalWavelength(*signal, glonass_frequency) + scaled_adr) / CMP_MAX_VALUE;
+    if (adr_rolls <= 0)
+        adr_rolls -= 0.5;
+    else
+        adr_rolls += 0.5;
+    return scaled_adr - (CMP_MAX_VALUE * (int)adr_rolls);
+}
+
+}
+
+#endif
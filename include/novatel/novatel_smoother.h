@@ -0,0 +1,180 @@
+/*!
+ * \file novatel/novatel_smoother.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Offline forward-backward (Rauch-Tung-Striebel) smoothing of a recorded
+ * INS trajectory.  The INSPVA position increments drive a position filter
+ * whose process noise comes from the INSCOV velocity covariance, and
+ * BESTPOS fixes are the measurements.  Position is smoothed; velocity,
+ * attitude and INS status are passed through from INSPVA.
+ *
+ * The forward pass runs as the logs are streamed in.  Its results are cut
+ * into segments, each extended by an overlap, and the backward pass of
+ * each segment runs on a worker thread starting from the forward solution
+ * at the end of its overlap.  Results in the overlap are discarded, so
+ * with an overlap that is long compared to the gaps between fixes the
+ * output matches a single backward pass over the whole drive, while
+ * memory is bounded by the segments in flight.
+ *
+ */
+
+#ifndef NOVATEL_SMOOTHER_H
+#define NOVATEL_SMOOTHER_H
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+struct SmootherConfig {
+    double segment_length;      //!< output time of each segment [s]
+    double overlap;             //!< time each backward pass starts after the end of its segment [s], at most segment_length
+    int threads;                //!< backward passes run in parallel, 0 for one per core
+    size_t max_segments;        //!< segments held in memory before the input waits, 0 for twice the threads
+    double position_noise;      //!< random walk added to each INS position increment [m^2/s]
+    double min_position_sigma;  //!< lower limit of BESTPOS standard deviations [m]
+    double history;             //!< how late a fix may arrive after the INS epochs around it [s]
+
+    SmootherConfig() : segment_length(300.0), overlap(30.0), threads(0), max_segments(0),
+        position_noise(0.01), min_position_sigma(0.01), history(2.0) {}
+};
+
+//! One smoothed INSPVA epoch
+struct SmoothedEpoch {
+    uint32_t gps_week;
+    double gps_seconds;         //!< seconds into the GPS week
+    double latitude;            //!< smoothed WGS84 latitude [deg]
+    double longitude;           //!< smoothed WGS84 longitude [deg]
+    double height;              //!< smoothed ellipsoidal height [m]
+    double covariance[9];       //!< smoothed position covariance, east north up, row major [m^2]
+    double north_velocity;      //!< from INSPVA [m/s]
+    double east_velocity;
+    double up_velocity;
+    double roll;                //!< from INSPVA [deg]
+    double pitch;
+    double azimuth;
+    InsStatus status;
+};
+
+struct SmootherStats {
+    uint64_t epochs;            //!< INSPVA epochs filtered
+    uint64_t fixes;             //!< BESTPOS fixes used
+    uint64_t fixes_dropped;     //!< fixes without a solution or outside the INS history
+    uint32_t segments;          //!< segments smoothed
+};
+
+//! Called with each smoothed epoch, in time order
+typedef boost::function<void(const SmoothedEpoch&)> SmoothedEpochCallback;
+
+struct SmootherRecord;
+struct SmootherSegment;
+
+/*!
+ * Smooths a recorded trajectory.  Feed the decoded logs in the order they
+ * were logged, then call Finish().  The smoothed epoch callback is called
+ * from the thread feeding the logs.
+ */
+class TrajectorySmoother {
+public:
+    TrajectorySmoother(const SmootherConfig &config = SmootherConfig());
+    ~TrajectorySmoother();
+
+    void set_smoothed_epoch_callback(SmoothedEpochCallback handler) {smoothed_epoch_callback_=handler;}
+
+    void AddInsPva(const InsPositionVelocityAttitude &pva);
+    //! Latest INS velocity covariance, used for the following INSPVA epochs
+    void AddInsCovariance(const InsCovariance &covariance);
+    void AddPosition(const Position &position);
+
+    //! Smooths what is left and delivers every remaining epoch
+    void Finish();
+
+    SmootherStats stats() {return stats_;}
+
+private:
+    struct Fix {
+        double time;
+        double position[3];     //!< ECEF [m]
+        double covariance[9];   //!< ECEF [m^2]
+    };
+    struct InsSample {
+        double time;
+        double position[3];     //!< ECEF [m]
+    };
+
+    //! Applies pending fixes at or before the latest epoch to the forward state
+    void ApplyFixes(const InsSample &current);
+    //! Adds the latest epoch to the open segments, submitting them once they are complete
+    void AddToSegments(const SmootherRecord &record);
+    void Submit(SmootherSegment *segment);
+    //! Delivers finished segments in order, waiting while too many are in flight
+    void Deliver(bool wait_for_all);
+    //! Method run in seperate threads that runs backward passes
+    void Worker();
+
+    SmootherConfig config_;
+    SmoothedEpochCallback smoothed_epoch_callback_;
+    SmootherStats stats_;
+
+    // forward pass, on the feeding thread
+    bool initialised_;
+    double state_[3];               //!< filtered ECEF position [m]
+    double covariance_[9];          //!< filtered covariance [m^2]
+    double predicted_state_[3];
+    double predicted_covariance_[9];
+    double velocity_covariance_[9]; //!< INSCOV, east north up [(m/s)^2]
+    bool have_velocity_covariance_;
+    double initial_covariance_[9];  //!< INSCOV position, east north up [m^2]
+    bool have_initial_covariance_;
+    std::deque<InsSample> history_; //!< recent INS positions to place late fixes
+    std::deque<Fix> fixes_;         //!< fixes waiting for the INS epoch after them
+
+    SmootherSegment *current_;      //!< segment being filled
+    SmootherSegment *overlapping_;  //!< complete segment still collecting its overlap
+    uint32_t segment_count_;
+
+    // backward passes
+    boost::mutex mutex_;
+    boost::condition_variable work_condition_;
+    boost::condition_variable done_condition_;
+    std::deque<SmootherSegment*> queue_;
+    std::map<uint32_t, SmootherSegment*> in_flight_;    //!< by index, delivered in order
+    uint32_t next_delivery_;
+    bool stopping_;
+    boost::thread_group workers_;
+};
+
+}
+
+#endif
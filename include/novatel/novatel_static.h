@@ -0,0 +1,198 @@
+/*!
+ * \file novatel/novatel_static.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Header only receiver interface with handlers chosen at compile time.
+ *
+ * Novatel calls a boost::function for every log it decodes.  BasicNovatel
+ * instead calls member functions of handler objects given as template
+ * parameters, so dispatch can be inlined and logs that no handler takes
+ * are neither decoded nor linked in.  It does no I/O: data read from the
+ * receiver is passed to AddData().
+ *
+ * A handler implements any of:
+ *
+ *  void OnLog(BinaryLogTag<BESTPOSB_LOG_TYPE>, const Position &log, double timestamp);
+ *  void OnNmea(const char *sentence, size_t length, double timestamp);
+ *  void OnAsciiLog(const char *sentence, size_t length, double timestamp);
+ *  void OnRtcm3(const unsigned char *frame, size_t length);
+ *
+ * with one OnLog overload per log, or a template over the log id.  The
+ * structure passed for each log is given by BinaryLogTraits in
+ * novatel_decode.h.  RANGECMPB is delivered compressed.
+ *
+ * Requires C++14.
+ *
+ */
+
+#ifndef NOVATEL_STATIC_H
+#define NOVATEL_STATIC_H
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "novatel/novatel_demux.h"
+#include "novatel/novatel_decode.h"
+
+namespace novatel {
+
+//! Selects the OnLog overload for a log id
+template <BINARY_LOG_TYPE Id> struct BinaryLogTag {};
+
+//! True if Handler has an OnLog overload for log Id
+template <class Handler, BINARY_LOG_TYPE Id>
+struct HandlesLog {
+    template <class H>
+    static auto Test(int) -> decltype(std::declval<H&>().OnLog(BinaryLogTag<Id>(),
+            std::declval<const typename BinaryLogTraits<Id>::Type&>(), 0.0), std::true_type());
+    template <class H>
+    static std::false_type Test(...);
+    static const bool value = decltype(Test<Handler>(0))::value;
+};
+
+//! True if any of Handlers has an OnLog overload for log Id
+template <BINARY_LOG_TYPE Id, class... Handlers>
+struct AnyHandlesLog : std::false_type {};
+template <BINARY_LOG_TYPE Id, class Handler, class... Handlers>
+struct AnyHandlesLog<Id, Handler, Handlers...>
+    : std::integral_constant<bool, HandlesLog<Handler, Id>::value || AnyHandlesLog<Id, Handlers...>::value> {};
+
+template <class... Handlers>
+class BasicNovatel {
+public:
+    //! The handlers are held by reference and must outlive this object
+    explicit BasicNovatel(Handlers&... handlers)
+        : handlers_(handlers...), demux_(*this), timestamp_(0) {}
+
+    /*!
+     * Adds data read from the receiver, calling handlers for each complete
+     * frame.  timestamp is passed on to the handlers.
+     */
+    void AddData(const unsigned char *data, size_t length, double timestamp = 0) {
+        timestamp_ = timestamp;
+        demux_.AddData(data, length);
+    }
+
+    //! Discards any partial frame, e.g. after a gap in the data
+    void Reset() {demux_.Reset();}
+
+    const DemuxCounters &counters() const {return demux_.counters();}
+
+private:
+    typedef std::index_sequence_for<Handlers...> HandlerIndices;
+
+    friend class FrameDemultiplexer<BasicNovatel>;
+
+    void OnNovatelBinary(unsigned char *frame, size_t length) {
+        switch ((frame[5] << 8) | frame[4]) {
+#define NOVATEL_DISPATCH_LOG(id, type) \
+            case id: DispatchLog<id>(frame, length, AnyHandlesLog<id, Handlers...>()); break;
+            NOVATEL_BINARY_LOG_TYPES(NOVATEL_DISPATCH_LOG)
+#undef NOVATEL_DISPATCH_LOG
+            default: break;
+        }
+    }
+
+    void OnNovatelAscii(const char *sentence, size_t length) {
+        CallAll([&](auto &handler) {CallAsciiLog(handler, sentence, length, timestamp_, 0);});
+    }
+    void OnNmea(const char *sentence, size_t length) {
+        CallAll([&](auto &handler) {CallNmea(handler, sentence, length, timestamp_, 0);});
+    }
+    void OnRtcm3(const unsigned char *frame, size_t length) {
+        CallAll([&](auto &handler) {CallRtcm3(handler, frame, length, 0);});
+    }
+    void OnAcknowledgement() {}
+    void OnCommandError(const char *reply, size_t length) {}
+    void OnPrompt(const char *prompt, size_t length) {}
+
+    //! No handler takes this log, so it is not decoded
+    template <BINARY_LOG_TYPE Id>
+    void DispatchLog(unsigned char *frame, size_t length, std::false_type) {}
+
+    template <BINARY_LOG_TYPE Id>
+    void DispatchLog(unsigned char *frame, size_t length, std::true_type) {
+        typename BinaryLogTraits<Id>::Type log;
+        if (!DecodeBinaryLog(frame, length, log))
+            return;
+        CallAll([&](auto &handler) {CallLog<Id>(handler, log, timestamp_, 0);});
+    }
+
+    template <class Function>
+    void CallAll(Function function) {CallAll(function, HandlerIndices());}
+
+    template <class Function, size_t... I>
+    void CallAll(Function &function, std::index_sequence<I...>) {
+        int expand[] = {0, (function(std::get<I>(handlers_)), 0)...};
+        (void)expand;
+    }
+
+    // Each Call* has an overload that calls the handler when it has a
+    // matching member and one taking a long that does nothing; passing 0
+    // prefers the first when it exists.
+    template <BINARY_LOG_TYPE Id, class H, class Log>
+    static auto CallLog(H &handler, const Log &log, double timestamp, int)
+            -> decltype(handler.OnLog(BinaryLogTag<Id>(), log, timestamp), void()) {
+        handler.OnLog(BinaryLogTag<Id>(), log, timestamp);
+    }
+    template <BINARY_LOG_TYPE Id, class H, class Log>
+    static void CallLog(H&, const Log&, double, long) {}
+
+    template <class H>
+    static auto CallNmea(H &handler, const char *sentence, size_t length, double timestamp, int)
+            -> decltype(handler.OnNmea(sentence, length, timestamp), void()) {
+        handler.OnNmea(sentence, length, timestamp);
+    }
+    template <class H>
+    static void CallNmea(H&, const char*, size_t, double, long) {}
+
+    template <class H>
+    static auto CallAsciiLog(H &handler, const char *sentence, size_t length, double timestamp, int)
+            -> decltype(handler.OnAsciiLog(sentence, length, timestamp), void()) {
+        handler.OnAsciiLog(sentence, length, timestamp);
+    }
+    template <class H>
+    static void CallAsciiLog(H&, const char*, size_t, double, long) {}
+
+    template <class H>
+    static auto CallRtcm3(H &handler, const unsigned char *frame, size_t length, int)
+            -> decltype(handler.OnRtcm3(frame, length), void()) {
+        handler.OnRtcm3(frame, length);
+    }
+    template <class H>
+    static void CallRtcm3(H&, const unsigned char*, size_t, long) {}
+
+    std::tuple<Handlers&...> handlers_;
+    FrameDemultiplexer<BasicNovatel> demux_;
+    double timestamp_;  //!< time stamp of the data being added
+};
+
+}
+
+#endif
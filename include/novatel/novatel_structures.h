@@ -1036,7 +1036,10 @@ struct rtkdatab_log {
     PositionType positionType; //Position type
     rtkdatab_header header;
     rtkdatab_data data[MAX_NUM_SAT];
+    uint8_t crc[4];
 } __attribute__((packed));
+//! Bytes from the start of the RTKDATA payload to its first satellite record
+#define RTKDATA_RECORDS_OFFSET (8+sizeof(rtkdatab_header))
 //********************
 
 
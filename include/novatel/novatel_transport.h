@@ -0,0 +1,265 @@
+/*!
+ * \file novatel/novatel_transport.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Byte sources and sinks the Novatel driver can read receiver data from:
+ * serial ports, TCP and UDP sockets (e.g. ICOM ports), recorded files and
+ * pseudo terminals.
+ *
+ * Transports are created from a URL with CreateTransport():
+ *   /dev/ttyUSB0 or serial:///dev/ttyUSB0   serial port at the given baud rate
+ *   tcp://192.168.1.10:3001                 TCP client
+ *   udp://192.168.1.10:3002                 UDP socket exchanging datagrams with a receiver
+ *   udp://:3002                             UDP socket receiving on a local port
+ *   file://data/OneEach.GPS                 memory mapped recording
+ *   replay://data/run.nvrec                 block compressed recording from Recorder
+ *   pty://                                  new pseudo terminal, the slave name is logged
+ *
+ */
+
+#ifndef NOVATEL_TRANSPORT_H
+#define NOVATEL_TRANSPORT_H
+
+#include <string>
+#include <cstring> // for size_t
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h> // for addrinfo
+#include <sys/uio.h> // for iovec
+
+// Serial Headers
+#include "serial/serial.h"
+
+namespace novatel {
+
+/*!
+ * Interface to a bidirectional byte stream connected to a receiver.
+ *
+ * Reads block for at most a few milliseconds and return 0 when no data
+ * is available so the read thread can check whether it should stop.
+ * Errors that mean the device or connection is gone are reported by
+ * throwing std::exception, after which the transport can be reopened with
+ * Close() and Open().
+ */
+class Transport {
+public:
+    virtual ~Transport() {}
+
+    //! Opens the device or connection.  Throws std::exception on failure.
+    virtual void Open() = 0;
+    virtual void Close() = 0;
+    virtual bool IsOpen() = 0;
+
+    //! Reads up to size bytes, returns 0 if nothing arrived before the timeout
+    virtual size_t Read(unsigned char *buffer, size_t size) = 0;
+
+    /*!
+     * Scatter read into several buffers, filling them in order.  Lets the
+     * driver read the rest of a frame straight into the framing buffer.
+     * The default reads into the first non-empty buffer only.
+     */
+    virtual size_t ReadV(const struct iovec *iov, int count);
+
+    virtual size_t Write(const unsigned char *data, size_t length) = 0;
+    size_t Write(const std::string &data) {
+        return Write((const unsigned char*)data.data(), data.size());}
+
+    //! Discards any buffered input and output
+    virtual void Flush() {}
+
+    /*!
+     * Reads until max_length bytes have been read or no more data arrives
+     * within the read timeout.
+     */
+    std::string ReadString(size_t max_length);
+
+    //! Description used in log messages, usually the URL
+    virtual std::string name() = 0;
+
+    /*!
+     * Path of the device node, if any.  Used to watch for the device to
+     * reappear after it was unplugged.  Empty for network transports.
+     */
+    virtual std::string device_path() {return "";}
+
+    /*!
+     * CLOCK_MONOTONIC time the last read that returned data stopped
+     * waiting [microseconds], or 0 if the transport can not tell, in which
+     * case the caller times the read's return instead.
+     */
+    virtual uint64_t wakeup_time_us() {return 0;}
+};
+
+/*!
+ * Creates a transport from a URL (see the file description for the
+ * supported schemes).  Throws std::invalid_argument for malformed URLs.
+ * The transport is not opened.
+ */
+Transport* CreateTransport(const std::string &url, int baudrate);
+
+//! True if the URL refers to a serial port, where the baud rate applies
+bool IsSerialUrl(const std::string &url);
+
+//! Throws std::runtime_error with the message and the description of errno
+void ThrowSystemError(const std::string &message);
+
+/*!
+ * Splits "host:port" (or ":port") into its parts.  Throws
+ * std::invalid_argument if there is no port.
+ */
+void SplitHostPort(const std::string &address, std::string &host, std::string &port);
+
+//! Resolves host and port, throws std::runtime_error on failure.  Free with freeaddrinfo().
+struct addrinfo* ResolveAddress(const std::string &host, const std::string &port, int socktype, bool passive);
+
+
+//! Serial port using the serial library
+class SerialTransport : public Transport {
+public:
+    SerialTransport(std::string port, int baudrate);
+    ~SerialTransport();
+    void Open();
+    void Close();
+    bool IsOpen();
+    size_t Read(unsigned char *buffer, size_t size);
+    size_t Write(const unsigned char *data, size_t length);
+    void Flush();
+    std::string name() {return port_;}
+    std::string device_path() {return port_;}
+private:
+    std::string port_;
+    int baudrate_;
+    serial::Serial *serial_port_;
+};
+
+/*!
+ * Base for transports built on a POSIX file descriptor.  Reads wait up
+ * to read_timeout_ms with poll() and use readv() for scatter reads.
+ */
+class FdTransport : public Transport {
+public:
+    FdTransport();
+    ~FdTransport();
+    void Close();
+    bool IsOpen() {return fd_ >= 0;}
+    size_t Read(unsigned char *buffer, size_t size);
+    size_t ReadV(const struct iovec *iov, int count);
+    size_t Write(const unsigned char *data, size_t length);
+    uint64_t wakeup_time_us() {return wakeup_us_;}
+protected:
+    //! Waits for the descriptor to become readable, false on timeout
+    bool WaitReadable();
+    //! Handles a read result, throwing if the stream has ended
+    size_t CheckRead(ssize_t result);
+
+    int fd_;
+    int read_timeout_ms_;
+    bool eof_is_error_; //!< a zero length read means the peer has gone away
+    uint64_t wakeup_us_; //!< when poll() last reported data
+};
+
+//! TCP client, e.g. for a receiver ICOM port
+class TcpTransport : public FdTransport {
+public:
+    TcpTransport(std::string host, std::string port);
+    void Open();
+    std::string name() {return "tcp://" + host_ + ":" + port_;}
+private:
+    std::string host_;
+    std::string port_;
+};
+
+/*!
+ * UDP socket.  With a host the socket is connected to the receiver port
+ * and commands are sent to it.  Without a host it receives on the local
+ * port and sends commands back to the last sender.
+ */
+class UdpTransport : public FdTransport {
+public:
+    UdpTransport(std::string host, std::string port);
+    void Open();
+    size_t Read(unsigned char *buffer, size_t size);
+    size_t ReadV(const struct iovec *iov, int count);
+    size_t Write(const unsigned char *data, size_t length);
+    std::string name() {return "udp://" + host_ + ":" + port_;}
+private:
+    size_t Receive(struct iovec *iov, int count);
+
+    std::string host_;
+    std::string port_;
+    struct sockaddr_storage peer_; //!< last sender when listening
+    socklen_t peer_length_;
+};
+
+/*!
+ * Memory mapped recording.  Data is handed out in chunks of at most
+ * chunk_size bytes; once the end is reached reads return 0 as if the
+ * receiver had gone quiet.  Writes are not supported.
+ */
+class FileTransport : public Transport {
+public:
+    FileTransport(std::string path, size_t chunk_size=4096);
+    ~FileTransport();
+    void Open();
+    void Close();
+    bool IsOpen() {return data_ != NULL;}
+    size_t Read(unsigned char *buffer, size_t size);
+    size_t ReadV(const struct iovec *iov, int count);
+    size_t Write(const unsigned char *data, size_t length);
+    std::string name() {return "file://" + path_;}
+    //! True once every byte of the file has been read
+    bool AtEnd() {return (data_ != NULL) && (position_ >= size_);}
+private:
+    std::string path_;
+    size_t chunk_size_;
+    unsigned char *data_;
+    size_t size_;
+    size_t position_;
+};
+
+/*!
+ * Creates a new pseudo terminal and reads from its master side.  A
+ * simulator or bridge (e.g. socat) writes receiver data to the slave
+ * device named by slave_name().
+ */
+class PtyTransport : public FdTransport {
+public:
+    PtyTransport();
+    ~PtyTransport();
+    void Open();
+    void Close();
+    std::string name() {return "pty://" + slave_name_;}
+    std::string slave_name() {return slave_name_;}
+private:
+    std::string slave_name_;
+    int slave_fd_; //!< held open so the master does not see a hangup between writers
+};
+
+}
+
+#endif
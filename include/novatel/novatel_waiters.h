@@ -0,0 +1,179 @@
+/*!
+ * \file novatel/novatel_waiters.h
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Registry of callers waiting for the next matching log or for a
+ * command acknowledgement.  Waiters are completed by the read thread as
+ * frames arrive, so waiting needs no thread of its own.
+ *
+ */
+
+#ifndef NOVATEL_WAITERS_H
+#define NOVATEL_WAITERS_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "novatel/novatel_enums.h"
+
+namespace novatel {
+
+//! How a wait ended
+enum WaitResult {
+    WAIT_MATCHED,       //!< a matching frame or acknowledgement arrived
+    WAIT_TIMED_OUT,     //!< the timeout passed first
+    WAIT_CANCELLED,     //!< the wait was cancelled, reading stopped or the receiver object destroyed
+    WAIT_REJECTED       //!< the receiver replied to the command with an error
+};
+
+/*!
+ * Decides whether a frame completes a wait.  Called on the read thread
+ * with the waiter list locked, so it must not call back into the driver.
+ */
+typedef boost::function<bool(const unsigned char*, size_t)> FrameFilter;
+
+/*!
+ * Called once when a wait ends, on the read thread or the thread that
+ * cancelled it.  The frame is only valid during the call and is NULL
+ * unless a frame matched, or holds the receiver's "<ERROR:" reply for
+ * WAIT_REJECTED.
+ */
+typedef boost::function<void(WaitResult, const unsigned char*, size_t, double)> WaitCompletion;
+
+/*!
+ * Waiters for frames and acknowledgements.  Completions run without the
+ * list locked, so they may add new waiters.  When nothing is waiting the
+ * read thread pays one atomic load per frame.
+ */
+class WaiterList {
+public:
+    WaiterList() : next_id_(1), count_(0) {}
+    ~WaiterList() {CancelAll();}
+
+    /*!
+     * Waits for the next frame of the given type that passes the filter.
+     *
+     * @param filter empty to take the next frame of the type
+     * @param timeout seconds to wait, 0 or less to wait forever
+     * @return id for Cancel()
+     */
+    uint64_t AddFrameWaiter(BINARY_LOG_TYPE message_id, FrameFilter filter,
+                            WaitCompletion completion, double timeout);
+
+    /*!
+     * Waits for the next acknowledgement not taken by an earlier waiter,
+     * so acknowledgements are matched to commands in the order sent.
+     */
+    uint64_t AddAckWaiter(WaitCompletion completion, double timeout);
+
+    //! Completes a waiter with WAIT_CANCELLED, returns false if it already ended
+    bool Cancel(uint64_t waiter_id);
+
+    //! Drops a waiter without completing it, returns false if it already ended
+    bool Remove(uint64_t waiter_id);
+
+    //! Completes every waiter with WAIT_CANCELLED
+    void CancelAll();
+
+    //! Completes the waiters matching a frame
+    void OnFrame(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id, double timestamp);
+
+    //! Completes the oldest acknowledgement waiter
+    void OnAcknowledgement(double timestamp);
+
+    //! Completes the oldest acknowledgement waiter with WAIT_REJECTED
+    void OnCommandError(const char *reply, size_t length, double timestamp);
+
+    //! Completes the waiters whose timeout has passed with WAIT_TIMED_OUT
+    void Expire();
+
+    bool empty() const {return count_.load(boost::memory_order_relaxed) == 0;}
+
+private:
+    struct Waiter {
+        uint64_t id;
+        bool acknowledgement;       //!< waiting for an acknowledgement rather than a frame
+        BINARY_LOG_TYPE message_id;
+        FrameFilter filter;
+        WaitCompletion completion;
+        uint64_t deadline_us;       //!< monotonic time the wait times out, 0 for never
+    };
+
+    uint64_t Add(Waiter &waiter, double timeout);
+    //! Moves the waiter with the given id to taken, returns false if there is none
+    bool Take(uint64_t waiter_id, std::list<Waiter> &taken);
+    //! Moves a waiter to the list to complete, called with mutex_ held
+    void Take(std::list<Waiter>::iterator waiter, std::list<Waiter> &taken);
+    //! Completes the oldest acknowledgement waiter, the one the reply answers
+    void CompleteAck(WaitResult result, const unsigned char *reply, size_t length, double timestamp);
+    static void Complete(std::list<Waiter> &taken, WaitResult result,
+                         const unsigned char *frame, size_t length, double timestamp);
+
+    boost::mutex mutex_;
+    std::list<Waiter> waiters_;     //!< in the order they were added
+    uint64_t next_id_;
+    boost::atomic<size_t> count_;   //!< waiters_.size(), readable without the lock
+};
+
+/*!
+ * Blocks the calling thread on one waiter, for the synchronous commands.
+ * Pass completion() when adding the waiter, then call Wait().
+ */
+class BlockingWait {
+public:
+    BlockingWait() : done_(false), result_(WAIT_CANCELLED) {}
+
+    WaitCompletion completion() {return boost::bind(&BlockingWait::Complete, this, _1, _2, _3, _4);}
+
+    /*!
+     * Waits for the waiter to end, removing it from the list if it has not
+     * after timeout seconds.  Once this returns the completion will not run.
+     */
+    WaitResult Wait(WaiterList &waiters, uint64_t waiter_id, double timeout);
+
+    //! The error reply, for WAIT_REJECTED
+    const std::string &reply() const {return reply_;}
+
+private:
+    void Complete(WaitResult result, const unsigned char *frame, size_t length, double timestamp);
+
+    boost::mutex mutex_;
+    boost::condition_variable condition_;
+    bool done_;
+    WaitResult result_;
+    std::string reply_;
+};
+
+}
+
+#endif
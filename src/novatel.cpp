@@ -6,6 +6,19 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <cerrno>
+
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace novatel;
@@ -41,18 +54,57 @@ Calculates the CRC-32 of a block of data all at once
 unsigned long CalculateBlockCRC32 ( unsigned long ulCount, /* Number of bytes in the data block */
                                     unsigned char *ucBuffer ) /* Data block */
 {
-  unsigned long ulTemp1;
-  unsigned long ulTemp2;
-  unsigned long ulCRC = 0;
-  while ( ulCount-- != 0 ) {
-    ulTemp1 = ( ulCRC >> 8 ) & 0x00FFFFFFL;
-    ulTemp2 = CRC32Value( ((int) ulCRC ^ *ucBuffer++ ) & 0xff );
-    ulCRC = ulTemp1 ^ ulTemp2;
-  }
-  return( ulCRC );
+  return novatel::CalculateCrc32(ucBuffer, ulCount);
 }
 
 
+/*!
+ * Names of the binary logs the driver knows about.  Used to match
+ * log commands against the logs that are seen on the incoming stream.
+ */
+struct BinaryLogName {
+  BINARY_LOG_TYPE id;
+  const char *name;
+};
+
+static const BinaryLogName binary_log_names[] = {
+  {GPSEPHEMB_LOG_TYPE, "GPSEPHEMB"}, {IONUTCB_LOG_TYPE, "IONUTCB"},
+  {CLOCKMODELB_LOG_TYPE, "CLOCKMODELB"}, {VERSIONB_LOG_TYPE, "VERSIONB"},
+  {RAWEPHEMB_LOG_TYPE, "RAWEPHEMB"}, {BESTPOSB_LOG_TYPE, "BESTPOSB"},
+  {BESTUTMB_LOG_TYPE, "BESTUTMB"}, {BESTXYZB_LOG_TYPE, "BESTXYZB"},
+  {RANGEB_LOG_TYPE, "RANGEB"}, {PSRPOSB_LOG_TYPE, "PSRPOSB"},
+  {SATVISB_LOG_TYPE, "SATVISB"}, {ALMANACB_LOG_TYPE, "ALMANACB"},
+  {RAWALMB_LOG_TYPE, "RAWALMB"}, {TRACKSTATB_LOG_TYPE, "TRACKSTATB"},
+  {SATSTATB_LOG_TYPE, "SATSTATB"}, {SATXYZB_LOG_TYPE, "SATXYZB"},
+  {RXSTATUSB_LOG_TYPE, "RXSTATUSB"}, {RXSTATUSEVENTB_LOG_TYPE, "RXSTATUSEVENTB"},
+  {RXHWLEVELSB_LOG_TYPE, "RXHWLEVELSB"}, {MATCHEDPOSB_LOG_TYPE, "MATCHEDPOSB"},
+  {BESTVELB_LOG_TYPE, "BESTVELB"}, {PSRVELB_LOG_TYPE, "PSRVELB"},
+  {TIMEB_LOG_TYPE, "TIMEB"}, {RANGEPNB_LOG_TYPE, "RANGEPNB"},
+  {RXCONFIGB_LOG_TYPE, "RXCONFIGB"}, {RANGECMPB_LOG_TYPE, "RANGECMPB"},
+  {RTKPOSB_LOG_TYPE, "RTKPOSB"}, {RTKDOPB_LOG_TYPE, "RTKDOPB"},
+  {RTKDATAB_LOG_TYPE, "RTKDATAB"},
+  {NAVIGATEB_LOG_TYPE, "NAVIGATEB"}, {AVEPOSB_LOG_TYPE, "AVEPOSB"},
+  {REFSTATIONB_LOG_TYPE, "REFSTATIONB"}, {PASSCOM1B_LOG_TYPE, "PASSCOM1B"},
+  {PASSCOM2B_LOG_TYPE, "PASSCOM2B"}, {PASSCOM3B_LOG_TYPE, "PASSCOM3B"},
+  {BSLNXYZ_LOG_TYPE, "BSLNXYZB"}, {PSRXYZ_LOG_TYPE, "PSRXYZB"},
+  {PSRDOPB_LOG_TYPE, "PSRDOPB"}, {BESTGPSPOS_LOG_TYPE, "BESTGPSPOSB"},
+  {BESTGPSVEL_LOG_TYPE, "BESTGPSVELB"}, {BESTLEVERARM_LOG_TYPE, "BESTLEVERARMB"},
+  {INSATT_LOG_TYPE, "INSATTB"}, {INSCOV_LOG_TYPE, "INSCOVB"},
+  {INSCOVS_LOG_TYPE, "INSCOVSB"}, {INSPOS_LOG_TYPE, "INSPOSB"},
+  {INSPOSSYNC_LOG_TYPE, "INSPOSSYNCB"}, {INSPVA_LOG_TYPE, "INSPVAB"},
+  {INSPVAS_LOG_TYPE, "INSPVASB"}, {INSSPD_LOG_TYPE, "INSSPDB"},
+  {INSUTM_LOG_TYPE, "INSUTMB"}, {INSUPDATE_LOG_TYPE, "INSUPDATEB"},
+  {INSVEL_LOG_TYPE, "INSVELB"}, {RAWIMU_LOG_TYPE, "RAWIMUB"},
+  {RAWIMUS_LOG_TYPE, "RAWIMUSB"}, {VEHICLEBODYROTATION_LOG_TYPE, "VEHICLEBODYROTATIONB"}
+};
+
+inline const char* LookupBinaryLogName(uint16_t id) {
+  for (size_t ii=0; ii<sizeof(binary_log_names)/sizeof(binary_log_names[0]); ii++) {
+    if (binary_log_names[ii].id == id)
+      return binary_log_names[ii].name;
+  }
+  return "";
+}
 
 
 
@@ -105,6 +157,110 @@ void Tokenize(const std::string& str, std::vector<std::string>& tokens, const st
 	}
 }
 
+/*!
+ * Returns the upper case log name from a log command such as
+ * "bestutmb ontime 0.05".
+ */
+inline std::string LogNameOf(const std::string &log) {
+	std::vector<std::string> tokens;
+	Tokenize(log, tokens, " ");
+	if (tokens.empty())
+		return "";
+	std::string name = tokens[0];
+	std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+	return name;
+}
+
+/*!
+ * Blocks until the serial device (e.g. /dev/serial/by-id/usb-...) is
+ * created in its directory, when the adapter is plugged back in, or until
+ * timeout_ms has passed.  Returns at once if it already exists, as it was
+ * created between two waits.  Other devices coming and going are ignored.
+ * Where inotify is not available this is a plain sleep, as it is for
+ * transports without a device node.
+ *
+ * @return true if the device was created before the timeout
+ */
+inline bool WaitForDeviceChange(const std::string &port, int timeout_ms) {
+#ifdef __linux__
+	if (port.empty()) {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(timeout_ms));
+		return false;
+	}
+	std::string dir = "/dev";
+	std::string name = port;
+	std::string::size_type slash = port.find_last_of('/');
+	if (slash != std::string::npos) {
+		if (slash > 0)
+			dir = port.substr(0, slash);
+		name = port.substr(slash+1);
+	}
+
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd >= 0) {
+		// the by-id directory is removed with the last device, so fall back
+		// to watching /dev for the first directory on the path to be recreated
+		bool watching = (inotify_add_watch(fd, dir.c_str(), IN_CREATE | IN_MOVED_TO) >= 0);
+		if (!watching && (port.compare(0, 5, "/dev/") == 0)) {
+			name = port.substr(5, port.find('/', 5) - 5);
+			watching = (inotify_add_watch(fd, "/dev", IN_CREATE | IN_MOVED_TO) >= 0);
+		}
+		if (watching) {
+			boost::system_time const timeout = boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms);
+			bool created = (access(port.c_str(), F_OK) == 0);
+			while (!created) {
+				int remaining = (int)(timeout - boost::get_system_time()).total_milliseconds();
+				struct pollfd pfd;
+				pfd.fd = fd;
+				pfd.events = POLLIN;
+				pfd.revents = 0;
+				if ((remaining <= 0) || (poll(&pfd, 1, remaining) <= 0))
+					break;
+				char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+				ssize_t length = read(fd, events, sizeof(events));
+				for (ssize_t offset = 0; offset < length; ) {
+					const struct inotify_event *event = (const struct inotify_event*)(events + offset);
+					if ((event->len > 0) && (name == event->name))
+						created = true;
+					offset += sizeof(struct inotify_event) + event->len;
+				}
+			}
+			close(fd);
+			return created;
+		}
+		close(fd);
+	}
+#endif
+	boost::this_thread::sleep(boost::posix_time::milliseconds(timeout_ms));
+	return false;
+}
+
+//! Whether the device node exists, true for transports without one
+inline bool DeviceExists(const std::string &port) {
+#ifdef __linux__
+	return port.empty() || (access(port.c_str(), F_OK) == 0);
+#else
+	return true;
+#endif
+}
+
+//! Monotonic clock in microseconds, used for latency measurement
+inline uint64_t MonotonicMicroseconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+/*!
+ * Touches a block of stack so the pages the parse and callback path use
+ * are mapped (and locked when mlockall is active) before data arrives.
+ */
+static void __attribute__((noinline)) PrefaultStack() {
+	volatile unsigned char stack[256*1024];
+	for (size_t ii=0; ii<sizeof(stack); ii+=4096)
+		stack[ii] = 0;
+}
+
 inline void DefaultAcknowledgementHandler() {
     ;//std::cout << "Acknowledgement received." << std::endl;
 }
@@ -125,51 +281,70 @@ inline void DefaultErrorMsgCallback(const std::string &msg) {
     std::cout << "Novatel Error: " << msg << std::endl;
 }
 
-inline void DefaultBestPositionCallback(Position best_position, double time_stamp){
-    std:: cout << "BESTPOS: \nGPS Week: " << best_position.header.gps_week <<
-                  "  GPS milliseconds: " << best_position.header.gps_millisecs << std::endl <<
-                  "  Latitude: " << best_position.latitude << std::endl <<
-                  "  Longitude: " << best_position.longitude << std::endl <<
-                  "  Height: " << best_position.height << std::endl << std::endl <<
-                  "  Solution status: " << best_position.solution_status << std::endl <<
-                  "  position type: " << best_position.position_type << std::endl <<
-                  "  number of svs tracked: " << (double)best_position.number_of_satellites << std::endl <<
-                  "  number of svs used: " << (double)best_position.number_of_satellites_in_solution << std::endl;
-}
-
-inline void DefaultRawEphemCallback(RawEphemeris ephemeris, double time_stamp) {
-    std::cout << "Got RAWEPHEM for PRN " << ephemeris.prn << std::endl;
-}
-
-Novatel::Novatel() {
-	serial_port_=NULL;
+Novatel::Novatel() : log_debug_(logger_), log_info_(logger_), log_warning_(logger_),
+                     log_error_(logger_), demux_(*this) {
+	transport_=NULL;
 	reading_status_=false;
     time_handler_ = DefaultGetTime;
     handle_acknowledgement_=DefaultAcknowledgementHandler;
-    best_position_callback_=DefaultBestPositionCallback;
-    raw_ephemeris_callback_=DefaultRawEphemCallback;
-    log_debug_=DefaultDebugMsgCallback;
-    log_info_=DefaultInfoMsgCallback;
-    log_warning_=DefaultWarningMsgCallback;
-    log_error_=DefaultErrorMsgCallback;
-	reading_acknowledgement_=false;
-    buffer_index_=0;
+    logger_.set_sink(LOG_LEVEL_DEBUG, DefaultDebugMsgCallback);
+    logger_.set_sink(LOG_LEVEL_INFO, DefaultInfoMsgCallback);
+    logger_.set_sink(LOG_LEVEL_WARNING, DefaultWarningMsgCallback);
+    logger_.set_sink(LOG_LEVEL_ERROR, DefaultErrorMsgCallback);
     read_timestamp_=0;
     parse_timestamp_=0;
-    ack_received_=false;
     waiting_for_reset_complete_=false;
     is_connected_ = false;
+    unlog_on_disconnect_ = true;
+    valid_frame_count_ = 0;
+    device_lost_ = false;
+    max_reconnect_backoff_ms_ = 5000;
+    reconnect_count_ = 0;
+    last_gap_duration_ = 0;
+    read_wakeup_us_ = 0;
+    latency_samples_ = 0;
+    latency_total_us_ = 0;
+    latency_max_us_ = 0;
+    writing_corrections_ = false;
+    reading_corrections_ = false;
+    correction_source_ = NULL;
+    memset(&correction_stats_, 0, sizeof(correction_stats_));
+    correction_latency_total_us_ = 0;
+    last_correction_us_ = 0;
+    recorder_ = NULL;
+    stream_server_ = NULL;
+    flight_recorder_ = NULL;
+    batch_window_us_ = 0;
+    batch_start_us_ = 0;
+    deferred_running_ = false;
+    deferred_busy_ = false;
+    deferred_dropped_count_ = 0;
+    executor_ = NULL;
+    lane_frame_.resize(MAX_NOUT_SIZE);
+    sentence_.reserve(MAX_NOUT_SIZE);
+    for (size_t ii=0; ii<GLONASS_FREQUENCY_SLOTS; ii++)
+        glonass_frequency_[ii] = GLONASS_FREQUENCY_NOT_SEEN;
+    memset(&recorder_stats_, 0, sizeof(recorder_stats_));
+    rtcm_framer_.set_frame_callback(boost::bind(&Novatel::QueueCorrection, this, _1, _2));
+    restart_tracker_.set_milestone_callback(boost::bind(&Novatel::OnRestartMilestone, this, _1, _2, _3));
 }
 
 Novatel::~Novatel() {
     Disconnect();
+    StopRecording();
+    StopStreamServer();
+    StopFlightRecorder();
+    StopDeferredWorker();
+    StopCallbackExecutor();
+    // waits added after reading stopped
+    waiters_.CancelAll();
 }
 
 bool Novatel::Connect(std::string port, int baudrate, bool search) {
 
 	bool connected = Connect_(port, baudrate);
 
-	if (!connected && search) {
+	if (!connected && search && IsSerialUrl(port)) {
 		// search additional baud rates
 
         int bauds_to_search[9]={1200,2400,4800,9600,19200,38400,57600,115200,230400};
@@ -194,7 +369,7 @@ bool Novatel::Connect(std::string port, int baudrate, bool search) {
 			baud_msg << "Changing receiver baud rate to " << baudrate;
 			log_info_(baud_msg.str());
 			try {
-				serial_port_->write(cmd.str());
+				WriteToPort(cmd.str());
 			} catch (std::exception &e) {
 				std::stringstream output;
 			    output << "Error changing baud rate: " << e.what();
@@ -211,6 +386,7 @@ bool Novatel::Connect(std::string port, int baudrate, bool search) {
 		// start reading
 		StartReading();
 		is_connected_ = true;
+		unlog_on_disconnect_ = true;
 		return true;
 	} else {
 		log_error_("Failed to connect.");
@@ -222,45 +398,47 @@ bool Novatel::Connect(std::string port, int baudrate, bool search) {
 bool Novatel::Connect_(std::string port, int baudrate=115200) {
 	try {
 
-		//serial::Timeout my_timeout(50, 200, 0, 200, 0); // 115200 working settings
-		//serial_port_ = new serial::Serial(port,baudrate,my_timeout);
-
-		serial_port_ = new serial::Serial(port,baudrate,serial::Timeout::simpleTimeout(10)); 
+		// serial port, socket or file depending on the url
+		transport_ = CreateTransport(port, baudrate);
+		transport_->Open();
 
-		if (!serial_port_->isOpen()){
+		if (!transport_->IsOpen()){
 	        std::stringstream output;
 	        output << "Serial port: " << port << " failed to open." << std::endl;
 	        log_error_(output.str());
-			delete serial_port_;
-			serial_port_ = NULL;
+			delete transport_;
+			transport_ = NULL;
 			return false;
 		} else {
 	        std::stringstream output;
-	        output << "Serial port: " << port << " opened successfully." << std::endl;
+	        output << "Serial port: " << transport_->name() << " opened successfully." << std::endl;
 	        log_info_(output.str());
 		}
 
 		// stop any incoming data and flush buffers
-		serial_port_->write("UNLOGALL\r\n");
+		WriteToPort("UNLOGALL\r\n");
 		// wait for data to stop cominig in
 		boost::this_thread::sleep(boost::posix_time::milliseconds(1000));
 		// clear serial port buffers
-		serial_port_->flush();
+		transport_->Flush();
 
 		// look for GPS by sending ping and waiting for response
 		if (!Ping()){
 	        std::stringstream output;
 	        output << "Novatel GPS not found on port: " << port << " at baudrate " << baudrate << std::endl;
 	        log_error_(output.str());
-			delete serial_port_;
-			serial_port_ = NULL;
+			delete transport_;
+			transport_ = NULL;
 			is_connected_ = false;
 			return false;
 		}
+		port_name_ = transport_->name();
 	} catch (std::exception &e) {
 	    std::stringstream output;
 	    output << "Error connecting to gps on com port " << port << ": " << e.what();
 	    log_error_(output.str());
+	    delete transport_;
+	    transport_ = NULL;
 	    is_connected_ = false;
 	    return false;
 	}
@@ -268,20 +446,95 @@ bool Novatel::Connect_(std::string port, int baudrate=115200) {
 	return true;
 }
 
+bool Novatel::Attach(std::string port, int baudrate, int timeout_ms) {
+	Transport *transport;
+	try {
+		transport = CreateTransport(port, baudrate);
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error attaching to gps on com port " << port << ": " << e.what();
+		log_error_(output.str());
+		return false;
+	}
+	return Attach(transport, timeout_ms);
+}
+
+bool Novatel::Attach(Transport *transport, int timeout_ms) {
+	transport_ = transport;
+	std::string port = transport_->name();
+	try {
+		if (!transport_->IsOpen())
+			transport_->Open();
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error attaching to gps on com port " << port << ": " << e.what();
+		log_error_(output.str());
+		delete transport_;
+		transport_ = NULL;
+		return false;
+	}
+
+	port_name_ = port;
+
+	// forget anything seen on a previous connection
+	{
+		boost::mutex::scoped_lock lock(log_activity_mutex_);
+		log_activity_.clear();
+	}
+	valid_frame_count_ = 0;
+
+	// start dispatching right away and wait for the receiver to prove it is
+	// streaming by sending a frame with a valid CRC
+	StartReading();
+	boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(timeout_ms);
+	while ((valid_frame_count_ == 0) && (boost::get_system_time() < timeout))
+		boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+
+	if (valid_frame_count_ == 0) {
+		std::stringstream output;
+		output << "No valid data streaming on port " << port << ".";
+		log_warning_(output.str());
+		StopReading();
+		try {
+			transport_->Close();
+		} catch (std::exception &e) {
+			;
+		}
+		delete transport_;
+		transport_ = NULL;
+		return false;
+	}
+
+	std::stringstream output;
+	output << "Attached to receiver streaming on port " << port << ".";
+	log_info_(output.str());
+	is_connected_ = true;
+	unlog_on_disconnect_ = false;
+	return true;
+}
+
 
 void Novatel::Disconnect() {
 	log_info_("Novatel disconnecting.");
+	StopCorrections();
 	StopReading();
 	// sleep longer than the timeout period
 	boost::this_thread::sleep(boost::posix_time::milliseconds(150));
 
 	try {
-		if ((serial_port_!=NULL) && (serial_port_->isOpen()) ) {
-			log_info_("Sending UNLOGALL and closing port.");
-			serial_port_->write("UNLOGALL\r\n");
-			serial_port_->close();
-			delete serial_port_;
-			serial_port_=NULL;
+		if (transport_!=NULL) {
+			// the port may already be closed if the device was lost
+			if (transport_->IsOpen()) {
+				if (unlog_on_disconnect_) {
+					log_info_("Sending UNLOGALL and closing port.");
+					WriteToPort("UNLOGALL\r\n");
+				} else {
+					log_info_("Closing port and leaving receiver logs running.");
+				}
+				transport_->Close();
+			}
+			delete transport_;
+			transport_=NULL;
 		}
 	} catch (std::exception &e) {
 	    std::stringstream output;
@@ -293,44 +546,20 @@ void Novatel::Disconnect() {
 bool Novatel::Ping(int num_attempts) {
 
 	while ((num_attempts--)>0) {
-        std::stringstream output;
-        output << "Searching for Novatel receiver..." << std::endl;
-        log_info_(output.str());
+		log_info_("Searching for Novatel receiver...");
 		if (UpdateVersion()) {
-            std::stringstream output;
-            output << "Found Novatel receiver." << std::endl;
-            output << "\tModel: " << model_ << std::endl;
-            output << "\tSerial Number: " << serial_number_ << std::endl;
-            output << "\tHardware version: " << hardware_version_ << std::endl;
-            output << "\tSoftware version: " << software_version_ << std::endl << std::endl;;
-            output << "Receiver capabilities:" << std::endl;
-            output << "\tL2: ";
-			if (l2_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            output << "\tRaw measurements: ";
-			if (raw_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            output << "\tRTK: ";
-			if (rtk_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            output << "\tSPAN: ";
-			if (span_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            output << "\tGLONASS: ";
-			if (glonass_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            log_info_(output.str());
-            return true;
+			NOVATEL_LOG(log_info_, "Found Novatel receiver." << std::endl
+				<< "\tModel: " << model_ << std::endl
+				<< "\tSerial Number: " << serial_number_ << std::endl
+				<< "\tHardware version: " << hardware_version_ << std::endl
+				<< "\tSoftware version: " << software_version_ << std::endl << std::endl
+				<< "Receiver capabilities:" << std::endl
+				<< "\tL2: " << (l2_capable_ ? "+" : "-") << std::endl
+				<< "\tRaw measurements: " << (raw_capable_ ? "+" : "-") << std::endl
+				<< "\tRTK: " << (rtk_capable_ ? "+" : "-") << std::endl
+				<< "\tSPAN: " << (span_capable_ ? "+" : "-") << std::endl
+				<< "\tGLONASS: " << (glonass_capable_ ? "+" : "-") << std::endl);
+			return true;
 		}
 	}
 
@@ -340,16 +569,15 @@ bool Novatel::Ping(int num_attempts) {
 }
 
 void Novatel::SendRawEphemeridesToReceiver(RawEphemerides raw_ephemerides) {
-    try{
-    for(uint8_t index=0;index<MAX_NUM_SAT; index++){
-        cout << "SIZEOF: " << sizeof(raw_ephemerides.ephemeris[index]) << endl;
-        if(sizeof(raw_ephemerides.ephemeris[index]) == 106+HEADER_SIZE) {
-            uint8_t* msg_ptr = (unsigned char*)&raw_ephemerides.ephemeris[index];
-            bool result = SendBinaryDataToReceiver(msg_ptr, sizeof(raw_ephemerides.ephemeris[index]));
-            if(result)
-                cout << "Sent RAWEPHEM for PRN " << (double)raw_ephemerides.ephemeris[index].prn << endl;
+    try {
+        // empty slots (prn 0) are skipped and the rest sent in one write
+        BinaryEncoder encoder;
+        for (uint8_t index=0; index<MAX_NUM_SAT; index++) {
+            if (raw_ephemerides.ephemeris[index].prn != 0)
+                encoder.Add<RAWEPHEMB_LOG_TYPE>(raw_ephemerides.ephemeris[index]);
         }
-    }
+        if (SendBinaryMessages(encoder))
+            NOVATEL_LOG(log_debug_, "Sent RAWEPHEM for " << encoder.messages() << " satellites.");
     } catch (std::exception &e) {
         std::stringstream output;
         output << "Error in Novatel::SendRawEphemeridesToReceiver(): " << e.what();
@@ -357,17 +585,21 @@ void Novatel::SendRawEphemeridesToReceiver(RawEphemerides raw_ephemerides) {
     }
 }
 
-bool Novatel::SendBinaryDataToReceiver(uint8_t* msg_ptr, size_t length) {
+bool Novatel::SendBinaryMessages(const BinaryEncoder &encoder) {
+    if (encoder.empty())
+        return true;
+    return SendBinaryDataToReceiver(encoder.data(), encoder.size());
+}
+
+bool Novatel::SendBinaryDataToReceiver(const uint8_t* msg_ptr, size_t length) {
 
     try {
         stringstream output1;
-        std::cout << length << std::endl;
-        std::cout << "Message Pointer" << endl;
-        printHex((unsigned char*) msg_ptr, length);
+        NOVATEL_LOG(log_debug_, "Sending " << length << " byte binary message.");
         size_t bytes_written;
 
-        if ((serial_port_!=NULL)&&(serial_port_->isOpen())) {
-            bytes_written=serial_port_->write(msg_ptr, length);
+        if ((transport_!=NULL)&&(transport_->IsOpen())) {
+            bytes_written=WriteToPort(msg_ptr, length);
         } else {
             log_error_("Unable to send message. Serial port not open.");
             return false;
@@ -389,22 +621,200 @@ bool Novatel::SendBinaryDataToReceiver(uint8_t* msg_ptr, size_t length) {
     }
 }
 
+bool Novatel::SendMessage(uint8_t* msg_ptr, size_t length) {
+	try {
+		return WriteToPort(msg_ptr, length) == length;
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error in Novatel::SendMessage(): " << e.what();
+		log_error_(output.str());
+		return false;
+	}
+}
+
+size_t Novatel::WriteToPort(const unsigned char *data, size_t length) {
+	boost::mutex::scoped_lock lock(write_mutex_);
+	if (transport_ == NULL)
+		throw std::runtime_error("Not connected to a receiver.");
+	return transport_->Write(data, length);
+}
+
+size_t Novatel::WriteToPort(const std::string &data) {
+	return WriteToPort((const unsigned char*)data.data(), data.size());
+}
+
+void Novatel::InjectCorrections(const unsigned char *data, size_t length) {
+	boost::mutex::scoped_lock lock(inject_mutex_);
+	rtcm_framer_.AddData(data, length);
+}
+
+void Novatel::QueueCorrection(const unsigned char *frame, size_t length) {
+	QueuedCorrection correction;
+	correction.data.assign(frame, frame+length);
+	correction.received_us = MonotonicMicroseconds();
+
+	boost::mutex::scoped_lock lock(correction_mutex_);
+	// start the writer on the first correction
+	if (!writing_corrections_) {
+		writing_corrections_ = true;
+		correction_writer_ptr_ = boost::shared_ptr<boost::thread >
+			(new boost::thread(boost::bind(&Novatel::WriteCorrections, this)));
+	}
+	// old corrections are worth less than new ones, drop from the front
+	if (correction_queue_.size() >= 64) {
+		correction_queue_.pop_front();
+		correction_stats_.frames_dropped++;
+	}
+	correction_queue_.push_back(correction);
+	correction_condition_.notify_one();
+}
+
+void Novatel::WriteCorrections() {
+	boost::mutex::scoped_lock lock(correction_mutex_);
+	while (writing_corrections_) {
+		if (correction_queue_.empty()) {
+			correction_condition_.wait(lock);
+			continue;
+		}
+		QueuedCorrection correction;
+		correction.data.swap(correction_queue_.front().data);
+		correction.received_us = correction_queue_.front().received_us;
+		correction_queue_.pop_front();
+
+		// write without holding the queue so injection never waits on the port
+		lock.unlock();
+		bool written = false;
+		try {
+			written = (WriteToPort(&correction.data[0], correction.data.size()) == correction.data.size());
+		} catch (std::exception &e) {
+			// fails for every frame while the port is down
+			NOVATEL_LOG_THROTTLE(log_warning_, 5.0, "Error writing corrections: " << e.what());
+		}
+		uint64_t now = MonotonicMicroseconds();
+		lock.lock();
+
+		if (written) {
+			uint64_t latency = now - correction.received_us;
+			correction_stats_.frames_forwarded++;
+			correction_stats_.bytes_forwarded += correction.data.size();
+			correction_latency_total_us_ += latency;
+			if (latency > correction_stats_.max_latency_us)
+				correction_stats_.max_latency_us = latency;
+			last_correction_us_ = now;
+		} else {
+			correction_stats_.frames_dropped++;
+		}
+	}
+}
+
+bool Novatel::StartCorrectionSource(std::string url) {
+	StopCorrectionSource();
+	try {
+		correction_source_ = CreateTransport(url, 115200);
+		correction_source_->Open();
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error opening correction source " << url << ": " << e.what();
+		log_error_(output.str());
+		delete correction_source_;
+		correction_source_ = NULL;
+		return false;
+	}
+	log_info_("Injecting corrections from " + correction_source_->name() + ".");
+	reading_corrections_ = true;
+	correction_source_ptr_ = boost::shared_ptr<boost::thread >
+		(new boost::thread(boost::bind(&Novatel::ReadCorrectionSource, this)));
+	return true;
+}
+
+void Novatel::StopCorrectionSource() {
+	reading_corrections_ = false;
+	if (correction_source_ptr_) {
+		correction_source_ptr_->join();
+		correction_source_ptr_.reset();
+	}
+	delete correction_source_;
+	correction_source_ = NULL;
+}
+
+void Novatel::ReadCorrectionSource() {
+	unsigned char buffer[RTCM3_MAX_FRAME_SIZE];
+	while (reading_corrections_) {
+		try {
+			size_t len = correction_source_->Read(buffer, sizeof(buffer));
+			if (len > 0)
+				InjectCorrections(buffer, len);
+		} catch (std::exception &e) {
+			std::stringstream output;
+			output << "Lost correction source " << correction_source_->name() << ": " << e.what();
+			log_warning_(output.str());
+			// wait for the proxy to come back
+			while (reading_corrections_) {
+				boost::this_thread::sleep(boost::posix_time::milliseconds(1000));
+				try {
+					correction_source_->Close();
+					correction_source_->Open();
+					log_info_("Reconnected to correction source " + correction_source_->name() + ".");
+					break;
+				} catch (std::exception &e) {
+					;
+				}
+			}
+		}
+	}
+}
+
+void Novatel::StopCorrections() {
+	StopCorrectionSource();
+	{
+		boost::mutex::scoped_lock lock(correction_mutex_);
+		writing_corrections_ = false;
+		correction_queue_.clear();
+	}
+	correction_condition_.notify_all();
+	if (correction_writer_ptr_) {
+		correction_writer_ptr_->join();
+		correction_writer_ptr_.reset();
+	}
+}
+
+CorrectionStats Novatel::GetCorrectionStats() {
+	CorrectionStats stats;
+	{
+		boost::mutex::scoped_lock lock(correction_mutex_);
+		stats = correction_stats_;
+		stats.mean_latency_us = stats.frames_forwarded ?
+			(double)correction_latency_total_us_/stats.frames_forwarded : 0;
+		stats.last_frame_age = last_correction_us_ ?
+			(double)(MonotonicMicroseconds() - last_correction_us_)/1e6 : -1;
+	}
+	{
+		boost::mutex::scoped_lock lock(inject_mutex_);
+		stats.crc_errors = rtcm_framer_.crc_error_count();
+	}
+	return stats;
+}
+
 bool Novatel::SendCommand(std::string cmd_msg, bool wait_for_ack) {
 	try {
-		// sends command to GPS receiver
-        serial_port_->write(cmd_msg + "\r\n");
 		// wait for acknowledgement (or 2 seconds)
         if(wait_for_ack) {
-            boost::mutex::scoped_lock lock(ack_mutex_);
-            boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(2000);
-            if (ack_condition_.timed_wait(lock,timeout)) {
+            std::string reply;
+            WaitResult result = WriteCommandAndWait(cmd_msg + "\r\n", reply);
+            if (result == WAIT_MATCHED) {
                 log_info_("Command `" + cmd_msg + "` sent to GPS receiver.");
                 return true;
+            } else if (result == WAIT_REJECTED) {
+                log_error_("Command '" + cmd_msg + "' rejected: " + reply);
+                return false;
             } else {
                 log_error_("Command '" + cmd_msg + "' failed.");
+                TriggerFlightRecorder(FLIGHT_TRIGGER_ACK_TIMEOUT);
                 return false;
             }
         } else {
+            // sends command to GPS receiver
+            WriteToPort(cmd_msg + "\r\n");
             log_info_("Command `" + cmd_msg + "` sent to GPS receiver.");
             return true;
         }
@@ -416,6 +826,37 @@ bool Novatel::SendCommand(std::string cmd_msg, bool wait_for_ack) {
 	}
 }
 
+WaitResult Novatel::WriteCommandAndWait(const std::string &command, std::string &reply, double timeout) {
+	// queued with the asynchronous commands, before writing, so each
+	// acknowledgement goes to the command it answers
+	BlockingWait wait;
+	uint64_t waiter = waiters_.AddAckWaiter(wait.completion(), 0);
+	try {
+		WriteToPort(command);
+	} catch (...) {
+		wait.Wait(waiters_, waiter, 0);
+		throw;
+	}
+	WaitResult result = wait.Wait(waiters_, waiter, timeout);
+	reply = wait.reply();
+	return result;
+}
+
+uint64_t Novatel::AsyncSendCommand(std::string cmd_msg, WaitCompletion completion, double timeout) {
+	// waiting before writing so a fast acknowledgement is not missed
+	uint64_t waiter = waiters_.AddAckWaiter(completion, timeout);
+	try {
+		WriteToPort(cmd_msg + "\r\n");
+		log_info_("Command `" + cmd_msg + "` sent to GPS receiver.");
+		return waiter;
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error in Novatel::AsyncSendCommand(): " << e.what();
+		log_error_(output.str());
+		return waiters_.Remove(waiter) ? 0 : waiter;
+	}
+}
+
 bool Novatel::SetSvElevationAngleCutoff(float angle) {
     try {
         std::stringstream ang_cmd;
@@ -546,36 +987,12 @@ uint16_t         version;       	//!< Receiver software build number (0-65535)
 
 bool Novatel::InjectAlmanac(Almanac almanac) {
     try {
-        MessageType type;
-        type.format = BINARY;
-        type.response = ORIGINAL_MESSAGE;
-
-        almanac.header.sync1 = NOVATEL_SYNC_BYTE_1;
-        almanac.header.sync2 = NOVATEL_SYNC_BYTE_2;
-        almanac.header.sync3 = NOVATEL_SYNC_BYTE_3;
-        almanac.header.header_length = HEADER_SIZE;
-        almanac.header.message_id = ALMANACB_LOG_TYPE;
-        almanac.header.message_type = type;
-        almanac.header.port_address = THISPORT;
-        almanac.header.message_length = 4+almanac.number_of_prns*112;
-        almanac.header.sequence = 0;
-        almanac.header.idle = 0; //!< ignored on input
-        almanac.header.time_status = 0; //!< ignored on input
-        almanac.header.gps_week = 0; //!< ignored on input
-        almanac.header.gps_millisecs = 0; //!< ignored on input
-        almanac.header.status = 0; //!< ignored on input
-        almanac.header.Reserved = 0; //!< ignored on input
-        almanac.header.version = 0; //!< ignored on input
-
-        cout << "SIZEOF: " << sizeof(almanac) << endl;
-        uint8_t* msg_ptr = (unsigned char*)&almanac;
-        uint32_t crc = CalculateBlockCRC32 (sizeof(almanac)-4, msg_ptr);
-        memcpy(almanac.crc, &crc, sizeof(crc)); // TODO: check byte ordering for crc
-        bool result = SendBinaryDataToReceiver(msg_ptr, sizeof(almanac));
-        if(result) {
-            cout << "Sent ALMANAC." << endl;
-            return true;
-        }
+        BinaryEncoder encoder;
+        encoder.Add<ALMANACB_LOG_TYPE>(almanac);
+        if (!SendBinaryMessages(encoder))
+            return false;
+        NOVATEL_LOG(log_debug_, "Sent ALMANAC for " << almanac.number_of_prns << " satellites.");
+        return true;
     } catch (std::exception &e){
         std::stringstream output;
         output << "Error in Novatel::InjectAlmanac(): " << e.what();
@@ -608,6 +1025,7 @@ bool Novatel::SetCarrierSmoothing(uint32_t l1_time_constant, uint32_t l2_time_co
 bool Novatel::HardwareReset() {
     // Resets receiver to cold start, does NOT clear non-volatile memory!
     try {
+        restart_tracker_.Start(RESET_HARDWARE);
         std::stringstream rst_cmd;
         rst_cmd << "RESET";
         bool command_sent = SendCommand(rst_cmd.str(),false);
@@ -624,6 +1042,7 @@ bool Novatel::HardwareReset() {
                 return false;
             }
         } else {
+            restart_tracker_.Stop();
             return false;
         }
     } catch (std::exception &e) {
@@ -637,6 +1056,7 @@ bool Novatel::HardwareReset() {
 
 bool Novatel::HotStartReset() {
     try {
+        restart_tracker_.Start(RESET_HOT);
         std::stringstream rst_cmd;
         rst_cmd << "RESET";
         bool command_sent = SendCommand(rst_cmd.str(),false);
@@ -653,6 +1073,7 @@ bool Novatel::HotStartReset() {
                 return false;
             }
         } else {
+            restart_tracker_.Stop();
             return false;
         }
     } catch (std::exception &e) {
@@ -666,6 +1087,7 @@ bool Novatel::HotStartReset() {
 
 bool Novatel::WarmStartReset() {
     try {
+        restart_tracker_.Start(RESET_WARM);
         std::stringstream rst_pos_cmd;
         std::stringstream rst_time_cmd;
         rst_pos_cmd << "FRESET " << LAST_POSITION;  //!< FRESET doesn't reply with an ACK
@@ -685,6 +1107,7 @@ bool Novatel::WarmStartReset() {
                 return false;
             }
         } else {
+            restart_tracker_.Stop();
             return false;
         }
     } catch (std::exception &e) {
@@ -698,6 +1121,7 @@ bool Novatel::WarmStartReset() {
 
 bool Novatel::ColdStartReset() {
     try {
+        restart_tracker_.Start(RESET_COLD);
         std::stringstream rst_cmd;
         rst_cmd << "FRESET STANDARD";
         bool command_sent = SendCommand(rst_cmd.str(),false); //!< FRESET doesn't reply with an ACK
@@ -714,6 +1138,7 @@ bool Novatel::ColdStartReset() {
                 return false;
             }
         } else {
+            restart_tracker_.Stop();
             return false;
         }
     } catch (std::exception &e) {
@@ -745,6 +1170,15 @@ void Novatel::ConfigureLogs(std::string log_string) {
 
 	Tokenize(log_string, logs, ";");
 
+	// remember the configuration so it can be restored after a reconnect
+	{
+		boost::mutex::scoped_lock lock(configured_logs_mutex_);
+		for (std::vector<std::string>::iterator it = logs.begin() ; it != logs.end(); ++it) {
+			if (std::find(configured_logs_.begin(), configured_logs_.end(), *it) == configured_logs_.end())
+				configured_logs_.push_back(*it);
+		}
+	}
+
 	// request each log from the receiver and wait for an ack
 	for (std::vector<std::string>::iterator it = logs.begin() ; it != logs.end(); ++it)
 	{
@@ -753,24 +1187,29 @@ void Novatel::ConfigureLogs(std::string log_string) {
 		while (ii<5) {
 			try {
 				// send log command to gps (e.g. "LOG BESTUTMB ONTIME 1.0")
-				serial_port_->write("LOG " + *it + "\r\n");
+				// and wait for acknowledgement (or 2 seconds)
 				std::stringstream cmd;
 				cmd << "LOG " << *it << "\r\n";
 				log_info_(cmd.str());
-				// wait for acknowledgement (or 2 seconds)
-				boost::mutex::scoped_lock lock(ack_mutex_);
-				boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(2000);
-				if (ack_condition_.timed_wait(lock,timeout)) {
+				std::string reply;
+				WaitResult result = WriteCommandAndWait(cmd.str(), reply);
+				if (result == WAIT_MATCHED) {
 					log_info_("Ack received for requested log: " + *it);
 					break;
+				} else if (result == WAIT_REJECTED) {
+					// sending it again will not change the answer
+					log_error_("Receiver rejected log " + *it + ": " + reply);
+					break;
 				} else {
 					log_error_("No acknowledgement received for log: " + *it);
+					TriggerFlightRecorder(FLIGHT_TRIGGER_ACK_TIMEOUT);
 				}
 				ii++;
 			} catch (std::exception &e) {
 				std::stringstream output;
 		        output << "Error configuring receiver logs: " << e.what();
 		        log_error_(output.str());
+		        ii++;
 			}
 		}
 
@@ -779,6 +1218,16 @@ void Novatel::ConfigureLogs(std::string log_string) {
 }
 
 void Novatel::Unlog(std::string log) {
+    {
+        boost::mutex::scoped_lock lock(configured_logs_mutex_);
+        std::string name = LogNameOf(log);
+        for (std::vector<std::string>::iterator it = configured_logs_.begin(); it != configured_logs_.end();) {
+            if (LogNameOf(*it) == name)
+                it = configured_logs_.erase(it);
+            else
+                ++it;
+        }
+    }
     try {
         std::stringstream unlog_cmd;
         unlog_cmd << "UNLOG " << log;
@@ -791,6 +1240,10 @@ void Novatel::Unlog(std::string log) {
 }
 
 void Novatel::UnlogAll() {
+    {
+        boost::mutex::scoped_lock lock(configured_logs_mutex_);
+        configured_logs_.clear();
+    }
     try {
         bool result = SendCommand("UNLOGALL THISPORT");
     } catch (std::exception &e) {
@@ -800,21 +1253,46 @@ void Novatel::UnlogAll() {
     }
 }
 
+std::vector<LogActivity> Novatel::GetActiveLogs() {
+    boost::mutex::scoped_lock lock(log_activity_mutex_);
+    std::vector<LogActivity> logs;
+    for (std::map<uint16_t, LogActivity>::iterator it = log_activity_.begin();
+         it != log_activity_.end(); ++it)
+        logs.push_back(it->second);
+    return logs;
+}
+
+bool Novatel::IsLogActive(std::string log) {
+    std::string name = LogNameOf(log);
+    if (name.empty())
+        return false;
+
+    boost::mutex::scoped_lock lock(log_activity_mutex_);
+    for (std::map<uint16_t, LogActivity>::iterator it = log_activity_.begin();
+         it != log_activity_.end(); ++it) {
+        if (it->second.name == name)
+            return true;
+    }
+    return false;
+}
+
 void Novatel::ConfigureInterfaceMode(std::string com_port,  
   std::string rx_mode, std::string tx_mode) {
 
 	try {
 		// send command to set interface mode on com port
 		// ex: INTERFACEMODE COM2 RX_MODE TX_MODE
-		serial_port_->write("INTERFACEMODE " + com_port + " " + rx_mode + " " + tx_mode + "\r\n");
-		// wait for acknowledgement (or 2 seconds)
-		boost::mutex::scoped_lock lock(ack_mutex_);
-		boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(2000);
-		if (ack_condition_.timed_wait(lock,timeout)) {
+		// and wait for acknowledgement (or 2 seconds)
+		std::string reply;
+		WaitResult result = WriteCommandAndWait("INTERFACEMODE " + com_port + " " + rx_mode + " " + tx_mode + "\r\n", reply);
+		if (result == WAIT_MATCHED) {
 			log_info_("Ack received.  Interface mode for port " + 
 				com_port + " set to: " + rx_mode + " " + tx_mode);
+		} else if (result == WAIT_REJECTED) {
+			log_error_("Interface mode command rejected: " + reply);
 		} else {
 			log_error_("No acknowledgement received for interface mode command.");
+			TriggerFlightRecorder(FLIGHT_TRIGGER_ACK_TIMEOUT);
 		}
 	} catch (std::exception &e) {
 		std::stringstream output;
@@ -829,15 +1307,16 @@ void Novatel::ConfigureBaudRate(std::string com_port, int baudrate) {
 		// ex: COM com1 9600 n 8 1 n off on
 		std::stringstream cmd;
 		cmd << "COM " << com_port << " " << baudrate << " n 8 1 n off on\r\n";
-		serial_port_->write(cmd.str());
-		// wait for acknowledgement (or 2 seconds)
-		boost::mutex::scoped_lock lock(ack_mutex_);
-		boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(2000);
-		if (ack_condition_.timed_wait(lock,timeout)) {
+		// send it and wait for acknowledgement (or 2 seconds)
+		std::string reply;
+		WaitResult result = WriteCommandAndWait(cmd.str(), reply);
+		if (result == WAIT_MATCHED) {
 			std::stringstream log_out;
 			log_out << "Ack received.  Baud rate on com port " <<
 				com_port << " set to " << baudrate << std::endl;
 			log_info_(log_out.str());
+		} else if (result == WAIT_REJECTED) {
+			log_error_("Com configure command rejected: " + reply);
 		} else {
 			log_error_("No acknowledgement received for com configure command.");
 		}
@@ -858,18 +1337,18 @@ bool Novatel::UpdateVersion()
 
 	try {
 		// clear port
-		serial_port_->flush();
+		transport_->Flush();
 		// read out any data currently in the buffer
-		std::string read_data = serial_port_->read(5000);
+		std::string read_data = transport_->ReadString(5000);
 		while (read_data.length())
-			read_data = serial_port_->read(5000);
+			read_data = transport_->ReadString(5000);
 
 		// send request for version
-		serial_port_->write("log versiona once\r\n");
+		WriteToPort("log versiona once\r\n");
 		// wait for response from the receiver
 		boost::this_thread::sleep(boost::posix_time::milliseconds(500));
 		// read from the serial port until a new line character is seen
-		std::string gps_response = serial_port_->read(15000);
+		std::string gps_response = transport_->ReadString(15000);
 
 		std::vector<std::string> packets;
 
@@ -1004,31 +1483,85 @@ bool Novatel::ParseVersion(std::string packet) {
 void Novatel::StartReading() {
 	if (reading_status_)
 		return;
+#ifdef __linux__
+	// lock before the threads are created so their stacks are locked too
+	if (scheduling_.lock_memory && (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)) {
+		std::stringstream output;
+		output << "Could not lock memory: " << strerror(errno);
+		log_warning_(output.str());
+	}
+#endif
 	// create thread to read from sensor
 	reading_status_=true;
+	device_lost_=false;
 	read_thread_ptr_ = boost::shared_ptr<boost::thread >
 		(new boost::thread(boost::bind(&Novatel::ReadSerialPort, this)));
+	supervisor_thread_ptr_ = boost::shared_ptr<boost::thread >
+		(new boost::thread(boost::bind(&Novatel::SuperviseSerialPort, this)));
 }
 
 void Novatel::StopReading() {
-	reading_status_=false;
+	{
+		boost::mutex::scoped_lock lock(supervisor_mutex_);
+		reading_status_=false;
+	}
+	// wake the read thread if it is parked and the supervisor if it is idle
+	supervisor_condition_.notify_all();
+
+	// wait for both threads unless called from one of them (e.g. a callback)
+	if (read_thread_ptr_ && (read_thread_ptr_->get_id() != boost::this_thread::get_id()))
+		read_thread_ptr_->join();
+	if (supervisor_thread_ptr_ && (supervisor_thread_ptr_->get_id() != boost::this_thread::get_id()))
+		supervisor_thread_ptr_->join();
+	// nothing can complete them once reading has stopped
+	waiters_.CancelAll();
 }
 
 void Novatel::ReadSerialPort() {
 	unsigned char buffer[MAX_NOUT_SIZE];
+	struct iovec iov[2];
 	size_t len;
 	log_info_("Started read thread.");
+	ApplyThreadScheduling();
+	if (scheduling_.lock_memory)
+		memset(buffer, 0, sizeof(buffer));
 
 	// continuously read data from serial port
 	while (reading_status_) {
 		try {
-			// read data
-			len = serial_port_->read(buffer, MAX_NOUT_SIZE);
+			// in the middle of a binary frame the rest of its body (all but
+			// the final byte, which triggers the parse) is read straight into
+			// the demultiplexer; anything after it goes to the local buffer
+			size_t direct = demux_.direct_fill_size();
+			iov[0].iov_base = demux_.direct_fill_buffer();
+			iov[0].iov_len = direct;
+			iov[1].iov_base = buffer;
+			iov[1].iov_len = MAX_NOUT_SIZE;
+			len = transport_->ReadV(iov, 2);
+			if (scheduling_.measure_latency && (len > 0)) {
+				// from when the wait for data ended, not when the read returned
+				read_wakeup_us_ = transport_->wakeup_time_us();
+				if (read_wakeup_us_ == 0)
+					read_wakeup_us_ = MonotonicMicroseconds();
+			}
+
+			size_t framed = std::min(len, direct);
+			if (recorder_)
+				RecordData((unsigned char*)iov[0].iov_base, framed, buffer, len-framed);
+			if (stream_server_)
+				ServeRawData((unsigned char*)iov[0].iov_base, framed, buffer, len-framed);
+			if (flight_recorder_)
+				FlightRecordData((unsigned char*)iov[0].iov_base, framed, buffer, len-framed);
+			demux_.DirectFilled(framed);
+			len -= framed;
 		} catch (std::exception &e) {
 	        std::stringstream output;
 	        output << "Error reading from serial port: " << e.what();
 	        log_error_(output.str());
-	        //return;
+	        // the device is gone, wait for the supervisor to bring it back
+	        // rather than spinning on a dead port
+	        ParkReadThread();
+	        continue;
     	}
 		// timestamp the read
 		if (time_handler_) 
@@ -1040,130 +1573,691 @@ void Novatel::ReadSerialPort() {
 		// add data to the buffer to be parsed
 		BufferIncomingData(buffer, len);
 	}
-	
+	// deliver whatever was still collecting for the batch window
+	if (batch_callback_ && !batch_.empty())
+		FlushBatch();
+}
+
+bool Novatel::StartRecording(std::string path, RecorderConfig config) {
+	Recorder *recorder = new Recorder();
+	try {
+		recorder->Open(path, config);
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error starting recording to " << path << ": " << e.what();
+		log_error_(output.str());
+		delete recorder;
+		return false;
+	}
+	StopRecording();
+	boost::mutex::scoped_lock lock(recorder_mutex_);
+	recorder_ = recorder;
+	log_info_("Recording receiver data to " + path);
+	return true;
+}
+
+void Novatel::StopRecording() {
+	Recorder *recorder;
+	{
+		boost::mutex::scoped_lock lock(recorder_mutex_);
+		recorder = recorder_;
+		recorder_ = NULL;
+	}
+	if (recorder == NULL)
+		return;
+	// closing waits for the last blocks to reach the disk, so it happens
+	// outside the lock the read thread takes
+	recorder->Close();
+	boost::mutex::scoped_lock lock(recorder_mutex_);
+	recorder_stats_ = recorder->stats();
+	delete recorder;
+}
+
+RecorderStats Novatel::GetRecorderStats() {
+	boost::mutex::scoped_lock lock(recorder_mutex_);
+	if (recorder_)
+		return recorder_.load()->stats();
+	return recorder_stats_;
+}
+
+void Novatel::RecordData(const unsigned char *framed, size_t framed_length,
+                         const unsigned char *buffered, size_t buffered_length) {
+	boost::mutex::scoped_lock lock(recorder_mutex_);
+	Recorder *recorder = recorder_;
+	if (recorder == NULL)
+		return;
+	recorder->Write(framed, framed_length);
+	recorder->Write(buffered, buffered_length);
+}
+
+bool Novatel::StartStreamServer(const std::vector<std::string> &endpoints, StreamServerConfig config) {
+	FanoutServer *server = new FanoutServer(config.ring_size, config.max_clients);
+	try {
+		for (size_t ii=0; ii<endpoints.size(); ii++)
+			server->AddEndpoint(endpoints[ii]);
+		server->Start();
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error starting stream server: " << e.what();
+		log_error_(output.str());
+		delete server;
+		return false;
+	}
+	StopStreamServer();
+	boost::mutex::scoped_lock lock(stream_server_mutex_);
+	stream_config_ = config;
+	stream_server_ = server;
+	std::stringstream output;
+	output << "Serving " << (config.raw ? "raw receiver data" : "receiver frames") << " on";
+	for (size_t ii=0; ii<endpoints.size(); ii++)
+		output << " " << endpoints[ii];
+	log_info_(output.str());
+	return true;
+}
+
+void Novatel::StopStreamServer() {
+	FanoutServer *server;
+	{
+		boost::mutex::scoped_lock lock(stream_server_mutex_);
+		server = stream_server_;
+		stream_server_ = NULL;
+	}
+	// stopping joins the server thread, outside the lock the read thread takes
+	delete server;
+}
+
+FanoutStats Novatel::GetStreamServerStats() {
+	boost::mutex::scoped_lock lock(stream_server_mutex_);
+	if (stream_server_)
+		return stream_server_.load()->Stats();
+	FanoutStats stats;
+	memset(&stats, 0, sizeof(stats));
+	return stats;
+}
+
+void Novatel::ServeRawData(const unsigned char *framed, size_t framed_length,
+                           const unsigned char *buffered, size_t buffered_length) {
+	boost::mutex::scoped_lock lock(stream_server_mutex_);
+	FanoutServer *server = stream_server_;
+	if ((server == NULL) || !stream_config_.raw)
+		return;
+	server->Publish(framed, framed_length);
+	server->Publish(buffered, buffered_length);
+}
+
+void Novatel::ServeFrame(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id) {
+	boost::mutex::scoped_lock lock(stream_server_mutex_);
+	FanoutServer *server = stream_server_;
+	if ((server == NULL) || stream_config_.raw)
+		return;
+	if (!stream_config_.message_ids.empty() && !stream_config_.message_ids.count(message_id))
+		return;
+	server->Publish(frame, length);
+}
+
+bool Novatel::StartFlightRecorder(const FlightRecorderConfig &config) {
+	FlightRecorder *recorder;
+	try {
+		recorder = new FlightRecorder(config);
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error starting flight recorder: " << e.what();
+		log_error_(output.str());
+		return false;
+	}
+	recorder->set_dump_callback(boost::bind(&Novatel::OnFlightRecorderDump, this, _1, _2, _3));
+	StopFlightRecorder();
+	boost::mutex::scoped_lock lock(flight_recorder_mutex_);
+	flight_recorder_ = recorder;
+	std::stringstream output;
+	output << "Flight recorder keeping " << config.window << " s of frames, dumps to " << config.directory;
+	log_info_(output.str());
+	return true;
+}
+
+void Novatel::StopFlightRecorder() {
+	FlightRecorder *recorder;
+	{
+		boost::mutex::scoped_lock lock(flight_recorder_mutex_);
+		recorder = flight_recorder_;
+		flight_recorder_ = NULL;
+	}
+	// waits for a pending dump, outside the lock the read thread takes
+	delete recorder;
+}
+
+bool Novatel::TriggerFlightRecorder(FlightTrigger trigger) {
+	boost::mutex::scoped_lock lock(flight_recorder_mutex_);
+	if (flight_recorder_ == NULL)
+		return false;
+	return flight_recorder_.load()->Trigger(trigger);
+}
+
+FlightRecorderStats Novatel::GetFlightRecorderStats() {
+	boost::mutex::scoped_lock lock(flight_recorder_mutex_);
+	if (flight_recorder_)
+		return flight_recorder_.load()->stats();
+	return FlightRecorderStats();
+}
+
+void Novatel::FlightRecordData(const unsigned char *framed, size_t framed_length,
+                               const unsigned char *buffered, size_t buffered_length) {
+	boost::mutex::scoped_lock lock(flight_recorder_mutex_);
+	FlightRecorder *recorder = flight_recorder_;
+	if (recorder == NULL)
+		return;
+	recorder->AddData(framed, framed_length);
+	recorder->AddData(buffered, buffered_length);
+}
+
+void Novatel::OnFlightRecorderDump(FlightTrigger trigger, const std::string &path, bool written) {
+	if (written)
+		log_warning_(std::string("Flight recorder dump for ") + FlightTriggerName(trigger) + " written to " + path);
+	else
+		log_error_(std::string("Could not write flight recorder dump for ") + FlightTriggerName(trigger) + " to " + path);
+}
+
+void Novatel::ParkReadThread() {
+	boost::mutex::scoped_lock lock(supervisor_mutex_);
+	if (!reading_status_)
+		return;
+	device_lost_ = true;
+	supervisor_condition_.notify_all();
+	while (device_lost_ && reading_status_) {
+		// no reads end to time out the waits while parked, so wake for them
+		if (!supervisor_condition_.timed_wait(lock, boost::posix_time::milliseconds(50))) {
+			lock.unlock();
+			waiters_.Expire();
+			lock.lock();
+		}
+	}
+	// a partial frame from before the gap can not be completed
+	demux_.Reset();
+}
+
+void Novatel::SuperviseSerialPort() {
+	while (reading_status_) {
+		// sleep until the read thread reports a problem
+		{
+			boost::mutex::scoped_lock lock(supervisor_mutex_);
+			while (!device_lost_ && reading_status_)
+				supervisor_condition_.wait(lock);
+		}
+		if (!reading_status_)
+			break;
+
+		boost::system_time gap_start = boost::get_system_time();
+		std::stringstream lost_msg;
+		lost_msg << "Lost connection to " << port_name_ << ". Waiting for it to return.";
+		log_warning_(lost_msg.str());
+
+		try {
+			transport_->Close();
+		} catch (std::exception &e) {
+			;
+		}
+
+		if (!ReopenSerialPort())
+			break;
+
+		// let the read thread continue
+		uint32_t frames_before = valid_frame_count_;
+		{
+			boost::mutex::scoped_lock lock(supervisor_mutex_);
+			device_lost_ = false;
+		}
+		supervisor_condition_.notify_all();
+
+		// if only the link was lost the receiver is still logging, otherwise
+		// it was power cycled and the logs have to be requested again
+		if (!WaitForValidFrame(frames_before, 1500) && reading_status_) {
+			std::vector<std::string> logs;
+			{
+				boost::mutex::scoped_lock lock(configured_logs_mutex_);
+				logs = configured_logs_;
+			}
+			// logs that were already running when attaching are only seen on
+			// the stream, which does not tell ONTIME logs from ONCHANGED ones
+			std::vector<std::string> configured_names;
+			for (size_t ii=0; ii<logs.size(); ii++)
+				configured_names.push_back(LogNameOf(logs[ii]));
+			std::stringstream unknown;
+			std::vector<LogActivity> active = GetActiveLogs();
+			for (size_t ii=0; ii<active.size(); ii++) {
+				if (std::find(configured_names.begin(), configured_names.end(), active[ii].name) != configured_names.end())
+					continue;
+				if (active[ii].name.empty())
+					unknown << " " << active[ii].message_id;
+				else
+					unknown << " " << active[ii].name;
+			}
+			if (!unknown.str().empty())
+				log_warning_("Receiver is not streaming. Logs not requested with ConfigureLogs are not restored:" + unknown.str());
+			if (!logs.empty())
+				log_info_("Receiver is not streaming. Restoring log configuration.");
+			for (size_t ii=0; (ii<logs.size()) && reading_status_; ii++)
+				ConfigureLogs(logs[ii]);
+			WaitForValidFrame(frames_before, 2000);
+		}
+
+		double gap = (double)(boost::get_system_time() - gap_start).total_milliseconds()/1000.0;
+		last_gap_duration_ = gap;
+		reconnect_count_++;
+		std::stringstream gap_msg;
+		gap_msg << "Connection to " << port_name_ << " recovered after a gap of "
+		        << gap << " s.";
+		log_warning_(gap_msg.str());
+		if (device_gap_callback_)
+			device_gap_callback_(gap);
+	}
+}
+
+bool Novatel::ReopenSerialPort() {
+	int backoff_ms = 100;
+	while (reading_status_) {
+		try {
+			transport_->Open();
+			if (transport_->IsOpen()) {
+				transport_->Flush();
+				return true;
+			}
+		} catch (std::exception &e) {
+			NOVATEL_LOG(log_debug_, "Could not reopen " << port_name_ << ": " << e.what());
+		}
+
+		// wait in short slices so StopReading is not held up by the backoff
+		boost::system_time const retry = boost::get_system_time() + boost::posix_time::milliseconds(backoff_ms);
+		bool missing = !DeviceExists(transport_->device_path());
+		while (reading_status_ && (boost::get_system_time() < retry)) {
+			int remaining = std::max(1, std::min((int)(retry - boost::get_system_time()).total_milliseconds(), 100));
+			// a device that is there but would not open waits out the backoff
+			if (!missing)
+				boost::this_thread::sleep(boost::posix_time::milliseconds(remaining));
+			// a new device node showed up, try right away
+			else if (WaitForDeviceChange(transport_->device_path(), remaining))
+				break;
+		}
+		backoff_ms = std::min(backoff_ms*2, max_reconnect_backoff_ms_);
+	}
+	return false;
+}
+
+bool Novatel::WaitForValidFrame(uint32_t start_count, int timeout_ms) {
+	boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(timeout_ms);
+	while (reading_status_ && (valid_frame_count_ == start_count) && (boost::get_system_time() < timeout))
+		boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+	return valid_frame_count_ != start_count;
+}
+
+void Novatel::ApplyThreadScheduling() {
+#ifdef __linux__
+	if (scheduling_.cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(scheduling_.cpu, &cpus);
+		int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		std::stringstream output;
+		if (result == 0) {
+			output << "Read thread pinned to cpu " << scheduling_.cpu << ".";
+			log_info_(output.str());
+		} else {
+			output << "Could not pin read thread to cpu " << scheduling_.cpu << ": " << strerror(result);
+			log_warning_(output.str());
+		}
+	}
+	if (scheduling_.priority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = scheduling_.priority;
+		int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		std::stringstream output;
+		if (result == 0) {
+			output << "Read thread running SCHED_FIFO at priority " << scheduling_.priority << ".";
+			log_info_(output.str());
+		} else {
+			output << "Could not set SCHED_FIFO priority " << scheduling_.priority << ": " << strerror(result);
+			log_warning_(output.str());
+		}
+	}
+#else
+	if ((scheduling_.cpu >= 0) || (scheduling_.priority > 0))
+		log_warning_("Read thread affinity and priority are only supported on Linux.");
+#endif
+	if (scheduling_.lock_memory) {
+		// map everything the hot path touches before the first frame arrives
+		PrefaultStack();
+	}
+}
+
+void Novatel::RecordDispatchLatency(uint64_t frames) {
+	uint64_t latency = MonotonicMicroseconds() - read_wakeup_us_;
+	boost::mutex::scoped_lock lock(latency_mutex_);
+	latency_samples_ += frames;
+	latency_total_us_ += latency*frames;
+	if (latency > latency_max_us_)
+		latency_max_us_ = latency;
+}
+
+DispatchLatency Novatel::GetDispatchLatency() {
+	boost::mutex::scoped_lock lock(latency_mutex_);
+	DispatchLatency latency;
+	latency.samples = latency_samples_;
+	latency.mean_us = latency_samples_ ? (double)latency_total_us_/latency_samples_ : 0;
+	latency.max_us = (double)latency_max_us_;
+	return latency;
+}
+
+void Novatel::ResetDispatchLatency() {
+	boost::mutex::scoped_lock lock(latency_mutex_);
+	latency_samples_ = 0;
+	latency_total_us_ = 0;
+	latency_max_us_ = 0;
 }
 
 void Novatel::ReadFromFile(unsigned char* buffer, unsigned int length)
 {
+	if (scheduling_.measure_latency)
+		read_wakeup_us_ = MonotonicMicroseconds();
+	if (flight_recorder_)
+		FlightRecordData(buffer, length, NULL, 0);
 	BufferIncomingData(buffer, length);
 }
 
 void Novatel::BufferIncomingData(unsigned char *message, unsigned int length)
 {
+	demux_.AddData(message, length);
+	if (flight_recorder_) {
+		boost::mutex::scoped_lock lock(flight_recorder_mutex_);
+		FlightRecorder *recorder = flight_recorder_;
+		if (recorder)
+			recorder->AddCrcErrors(demux_.counters().novatel_binary.errors);
+	}
+	if (batch_callback_ && !batch_.empty() &&
+	    ((batch_window_us_ == 0) || (MonotonicMicroseconds() - batch_start_us_ >= batch_window_us_)))
+		FlushBatch();
+	if (!normal_logs_.empty()) {
+		DispatchLogs(normal_logs_, lane_frame_, scheduling_.measure_latency);
+		normal_logs_.Clear();
+	}
+	waiters_.Expire();
+}
+
+void Novatel::FlushBatch() {
+	batch_callback_(batch_);
+	if (scheduling_.measure_latency)
+		RecordDispatchLatency(batch_.size());
+	batch_.Clear();
+}
 
-	// add incoming data to buffer
-	for (unsigned int ii=0; ii<length; ii++) {
-		// make sure bufIndex is not larger than buffer
-		if (buffer_index_ >= MAX_NOUT_SIZE) {
-			buffer_index_=0;
-            log_warning_("Overflowed receive buffer. Buffer cleared.");
+void Novatel::OnNovatelBinary(unsigned char *frame, size_t length) {
+	valid_frame_count_++;
+	BINARY_LOG_TYPE message_id = BINARY_LOG_TYPE((frame[5] << 8) + frame[4]);
+	UpdateLogActivity(frame, message_id);
+	// cached on the read thread whichever thread dispatches the callback
+	latest_.Store(frame, length, message_id, read_timestamp_);
+	waiters_.OnFrame(frame, length, message_id, read_timestamp_);
+	restart_tracker_.AddFrame(frame, length, message_id);
+	if (stream_server_)
+		ServeFrame(frame, length, message_id);
+	if (flight_recorder_) {
+		boost::mutex::scoped_lock lock(flight_recorder_mutex_);
+		FlightRecorder *recorder = flight_recorder_;
+		if (recorder)
+			recorder->CheckFrame(frame, length, message_id);
+	}
+	if (batch_callback_) {
+		if (batch_.empty())
+			batch_start_us_ = MonotonicMicroseconds();
+		batch_.Add(frame, length, message_id, read_timestamp_);
+		return;
+	}
+	LogPriority priority = LOG_PRIORITY_NORMAL;
+	if (!log_priorities_.empty()) {
+		std::map<BINARY_LOG_TYPE, LogPriority>::const_iterator it = log_priorities_.find(message_id);
+		if (it != log_priorities_.end())
+			priority = it->second;
+	}
+	if (executor_ && (priority != LOG_PRIORITY_HIGH)) {
+		boost::mutex::scoped_lock lock(executor_mutex_);
+		if (executor_) {
+			executor_->Post(frame, length, message_id, read_timestamp_);
+			return;
+		}
+	}
+	if (!log_priorities_.empty()) {
+		if (priority == LOG_PRIORITY_LOW) {
+			DeferLog(frame, length, message_id);
+			return;
+		} else if (priority == LOG_PRIORITY_NORMAL) {
+			// held until the rest of the read has been framed
+			normal_logs_.Add(frame, length, message_id, read_timestamp_);
+			return;
 		}
+	}
+	ParseBinary(frame, length, message_id, read_timestamp_);
+	if (scheduling_.measure_latency)
+		RecordDispatchLatency();
+}
 
-		if (buffer_index_ == 0) {	// looking for beginning of message
-            if (message[ii] == NOVATEL_SYNC_BYTE_1) {	// beginning of msg found - add to buffer
-				data_buffer_[buffer_index_++] = message[ii];
-				bytes_remaining_ = 0;
-            } else if (message[ii] == NOVATEL_ACK_BYTE_1) {
-				// received beginning of acknowledgement
-				reading_acknowledgement_ = true;
-				buffer_index_ = 1;
-            } else if ((message[ii] == NOVATEL_RESET_BYTE_1) && waiting_for_reset_complete_) {
-                // received {COM#} acknowledging receiver reset complete
-                reading_reset_complete_ = true;
-                buffer_index_ = 1;
-			} else {
-        //log_debug_("BufferIncomingData::Received unknown data.");
-			}
-		} else if (buffer_index_ == 1) {	// verify 2nd character of header
-            if (message[ii] == NOVATEL_SYNC_BYTE_2) {	// 2nd byte ok - add to buffer
-				data_buffer_[buffer_index_++] = message[ii];
-            } else if ( (message[ii] == NOVATEL_ACK_BYTE_2) && reading_acknowledgement_ ) {
-				// 2nd byte of acknowledgement
-				buffer_index_ = 2;
-            } else if ((message[ii] == NOVATEL_RESET_BYTE_2) && reading_reset_complete_) {
-                // 2nd byte of receiver reset complete message
-                buffer_index_ = 2;
-			} else {
-				// start looking for new message again
-				buffer_index_ = 0;
-				bytes_remaining_=0;
-				reading_acknowledgement_=false;
-                reading_reset_complete_=false;
-			} // end if (msg[i]==0x44)
-		} else if (buffer_index_ == 2) {	// verify 3rd character of header
-            if (message[ii] == NOVATEL_SYNC_BYTE_3) {	// 2nd byte ok - add to buffer
-				data_buffer_[buffer_index_++] = message[ii];
-            } else if ( (message[ii] == NOVATEL_ACK_BYTE_3) && (reading_acknowledgement_) ) {
-                log_info_("RECEIVED AN ACK.");
-				// final byte of acknowledgement received
-				buffer_index_ = 0;
-				reading_acknowledgement_ = false;
-				boost::lock_guard<boost::mutex> lock(ack_mutex_);
-				ack_received_ = true;
-				ack_condition_.notify_all();
-
-				// ACK received
-				handle_acknowledgement_();
-            } else if ((message[ii] == NOVATEL_RESET_BYTE_3) && reading_reset_complete_) {
-                // 3rd byte of receiver reset complete message
-                buffer_index_ = 3;
-			} else {
-				// start looking for new message again
-				buffer_index_ = 0;
-				bytes_remaining_ = 0;
-				reading_acknowledgement_ = false;
-                reading_reset_complete_ = false;
-			} // end if (msg[i]==0x12)
-		} else if (buffer_index_ == 3) {	// number of bytes in header - not including sync
-            if((message[ii] == NOVATEL_RESET_BYTE_4) && (message[ii+2] == NOVATEL_RESET_BYTE_6)
-                    && reading_reset_complete_ && waiting_for_reset_complete_) {
-                // 4th byte of receiver reset complete message
-//                log_info_("RECEIVER RESET COMPLETE RECEIVED.");
-                buffer_index_ = 0;
-                reading_reset_complete_ = false;
-                boost::lock_guard<boost::mutex> lock(reset_mutex_);
-                waiting_for_reset_complete_ = false;
-                reset_condition_.notify_all();
+void Novatel::set_log_priority(BINARY_LOG_TYPE message_id, LogPriority priority) {
+	if (priority == LOG_PRIORITY_NORMAL)
+		log_priorities_.erase(message_id);
+	else
+		log_priorities_[message_id] = priority;
+}
 
-            } else {
-                reading_reset_complete_ = false;
-                data_buffer_[buffer_index_++] = message[ii];
-                // length of header is in byte 4
-                header_length_ = message[ii];
-            }
-		} else if (buffer_index_ == 5) { // get message id
-			data_buffer_[buffer_index_++] = message[ii];
-			bytes_remaining_--;
-			message_id_ = BINARY_LOG_TYPE( ((data_buffer_[buffer_index_-1]) << 8) + data_buffer_[buffer_index_-2] );
-		// } else if (buffer_index_ == 8) {	// set number of bytes
-		// 	data_buffer_[buffer_index_++] = message[ii];
-		// 	// length of message is in byte 8
-		// 	// bytes remaining = remainder of header  + 4 byte checksum + length of body
-		// 	// TODO: added a -2 to make things work right, figure out why i need this
-		// 	bytes_remaining_ = message[ii] + 4 + (header_length_-7) - 2;
-		} else if (buffer_index_ == 9) {
-			data_buffer_[buffer_index_++] = message[ii];
-			bytes_remaining_ = (header_length_ - 10) + 4 + (data_buffer_[9] << 8) + data_buffer_[8];
-		} else if (bytes_remaining_ == 1) {	// add last byte and parse
-			data_buffer_[buffer_index_++] = message[ii];
-			// BINARY_LOG_TYPE message_id = (BINARY_LOG_TYPE) (((data_buffer_[5]) << 8) + data_buffer_[4]);
-			// log_info_("Sending to ParseBinary");
-			ParseBinary(data_buffer_, buffer_index_, message_id_);
-			// reset counters
-			buffer_index_ = 0;
-			bytes_remaining_ = 0;
-		} else {	// add data to buffer
-			data_buffer_[buffer_index_++] = message[ii];
-			bytes_remaining_--;
+void Novatel::UseDefaultLogPriorities() {
+	BINARY_LOG_TYPE high[] = {INSPVA_LOG_TYPE, INSPVAS_LOG_TYPE, BESTPOSB_LOG_TYPE, BESTUTMB_LOG_TYPE,
+		BESTVELB_LOG_TYPE, BESTXYZB_LOG_TYPE, PSRPOSB_LOG_TYPE, RTKPOSB_LOG_TYPE, BESTGPSPOS_LOG_TYPE,
+		BESTGPSVEL_LOG_TYPE, INSSPD_LOG_TYPE, RAWIMU_LOG_TYPE, RAWIMUS_LOG_TYPE};
+	BINARY_LOG_TYPE low[] = {ALMANACB_LOG_TYPE, RAWALMB_LOG_TYPE, GPSEPHEMB_LOG_TYPE, RAWEPHEMB_LOG_TYPE,
+		RANGEB_LOG_TYPE, RANGECMPB_LOG_TYPE, SATXYZB_LOG_TYPE, SATVISB_LOG_TYPE, TRACKSTATB_LOG_TYPE,
+		IONUTCB_LOG_TYPE};
+	for (size_t ii=0; ii<sizeof(high)/sizeof(high[0]); ii++)
+		set_log_priority(high[ii], LOG_PRIORITY_HIGH);
+	for (size_t ii=0; ii<sizeof(low)/sizeof(low[0]); ii++)
+		set_log_priority(low[ii], LOG_PRIORITY_LOW);
+}
+
+void Novatel::DeferLog(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id) {
+	boost::mutex::scoped_lock lock(deferred_mutex_);
+	if (!deferred_running_) {
+		if (deferred_thread_.joinable()) {
+			// a stopped worker needs the lock to finish
+			lock.unlock();
+			deferred_thread_.join();
+			lock.lock();
 		}
-	}	// end for
+		deferred_running_ = true;
+		deferred_thread_ = boost::thread(&Novatel::DispatchDeferredLogs, this);
+	}
+	if (deferred_logs_.size() >= MAX_DEFERRED_LOGS) {
+		deferred_dropped_count_++;
+		return;
+	}
+	deferred_logs_.Add(frame, length, message_id, read_timestamp_);
+	deferred_condition_.notify_all();
+}
+
+void Novatel::DispatchLogs(const FrameBatch &logs, std::vector<unsigned char> &frame, bool measure_latency) {
+	// the decoders expect a frame at the start of a full size buffer, as
+	// it is in the demultiplexer
+	for (size_t ii=0; ii<logs.size(); ii++) {
+		memcpy(&frame[0], logs.frame(ii), logs.length(ii));
+		ParseBinary(&frame[0], logs.length(ii), logs.id(ii), logs.timestamp(ii));
+		if (measure_latency)
+			RecordDispatchLatency();
+	}
 }
 
-void Novatel::ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE message_id) {
+void Novatel::DispatchDeferredLogs() {
+	FrameBatch logs;
+	std::vector<unsigned char> frame(MAX_NOUT_SIZE);
+	boost::mutex::scoped_lock lock(deferred_mutex_);
+	while (true) {
+		while (deferred_running_ && deferred_logs_.empty())
+			deferred_condition_.wait(lock);
+		if (deferred_logs_.empty())
+			break;	// stopped and drained
+		logs.Swap(deferred_logs_);
+		deferred_busy_ = true;
+		lock.unlock();
+		try {
+			DispatchLogs(logs, frame);
+		} catch (std::exception &e) {
+			std::stringstream output;
+			output << "Error parsing low priority log: " << e.what();
+			log_error_(output.str());
+		}
+		logs.Clear();
+		lock.lock();
+		deferred_busy_ = false;
+		deferred_condition_.notify_all();
+	}
+}
+
+void Novatel::WaitForDeferredLogs() {
+	{
+		boost::mutex::scoped_lock lock(deferred_mutex_);
+		while (!deferred_logs_.empty() || deferred_busy_)
+			deferred_condition_.wait(lock);
+	}
+	boost::mutex::scoped_lock lock(executor_mutex_);
+	if (executor_)
+		executor_->Wait();
+}
+
+void Novatel::StartCallbackExecutor(size_t threads, size_t max_queued) {
+	StopCallbackExecutor();
+	CallbackExecutor *executor = new CallbackExecutor(boost::bind(&Novatel::ParseBinary, this, _1, _2, _3, _4),
+	                                                  threads, MAX_NOUT_SIZE, max_queued);
+	boost::mutex::scoped_lock lock(executor_mutex_);
+	executor_ = executor;
+}
+
+void Novatel::StopCallbackExecutor() {
+	CallbackExecutor *executor;
+	{
+		boost::mutex::scoped_lock lock(executor_mutex_);
+		executor = executor_;
+		executor_ = NULL;
+	}
+	// deleting the executor runs everything still queued, outside the lock
+	// so the read thread can dispatch on its own meanwhile
+	delete executor;
+}
+
+std::vector<ExecutorStats> Novatel::GetExecutorStats() {
+	boost::mutex::scoped_lock lock(executor_mutex_);
+	if (executor_)
+		return executor_->stats();
+	return std::vector<ExecutorStats>();
+}
+
+void Novatel::StopDeferredWorker() {
+	{
+		boost::mutex::scoped_lock lock(deferred_mutex_);
+		deferred_running_ = false;
+		deferred_condition_.notify_all();
+	}
+	if (deferred_thread_.joinable() && (deferred_thread_.get_id() != boost::this_thread::get_id()))
+		deferred_thread_.join();
+}
+
+void Novatel::OnNovatelAscii(const char *sentence, size_t length) {
+	if (ascii_log_callback_) {
+		// sentence_ has room for the longest sentence, so this never allocates
+		sentence_.assign(sentence, length);
+		ascii_log_callback_(sentence_, read_timestamp_);
+	}
+}
+
+void Novatel::OnNmea(const char *sentence, size_t length) {
+	if (nmea_callback_) {
+		sentence_.assign(sentence, length);
+		nmea_callback_(sentence_, read_timestamp_);
+	}
+}
+
+void Novatel::OnRtcm3(const unsigned char *frame, size_t length) {
+	if (rtcm3_output_callback_)
+		rtcm3_output_callback_(frame, length);
+}
+
+void Novatel::OnAcknowledgement() {
+	static const std::string ack_message("RECEIVED AN ACK.");
+	log_info_(ack_message);
+	waiters_.OnAcknowledgement(read_timestamp_);
+	handle_acknowledgement_();
+}
+
+void Novatel::OnCommandError(const char *reply, size_t length) {
+	// logged by whoever sent the command, the read thread does not allocate
+	waiters_.OnCommandError(reply, length, read_timestamp_);
+}
+
+void Novatel::OnPrompt(const char *prompt, size_t length) {
+	// the port prompt, e.g. "[COM1]", is sent once the receiver is back up
+	// after a reset
+	if ((length < 4) || (strncmp(prompt+1, "COM", 3) != 0))
+		return;
+	restart_tracker_.AddBanner();
+	if (!waiting_for_reset_complete_)
+		return;
+	boost::lock_guard<boost::mutex> lock(reset_mutex_);
+	waiting_for_reset_complete_ = false;
+	reset_condition_.notify_all();
+}
+
+void Novatel::OnRestartMilestone(RestartMilestone milestone, PositionType type, double seconds) {
+	if (logger_.Enabled(LOG_LEVEL_INFO)) {
+		std::stringstream output;
+		output.setf(std::ios::fixed);
+		output.precision(2);
+		switch (milestone) {
+			case RESTART_BANNER: output << "Receiver banner"; break;
+			case RESTART_COARSE_TIME: output << "Coarse GPS time"; break;
+			case RESTART_FINE_TIME: output << "Fine GPS time"; break;
+			case RESTART_FIRST_FIX: output << "First " << PositionTypeName(type) << " fix"; break;
+			case RESTART_INS_ALIGNED: output << "INS aligned"; break;
+		}
+		output << " " << seconds << " s after reset.";
+		log_info_(output.str());
+	}
+	if (restart_milestone_callback_)
+		restart_milestone_callback_(milestone, type, seconds);
+}
+
+void Novatel::UpdateLogActivity(unsigned char *message, BINARY_LOG_TYPE message_id) {
+	Oem4BinaryHeader header;
+	memcpy(&header, message, sizeof(header));
+
+	double gps_seconds = header.gps_millisecs/1000.0;
+
+	boost::mutex::scoped_lock lock(log_activity_mutex_);
+	std::map<uint16_t, LogActivity>::iterator it = log_activity_.find(message_id);
+	if (it == log_activity_.end()) {
+		LogActivity activity;
+		activity.message_id = message_id;
+		activity.name = LookupBinaryLogName(message_id);
+		activity.count = 0;
+		activity.period = 0;
+		activity.gps_seconds = gps_seconds;
+		activity.last_timestamp = 0;
+		it = log_activity_.insert(std::make_pair((uint16_t)message_id, activity)).first;
+	} else if (gps_seconds > it->second.gps_seconds) {
+		// logs split over several frames (e.g. GPSEPHEMB) share one time tag
+		it->second.period = gps_seconds - it->second.gps_seconds;
+		it->second.gps_seconds = gps_seconds;
+	}
+	it->second.count++;
+	it->second.last_timestamp = read_timestamp_;
+}
+
+void Novatel::ParseBinary(const unsigned char *message, size_t length, BINARY_LOG_TYPE message_id, double timestamp) {
     //stringstream output;
     //output << "Parsing Log: " << message_id << endl;
     //log_debug_(output.str());
-		uint16_t payload_length;
 		uint16_t header_length;
 
 		// obtain the received crc
@@ -1172,193 +2266,136 @@ void Novatel::ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE
             Position best_gps;
             memcpy(&best_gps, message, sizeof(best_gps));
             if (best_gps_position_callback_)
-            	best_gps_position_callback_(best_gps, read_timestamp_);
+            	best_gps_position_callback_(best_gps, timestamp);
             break;
         case BESTLEVERARM_LOG_TYPE:
             BestLeverArm best_lever;
             memcpy(&best_lever, message, sizeof(best_lever));
             if (best_lever_arm_callback_)
-            	best_lever_arm_callback_(best_lever, read_timestamp_);
+            	best_lever_arm_callback_(best_lever, timestamp);
             break;
         case BESTPOSB_LOG_TYPE:
             Position best_pos;
             memcpy(&best_pos, message, sizeof(best_pos));
             if (best_position_callback_)
-            	best_position_callback_(best_pos, read_timestamp_);
+            	best_position_callback_(best_pos, timestamp);
             break;
         case BESTUTMB_LOG_TYPE:
             UtmPosition best_utm;
             memcpy(&best_utm, message, sizeof(best_utm));
             if (best_utm_position_callback_)
-           		best_utm_position_callback_(best_utm, read_timestamp_);
+           		best_utm_position_callback_(best_utm, timestamp);
             break;
         case BESTVELB_LOG_TYPE:
             Velocity best_vel;
             memcpy(&best_vel, message, sizeof(best_vel));
             if (best_velocity_callback_)
-            	best_velocity_callback_(best_vel, read_timestamp_);
+            	best_velocity_callback_(best_vel, timestamp);
             break;
         case BESTXYZB_LOG_TYPE:
             PositionEcef best_xyz;
             memcpy(&best_xyz, message, sizeof(best_xyz));
             if (best_position_ecef_callback_)
-            	best_position_ecef_callback_(best_xyz, read_timestamp_);
+            	best_position_ecef_callback_(best_xyz, timestamp);
             break;
         case INSPVA_LOG_TYPE:
             InsPositionVelocityAttitude ins_pva;
             memcpy(&ins_pva, message, sizeof(ins_pva));
             if (ins_position_velocity_attitude_callback_)
-            	ins_position_velocity_attitude_callback_(ins_pva, read_timestamp_);
+            	ins_position_velocity_attitude_callback_(ins_pva, timestamp);
             break;
         case INSPVAS_LOG_TYPE:
             InsPositionVelocityAttitudeShort ins_pva_short;
             memcpy(&ins_pva_short, message, sizeof(ins_pva_short));
             if (ins_position_velocity_attitude_short_callback_)
-            	ins_position_velocity_attitude_short_callback_(ins_pva_short, read_timestamp_);
+            	ins_position_velocity_attitude_short_callback_(ins_pva_short, timestamp);
             break;
         case VEHICLEBODYROTATION_LOG_TYPE:
             VehicleBodyRotation vehicle_body_rotation;
             memcpy(&vehicle_body_rotation, message, sizeof(vehicle_body_rotation));
             if (vehicle_body_rotation_callback_)
-            	vehicle_body_rotation_callback_(vehicle_body_rotation, read_timestamp_);
+            	vehicle_body_rotation_callback_(vehicle_body_rotation, timestamp);
             break;
         case INSSPD_LOG_TYPE:
             InsSpeed ins_speed;
             memcpy(&ins_speed, message, sizeof(ins_speed));
             if (ins_speed_callback_)
-            	ins_speed_callback_(ins_speed, read_timestamp_);
+            	ins_speed_callback_(ins_speed, timestamp);
             break;
         case RAWIMU_LOG_TYPE:
             RawImu raw_imu;
             memcpy(&raw_imu, message, sizeof(raw_imu));
             if (raw_imu_callback_)
-            	raw_imu_callback_(raw_imu, read_timestamp_);
+            	raw_imu_callback_(raw_imu, timestamp);
             break;
         case RAWIMUS_LOG_TYPE:
             RawImuShort raw_imu_s;
             memcpy(&raw_imu_s, message, sizeof(raw_imu_s));
             if (raw_imu_short_callback_)
-            	raw_imu_short_callback_(raw_imu_s, read_timestamp_);
+            	raw_imu_short_callback_(raw_imu_s, timestamp);
             break;
         case INSCOV_LOG_TYPE:
             InsCovariance ins_cov;
             memcpy(&ins_cov, message, sizeof(ins_cov));
             if (ins_covariance_callback_)
-            	ins_covariance_callback_(ins_cov, read_timestamp_);
+            	ins_covariance_callback_(ins_cov, timestamp);
             break;
         case INSCOVS_LOG_TYPE:
             InsCovarianceShort ins_cov_s;
             memcpy(&ins_cov_s, message, sizeof(ins_cov_s));
             if (ins_covariance_short_callback_)
-            	ins_covariance_short_callback_(ins_cov_s, read_timestamp_);
+            	ins_covariance_short_callback_(ins_cov_s, timestamp);
             break;
         case PSRDOPB_LOG_TYPE:
             Dop psr_dop;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) +
-                             ((uint16_t) *(message+8));
-
-            // Copy header and unrepeated fields
-            memcpy(&psr_dop, message, header_length+24);
-            //Copy repeated fields
-            memcpy(&psr_dop.prn, message+header_length+28, (4*psr_dop.number_of_prns));
-            //Copy CRC
-            memcpy(&psr_dop.crc, message+header_length+payload_length, 4);
-
+            DecodeBinaryLog(message, length, psr_dop);
             if (pseudorange_dop_callback_)
-            	pseudorange_dop_callback_(psr_dop, read_timestamp_);
+            	pseudorange_dop_callback_(psr_dop, timestamp);
             break;
         case RTKDOPB_LOG_TYPE:
             Dop rtk_dop;
-            memcpy(&rtk_dop, message, sizeof(rtk_dop));
+            DecodeBinaryLog(message, length, rtk_dop);
             if (rtk_dop_callback_)
-            	rtk_dop_callback_(rtk_dop, read_timestamp_);
+            	rtk_dop_callback_(rtk_dop, timestamp);
             break;
         case BSLNXYZ_LOG_TYPE:
             BaselineEcef baseline_xyz;
             memcpy(&baseline_xyz, message, sizeof(baseline_xyz));
             if (baseline_ecef_callback_)
-            	baseline_ecef_callback_(baseline_xyz, read_timestamp_);
+            	baseline_ecef_callback_(baseline_xyz, timestamp);
             break;
         case IONUTCB_LOG_TYPE:
             IonosphericModel ion;
             memcpy(&ion, message, sizeof(ion));
             if (ionospheric_model_callback_)
-            	ionospheric_model_callback_(ion, read_timestamp_);
+            	ionospheric_model_callback_(ion, timestamp);
             break;
         case RANGEB_LOG_TYPE:
             RangeMeasurements ranges;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) +
-                             ((uint16_t) *(message+8));
-
-            // Copy header and #observations following
-            memcpy(&ranges, message, header_length+4);
-
-            //Copy repeated fields
-            memcpy(&ranges.range_data,
-                   message + header_length + 4,
-                   (44*ranges.number_of_observations));
-
-            //Copy CRC
-            memcpy(&ranges.crc,
-                   message + header_length + payload_length,
-                   4);
+            DecodeBinaryLog(message, length, ranges);
+            // RANGECMP needs the frequency numbers to unpack GLONASS ADR
+            for (int32_t kk = 0; kk < ranges.number_of_observations; ++kk) {
+                if (ranges.range_data[kk].channel_status.satellite_sys == SATSYS_GLONASS)
+                    set_glonass_frequency(ranges.range_data[kk].satellite_prn,
+                        (int)ranges.range_data[kk].glonass_frequency + GLONASS_MIN_FREQUENCY_NUMBER);
+            }
 
             if (range_measurements_callback_)
             {
-            	range_measurements_callback_(ranges, read_timestamp_);
+            	range_measurements_callback_(ranges, timestamp);
             }
 
             break;
 
         case RANGECMPB_LOG_TYPE: {
 	          CompressedRangeMeasurements cmp_ranges;
-	        	header_length = (uint16_t) *(message + 3);
-	        	payload_length = (((uint16_t) *(message + 9)) << 8) +
-	        	                 ((uint16_t) *(message + 8));
-	        	// unsigned long crc_of_received = CalculateBlockCRC32(length-4, message);
-	        	
-	        	// std::stringstream asdf;
-	        	// asdf << "------\nheader_length: " << header_length << "\npayload_length: " << payload_length << "\n";
-	        	// asdf << "length idx: " << length << "\nsizeof: " << sizeof(cmp_ranges) << "\n";
-	        	//asdf << "crc of received: " << crc_of_received << "\n";
-	        	// log_info_(asdf.str().c_str()); asdf.str("");
-
-	        	//Copy header and unrepeated message block
-	        	memcpy(&cmp_ranges.header, message, header_length);
-	        	memcpy(&cmp_ranges.number_of_observations,
-	        	       message + header_length,
-	        	       4);
-
-	        	// Copy Repeated portion of message block)
-            memcpy(&cmp_ranges.range_data,
-                   message + header_length + 4,
-                   (24 * cmp_ranges.number_of_observations));
-
-	        	// Copy the CRC
-	        	memcpy(&cmp_ranges.crc,
-	        	       message + header_length + payload_length,
-	        	       4);
-
-	        	
-
-	        	// asdf << "sizeof after memcpy : " << sizeof(cmp_ranges) << "\n";
-	        	// asdf << "crc after shoving: " ;
-						// log_info_(asdf.str().c_str()); asdf.str("");
-						// printHex((char*)cmp_ranges.crc,4);
-	        	// asdf << "\nMessage from BufferIncomingData\n";
-	        	// log_info_(asdf.str().c_str()); asdf.str("");
-	        	// printHex((char*)message,length);
-
-	        	
-	        	//printHex((char*)cmp_ranges.range_data[0],sizeof(24*((int32_t)*(message+header_length))));
+	          DecodeBinaryLog(message, length, cmp_ranges);
 
 	            // memcpy(&cmp_ranges, message, length);
 	            if (compressed_range_measurements_callback_)
 	            {
 		           	compressed_range_measurements_callback_(cmp_ranges,
-		           	                                        read_timestamp_);
+		           	                                        timestamp);
 	            }
 
 	            if (range_measurements_callback_)
@@ -1374,7 +2411,7 @@ void Novatel::ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE
                       UnpackCompressedRangeData(cmp_ranges.range_data[kk],
                                                 rng.range_data[kk]);
                     }
-	                range_measurements_callback_(rng, read_timestamp_);
+	                range_measurements_callback_(rng, timestamp);
 	            }
 
 	            break;
@@ -1382,20 +2419,17 @@ void Novatel::ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE
         case GPSEPHEMB_LOG_TYPE: {
             GpsEphemeris ephemeris;
             header_length = (uint16_t) *(message+3);
-            std::cout << "GPSEPHEMB message: " << std::endl
-                  << "PRN #: " << (double)*(message+header_length)<< std::endl;
+            NOVATEL_LOG(log_debug_, "GPSEPHEMB message, PRN #: " << (double)*(message+header_length));
             //printHex(message, length);
-            if (length>sizeof(ephemeris)) {
+            if (!DecodeBinaryLog(message, length, ephemeris)) {
             	std::stringstream ss;
             	ss << "Novatel Driver: GpsEphemeris mismatch\n";
             	ss << "\tlength = " << length << "\n";
 	            ss << "\tsizeof msg = " << sizeof(ephemeris);
 	            log_warning_(ss.str().c_str());
 	          } else {
-	            memcpy(&ephemeris, message, sizeof(ephemeris));
-
 	            if (gps_ephemeris_callback_)
-	            	gps_ephemeris_callback_(ephemeris, read_timestamp_);
+	            	gps_ephemeris_callback_(ephemeris, timestamp);
 	          }
             break;
         }
@@ -1409,37 +2443,21 @@ void Novatel::ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE
 //            test_ephems_.ephemeris[raw_ephemeris.prn] = raw_ephemeris;
 
             if (raw_ephemeris_callback_)
-                raw_ephemeris_callback_(raw_ephemeris, read_timestamp_);
+                raw_ephemeris_callback_(raw_ephemeris, timestamp);
 
 //            bool result = SendBinaryDataToReceiver(message, length);
 
             break;}
         case RAWALMB_LOG_TYPE:
             RawAlmanac raw_almanac;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            //Copy header and unrepeated message block
-            memcpy(&raw_almanac.header,message, header_length+12);
-            // Copy Repeated portion of message block)
-            memcpy(&raw_almanac.subframe_data, message+header_length+12, (32*raw_almanac.num_of_subframes));
-            // Copy the CRC
-            memcpy(&raw_almanac.crc, message+header_length+payload_length, 4);
+            DecodeBinaryLog(message, length, raw_almanac);
 
             if(raw_almanac_callback_)
-                raw_almanac_callback_(raw_almanac, read_timestamp_);
+                raw_almanac_callback_(raw_almanac, timestamp);
             break;
         case ALMANACB_LOG_TYPE:
             Almanac almanac;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            //Copy header and unrepeated message block
-            memcpy(&almanac.header,message, header_length+4);
-            // Copy Repeated portion of message block)
-            memcpy(&almanac.data, message+header_length+4, (112*almanac.number_of_prns));
-            // Copy the CRC
-            memcpy(&raw_almanac.crc, message+header_length+payload_length, 4);
+            DecodeBinaryLog(message, length, almanac);
 
             /*
             //TODO: Test crc calculation, see if need to flip byte order
@@ -1451,76 +2469,64 @@ void Novatel::ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE
             printHex((unsigned char*)crc,4);
             */
             if(almanac_callback_)
-                almanac_callback_(almanac, read_timestamp_);
+                almanac_callback_(almanac, timestamp);
             break;
         case SATXYZB_LOG_TYPE:
             SatellitePositions sat_pos;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            // Copy header and unrepeated part of message
-            memcpy(&sat_pos, message, header_length+12);
-            //Copy repeated fields
-            memcpy(&sat_pos.data, message+header_length+12, (68*sat_pos.number_of_satellites));
-            //Copy CRC
-            memcpy(&ranges.crc, message+header_length+payload_length, 4);
+            DecodeBinaryLog(message, length, sat_pos);
 
             if (satellite_positions_callback_)
-            	satellite_positions_callback_(sat_pos, read_timestamp_);
+            	satellite_positions_callback_(sat_pos, timestamp);
             break;
         case SATVISB_LOG_TYPE:
             SatelliteVisibility sat_vis;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            // Copy header and unrepeated part of message
-            memcpy(&sat_pos, message, header_length+12);
-            //Copy repeated fields
-            memcpy(&sat_vis.data, message+header_length+12, (40*sat_vis.number_of_satellites));
-            //Copy CRC
-            memcpy(&ranges.crc, message+header_length+payload_length, 4);
+            DecodeBinaryLog(message, length, sat_vis);
 
             if(satellite_visibility_callback_)
-                satellite_visibility_callback_(sat_vis, read_timestamp_);
+                satellite_visibility_callback_(sat_vis, timestamp);
             break;
         case TIMEB_LOG_TYPE:
             TimeOffset time_offset;
             memcpy(&time_offset, message, sizeof(time_offset));
             if (time_offset_callback_)
-            	time_offset_callback_(time_offset, read_timestamp_);
+            	time_offset_callback_(time_offset, timestamp);
             break;
         case TRACKSTATB_LOG_TYPE:
             TrackStatus tracking_status;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            // Copy header and unrepeated part of message
-            memcpy(&tracking_status, message, header_length+16);
-            //Copy repeated fields
-            memcpy(&tracking_status.data, message+header_length+16, (40*tracking_status.number_of_channels));
-            //Copy CRC
-            memcpy(&tracking_status.crc, message+header_length+payload_length, 4);
+            DecodeBinaryLog(message, length, tracking_status);
 
             if(tracking_status_callback_)
-                tracking_status_callback_(tracking_status, read_timestamp_);
+                tracking_status_callback_(tracking_status, timestamp);
             break;
         case RXHWLEVELSB_LOG_TYPE:
             ReceiverHardwareStatus hw_levels;
             memcpy(&hw_levels, message, sizeof(hw_levels));
             if (receiver_hardware_status_callback_)
-            	receiver_hardware_status_callback_(hw_levels, read_timestamp_);
+            	receiver_hardware_status_callback_(hw_levels, timestamp);
+            break;
+        case RXSTATUSB_LOG_TYPE:
+            RXStatus receiver_status;
+            DecodeBinaryLog(message, length, receiver_status);
+            if (receiver_status_callback_)
+                receiver_status_callback_(receiver_status, timestamp);
             break;
         case PSRPOSB_LOG_TYPE:
             Position psr_pos;
             memcpy(&psr_pos, message, sizeof(psr_pos));
             if (best_pseudorange_position_callback_)
-            	best_pseudorange_position_callback_(psr_pos, read_timestamp_);
+            	best_pseudorange_position_callback_(psr_pos, timestamp);
             break;
         case RTKPOSB_LOG_TYPE:
             Position rtk_pos;
             memcpy(&rtk_pos, message, sizeof(rtk_pos));
             if (rtk_position_callback_)
-            	rtk_position_callback_(rtk_pos, read_timestamp_);
+            	rtk_position_callback_(rtk_pos, timestamp);
+            break;
+        case RTKDATAB_LOG_TYPE:
+            rtkdatab_log rtk_data;
+            DecodeBinaryLog(message, length, rtk_data);
+            if (rtk_data_callback_)
+                rtk_data_callback_(rtk_data, timestamp);
             break;
         default:
             break;
@@ -1532,6 +2538,14 @@ void Novatel::UnpackCompressedRangeData(const CompressedRangeData &cmp,
 {
   rng.satellite_prn = cmp.range_record.satellite_prn;
 
+  // RANGECMP leaves out the GLONASS frequency number, use the one last seen
+  rng.glonass_frequency = 0;
+  if (cmp.channel_status.satellite_sys == SATSYS_GLONASS) {
+    uint16_t prn = cmp.range_record.satellite_prn;
+    rng.glonass_frequency = glonass_frequency_known(prn) ?
+        glonass_frequency(prn) - GLONASS_MIN_FREQUENCY_NUMBER : GLONASS_FREQUENCY_UNKNOWN;
+  }
+
   rng.channel_status = cmp.channel_status;
 
   rng.pseudorange = double(cmp.range_record.pseudorange) / 128.0;
@@ -1613,106 +2627,7 @@ double Novatel::UnpackCompressedAccumulatedDoppler(
     const CompressedRangeData &cmp,
     const double              &uncmpPsr) const
 {
-
-  double scaled_adr = (double)cmp.range_record.accumulated_doppler / 256.0;
-
-  double adr_rolls = uncmpPsr;
-
-
-  switch (cmp.channel_status.satellite_sys)
-  {
-  case 0: // GPS
-
-    if (cmp.channel_status.signal_type == 0) // L1
-    {
-      adr_rolls /= CMP_GPS_WAVELENGTH_L1;
-    }
-    else if ((cmp.channel_status.signal_type == 5) ||  // L2 P
-             (cmp.channel_status.signal_type == 9) ||  // L2 P codeless
-             (cmp.channel_status.signal_type == 17))   // L2C
-    {
-      adr_rolls /= CMP_GPS_WAVELENGTH_L2;
-    }
-    else
-    {
-/*      std::cout << "Unknown GPS Frequency type!" << std::endl;
-      std::cout << "PRN: "
-                << cmp.range_record.satellite_prn
-                << "\tSatellite System: "
-                << cmp.channel_status.satellite_sys
-                << "\tSignal Type: "
-                << cmp.channel_status.signal_type
-                << std::endl;*/
-    }
-
-    break;
-
-  case 1: // GLO
-    // TODO: Need to compute actual wavelengths here, this is incorrect
-    if (cmp.channel_status.signal_type == 0) // L1
-    {
-      adr_rolls /= CMP_GPS_WAVELENGTH_L1;
-    }
-    else if (cmp.channel_status.signal_type == 5) // L2 P
-    {
-      adr_rolls /= CMP_GPS_WAVELENGTH_L2;
-    }
-    else
-    {
-/*      std::cout << "Unknown GLO Frequency type!" << std::endl;
-      std::cout << "PRN: "
-                << cmp.range_record.satellite_prn
-                << "\tSatellite System: "
-                << cmp.channel_status.satellite_sys
-                << "\tSignal Type: "
-                << cmp.channel_status.signal_type
-                << std::endl;*/
-    }
-    break;
-
-  case 2: // WAAS
-    if (cmp.channel_status.signal_type == 1) // L1
-    {
-      adr_rolls /= CMP_GPS_WAVELENGTH_L1;
-    }
-    else
-    {
-/*      std::cout << "Unknown WAAS Frequency type!" << std::endl;
-      std::cout << "PRN: "
-                << cmp.range_record.satellite_prn
-                << "\tSatellite System: "
-                << cmp.channel_status.satellite_sys
-                << "\tSignal Type: "
-                << cmp.channel_status.signal_type
-                << std::endl;*/
-    }
-    break;
-
-  default:
-/*    std::cout << "Unknown Satellite System type!" << std::endl;
-    std::cout << "PRN: "
-              << cmp.range_record.satellite_prn
-              << "\tSatellite System: "
-              << cmp.channel_status.satellite_sys
-              << "\tSignal Type: "
-              << cmp.channel_status.signal_type
-              << std::endl;*/
-    break;
-  }
-
-
-  adr_rolls = (adr_rolls + scaled_adr) / CMP_MAX_VALUE;
-
-  if(adr_rolls <= 0)
-  {
-    adr_rolls -= 0.5;
-  }
-  else
-  {
-    adr_rolls += 0.5;
-  }
-
-  return(scaled_adr - (CMP_MAX_VALUE * (int)adr_rolls));
+  return UnpackCompressedAdr(cmp, uncmpPsr, glonass_frequency(cmp.range_record.satellite_prn));
 }
 
 /* --------------------------------------------------------------------------
@@ -1739,15 +2654,7 @@ Calculates the CRC-32 of a block of data all at once
 unsigned long Novatel::CalculateBlockCRC32 ( unsigned long ulCount, /* Number of bytes in the data block */
                                              unsigned char *ucBuffer ) /* Data block */
 {
-  unsigned long ulTemp1;
-  unsigned long ulTemp2;
-  unsigned long ulCRC = 0;
-  while ( ulCount-- != 0 ) {
-    ulTemp1 = ( ulCRC >> 8 ) & 0x00FFFFFFL;
-    ulTemp2 = CRC32Value( ((int) ulCRC ^ *ucBuffer++ ) & 0xff );
-    ulCRC = ulTemp1 ^ ulTemp2;
-  }
-  return( ulCRC );
+  return ::CalculateBlockCRC32(ulCount, ucBuffer);
 }
 
 // this functions matches the conversion done by the Novatel receivers
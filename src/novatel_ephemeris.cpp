@@ -0,0 +1,67 @@
+#include "novatel/novatel_ephemeris.h"
+
+using namespace novatel;
+
+EphemerisStore::EphemerisStore() {
+	version_ = 0;
+	update_count_ = 0;
+}
+
+bool EphemerisStore::SameEphemeris(const GpsEphemeris &a, const GpsEphemeris &b) {
+	return (a.issue_of_ephemeris_1 == b.issue_of_ephemeris_1) && (a.gps_week == b.gps_week) &&
+	       (a.time_of_ephemeris == b.time_of_ephemeris) && (a.health == b.health);
+}
+
+bool EphemerisStore::Update(const GpsEphemeris &ephemeris) {
+	boost::mutex::scoped_lock lock(mutex_);
+	update_count_++;
+	std::map<uint32_t, GpsEphemeris>::iterator it = ephemerides_.find(ephemeris.prn);
+	if (it == ephemerides_.end()) {
+		ephemerides_[ephemeris.prn] = ephemeris;
+	} else if (!SameEphemeris(it->second, ephemeris)) {
+		it->second = ephemeris;
+	} else {
+		return false;
+	}
+	version_++;
+	return true;
+}
+
+bool EphemerisStore::Get(uint32_t prn, GpsEphemeris &ephemeris) {
+	boost::mutex::scoped_lock lock(mutex_);
+	std::map<uint32_t, GpsEphemeris>::iterator it = ephemerides_.find(prn);
+	if (it == ephemerides_.end())
+		return false;
+	ephemeris = it->second;
+	return true;
+}
+
+std::vector<GpsEphemeris> EphemerisStore::Snapshot() {
+	boost::mutex::scoped_lock lock(mutex_);
+	std::vector<GpsEphemeris> snapshot;
+	snapshot.reserve(ephemerides_.size());
+	for (std::map<uint32_t, GpsEphemeris>::iterator it = ephemerides_.begin(); it != ephemerides_.end(); ++it)
+		snapshot.push_back(it->second);
+	return snapshot;
+}
+
+uint32_t EphemerisStore::version() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return version_;
+}
+
+uint32_t EphemerisStore::update_count() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return update_count_;
+}
+
+size_t EphemerisStore::size() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return ephemerides_.size();
+}
+
+void EphemerisStore::Clear() {
+	boost::mutex::scoped_lock lock(mutex_);
+	ephemerides_.clear();
+	version_++;
+}
@@ -0,0 +1,139 @@
+#include "novatel/novatel_executor.h"
+
+#include <cstring>
+#include <time.h>
+
+#include <boost/bind.hpp>
+
+using namespace novatel;
+
+static uint64_t MonotonicMicroseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+CallbackExecutor::CallbackExecutor(FrameHandler handler, size_t threads, size_t frame_buffer_size,
+                                   size_t max_queued)
+	: handler_(handler), frame_buffer_size_(frame_buffer_size), max_queued_(max_queued), running_(true) {
+	if (threads == 0)
+		threads = 1;
+	for (size_t ii=0; ii<threads; ii++)
+		threads_.create_thread(boost::bind(&CallbackExecutor::Run, this));
+}
+
+CallbackExecutor::~CallbackExecutor() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		running_ = false;
+		work_condition_.notify_all();
+	}
+	threads_.join_all();
+}
+
+bool CallbackExecutor::Post(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id,
+                            double timestamp) {
+	if (length > frame_buffer_size_)
+		return false;
+	boost::mutex::scoped_lock lock(mutex_);
+	std::map<BINARY_LOG_TYPE, Strand>::iterator it = strands_.find(message_id);
+	if (it == strands_.end()) {
+		// built in place, a copy would drop the capacity the batches reserve
+		Strand &strand = strands_[message_id];
+		strand.scheduled = false;
+		strand.running = 0;
+		memset(&strand.stats, 0, sizeof(strand.stats));
+		strand.stats.message_id = message_id;
+		strand.total_us = 0;
+		it = strands_.find(message_id);
+		if (ready_.capacity() < strands_.size())
+			ready_.set_capacity(2*strands_.size());
+	}
+	Strand &strand = it->second;
+	if (strand.pending.size() >= max_queued_) {
+		strand.stats.dropped++;
+		return false;
+	}
+	strand.pending.Add(frame, length, message_id, timestamp);
+	uint32_t queued = strand.pending.size() + strand.running;
+	if (queued > strand.stats.max_queued)
+		strand.stats.max_queued = queued;
+	if (!strand.scheduled) {
+		strand.scheduled = true;
+		ready_.push_back(message_id);
+		work_condition_.notify_one();
+	}
+	return true;
+}
+
+void CallbackExecutor::Run() {
+	std::vector<unsigned char> buffer(frame_buffer_size_);
+	boost::mutex::scoped_lock lock(mutex_);
+	while (true) {
+		while (running_ && ready_.empty())
+			work_condition_.wait(lock);
+		if (ready_.empty())
+			return;	// stopped and drained
+		BINARY_LOG_TYPE message_id = ready_.front();
+		ready_.pop_front();
+		// the strand stays scheduled while its frames run, so no other
+		// thread can take frames of this type out of order
+		Strand &strand = strands_[message_id];
+		FrameBatch &frames = strand.taken;
+		frames.Swap(strand.pending);
+		strand.running = frames.size();
+		lock.unlock();
+
+		uint64_t total_us = 0, max_us = 0;
+		for (size_t ii=0; ii<frames.size(); ii++) {
+			memcpy(&buffer[0], frames.frame(ii), frames.length(ii));
+			uint64_t start_us = MonotonicMicroseconds();
+			try {
+				handler_(&buffer[0], frames.length(ii), frames.id(ii), frames.timestamp(ii));
+			} catch (...) {
+				// a failing handler must not take the pool thread with it
+			}
+			uint64_t run_us = MonotonicMicroseconds() - start_us;
+			total_us += run_us;
+			if (run_us > max_us)
+				max_us = run_us;
+		}
+
+		lock.lock();
+		strand.stats.executed += frames.size();
+		strand.total_us += total_us;
+		if (max_us > strand.stats.max_us)
+			strand.stats.max_us = max_us;
+		strand.running = 0;
+		frames.Clear();
+		if (strand.pending.empty())
+			strand.scheduled = false;
+		else
+			ready_.push_back(message_id);	// behind other types to stay fair
+		idle_condition_.notify_all();
+	}
+}
+
+void CallbackExecutor::Wait() {
+	boost::mutex::scoped_lock lock(mutex_);
+	while (true) {
+		bool busy = false;
+		for (std::map<BINARY_LOG_TYPE, Strand>::iterator it = strands_.begin(); it != strands_.end(); ++it)
+			busy = busy || it->second.scheduled;
+		if (!busy)
+			return;
+		idle_condition_.wait(lock);
+	}
+}
+
+std::vector<ExecutorStats> CallbackExecutor::stats() {
+	boost::mutex::scoped_lock lock(mutex_);
+	std::vector<ExecutorStats> result;
+	for (std::map<BINARY_LOG_TYPE, Strand>::iterator it = strands_.begin(); it != strands_.end(); ++it) {
+		ExecutorStats stats = it->second.stats;
+		stats.queued = it->second.pending.size() + it->second.running;
+		stats.mean_us = stats.executed ? it->second.total_us/stats.executed : 0;
+		result.push_back(stats);
+	}
+	return result;
+}
@@ -0,0 +1,342 @@
+#include "novatel/novatel_fanout.h"
+#include "novatel/novatel_transport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace novatel;
+
+//! Bytes read from a client per poll, anything a client sends is discarded
+#define FANOUT_DISCARD_SIZE 512
+
+FanoutServer::FanoutServer(size_t ring_size, size_t max_clients)
+	: ring_mask_(0), head_(0), max_clients_(max_clients), wake_pending_(false), running_(false) {
+	size_t size = 1;
+	while (size < ring_size)
+		size <<= 1;
+	ring_.resize(size);
+	ring_mask_ = size - 1;
+	memset(&stats_, 0, sizeof(stats_));
+	if (pipe2(wake_pipe_, O_NONBLOCK | O_CLOEXEC) != 0)
+		ThrowSystemError("Could not create fan-out wake pipe");
+}
+
+FanoutServer::~FanoutServer() {
+	Stop();
+	for (size_t ii=0; ii<listeners_.size(); ii++) {
+		::close(listeners_[ii].fd);
+		if (!listeners_[ii].unix_path.empty())
+			unlink(listeners_[ii].unix_path.c_str());
+	}
+	for (size_t ii=0; ii<destinations_.size(); ii++)
+		::close(destinations_[ii].fd);
+	::close(wake_pipe_[0]);
+	::close(wake_pipe_[1]);
+}
+
+void FanoutServer::AddEndpoint(const std::string &url) {
+	if (running_)
+		throw std::runtime_error("Fan-out endpoints must be added before Start()");
+	std::string::size_type separator = url.find("://");
+	if (separator == std::string::npos)
+		throw std::invalid_argument("Expected tcp://, unix:// or udp:// in fan-out endpoint '" + url + "'");
+	std::string scheme = url.substr(0, separator);
+	if (scheme == "unix") {
+		AddUnixListener(url, url.substr(separator+3));
+		return;
+	}
+	std::string host, port;
+	SplitHostPort(url.substr(separator+3), host, port);
+
+	bool tcp = (scheme == "tcp");
+	if (!tcp && (scheme != "udp"))
+		throw std::invalid_argument("Unknown fan-out endpoint scheme '" + scheme + "'");
+	if (!tcp && host.empty())
+		throw std::invalid_argument("UDP fan-out endpoint needs a destination host: '" + url + "'");
+
+	struct addrinfo *addresses = ResolveAddress(host, port, tcp ? SOCK_STREAM : SOCK_DGRAM, tcp);
+	int fd = -1;
+	int error = 0;
+	for (struct addrinfo *address = addresses; address != NULL; address = address->ai_next) {
+		fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, address->ai_protocol);
+		if (fd < 0) {
+			error = errno;
+			continue;
+		}
+		if (!tcp) {
+			Destination destination;
+			destination.fd = fd;
+			memcpy(&destination.address, address->ai_addr, address->ai_addrlen);
+			destination.address_length = address->ai_addrlen;
+			destinations_.push_back(destination);
+			break;
+		}
+		int flag = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+		if ((bind(fd, address->ai_addr, address->ai_addrlen) == 0) && (listen(fd, 16) == 0)) {
+			Listener listener = {fd, url, ""};
+			listeners_.push_back(listener);
+			break;
+		}
+		error = errno;
+		::close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addresses);
+	if (fd < 0) {
+		errno = error;
+		ThrowSystemError("Could not open fan-out endpoint " + url);
+	}
+}
+
+void FanoutServer::AddUnixListener(const std::string &url, const std::string &path) {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.empty() || (path.size() >= sizeof(address.sun_path)))
+		throw std::invalid_argument("Invalid Unix socket path in fan-out endpoint '" + url + "'");
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0)
+		ThrowSystemError("Could not open fan-out endpoint " + url);
+	// a socket left behind by a process that did not exit cleanly
+	unlink(path.c_str());
+	if ((bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) || (listen(fd, 16) != 0)) {
+		int error = errno;
+		::close(fd);
+		errno = error;
+		ThrowSystemError("Could not open fan-out endpoint " + url);
+	}
+	Listener listener = {fd, url, path};
+	listeners_.push_back(listener);
+}
+
+void FanoutServer::Start() {
+	if (running_)
+		return;
+	running_ = true;
+	thread_ = boost::thread(boost::bind(&FanoutServer::Run, this));
+}
+
+void FanoutServer::Stop() {
+	if (!running_)
+		return;
+	running_ = false;
+	Wake();
+	thread_.join();
+	while (!clients_.empty())
+		RemoveClient(clients_.size()-1, false);
+}
+
+void FanoutServer::Publish(const unsigned char *data, size_t length) {
+	if (length == 0)
+		return;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		// a message larger than the ring keeps only its end, which drops every TCP client
+		size_t skip = (length > ring_.size()) ? length - ring_.size() : 0;
+		size_t offset = (head_ + skip) & ring_mask_;
+		size_t first = std::min(length - skip, ring_.size() - offset);
+		memcpy(&ring_[offset], data + skip, first);
+		memcpy(&ring_[0], data + skip + first, length - skip - first);
+		head_ += length;
+		stats_.messages++;
+		stats_.bytes += length;
+	}
+
+	for (size_t ii=0; ii<destinations_.size(); ii++) {
+		const Destination &destination = destinations_[ii];
+		if (sendto(destination.fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL,
+		           (const struct sockaddr*)&destination.address, destination.address_length) < 0) {
+			boost::mutex::scoped_lock lock(mutex_);
+			stats_.datagram_errors++;
+		}
+	}
+
+	if (!listeners_.empty())
+		Wake();
+}
+
+FanoutStats FanoutServer::Stats() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return stats_;
+}
+
+void FanoutServer::Wake() {
+	// one byte in the pipe is enough however many messages arrive before the thread runs
+	if (!wake_pending_.exchange(true)) {
+		unsigned char byte = 0;
+		if (write(wake_pipe_[1], &byte, 1) < 0) {
+			// the pipe is full, so the thread is already due to wake
+		}
+	}
+}
+
+void FanoutServer::Run() {
+	std::vector<struct pollfd> fds;
+	std::vector<uint64_t> sent_from;
+	std::vector<bool> closed;
+	unsigned char discard[FANOUT_DISCARD_SIZE];
+	while (running_) {
+		uint64_t head;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			head = head_;
+		}
+
+		fds.clear();
+		struct pollfd entry;
+		entry.fd = wake_pipe_[0];
+		entry.events = POLLIN;
+		fds.push_back(entry);
+		for (size_t ii=0; ii<listeners_.size(); ii++) {
+			entry.fd = listeners_[ii].fd;
+			fds.push_back(entry);
+		}
+		for (size_t ii=0; ii<clients_.size(); ii++) {
+			entry.fd = clients_[ii].fd;
+			entry.events = POLLIN | ((clients_[ii].cursor < head) ? POLLOUT : 0);
+			fds.push_back(entry);
+		}
+		if (poll(&fds[0], fds.size(), 100) <= 0)
+			continue;
+
+		if (fds[0].revents & POLLIN) {
+			wake_pending_ = false;
+			while (read(wake_pipe_[0], discard, sizeof(discard)) > 0) {}
+		}
+		for (size_t ii=0; ii<listeners_.size(); ii++) {
+			if (fds[1+ii].revents & POLLIN)
+				AcceptClients(listeners_[ii]);
+		}
+
+		// sends read the ring without the lock, so refresh head and then
+		// check afterwards that the sent bytes were not overwritten meanwhile
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			head = head_;
+		}
+		size_t first_client = 1 + listeners_.size();
+		sent_from.resize(clients_.size());
+		closed.assign(clients_.size(), false);
+		for (size_t ii=0; ii<clients_.size(); ii++) {
+			Client &client = clients_[ii];
+			sent_from[ii] = client.cursor;
+			short revents = (first_client+ii < fds.size()) ? fds[first_client+ii].revents : 0;
+			if (revents & POLLIN) {
+				ssize_t count = recv(client.fd, discard, sizeof(discard), MSG_DONTWAIT);
+				if ((count == 0) || ((count < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+					closed[ii] = true;
+			}
+			if (revents & (POLLERR | POLLHUP))
+				closed[ii] = true;
+			if (!closed[ii] && !SendToClient(client, head))
+				closed[ii] = true;
+		}
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			head = head_;
+		}
+		uint64_t sent = 0;
+		uint64_t backlog = 0;
+		for (size_t ii=clients_.size(); ii-- > 0; ) {
+			sent += clients_[ii].cursor - sent_from[ii];
+			bool overrun = (clients_[ii].cursor != sent_from[ii]) && (head - sent_from[ii] > ring_.size());
+			if (closed[ii] || overrun)
+				RemoveClient(ii, overrun || (head - clients_[ii].cursor > ring_.size()));
+			else
+				backlog = std::max(backlog, head - clients_[ii].cursor);
+		}
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			stats_.bytes_sent += sent;
+			stats_.max_backlog = backlog;
+		}
+	}
+}
+
+void FanoutServer::AcceptClients(const Listener &listener) {
+	while (true) {
+		struct sockaddr_storage address;
+		socklen_t address_length = sizeof(address);
+		int fd = accept4(listener.fd, (struct sockaddr*)&address, &address_length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			return;
+		if (clients_.size() >= max_clients_) {
+			::close(fd);
+			boost::mutex::scoped_lock lock(mutex_);
+			stats_.rejected++;
+			continue;
+		}
+		char host[NI_MAXHOST], port[NI_MAXSERV];
+		Client client;
+		client.fd = fd;
+		if (address.ss_family == AF_UNIX) {
+			// unix clients are usually unnamed
+			client.name = listener.url;
+		} else {
+			int flag = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+			if (getnameinfo((struct sockaddr*)&address, address_length, host, sizeof(host), port, sizeof(port),
+			                NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+				client.name = std::string(host) + ":" + port;
+		}
+		{
+			// new clients start with the next message
+			boost::mutex::scoped_lock lock(mutex_);
+			client.cursor = head_;
+			stats_.accepted++;
+			stats_.clients = clients_.size() + 1;
+		}
+		clients_.push_back(client);
+		if (client_callback_)
+			client_callback_(client.name, true);
+	}
+}
+
+bool FanoutServer::SendToClient(Client &client, uint64_t head) {
+	while (client.cursor < head) {
+		if (head - client.cursor > ring_.size())
+			return false;
+		size_t offset = client.cursor & ring_mask_;
+		size_t length = head - client.cursor;
+		struct iovec iov[2];
+		iov[0].iov_base = &ring_[offset];
+		iov[0].iov_len = std::min(length, ring_.size() - offset);
+		iov[1].iov_base = &ring_[0];
+		iov[1].iov_len = length - iov[0].iov_len;
+		struct msghdr message;
+		memset(&message, 0, sizeof(message));
+		message.msg_iov = iov;
+		message.msg_iovlen = (iov[1].iov_len > 0) ? 2 : 1;
+		ssize_t sent = sendmsg(client.fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0)
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+		client.cursor += sent;
+	}
+	return true;
+}
+
+void FanoutServer::RemoveClient(size_t index, bool dropped) {
+	std::string name = clients_[index].name;
+	::close(clients_[index].fd);
+	clients_.erase(clients_.begin() + index);
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		stats_.clients = clients_.size();
+		if (dropped)
+			stats_.dropped_clients++;
+	}
+	if (client_callback_)
+		client_callback_(name, false);
+}
@@ -0,0 +1,247 @@
+#include "novatel/novatel_flight_recorder.h"
+#include "novatel/novatel_enums.h"
+#include "novatel/novatel_structures.h"
+
+#include <algorithm>
+#include <cstddef> // for offsetof
+#include <stdexcept>
+
+#include <sys/time.h>
+
+using namespace novatel;
+
+static uint64_t WallClockMicroseconds() {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (uint64_t)now.tv_sec*1000000 + now.tv_usec;
+}
+
+//! Reads a 4 byte enum from a frame, -1 if the frame is too short
+static int32_t FrameField(const unsigned char *frame, size_t length, size_t offset) {
+	if (offset + 4 > length)
+		return -1;
+	int32_t value;
+	memcpy(&value, frame + offset, 4);
+	return value;
+}
+
+const char* novatel::FlightTriggerName(FlightTrigger trigger) {
+	switch (trigger) {
+		case FLIGHT_TRIGGER_MANUAL: return "manual";
+		case FLIGHT_TRIGGER_CRC_STORM: return "crc_storm";
+		case FLIGHT_TRIGGER_SOLUTION_NONE: return "solution_none";
+		case FLIGHT_TRIGGER_INS_DEGRADED: return "ins_degraded";
+		case FLIGHT_TRIGGER_ACK_TIMEOUT: return "ack_timeout";
+	}
+	return "unknown";
+}
+
+FlightRecorder::FlightRecorder(const FlightRecorderConfig &config)
+	: config_(config), head_(0), entries_(config.max_reads), last_position_type_(-1), last_ins_status_(-1),
+	  crc_errors_(~(uint64_t)0), crc_window_start_(0), crc_window_errors_(0), dump_pending_(false),
+	  pending_trigger_(FLIGHT_TRIGGER_MANUAL), dump_deadline_(0), last_trigger_time_(0), running_(true) {
+	if ((config_.max_bytes < MAX_NOUT_SIZE) || (config_.max_reads == 0))
+		throw std::invalid_argument("Flight recorder must hold at least one frame.");
+	ring_.resize(config_.max_bytes);
+	dump_thread_ = boost::thread(&FlightRecorder::DumpThread, this);
+}
+
+FlightRecorder::~FlightRecorder() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		running_ = false;
+		condition_.notify_all();
+	}
+	dump_thread_.join();
+}
+
+void FlightRecorder::AddData(const unsigned char *data, size_t length) {
+	if (length == 0)
+		return;
+	// only the end of a read longer than the whole ring fits
+	if (length > ring_.size()) {
+		data += length - ring_.size();
+		length = ring_.size();
+	}
+	uint64_t now = WallClockMicroseconds();
+	boost::mutex::scoped_lock lock(mutex_);
+	Evict(now, length);
+	size_t offset = head_ % ring_.size();
+	size_t first = std::min(length, ring_.size() - offset);
+	memcpy(&ring_[offset], data, first);
+	memcpy(&ring_[0], data + first, length - first);
+	Entry entry = {head_, (uint32_t)length, now};
+	entries_.push_back(entry);
+	head_ += length;
+}
+
+void FlightRecorder::Evict(uint64_t now, size_t length) {
+	uint64_t oldest = now - (uint64_t)(config_.window*1e6);
+	while (!entries_.empty() &&
+	       (entries_.full() || (head_ + length - entries_.front().offset > ring_.size()) ||
+	        (entries_.front().timestamp < oldest)))
+		entries_.pop_front();
+}
+
+void FlightRecorder::CheckFrame(const unsigned char *frame, size_t length, uint16_t message_id) {
+	uint64_t now = WallClockMicroseconds();
+	boost::mutex::scoped_lock lock(mutex_);
+	stats_.frames++;
+	if ((message_id == BESTPOSB_LOG_TYPE) || (message_id == BESTUTMB_LOG_TYPE)) {
+		// both logs have the position type at the same offset
+		int32_t position_type = FrameField(frame, length, offsetof(Position, position_type));
+		if (config_.trigger_solution_none && (position_type == NONE) &&
+		    (last_position_type_ > 0))
+			TriggerLocked(FLIGHT_TRIGGER_SOLUTION_NONE, now);
+		last_position_type_ = position_type;
+	} else if ((message_id == INSPVA_LOG_TYPE) || (message_id == INSPVAS_LOG_TYPE)) {
+		size_t offset = (message_id == INSPVA_LOG_TYPE) ? offsetof(InsPositionVelocityAttitude, status) :
+		                                                  offsetof(InsPositionVelocityAttitudeShort, status);
+		int32_t status = FrameField(frame, length, offset);
+		if (config_.trigger_ins_degraded && (status != INS_SOLUTION_GOOD) &&
+		    (last_ins_status_ == INS_SOLUTION_GOOD))
+			TriggerLocked(FLIGHT_TRIGGER_INS_DEGRADED, now);
+		last_ins_status_ = status;
+	}
+}
+
+void FlightRecorder::AddCrcErrors(uint64_t total_errors) {
+	if (total_errors == crc_errors_)
+		return;
+	uint64_t now = WallClockMicroseconds();
+	boost::mutex::scoped_lock lock(mutex_);
+	uint64_t errors = total_errors - crc_errors_;
+	bool first = (crc_errors_ == ~(uint64_t)0);
+	crc_errors_ = total_errors;
+	// errors from before the recorder started are not a storm
+	if (first || (config_.crc_storm_errors == 0))
+		return;
+	if (now - crc_window_start_ > (uint64_t)(config_.crc_storm_window*1e6)) {
+		crc_window_start_ = now;
+		crc_window_errors_ = 0;
+	}
+	crc_window_errors_ += errors;
+	if (crc_window_errors_ >= config_.crc_storm_errors) {
+		crc_window_errors_ = 0;
+		TriggerLocked(FLIGHT_TRIGGER_CRC_STORM, now);
+	}
+}
+
+bool FlightRecorder::Trigger(FlightTrigger trigger) {
+	if ((trigger == FLIGHT_TRIGGER_ACK_TIMEOUT) && !config_.trigger_ack_timeout)
+		return false;
+	uint64_t now = WallClockMicroseconds();
+	boost::mutex::scoped_lock lock(mutex_);
+	return TriggerLocked(trigger, now);
+}
+
+bool FlightRecorder::TriggerLocked(FlightTrigger trigger, uint64_t now) {
+	stats_.triggers++;
+	if (dump_pending_ || ((last_trigger_time_ != 0) && (now - last_trigger_time_ < (uint64_t)(config_.holdoff*1e6)))) {
+		stats_.suppressed++;
+		return false;
+	}
+	dump_pending_ = true;
+	pending_trigger_ = trigger;
+	dump_deadline_ = now + (uint64_t)(config_.post_trigger*1e6);
+	last_trigger_time_ = now;
+	condition_.notify_all();
+	return true;
+}
+
+FlightRecorderStats FlightRecorder::stats() {
+	boost::mutex::scoped_lock lock(mutex_);
+	FlightRecorderStats stats = stats_;
+	stats.reads_buffered = entries_.size();
+	stats.bytes_buffered = entries_.empty() ? 0 : head_ - entries_.front().offset;
+	return stats;
+}
+
+void FlightRecorder::Snapshot(std::vector<unsigned char> &data, std::vector<Entry> &entries) {
+	data.clear();
+	entries.assign(entries_.begin(), entries_.end());
+	if (entries.empty())
+		return;
+	uint64_t start = entries.front().offset;
+	data.resize(head_ - start);
+	size_t offset = start % ring_.size();
+	size_t first = std::min(data.size(), ring_.size() - offset);
+	memcpy(&data[0], &ring_[offset], first);
+	memcpy(&data[first], &ring_[0], data.size() - first);
+	for (size_t ii=0; ii<entries.size(); ii++)
+		entries[ii].offset -= start;
+}
+
+void FlightRecorder::Dump(const std::string &path) {
+	std::vector<unsigned char> data;
+	std::vector<Entry> entries;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		Snapshot(data, entries);
+	}
+	WriteDump(path, data, entries);
+}
+
+void FlightRecorder::WriteDump(const std::string &path, const std::vector<unsigned char> &data,
+                               const std::vector<Entry> &entries) {
+	RecordingWriter writer;
+	writer.Open(path, config_.codec);
+	// one block per host timestamp keeps the time each read arrived
+	size_t first = 0;
+	for (size_t ii=1; ii<=entries.size(); ii++) {
+		if ((ii < entries.size()) && (entries[ii].timestamp == entries[first].timestamp))
+			continue;
+		size_t end = (ii < entries.size()) ? entries[ii].offset : data.size();
+		writer.WriteBlock(&data[entries[first].offset], end - entries[first].offset, entries[first].timestamp);
+		first = ii;
+	}
+	writer.Close();
+}
+
+void FlightRecorder::DumpThread() {
+	std::vector<unsigned char> data;
+	std::vector<Entry> entries;
+	boost::mutex::scoped_lock lock(mutex_);
+	while (running_ || dump_pending_) {
+		if (!dump_pending_) {
+			condition_.wait(lock);
+			continue;
+		}
+		// a dump still pending at shutdown is written straight away
+		uint64_t now = WallClockMicroseconds();
+		if (running_ && (now < dump_deadline_)) {
+			condition_.timed_wait(lock, boost::posix_time::microseconds(dump_deadline_ - now));
+			continue;
+		}
+		Snapshot(data, entries);
+		FlightTrigger trigger = pending_trigger_;
+		dump_pending_ = false;
+		if (entries.empty())
+			continue;
+
+		time_t seconds = last_trigger_time_/1000000;
+		struct tm time;
+		gmtime_r(&seconds, &time);
+		char name[64];
+		strftime(name, sizeof(name), "flight_%Y%m%d_%H%M%S_", &time);
+		std::string path = config_.directory + "/" + name + FlightTriggerName(trigger) + ".nvrec";
+		lock.unlock();
+
+		bool written = true;
+		try {
+			WriteDump(path, data, entries);
+		} catch (std::exception &e) {
+			written = false;
+		}
+		if (dump_callback_)
+			dump_callback_(trigger, path, written);
+
+		lock.lock();
+		if (written) {
+			stats_.dumps++;
+			stats_.last_dump = path;
+		} else {
+			stats_.write_errors++;
+		}
+	}
+}
@@ -0,0 +1,344 @@
+#include "novatel/novatel_health.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+using namespace novatel;
+
+//////////////////////////////////////////////////////
+// SlidingWindow
+//////////////////////////////////////////////////////
+SlidingWindow::SlidingWindow(size_t size) {
+	Resize(size);
+}
+
+void SlidingWindow::Resize(size_t size) {
+	if (size == 0)
+		size = 1;
+	values_.assign(size, 0);
+	minimum_.set_capacity(size);
+	maximum_.set_capacity(size);
+	Clear();
+}
+
+void SlidingWindow::Clear() {
+	next_ = 0;
+	count_ = 0;
+	index_ = 0;
+	sum_ = 0;
+	sum_squares_ = 0;
+	last_ = 0;
+	minimum_.clear();
+	maximum_.clear();
+}
+
+void SlidingWindow::Add(double value) {
+	size_t size = values_.size();
+	if (count_ == size) {
+		double oldest = values_[next_];
+		sum_ -= oldest;
+		sum_squares_ -= oldest*oldest;
+	} else {
+		count_++;
+	}
+	values_[next_] = value;
+	sum_ += value;
+	sum_squares_ += value*value;
+	last_ = value;
+
+	// drop samples that have left the window, then any that can no longer
+	// be the extreme because the new sample is both newer and beyond them
+	while (!minimum_.empty() && (minimum_.front().first + size <= index_))
+		minimum_.pop_front();
+	while (!maximum_.empty() && (maximum_.front().first + size <= index_))
+		maximum_.pop_front();
+	while (!minimum_.empty() && (minimum_.back().second >= value))
+		minimum_.pop_back();
+	while (!maximum_.empty() && (maximum_.back().second <= value))
+		maximum_.pop_back();
+	minimum_.push_back(std::make_pair(index_, value));
+	maximum_.push_back(std::make_pair(index_, value));
+	index_++;
+
+	if (++next_ == size) {
+		next_ = 0;
+		sum_ = 0;
+		sum_squares_ = 0;
+		for (size_t ii=0; ii<count_; ii++) {
+			sum_ += values_[ii];
+			sum_squares_ += values_[ii]*values_[ii];
+		}
+	}
+}
+
+double SlidingWindow::stddev() const {
+	if (count_ < 2)
+		return 0;
+	double mean = sum_/count_;
+	double variance = sum_squares_/count_ - mean*mean;
+	return (variance > 0) ? sqrt(variance) : 0;
+}
+
+//////////////////////////////////////////////////////
+// HealthMonitor
+//////////////////////////////////////////////////////
+static const char* health_event_names[HEALTH_EVENT_COUNT] = {
+	"BOARD_TEMPERATURE", "SUPPLY_VOLTAGE", "ANTENNA_CURRENT", "ANTENNA_OPEN",
+	"ANTENNA_SHORTED", "ANTENNA_POWER", "RF_AGC", "RECEIVER_ERROR",
+	"RECEIVER_WARNING", "LOW_CNO", "RANGE_REJECTS"
+};
+
+const char* novatel::HealthEventName(HealthEventType type) {
+	if ((type < 0) || (type >= HEALTH_EVENT_COUNT))
+		return "UNKNOWN";
+	return health_event_names[type];
+}
+
+std::string novatel::FormatHealthSummary(const HealthSummary &summary) {
+	std::stringstream output;
+	output.setf(std::ios::fixed);
+	output.precision(1);
+	output << "temp=" << summary.board_temperature << "/" << summary.max_board_temperature
+	       << " supply=" << summary.supply_voltage << "/" << summary.min_supply_voltage;
+	output.precision(3);
+	output << " ant=" << summary.antenna_current;
+	output.precision(1);
+	output << " cno=" << summary.mean_cno << "/" << summary.min_channel_cno
+	       << " trk=" << summary.tracked_channels;
+	output.precision(2);
+	output << " rej=" << summary.reject_fraction
+	       << std::hex << " err=0x" << summary.receiver_error << " stat=0x" << summary.receiver_status
+	       << std::dec << " events=";
+	if (summary.active_events == 0)
+		output << "none";
+	bool first = true;
+	for (int ii=0; ii<HEALTH_EVENT_COUNT; ii++) {
+		if (summary.active_events & (1 << ii)) {
+			output << (first ? "" : ",") << health_event_names[ii];
+			first = false;
+		}
+	}
+	return output.str();
+}
+
+HealthMonitor::HealthMonitor(const HealthThresholds &thresholds) {
+	channel_cno_.resize(MAX_CHAN);
+	channel_prn_.assign(MAX_CHAN, 0);
+	tracked_channels_ = 0;
+	receiver_error_ = 0;
+	receiver_status_ = 0;
+	active_events_ = 0;
+	event_count_ = 0;
+	pending_count_ = 0;
+	set_thresholds(thresholds);
+}
+
+void HealthMonitor::set_thresholds(const HealthThresholds &thresholds) {
+	boost::mutex::scoped_lock lock(mutex_);
+	thresholds_ = thresholds;
+	board_temperature_.Resize(thresholds.window_size);
+	supply_voltage_.Resize(thresholds.window_size);
+	antenna_current_.Resize(thresholds.window_size);
+	lna_voltage_.Resize(thresholds.window_size);
+	mean_cno_.Resize(thresholds.window_size);
+	for (size_t ii=0; ii<channel_cno_.size(); ii++)
+		channel_cno_[ii].Resize(thresholds.window_size);
+	reject_history_.set_capacity(std::max((size_t)1, thresholds.window_size));
+	reject_history_.clear();
+	memset(reject_totals_, 0, sizeof(reject_totals_));
+}
+
+bool HealthMonitor::Above(HealthEventType type, double value, double threshold) {
+	if (active_events_ & (1 << type))
+		threshold -= fabs(threshold)*thresholds_.hysteresis;
+	return value > threshold;
+}
+
+bool HealthMonitor::Below(HealthEventType type, double value, double threshold) {
+	if (active_events_ & (1 << type))
+		threshold += fabs(threshold)*thresholds_.hysteresis;
+	return value < threshold;
+}
+
+void HealthMonitor::SetCondition(HealthEventType type, bool active, double value, double threshold,
+                                 double timestamp) {
+	bool was_active = (active_events_ & (1 << type)) != 0;
+	if (active == was_active)
+		return;
+	if (active) {
+		active_events_ |= (1 << type);
+		event_count_++;
+	} else {
+		active_events_ &= ~(1 << type);
+	}
+	HealthEvent &event = pending_[pending_count_++];
+	event.type = type;
+	event.active = active;
+	event.value = value;
+	event.threshold = threshold;
+	event.timestamp = timestamp;
+}
+
+void HealthMonitor::DispatchEvents(HealthEvent *events, size_t count) {
+	if (!event_callback_)
+		return;
+	for (size_t ii=0; ii<count; ii++)
+		event_callback_(events[ii]);
+}
+
+void HealthMonitor::AddHardwareLevels(const ReceiverHardwareStatus &levels, double timestamp) {
+	HealthEvent events[HEALTH_EVENT_COUNT];
+	size_t count;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		pending_count_ = 0;
+		board_temperature_.Add(levels.board_temperature);
+		supply_voltage_.Add(levels.supply_voltage);
+		antenna_current_.Add(levels.antenna_current);
+		lna_voltage_.Add(levels.lna_voltage);
+
+		double temperature = board_temperature_.mean();
+		SetCondition(HEALTH_BOARD_TEMPERATURE,
+		             Above(HEALTH_BOARD_TEMPERATURE, temperature, thresholds_.max_board_temperature),
+		             temperature, thresholds_.max_board_temperature, timestamp);
+		double voltage = supply_voltage_.mean();
+		bool low_voltage = Below(HEALTH_SUPPLY_VOLTAGE, voltage, thresholds_.min_supply_voltage);
+		SetCondition(HEALTH_SUPPLY_VOLTAGE,
+		             low_voltage || Above(HEALTH_SUPPLY_VOLTAGE, voltage, thresholds_.max_supply_voltage),
+		             voltage, low_voltage ? thresholds_.min_supply_voltage : thresholds_.max_supply_voltage,
+		             timestamp);
+		double current = antenna_current_.mean();
+		bool low_current = Below(HEALTH_ANTENNA_CURRENT, current, thresholds_.min_antenna_current);
+		SetCondition(HEALTH_ANTENNA_CURRENT,
+		             low_current || Above(HEALTH_ANTENNA_CURRENT, current, thresholds_.max_antenna_current),
+		             current, low_current ? thresholds_.min_antenna_current : thresholds_.max_antenna_current,
+		             timestamp);
+
+		count = pending_count_;
+		std::copy(pending_, pending_+count, events);
+	}
+	DispatchEvents(events, count);
+}
+
+void HealthMonitor::AddTrackStatus(const TrackStatus &status, double timestamp) {
+	HealthEvent events[HEALTH_EVENT_COUNT];
+	size_t count;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		pending_count_ = 0;
+		uint32_t codes[REJECT_CODE_SLOTS] = {0};
+		uint32_t tracked = 0;
+		double cno_sum = 0;
+		size_t channels = std::min((size_t)std::max(status.number_of_channels, 0), (size_t)MAX_CHAN);
+		for (size_t ii=0; ii<channels; ii++) {
+			const TrackStatusData &channel = status.data[ii];
+			if ((channel.prn == 0) || (channel.cno_ratio <= 0)) {
+				channel_prn_[ii] = 0;
+				continue;
+			}
+			// a channel moved to a new satellite starts a fresh window
+			if (channel_prn_[ii] != channel.prn) {
+				channel_cno_[ii].Clear();
+				channel_prn_[ii] = channel.prn;
+			}
+			channel_cno_[ii].Add(channel.cno_ratio);
+			cno_sum += channel.cno_ratio;
+			codes[RejectCodeSlot(channel.range_reject_code)]++;
+			tracked++;
+		}
+		for (size_t ii=channels; ii<channel_prn_.size(); ii++)
+			channel_prn_[ii] = 0;
+		tracked_channels_ = tracked;
+
+		// no satellites at all is as much a sign of jamming as weak ones
+		mean_cno_.Add(tracked ? cno_sum/tracked : 0);
+		double cno = mean_cno_.mean();
+		SetCondition(HEALTH_LOW_CNO, Below(HEALTH_LOW_CNO, cno, thresholds_.min_mean_cno),
+		             cno, thresholds_.min_mean_cno, timestamp);
+
+		if (reject_history_.full()) {
+			const std::vector<uint32_t> &oldest = reject_history_.front();
+			for (size_t ii=0; ii<REJECT_CODE_SLOTS; ii++)
+				reject_totals_[ii] -= oldest[ii];
+		}
+		reject_history_.push_back(std::vector<uint32_t>(codes, codes+REJECT_CODE_SLOTS));
+		uint32_t total = 0;
+		for (size_t ii=0; ii<REJECT_CODE_SLOTS; ii++) {
+			reject_totals_[ii] += codes[ii];
+			total += reject_totals_[ii];
+		}
+		double rejected = total ? (double)(total - reject_totals_[GOOD])/total : 0;
+		SetCondition(HEALTH_RANGE_REJECTS,
+		             Above(HEALTH_RANGE_REJECTS, rejected, thresholds_.max_reject_fraction),
+		             rejected, thresholds_.max_reject_fraction, timestamp);
+
+		count = pending_count_;
+		std::copy(pending_, pending_+count, events);
+	}
+	DispatchEvents(events, count);
+}
+
+void HealthMonitor::AddReceiverStatus(const RXStatus &status, double timestamp) {
+	HealthEvent events[HEALTH_EVENT_COUNT];
+	size_t count;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		pending_count_ = 0;
+		memcpy(&receiver_error_, &status.error, sizeof(receiver_error_));
+		memcpy(&receiver_status_, &status.rxStat, sizeof(receiver_status_));
+		const ReceiverStatus &flags = status.rxStat;
+		SetCondition(HEALTH_ANTENNA_OPEN, flags.antennaOpenFlag != 0, receiver_status_, 0, timestamp);
+		SetCondition(HEALTH_ANTENNA_SHORTED, flags.antennaShortedFlag != 0, receiver_status_, 0, timestamp);
+		SetCondition(HEALTH_ANTENNA_POWER, flags.antennaPowerStatus != 0, receiver_status_, 0, timestamp);
+		SetCondition(HEALTH_RF_AGC, (flags.RF1AGCStatus != 0) || (flags.RF2AGCStatus != 0),
+		             receiver_status_, 0, timestamp);
+		SetCondition(HEALTH_RECEIVER_ERROR, receiver_error_ != 0, receiver_error_, 0, timestamp);
+		SetCondition(HEALTH_RECEIVER_WARNING,
+		             (flags.temperatureStatus != 0) || (flags.voltageSupplyStatus != 0),
+		             receiver_status_, 0, timestamp);
+
+		count = pending_count_;
+		std::copy(pending_, pending_+count, events);
+	}
+	DispatchEvents(events, count);
+}
+
+HealthSummary HealthMonitor::Summary() {
+	boost::mutex::scoped_lock lock(mutex_);
+	HealthSummary summary;
+	summary.board_temperature = board_temperature_.mean();
+	summary.max_board_temperature = board_temperature_.max();
+	summary.supply_voltage = supply_voltage_.mean();
+	summary.min_supply_voltage = supply_voltage_.min();
+	summary.antenna_current = antenna_current_.mean();
+	summary.lna_voltage = lna_voltage_.mean();
+	summary.mean_cno = mean_cno_.mean();
+	summary.min_channel_cno = 0;
+	bool first = true;
+	for (size_t ii=0; ii<channel_cno_.size(); ii++) {
+		if ((channel_prn_[ii] == 0) || (channel_cno_[ii].count() == 0))
+			continue;
+		if (first || (channel_cno_[ii].mean() < summary.min_channel_cno))
+			summary.min_channel_cno = channel_cno_[ii].mean();
+		first = false;
+	}
+	summary.tracked_channels = tracked_channels_;
+	uint32_t total = 0;
+	for (size_t ii=0; ii<REJECT_CODE_SLOTS; ii++) {
+		summary.reject_counts[ii] = reject_totals_[ii];
+		total += reject_totals_[ii];
+	}
+	summary.reject_fraction = total ? (double)(total - reject_totals_[GOOD])/total : 0;
+	summary.receiver_error = receiver_error_;
+	summary.receiver_status = receiver_status_;
+	summary.active_events = active_events_;
+	summary.event_count = event_count_;
+	return summary;
+}
+
+bool HealthMonitor::IsActive(HealthEventType type) {
+	boost::mutex::scoped_lock lock(mutex_);
+	return (active_events_ & (1 << type)) != 0;
+}
@@ -0,0 +1,94 @@
+#include "novatel/novatel_logging.h"
+
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+
+using namespace novatel;
+
+LogLevel novatel::LogLevelFromString(const std::string &name) {
+	if (name == "debug")
+		return LOG_LEVEL_DEBUG;
+	if (name == "info")
+		return LOG_LEVEL_INFO;
+	if (name == "warning")
+		return LOG_LEVEL_WARNING;
+	if (name == "error")
+		return LOG_LEVEL_ERROR;
+	if (name == "none")
+		return LOG_LEVEL_NONE;
+	throw std::invalid_argument("Unknown log level '" + name + "', expected debug, info, warning, error or none");
+}
+
+Logger::Logger() : level_(LOG_LEVEL_INFO), max_queued_(0), async_(false), dropped_count_(0) {
+}
+
+Logger::~Logger() {
+	StopAsync();
+}
+
+void Logger::set_sink(LogLevel level, LogMsgCallback sink) {
+	if (level < LOG_LEVEL_NONE)
+		sinks_[level] = sink;
+}
+
+void Logger::Write(LogLevel level, const std::string &message) {
+	if (level >= LOG_LEVEL_NONE)
+		return;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if (async_) {
+			if (queue_.size() >= max_queued_) {
+				dropped_count_++;
+				return;
+			}
+			queue_.push_back(std::make_pair(level, message));
+			condition_.notify_one();
+			return;
+		}
+	}
+	if (sinks_[level])
+		sinks_[level](message);
+}
+
+void Logger::StartAsync(size_t max_queued) {
+	boost::mutex::scoped_lock lock(mutex_);
+	max_queued_ = max_queued;
+	if (async_)
+		return;
+	async_ = true;
+	thread_ = boost::thread(boost::bind(&Logger::WriteQueued, this));
+}
+
+void Logger::StopAsync() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if (!async_)
+			return;
+		async_ = false;
+		condition_.notify_all();
+	}
+	thread_.join();
+}
+
+void Logger::WriteQueued() {
+	boost::mutex::scoped_lock lock(mutex_);
+	while (true) {
+		while (async_ && queue_.empty())
+			condition_.wait(lock);
+		if (queue_.empty())
+			return;	// stopped and drained
+		std::pair<LogLevel, std::string> message;
+		message.first = queue_.front().first;
+		message.second.swap(queue_.front().second);
+		queue_.pop_front();
+		lock.unlock();
+		try {
+			if (sinks_[message.first])
+				sinks_[message.first](message.second);
+		} catch (...) {
+			// a failing sink must not take the logging thread with it
+		}
+		lock.lock();
+	}
+}
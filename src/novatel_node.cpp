@@ -44,11 +44,18 @@
 #include "sensor_msgs/NavSatFix.h"
 #include "gps_msgs/Ephemeris.h"
 #include "gps_msgs/L1L2Range.h"
+#include "std_msgs/String.h"
+#include "std_msgs/UInt8MultiArray.h"
 
 #include <boost/tokenizer.hpp>
 #include <boost/thread/thread.hpp>
 
 #include "novatel/novatel.h"
+#include "novatel/novatel_ephemeris.h"
+#include "novatel/novatel_fanout.h"
+#include "novatel/novatel_health.h"
+#include "novatel/novatel_rtcm_encode.h"
+#include "novatel/novatel_rtk_monitor.h"
 using namespace novatel;
 
 // Logging system message handlers
@@ -78,13 +85,21 @@ public:
     gps_.setLogDebugCallback(handleDebugMessages);
 
     gps_.set_best_utm_position_callback(boost::bind(&NovatelNode::BestUtmHandler, this, _1, _2));
-    gps_.set_best_velocity_callback(boost::bind(&NovatelNode::BestVelocityHandler, this, _1, _2));
+    // velocity and ins covariance are read from the latest log cache when
+    // the matching position arrives
+    gps_.EnableLatest(BESTVELB_LOG_TYPE);
+    gps_.EnableLatest(INSCOV_LOG_TYPE);
     gps_.set_best_position_ecef_callback(boost::bind(&NovatelNode::BestPositionEcefHandler, this, _1, _2));
     //gps_.set_ins_position_velocity_attitude_short_callback(boost::bind(&NovatelNode::InsPvaHandler, this, _1, _2));
     //gps_.set_ins_covariance_short_callback(boost::bind(&NovatelNode::InsCovHandler, this, _1, _2));
     gps_.set_ins_position_velocity_attitude_callback(boost::bind(&NovatelNode::InsPvaHandler, this, _1, _2));
-    gps_.set_ins_covariance_callback(boost::bind(&NovatelNode::InsCovHandler, this, _1, _2));    gps_.set_raw_imu_short_callback(boost::bind(&NovatelNode::RawImuHandler, this, _1, _2));
+    gps_.set_raw_imu_short_callback(boost::bind(&NovatelNode::RawImuHandler, this, _1, _2));
     gps_.set_receiver_hardware_status_callback(boost::bind(&NovatelNode::HardwareStatusHandler, this, _1, _2));
+    gps_.set_tracking_status_callback(boost::bind(&NovatelNode::TrackStatusHandler, this, _1, _2));
+    gps_.set_receiver_status_callback(boost::bind(&NovatelNode::ReceiverStatusHandler, this, _1, _2));
+    health_monitor_.set_event_callback(boost::bind(&NovatelNode::HealthEventHandler, this, _1));
+    gps_.set_rtk_data_callback(boost::bind(&NovatelNode::RtkDataHandler, this, _1, _2));
+    rtk_monitor_.set_event_callback(boost::bind(&NovatelNode::RtkEventHandler, this, _1));
     gps_.set_gps_ephemeris_callback(boost::bind(&NovatelNode::EphemerisHandler, this, _1, _2));
     gps_.set_compressed_range_measurements_callback(boost::bind(&NovatelNode::CompressedRangeHandler, this, _1, _2));
     // gps_.set_range_measurements_callback(boost::bind(&NovatelNode::RangeHandler, this, _1, _2));
@@ -164,6 +179,7 @@ public:
     cur_odom_.pose.covariance[28] = DBL_MAX;
 
     // see if there is a recent velocity message
+    gps_.GetLatest<BESTVELB_LOG_TYPE>(cur_velocity_);
     if ((cur_velocity_.header.gps_week==pos.header.gps_week) 
          && (cur_velocity_.header.gps_millisecs==pos.header.gps_millisecs)) 
     {
@@ -193,12 +209,6 @@ public:
   }
 
 
-  void BestVelocityHandler(Velocity &vel, double &timestamp) {
-    ROS_DEBUG("Received BestVel");
-    cur_velocity_ = vel;
-  }
-
-
   void InsPvaHandler(InsPositionVelocityAttitude &ins_pva, double &timestamp) {
     //ROS_INFO("Received inspva.");
 
@@ -244,6 +254,7 @@ public:
       // TODO: add covariance
 
     // see if there is a matching ins covariance message
+    gps_.GetLatest<INSCOV_LOG_TYPE>(cur_ins_cov_);
     if ((cur_ins_cov_.gps_week==ins_pva.gps_week) 
          && (cur_ins_cov_.gps_millisecs==ins_pva.gps_millisecs)) {
 
@@ -286,47 +297,117 @@ public:
   void RawImuHandler(RawImuShort &imu, double &timestamp) {}
 
 
-  void InsCovHandler(InsCovariance &cov, double &timestamp) {
-     cur_ins_cov_ = cov;
+  void HardwareStatusHandler(ReceiverHardwareStatus &status, double &timestamp) {
+    health_monitor_.AddHardwareLevels(status, timestamp);
+  }
+
+  void TrackStatusHandler(TrackStatus &status, double &timestamp) {
+    health_monitor_.AddTrackStatus(status, timestamp);
   }
 
+  void ReceiverStatusHandler(RXStatus &status, double &timestamp) {
+    health_monitor_.AddReceiverStatus(status, timestamp);
+  }
 
-  void HardwareStatusHandler(ReceiverHardwareStatus &status, double &timestamp) {}
+  void HealthEventHandler(const HealthEvent &event) {
+    if (event.active)
+      ROS_WARN_STREAM(name_ << ": Receiver health: " << HealthEventName(event.type) << " value: "
+                      << event.value << " limit: " << event.threshold);
+    else
+      ROS_INFO_STREAM(name_ << ": Receiver health: " << HealthEventName(event.type) << " cleared");
+  }
+
+  void RtkDataHandler(rtkdatab_log &data, double &timestamp) {
+    rtk_monitor_.AddRtkData(data, timestamp);
+  }
+
+  void RtkEventHandler(const RtkEvent &event) {
+    if (event.type == RTK_FIX_LOST)
+      ROS_WARN_STREAM(name_ << ": RTK fix lost after " << event.value << " s");
+    else if (event.type == RTK_FIX_ACQUIRED)
+      ROS_INFO_STREAM(name_ << ": RTK fix acquired after " << event.value << " s");
+  }
+
+  void PublishRtkSummary(const ros::TimerEvent &event) {
+    std_msgs::String msg;
+    msg.data = FormatRtkSummary(rtk_monitor_.Summary());
+    rtk_publisher_.publish(msg);
+  }
+
+  void RestartMilestoneHandler(RestartMilestone milestone, PositionType type, double seconds) {
+    std_msgs::String msg;
+    msg.data = FormatRestartReport(gps_.GetRestartReport());
+    restart_publisher_.publish(msg);
+  }
+
+  void PublishHealth(const ros::TimerEvent &event) {
+    std_msgs::String msg;
+    msg.data = FormatHealthSummary(health_monitor_.Summary());
+    health_publisher_.publish(msg);
+  }
 
 
   void EphemerisHandler(GpsEphemeris &ephem, double &timestamp) {
-    cur_ephem_.header.stamp = ros::Time::now();
-    cur_ephem_.gps_time = ephem.header.gps_millisecs*1000;
-    cur_ephem_.obs = 1;
-    uint8_t n = ephem.prn; // how drtk expects it
-    cur_ephem_.prn[n] = ephem.prn;
-    cur_ephem_.health[n] = ephem.health;
-    cur_ephem_.semimajor_axis[n] = ephem.semi_major_axis; // this value is A, not the sqrt of A
-    cur_ephem_.mean_anomaly[n] = ephem.anomoly_reference_time;
-    cur_ephem_.eccentricity[n] = ephem.eccentricity;
-    cur_ephem_.perigee_arg[n] = ephem.omega;
-    cur_ephem_.cos_latitude[n] = ephem.latitude_cosine;
-    cur_ephem_.sin_latitude[n] = ephem.latitude_sine;
-    cur_ephem_.cos_orbit_radius[n] = ephem.orbit_radius_cosine;
-    cur_ephem_.sin_orbit_radius[n] = ephem.orbit_radius_sine;
-    cur_ephem_.cos_inclination[n] = ephem.inclination_cosine;
-    cur_ephem_.sin_inclination[n] = ephem.inclination_sine;
-    cur_ephem_.inclination_angle[n] = ephem.inclination_angle;
-    cur_ephem_.right_ascension[n] = ephem.right_ascension;
-    cur_ephem_.mean_motion_diff[n] = ephem.mean_motion_difference;
-    cur_ephem_.inclination_rate[n] = ephem.inclination_angle_rate;
-    cur_ephem_.ascension_rate[n] = ephem.right_ascension_rate;
-    cur_ephem_.time_of_week[n] = ephem.time_of_week;
-    cur_ephem_.reference_time[n] = ephem.time_of_ephemeris;
-    cur_ephem_.clock_correction[n] = ephem.sv_clock_correction;
-    cur_ephem_.group_delay[n] = ephem.group_delay_difference;
-    cur_ephem_.clock_aging_1[n] = ephem.clock_aligning_param_0;
-    cur_ephem_.clock_aging_2[n] = ephem.clock_aligning_param_1;
-    cur_ephem_.clock_aging_3[n] = ephem.clock_aligning_param_2;
+    // the receiver repeats ephemerides that have not changed, only publish
+    // new uploads
+    if (!ephemeris_store_.Update(ephem))
+      return;
+    if (ephemeris_publish_period_ > 0)
+      return; // published as a full set by PublishEphemerides
 
+    cur_ephem_.header.stamp = ros::Time::now();
+    FillEphemeris(ephem, cur_ephem_);
     ephemeris_publisher_.publish(cur_ephem_);
   }
 
+  void PublishEphemerides(const ros::TimerEvent &event) {
+    uint32_t version = ephemeris_store_.version();
+    if (version == published_ephemeris_version_)
+      return;
+    published_ephemeris_version_ = version;
+
+    std::vector<GpsEphemeris> ephemerides = ephemeris_store_.Snapshot();
+    gps_msgs::Ephemeris msg;
+    msg.header.stamp = ros::Time::now();
+    double newest = 0;
+    for (size_t ii=0; ii<ephemerides.size(); ii++) {
+      FillEphemeris(ephemerides[ii], msg);
+      newest = std::max(newest, msg.gps_time);
+    }
+    msg.gps_time = newest;
+    ephemeris_publisher_.publish(msg);
+  }
+
+  void FillEphemeris(const GpsEphemeris &ephem, gps_msgs::Ephemeris &msg) {
+    msg.gps_time = ephem.header.gps_millisecs*1000;
+    msg.obs = 1;
+    uint8_t n = ephem.prn; // how drtk expects it
+    msg.prn[n] = ephem.prn;
+    msg.health[n] = ephem.health;
+    msg.semimajor_axis[n] = ephem.semi_major_axis; // this value is A, not the sqrt of A
+    msg.mean_anomaly[n] = ephem.anomoly_reference_time;
+    msg.eccentricity[n] = ephem.eccentricity;
+    msg.perigee_arg[n] = ephem.omega;
+    msg.cos_latitude[n] = ephem.latitude_cosine;
+    msg.sin_latitude[n] = ephem.latitude_sine;
+    msg.cos_orbit_radius[n] = ephem.orbit_radius_cosine;
+    msg.sin_orbit_radius[n] = ephem.orbit_radius_sine;
+    msg.cos_inclination[n] = ephem.inclination_cosine;
+    msg.sin_inclination[n] = ephem.inclination_sine;
+    msg.inclination_angle[n] = ephem.inclination_angle;
+    msg.right_ascension[n] = ephem.right_ascension;
+    msg.mean_motion_diff[n] = ephem.mean_motion_difference;
+    msg.inclination_rate[n] = ephem.inclination_angle_rate;
+    msg.ascension_rate[n] = ephem.right_ascension_rate;
+    msg.time_of_week[n] = ephem.time_of_week;
+    msg.reference_time[n] = ephem.time_of_ephemeris;
+    msg.clock_correction[n] = ephem.sv_clock_correction;
+    msg.group_delay[n] = ephem.group_delay_difference;
+    msg.clock_aging_1[n] = ephem.clock_aligning_param_0;
+    msg.clock_aging_2[n] = ephem.clock_aligning_param_1;
+    msg.clock_aging_3[n] = ephem.clock_aligning_param_2;
+  }
+
 
   void CompressedRangeHandler(CompressedRangeMeasurements &range, double &timestamp) {
     gps_msgs::L1L2Range cur_range_;
@@ -340,41 +421,35 @@ public:
       // make sure something on this index & it is a GPS constellation SV
       if (
         (!range.range_data[n].range_record.satellite_prn) // empty field
-        || (range.range_data[n].channel_status.satellite_sys != 0) // critical
+        || (range.range_data[n].channel_status.satellite_sys != SATSYS_GPS) // critical
         || (range.range_data[n].range_record.satellite_prn > 33) // critical
         )
       {
         continue;
       }
 
-      uint8_t prn_idx = range.range_data[n].range_record.satellite_prn;
-      switch (range.range_data[n].channel_status.signal_type) {
-        case 0: // L1 C/A
-          cur_range_.L1.prn[prn_idx] = prn_idx;
-          cur_range_.L1.psr[prn_idx] = range.range_data[n].range_record.pseudorange/128.;
-          cur_range_.L1.psr_std[prn_idx] = range.range_data[n].range_record.pseudorange_standard_deviation; // FIXME scale factor?
-          cur_range_.L1.carrier.doppler[prn_idx] = range.range_data[n].range_record.doppler/256.;
-          cur_range_.L1.carrier.noise[prn_idx] = range.range_data[n].range_record.carrier_to_noise + 20.;
-          cur_range_.L1.carrier.phase[prn_idx] = -range.range_data[n].range_record.accumulated_doppler/256.; // negative sign is critical!!!
-          cur_range_.L1.carrier.phase_std[prn_idx] = range.range_data[n].range_record.accumulated_doppler_std_deviation; // FIXME scale factor?
-          L1_obs++;
-          break;
-        case 5: // L2 P
-        case 9: // L2 P codeless
-        case 17: // L2 C
-          cur_range_.L2.prn[prn_idx] = prn_idx;
-          cur_range_.L2.psr[prn_idx] = range.range_data[n].range_record.pseudorange/128.;
-          cur_range_.L2.psr_std[prn_idx] = range.range_data[n].range_record.pseudorange_standard_deviation; // FIXME scale factor?
-          cur_range_.L2.carrier.doppler[prn_idx] = range.range_data[n].range_record.doppler/256.;
-          cur_range_.L2.carrier.noise[prn_idx] = range.range_data[n].range_record.carrier_to_noise + 20.;
-          cur_range_.L2.carrier.phase[prn_idx] = -range.range_data[n].range_record.accumulated_doppler/256.; // negative sign is critical!!!
-          cur_range_.L2.carrier.phase_std[prn_idx] = range.range_data[n].range_record.accumulated_doppler_std_deviation; // FIXME scale factor?
-          L2_obs++;
-          break;
-        default:
-          ROS_INFO_STREAM(name_ << ": L1L2RangeHandler: Unhandled signal type " << range.range_data[n].channel_status.signal_type);
-          break;
+      const CompressedRangeData &data = range.range_data[n];
+      const SignalInfo *signal = LookupSignal(data.channel_status);
+      if (!signal || ((signal->band != BAND_L1) && (signal->band != BAND_L2))) {
+        ROS_INFO_STREAM(name_ << ": L1L2RangeHandler: Unhandled signal type "
+                        << (signal ? signal->id : "unknown") << " (" << data.channel_status.signal_type << ")");
+        continue;
       }
+      uint8_t prn_idx = data.range_record.satellite_prn;
+      gps_msgs::L1L2Range::_L1_type &band = (signal->band == BAND_L1) ? cur_range_.L1 : cur_range_.L2;
+      double psr = data.range_record.pseudorange/128.;
+      band.prn[prn_idx] = prn_idx;
+      band.psr[prn_idx] = psr;
+      band.psr_std[prn_idx] = data.range_record.pseudorange_standard_deviation; // FIXME scale factor?
+      band.carrier.doppler[prn_idx] = data.range_record.doppler/256.;
+      band.carrier.noise[prn_idx] = data.range_record.carrier_to_noise + 20.;
+      // rolled over ADR restored with the wavelength from the registry
+      band.carrier.phase[prn_idx] = -UnpackCompressedAdr(data, psr); // negative sign is critical!!!
+      band.carrier.phase_std[prn_idx] = data.range_record.accumulated_doppler_std_deviation; // FIXME scale factor?
+      if (signal->band == BAND_L1)
+        L1_obs++;
+      else
+        L2_obs++;
     }
         
     cur_range_.L1.obs = L1_obs;
@@ -476,13 +551,87 @@ public:
     this->odom_publisher_ = nh_.advertise<nav_msgs::Odometry>(odom_topic_,0);
     this->nav_sat_fix_publisher_ = nh_.advertise<sensor_msgs::NavSatFix>(nav_sat_fix_topic_,0);
     // ! FIXME - only advertise ephem/range if going to publish it.
-    this->ephemeris_publisher_ = nh_.advertise<gps_msgs::Ephemeris>(ephemeris_topic_,0);
+    this->ephemeris_publisher_ = nh_.advertise<gps_msgs::Ephemeris>(ephemeris_topic_,0,latch_ephemeris_);
+    published_ephemeris_version_ = 0;
+    if (ephemeris_publish_period_ > 0)
+      ephemeris_timer_ = nh_.createTimer(ros::Duration(ephemeris_publish_period_), &NovatelNode::PublishEphemerides, this);
     this->dual_band_range_publisher_ = nh_.advertise<gps_msgs::L1L2Range>(dual_band_range_topic_,0);
     this->psrpos_publisher_ = nh_.advertise<sensor_msgs::NavSatFix>(psrpos_topic_,0);
     this->ecefpos_publisher_ = nh_.advertise<nav_msgs::Odometry>(ecefpos_topic_,0);
+    // nmea and rtcm3 output sharing the receiver port with the binary logs
+    if (!nmea_topic_.empty()) {
+      nmea_publisher_ = nh_.advertise<std_msgs::String>(nmea_topic_,0);
+      gps_.set_nmea_callback(boost::bind(&NovatelNode::NmeaHandler, this, _1, _2));
+    }
+    if (!rtcm_output_topic_.empty()) {
+      rtcm_output_publisher_ = nh_.advertise<std_msgs::UInt8MultiArray>(rtcm_output_topic_,0);
+      gps_.set_rtcm3_output_callback(boost::bind(&NovatelNode::RtcmOutputHandler, this, _1, _2));
+    }
+    // rtcm3 msm and station position encoded from the range logs and
+    // served to local rovers, see range_default_logs_period
+    if (!rtcm_server_endpoints_.empty()) {
+      try {
+        boost::char_separator<char> separators(" ,");
+        boost::tokenizer<boost::char_separator<char> > endpoints(rtcm_server_endpoints_, separators);
+        for (boost::tokenizer<boost::char_separator<char> >::iterator endpoint = endpoints.begin();
+             endpoint != endpoints.end(); ++endpoint)
+          rtcm_server_.AddEndpoint(*endpoint);
+        rtcm_server_.set_client_callback(boost::bind(&NovatelNode::RtcmClientHandler, this, _1, _2));
+        rtcm_server_.Start();
+        rtcm_station_time_ = -1e9;
+        gps_.set_range_measurements_callback(boost::bind(&NovatelNode::RtcmEncodeHandler, this, _1, _2));
+        if (range_default_logs_period_ <= 0)
+          ROS_WARN_STREAM(name_ << ": RTCM server needs range_default_logs_period > 0 for RANGECMPB");
+      } catch (std::exception &e) {
+        ROS_ERROR_STREAM(name_ << ": Could not start the RTCM server: " << e.what());
+      }
+    }
+    // one line receiver health summary at a low rate
+    health_monitor_.set_thresholds(health_thresholds_);
+    if (!health_topic_.empty() && (health_publish_period_ > 0)) {
+      health_publisher_ = nh_.advertise<std_msgs::String>(health_topic_,0);
+      health_timer_ = nh_.createTimer(ros::Duration(health_publish_period_), &NovatelNode::PublishHealth, this);
+    }
+    // RTK engine statistics from RTKDATAB at a low rate
+    if (!rtk_topic_.empty() && (rtk_publish_period_ > 0)) {
+      rtk_publisher_ = nh_.advertise<std_msgs::String>(rtk_topic_,0);
+      rtk_timer_ = nh_.createTimer(ros::Duration(rtk_publish_period_), &NovatelNode::PublishRtkSummary, this);
+    }
+    // time to first fix from node start, republished as each milestone is reached
+    if (!restart_topic_.empty()) {
+      restart_publisher_ = nh_.advertise<std_msgs::String>(restart_topic_,0,true);
+      gps_.set_restart_milestone_callback(boost::bind(&NovatelNode::RestartMilestoneHandler, this, _1, _2, _3));
+      gps_.TrackRestart();
+    }
 
     //em_.setDataCallback(boost::bind(&EM61Node::HandleEmData, this, _1));
-    gps_.Connect(port_,baudrate_);
+    // try to pick up a receiver that is still streaming from a previous run
+    // before falling back to a full connect and reconfiguration
+    gps_.set_thread_scheduling(scheduling_);
+    if (prioritize_navigation_logs_)
+      gps_.UseDefaultLogPriorities();
+    if (callback_threads_ > 0) {
+      gps_.StartCallbackExecutor(callback_threads_);
+      executor_timer_ = nh_.createTimer(ros::Duration(10.0), &NovatelNode::ReportExecutor, this);
+    }
+    if (scheduling_.measure_latency)
+      latency_timer_ = nh_.createTimer(ros::Duration(10.0), &NovatelNode::ReportLatency, this);
+
+    // record from the first byte read, including the connection handshake
+    if (!record_file_.empty())
+      gps_.StartRecording(record_file_, record_config_);
+    // keep recent frames in memory and dump them when the solution degrades
+    if (!flight_config_.directory.empty())
+      gps_.StartFlightRecorder(flight_config_);
+    // share the receiver with local tools that cannot open the port themselves
+    if (!stream_endpoints_.empty())
+      gps_.StartStreamServer(stream_endpoints_, stream_config_);
+
+    attached_ = false;
+    if (attach_)
+      attached_ = gps_.Attach(port_,baudrate_);
+    if (!attached_)
+      gps_.Connect(port_,baudrate_);
 
     // configure default log sets
     if (gps_default_logs_period_>0) {
@@ -493,7 +642,7 @@ public:
       default_logs.precision(2);
       default_logs << "BESTUTMB ONTIME " << std::fixed << gps_default_logs_period_ << ";";
       default_logs << "BESTVELB ONTIME " << std::fixed << gps_default_logs_period_;
-      gps_.ConfigureLogs(default_logs.str());
+      ConfigureLogs(default_logs.str());
     }
 
     if (span_default_logs_period_>0) {
@@ -505,34 +654,59 @@ public:
       default_logs << "INSPVAB ONTIME " << std::fixed << span_default_logs_period_ << ";";
       default_logs << "INSCOVB ONTIME " << std::fixed << span_default_logs_period_;
       ROS_INFO_STREAM("default logs: " << default_logs);  
-    gps_.ConfigureLogs(default_logs.str());
+    ConfigureLogs(default_logs.str());
     }
 
     if (!ephem_log_.empty()) {
       std::stringstream default_logs;
       default_logs << "GPSEPHEMB " << std::fixed << ephem_log_;
-      gps_.ConfigureLogs(default_logs.str());
+      ConfigureLogs(default_logs.str());
     }
 
     if (range_default_logs_period_>0) {
       std::stringstream default_logs;
       default_logs.precision(2);
       default_logs << "RANGECMPB ONTIME " << std::fixed << range_default_logs_period_ << ";";
-      gps_.ConfigureLogs(default_logs.str());
+      ConfigureLogs(default_logs.str());
     }
 
     if (psrpos_default_logs_period_>0) {
       std::stringstream default_logs;
       default_logs.precision(2);
       default_logs << "PSRPOSB ONTIME " << std::fixed << psrpos_default_logs_period_ << ";";
-      gps_.ConfigureLogs(default_logs.str());
+      ConfigureLogs(default_logs.str());
+    }
+
+    if (health_logs_period_>0) {
+      std::stringstream health_logs;
+      health_logs.precision(2);
+      health_logs << "RXHWLEVELSB ONTIME " << std::fixed << health_logs_period_ << ";";
+      health_logs << "TRACKSTATB ONTIME " << std::fixed << health_logs_period_ << ";";
+      health_logs << "RXSTATUSB ONCHANGED";
+      ConfigureLogs(health_logs.str());
+    }
+
+    if (rtk_logs_period_>0) {
+      std::stringstream rtk_logs;
+      rtk_logs.precision(2);
+      rtk_logs << "RTKDATAB ONTIME " << std::fixed << rtk_logs_period_;
+      ConfigureLogs(rtk_logs.str());
     }
 
     // configure additional logs
-    gps_.ConfigureLogs(log_commands_);
+    ConfigureLogs(log_commands_);
+
+    // forward rtcm corrections to the receiver
+    if (!rtcm_source_.empty())
+      gps_.StartCorrectionSource(rtcm_source_);
+    if (!rtcm_topic_.empty())
+      rtcm_subscriber_ = nh_.subscribe(rtcm_topic_, 10, &NovatelNode::RtcmHandler, this,
+                                       ros::TransportHints().tcpNoDelay());
+    if (!rtcm_source_.empty() || !rtcm_topic_.empty())
+      correction_timer_ = nh_.createTimer(ros::Duration(10.0), &NovatelNode::ReportCorrections, this);
 
     // configure serial port (for rtk generally)
-    if (configure_port_!="") {
+    if ((configure_port_!="") && !attached_) {
       // string should contain com_port,baud_rate,rx_mode,tx_mode
       // parse message body by tokening on ","
       typedef boost::tokenizer<boost::char_separator<char> >
@@ -572,10 +746,101 @@ public:
 
 protected:
 
+  void NmeaHandler(const std::string &sentence, double &timestamp) {
+    std_msgs::String msg;
+    msg.data = sentence;
+    nmea_publisher_.publish(msg);
+  }
+
+  void RtcmOutputHandler(const unsigned char *frame, size_t length) {
+    std_msgs::UInt8MultiArray msg;
+    msg.data.assign(frame, frame+length);
+    rtcm_output_publisher_.publish(msg);
+  }
+
+  void RtcmEncodeHandler(RangeMeasurements &ranges, double &timestamp) {
+    // the encoder and frame buffer are reused, so each epoch is encoded
+    // once into the same memory and copied once into the server's ring
+    rtcm_frames_.clear();
+    if (rtcm_encoder_.has_reference_position() && (fabs(timestamp - rtcm_station_time_) >= rtcm_station_period_)) {
+      rtcm_encoder_.EncodeStationPosition(rtcm_frames_);
+      rtcm_station_time_ = timestamp;
+    }
+    rtcm_encoder_.EncodeObservations(ranges, rtcm_frames_);
+    if (rtcm_encoder_.unknown_glonass_frequency_count() > 0)
+      ROS_WARN_STREAM_THROTTLE(60, name_ << ": " << rtcm_encoder_.unknown_glonass_frequency_count()
+                               << " GLONASS observations left out of RTCM until RANGEB gives their frequency numbers");
+    // one message per frame so udp destinations get a datagram per frame
+    size_t offset = 0;
+    while (offset < rtcm_frames_.size()) {
+      size_t length = RTCM3_HEADER_SIZE + Rtcm3PayloadLength(&rtcm_frames_[offset]) + RTCM3_CRC_SIZE;
+      rtcm_server_.Publish(&rtcm_frames_[offset], length);
+      offset += length;
+    }
+  }
+
+  void RtcmClientHandler(const std::string &client, bool connected) {
+    ROS_INFO_STREAM(name_ << ": RTCM client " << client << (connected ? " connected" : " disconnected"));
+  }
+
+  void RtcmHandler(const std_msgs::UInt8MultiArray::ConstPtr &msg) {
+    if (!msg->data.empty())
+      gps_.InjectCorrections(&msg->data[0], msg->data.size());
+  }
+
+  void ReportCorrections(const ros::TimerEvent &event) {
+    CorrectionStats stats = gps_.GetCorrectionStats();
+    ROS_INFO_STREAM(name_ << ": Corrections forwarded: " << stats.frames_forwarded
+                    << " dropped: " << stats.frames_dropped << " bad crc: " << stats.crc_errors
+                    << " latency mean " << stats.mean_latency_us << " us, worst case " << stats.max_latency_us
+                    << " us, age " << stats.last_frame_age << " s");
+  }
+
+  void ReportLatency(const ros::TimerEvent &event) {
+    DispatchLatency latency = gps_.GetDispatchLatency();
+    ROS_INFO_STREAM(name_ << ": Dispatch latency over " << latency.samples << " frames: mean "
+                    << latency.mean_us << " us, worst case " << latency.max_us << " us");
+  }
+
+  void ReportExecutor(const ros::TimerEvent &event) {
+    std::vector<ExecutorStats> stats = gps_.GetExecutorStats();
+    for (size_t ii=0; ii<stats.size(); ii++)
+      ROS_INFO_STREAM(name_ << ": Callbacks for log " << stats[ii].message_id << ": " << stats[ii].executed
+                      << " run, " << stats[ii].dropped << " dropped, queued " << stats[ii].queued
+                      << " (max " << stats[ii].max_queued << "), run time mean " << stats[ii].mean_us
+                      << " us, worst case " << stats[ii].max_us << " us");
+  }
+
   void disconnect() {
     //em_.stopReading();
     //em_.disconnect();
-    gps_.SendCommand("UNLOGALL");
+    // leave the logs running when attached to a receiver that was already
+    // streaming, so a restarted node can pick the stream back up without
+    // reconfiguring the receiver
+    if (!attached_)
+      gps_.SendCommand("UNLOGALL");
+  }
+
+  // Requests logs from the receiver.  When attached to a receiver that is
+  // already streaming, only the logs that are not being received are requested.
+  void ConfigureLogs(std::string log_string) {
+    if (!attached_) {
+      gps_.ConfigureLogs(log_string);
+      return;
+    }
+    typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
+    boost::char_separator<char> sep(";");
+    tokenizer tokens(log_string, sep);
+    std::string missing_logs;
+    for (tokenizer::iterator it=tokens.begin(); it!=tokens.end(); ++it) {
+      if (gps_.IsLogActive(*it)) {
+        ROS_INFO_STREAM(name_ << ": Log already streaming: " << *it);
+      } else {
+        missing_logs += *it + ";";
+      }
+    }
+    if (!missing_logs.empty())
+      gps_.ConfigureLogs(missing_logs);
   }
 
   bool getParameters() {
@@ -590,6 +855,10 @@ protected:
 
     nh_.param("ephemeris_topic", ephemeris_topic_, std::string("/ephemeris"));
     ROS_INFO_STREAM(name_ << ": Ephemeris Topic: " << ephemeris_topic_);
+    nh_.param("ephemeris_publish_period", ephemeris_publish_period_, 0.0);
+    nh_.param("latch_ephemeris", latch_ephemeris_, false);
+    ROS_INFO_STREAM(name_ << ": Ephemeris publish period: " << ephemeris_publish_period_
+                    << " latched: " << latch_ephemeris_);
 
     nh_.param("dual_band_range_topic", dual_band_range_topic_, std::string("/range"));
     ROS_INFO_STREAM(name_ << ": L1L2Range Topic: " << dual_band_range_topic_);
@@ -600,10 +869,142 @@ protected:
     nh_.param("baudrate", baudrate_, 9600);
     ROS_INFO_STREAM(name_ << ": Baudrate: " << baudrate_);
 
+    nh_.param("attach", attach_, false);
+    ROS_INFO_STREAM(name_ << ": Attach to streaming receiver: " << attach_);
+
+    nh_.param("read_thread_cpu", scheduling_.cpu, -1);
+    nh_.param("read_thread_priority", scheduling_.priority, 0);
+    nh_.param("lock_memory", scheduling_.lock_memory, false);
+    nh_.param("measure_latency", scheduling_.measure_latency, false);
+    ROS_INFO_STREAM(name_ << ": Read thread cpu: " << scheduling_.cpu << " priority: " << scheduling_.priority
+                    << " lock memory: " << scheduling_.lock_memory);
+    nh_.param("prioritize_navigation_logs", prioritize_navigation_logs_, false);
+    nh_.param("callback_threads", callback_threads_, 0);
+    ROS_INFO_STREAM(name_ << ": Callback threads: " << callback_threads_);
+    ROS_INFO_STREAM(name_ << ": Prioritize navigation logs: " << prioritize_navigation_logs_);
+
+    nh_.param("record_file", record_file_, std::string(""));
+    std::string record_codec;
+    int record_block_size;
+    nh_.param("record_codec", record_codec, std::string("none"));
+    nh_.param("record_block_size", record_block_size, 65536);
+    nh_.param("record_flush_latency", record_config_.max_flush_latency, 1.0);
+    record_config_.block_size = record_block_size;
+    try {
+      record_config_.codec = RecordCodecFromString(record_codec);
+    } catch (std::exception &e) {
+      ROS_ERROR_STREAM(name_ << ": " << e.what());
+      return false;
+    }
+    if (!record_file_.empty())
+      ROS_INFO_STREAM(name_ << ": Recording to " << record_file_ << " codec: " << record_codec
+                      << " block size: " << record_block_size
+                      << " flush latency: " << record_config_.max_flush_latency);
+
+    std::string flight_codec;
+    nh_.param("flight_recorder_directory", flight_config_.directory, std::string(""));
+    nh_.param("flight_recorder_window", flight_config_.window, 30.0);
+    nh_.param("flight_recorder_post_trigger", flight_config_.post_trigger, 2.0);
+    nh_.param("flight_recorder_holdoff", flight_config_.holdoff, 30.0);
+    nh_.param("flight_recorder_codec", flight_codec, std::string("none"));
+    try {
+      flight_config_.codec = RecordCodecFromString(flight_codec);
+    } catch (std::exception &e) {
+      ROS_ERROR_STREAM(name_ << ": " << e.what());
+      return false;
+    }
+    if (!flight_config_.directory.empty())
+      ROS_INFO_STREAM(name_ << ": Flight recorder dumps to " << flight_config_.directory << " window: "
+                      << flight_config_.window << " post trigger: " << flight_config_.post_trigger
+                      << " holdoff: " << flight_config_.holdoff);
+
+    std::string stream_server, stream_ids;
+    nh_.param("stream_server", stream_server, std::string(""));
+    nh_.param("stream_server_raw", stream_config_.raw, false);
+    nh_.param("stream_server_ids", stream_ids, std::string(""));
+    boost::char_separator<char> separators(" ,");
+    boost::tokenizer<boost::char_separator<char> > endpoints(stream_server, separators);
+    stream_endpoints_.assign(endpoints.begin(), endpoints.end());
+    boost::tokenizer<boost::char_separator<char> > ids(stream_ids, separators);
+    for (boost::tokenizer<boost::char_separator<char> >::iterator id = ids.begin(); id != ids.end(); ++id)
+      stream_config_.message_ids.insert(atoi(id->c_str()));
+    if (!stream_endpoints_.empty())
+      ROS_INFO_STREAM(name_ << ": Stream server: " << stream_server << (stream_config_.raw ? " raw" : " frames")
+                      << " ids: " << (stream_ids.empty() ? "all" : stream_ids));
+
+    std::string log_level;
+    bool async_logging;
+    nh_.param("log_level", log_level, std::string("info"));
+    nh_.param("async_logging", async_logging, false);
+    try {
+      gps_.set_log_level(LogLevelFromString(log_level));
+    } catch (std::exception &e) {
+      ROS_ERROR_STREAM(name_ << ": " << e.what());
+      return false;
+    }
+    if (async_logging)
+      gps_.StartAsyncLogging();
+    ROS_INFO_STREAM(name_ << ": Driver log level: " << log_level << " async: " << async_logging);
+
     //nh_.param("log_commands", log_commands_, std::string("BESTUTMB ONTIME 1.0"));
     nh_.param("log_commands", log_commands_, std::string(""));
     ROS_INFO_STREAM(name_ << ": Log Commands: " << log_commands_);
 
+    nh_.param("rtcm_topic", rtcm_topic_, std::string(""));
+    nh_.param("rtcm_source", rtcm_source_, std::string(""));
+    if (!rtcm_topic_.empty() || !rtcm_source_.empty())
+      ROS_INFO_STREAM(name_ << ": RTCM corrections from: " << rtcm_topic_ << " " << rtcm_source_);
+
+    nh_.param("nmea_topic", nmea_topic_, std::string(""));
+    nh_.param("rtcm_output_topic", rtcm_output_topic_, std::string(""));
+
+    nh_.param("rtcm_server", rtcm_server_endpoints_, std::string(""));
+    if (!rtcm_server_endpoints_.empty()) {
+      int msm_type, station_id;
+      nh_.param("rtcm_msm", msm_type, 4);
+      nh_.param("rtcm_station_id", station_id, 0);
+      nh_.param("rtcm_station_period", rtcm_station_period_, 10.0);
+      rtcm_encoder_.set_msm_type((msm_type == 7) ? MSM7 : MSM4);
+      rtcm_encoder_.set_station_id(station_id);
+      std::string base_position;
+      nh_.param("rtcm_base_position", base_position, std::string(""));
+      double latitude, longitude, height;
+      if (sscanf(base_position.c_str(), "%lf,%lf,%lf", &latitude, &longitude, &height) == 3)
+        rtcm_encoder_.set_reference_position(latitude, longitude, height);
+      else
+        ROS_WARN_STREAM(name_ << ": No rtcm_base_position (lat,lon,height), 1005 will not be sent");
+      ROS_INFO_STREAM(name_ << ": RTCM server: " << rtcm_server_endpoints_ << " MSM" << ((msm_type == 7) ? 7 : 4)
+                      << " station: " << station_id);
+    }
+
+    nh_.param("health_topic", health_topic_, std::string(""));
+    nh_.param("health_publish_period", health_publish_period_, 5.0);
+    nh_.param("health_logs_period", health_logs_period_, 0.0);
+    int health_window;
+    nh_.param("health_window", health_window, 10);
+    health_thresholds_.window_size = std::max(health_window, 1);
+    nh_.param("max_board_temperature", health_thresholds_.max_board_temperature, 85.0);
+    nh_.param("min_supply_voltage", health_thresholds_.min_supply_voltage, 4.5);
+    nh_.param("max_supply_voltage", health_thresholds_.max_supply_voltage, 36.0);
+    nh_.param("min_antenna_current", health_thresholds_.min_antenna_current, 0.005);
+    nh_.param("max_antenna_current", health_thresholds_.max_antenna_current, 0.1);
+    nh_.param("min_mean_cno", health_thresholds_.min_mean_cno, 30.0);
+    nh_.param("max_reject_fraction", health_thresholds_.max_reject_fraction, 0.5);
+    if (!health_topic_.empty())
+      ROS_INFO_STREAM(name_ << ": Health topic: " << health_topic_ << " period: " << health_publish_period_
+                      << " logs period: " << health_logs_period_);
+
+    nh_.param("rtk_topic", rtk_topic_, std::string(""));
+    nh_.param("rtk_publish_period", rtk_publish_period_, 10.0);
+    nh_.param("rtk_logs_period", rtk_logs_period_, 0.0);
+    if (!rtk_topic_.empty())
+      ROS_INFO_STREAM(name_ << ": RTK topic: " << rtk_topic_ << " period: " << rtk_publish_period_
+                      << " logs period: " << rtk_logs_period_);
+
+    nh_.param("restart_topic", restart_topic_, std::string(""));
+    if (!restart_topic_.empty())
+      ROS_INFO_STREAM(name_ << ": Restart topic: " << restart_topic_);
+
     nh_.param("configure_port", configure_port_, std::string(""));
     ROS_INFO_STREAM(name_ << ": Configure port: " << configure_port_);
 
@@ -664,10 +1065,56 @@ protected:
   std::string ephem_log_;
   int baudrate_;
   double poll_rate_;
+  bool attach_; //!< try to attach to a receiver that is already streaming
+  bool attached_; //!< true if the current connection was made with Attach()
+  ThreadSchedulingConfig scheduling_; //!< read thread affinity, priority and memory locking
+  bool prioritize_navigation_logs_; //!< parse bulky logs on a background thread, see UseDefaultLogPriorities
+  int callback_threads_; //!< run log callbacks on this many threads, 0 to run them on the read thread
+  ros::Timer executor_timer_;
+  std::string record_file_; //!< raw receiver data is recorded here if not empty
+  RecorderConfig record_config_;
+  FlightRecorderConfig flight_config_; //!< flight recorder settings, not started if the directory is empty
+  std::vector<std::string> stream_endpoints_; //!< stream server urls, empty to not serve the receiver stream
+  StreamServerConfig stream_config_;
+  ros::Timer latency_timer_;
+  std::string rtcm_topic_;  //!< std_msgs/UInt8MultiArray topic carrying RTCM3 corrections
+  std::string rtcm_source_; //!< transport url to read RTCM3 corrections from
+  ros::Subscriber rtcm_subscriber_;
+  ros::Timer correction_timer_;
+  std::string nmea_topic_;  //!< std_msgs/String topic for NMEA sentences from the receiver port
+  ros::Publisher nmea_publisher_;
+  std::string rtcm_output_topic_; //!< std_msgs/UInt8MultiArray topic for RTCM3 output from the receiver port
+  ros::Publisher rtcm_output_publisher_;
+  std::string rtcm_server_endpoints_; //!< fan-out endpoint urls for rtcm3 encoded from the range logs
+  Rtcm3Encoder rtcm_encoder_;
+  FanoutServer rtcm_server_;
+  std::vector<unsigned char> rtcm_frames_; //!< frames of the current epoch, reused
+  double rtcm_station_period_; //!< send 1005 at this period [s]
+  double rtcm_station_time_;
+  HealthMonitor health_monitor_;
+  HealthThresholds health_thresholds_;
+  std::string health_topic_; //!< std_msgs/String topic for the receiver health summary
+  double health_publish_period_; //!< [s]
+  double health_logs_period_; //!< request RXHWLEVELSB and TRACKSTATB at this period [s], 0 to leave them alone
+  ros::Publisher health_publisher_;
+  ros::Timer health_timer_;
+  RtkMonitor rtk_monitor_;
+  std::string rtk_topic_; //!< std_msgs/String topic for the RTK engine summary
+  double rtk_publish_period_; //!< [s]
+  double rtk_logs_period_; //!< request RTKDATAB at this period [s], 0 to leave it alone
+  ros::Publisher rtk_publisher_;
+  ros::Timer rtk_timer_;
+  std::string restart_topic_; //!< latched std_msgs/String topic for the restart report
+  ros::Publisher restart_publisher_;
 
   Velocity cur_velocity_;
   // InsCovarianceShort cur_ins_cov_;
   gps_msgs::Ephemeris cur_ephem_;
+  EphemerisStore ephemeris_store_; //!< latest ephemeris for each PRN
+  double ephemeris_publish_period_; //!< publish the full set at this period [s], 0 to publish each change
+  bool latch_ephemeris_;
+  uint32_t published_ephemeris_version_; //!< ephemeris_store_ version last published
+  ros::Timer ephemeris_timer_;
   gps_msgs::L1L2Range cur_range_;
   InsCovariance cur_ins_cov_;
   Position cur_psrpos_;
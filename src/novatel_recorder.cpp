@@ -0,0 +1,535 @@
+#include "novatel/novatel_recorder.h"
+#include "novatel/novatel_demux.h" // for CalculateCrc32
+
+#include <algorithm>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef NOVATEL_HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef NOVATEL_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace novatel;
+
+static const char record_file_header[RECORD_FILE_HEADER_SIZE] = {'N','V','T','L','R','E','C',1};
+
+static uint64_t WallClockMicroseconds() {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (uint64_t)now.tv_sec*1000000 + now.tv_usec;
+}
+
+static void PutLittleEndian(unsigned char *destination, uint64_t value, int bytes) {
+	for (int ii=0; ii<bytes; ii++)
+		destination[ii] = (value >> (8*ii)) & 0xFF;
+}
+
+static uint64_t GetLittleEndian(const unsigned char *source, int bytes) {
+	uint64_t value = 0;
+	for (int ii=bytes-1; ii>=0; ii--)
+		value = (value << 8) | source[ii];
+	return value;
+}
+
+/*!
+ * Compresses data into output after room for the block header.  Returns
+ * the codec actually used, which is RECORD_CODEC_NONE when compression
+ * would not make the block smaller.
+ */
+static RecordCodec CompressBlock(RecordCodec codec, int level, const std::vector<unsigned char> &data,
+                                 std::vector<unsigned char> &output) {
+	(void)level;	// only used by the codecs that are built in
+	size_t compressed = 0;
+#ifdef NOVATEL_HAVE_LZ4
+	if (codec == RECORD_CODEC_LZ4) {
+		output.resize(RECORD_BLOCK_HEADER_SIZE + LZ4_compressBound(data.size()));
+		char *destination = (char*)&output[RECORD_BLOCK_HEADER_SIZE];
+		int capacity = output.size() - RECORD_BLOCK_HEADER_SIZE;
+		int result = (level > 0) ?
+			LZ4_compress_HC((const char*)&data[0], destination, data.size(), capacity, level) :
+			LZ4_compress_default((const char*)&data[0], destination, data.size(), capacity);
+		compressed = (result > 0) ? result : 0;
+	}
+#endif
+#ifdef NOVATEL_HAVE_ZSTD
+	if (codec == RECORD_CODEC_ZSTD) {
+		output.resize(RECORD_BLOCK_HEADER_SIZE + ZSTD_compressBound(data.size()));
+		size_t result = ZSTD_compress(&output[RECORD_BLOCK_HEADER_SIZE], output.size() - RECORD_BLOCK_HEADER_SIZE,
+		                              &data[0], data.size(), (level > 0) ? level : 3);
+		compressed = ZSTD_isError(result) ? 0 : result;
+	}
+#endif
+	if ((compressed > 0) && (compressed < data.size())) {
+		output.resize(RECORD_BLOCK_HEADER_SIZE + compressed);
+		return codec;
+	}
+	output.resize(RECORD_BLOCK_HEADER_SIZE + data.size());
+	memcpy(&output[RECORD_BLOCK_HEADER_SIZE], &data[0], data.size());
+	return RECORD_CODEC_NONE;
+}
+
+//! Compresses data into buffer and fills in the block header
+static void EncodeBlock(RecordCodec codec, int level, const std::vector<unsigned char> &data, uint64_t timestamp,
+                        std::vector<unsigned char> &buffer) {
+	RecordCodec used = CompressBlock(codec, level, data, buffer);
+	unsigned char *header = &buffer[0];
+	memset(header, 0, RECORD_BLOCK_HEADER_SIZE);
+	PutLittleEndian(header, RECORD_BLOCK_MAGIC, 4);
+	header[4] = used;
+	PutLittleEndian(header+8, data.size(), 4);
+	PutLittleEndian(header+12, buffer.size()-RECORD_BLOCK_HEADER_SIZE, 4);
+	PutLittleEndian(header+16, CalculateCrc32(&data[0], data.size()), 4);
+	PutLittleEndian(header+20, timestamp, 8);
+}
+
+//! Writes all of data, returns the number of bytes written before any error
+static size_t WriteAll(int fd, const std::vector<unsigned char> &data) {
+	size_t written = 0;
+	while (written < data.size()) {
+		ssize_t result = ::write(fd, &data[written], data.size()-written);
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		written += result;
+	}
+	return written;
+}
+
+//! Decompresses a block payload into data, returns false if it is damaged
+static bool DecompressBlock(RecordCodec codec, const unsigned char *payload, size_t length,
+                            size_t raw_length, std::vector<unsigned char> &data) {
+	data.resize(raw_length);
+	switch (codec) {
+		case RECORD_CODEC_NONE:
+			if (length != raw_length)
+				return false;
+			memcpy(&data[0], payload, length);
+			return true;
+#ifdef NOVATEL_HAVE_LZ4
+		case RECORD_CODEC_LZ4:
+			return LZ4_decompress_safe((const char*)payload, (char*)&data[0], length, raw_length) == (int)raw_length;
+#endif
+#ifdef NOVATEL_HAVE_ZSTD
+		case RECORD_CODEC_ZSTD:
+			return ZSTD_decompress(&data[0], raw_length, payload, length) == raw_length;
+#endif
+		default:
+			return false;
+	}
+}
+
+bool novatel::RecordCodecAvailable(RecordCodec codec) {
+	switch (codec) {
+		case RECORD_CODEC_NONE:
+			return true;
+#ifdef NOVATEL_HAVE_LZ4
+		case RECORD_CODEC_LZ4:
+			return true;
+#endif
+#ifdef NOVATEL_HAVE_ZSTD
+		case RECORD_CODEC_ZSTD:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+RecordCodec novatel::RecordCodecFromString(const std::string &name) {
+	if (name == "none")
+		return RECORD_CODEC_NONE;
+	if (name == "lz4")
+		return RECORD_CODEC_LZ4;
+	if (name == "zstd")
+		return RECORD_CODEC_ZSTD;
+	throw std::invalid_argument("Unknown recording codec '" + name + "', expected none, lz4 or zstd");
+}
+
+//////////////////////////////////////////////////////
+// Recorder
+//////////////////////////////////////////////////////
+Recorder::Recorder() : fd_(-1), writing_(false) {
+	memset(&stats_, 0, sizeof(stats_));
+}
+
+Recorder::~Recorder() {
+	Close();
+}
+
+void Recorder::Open(const std::string &path, const RecorderConfig &config) {
+	Close();
+	if (!RecordCodecAvailable(config.codec))
+		throw std::invalid_argument("This build does not support the requested recording codec.");
+	if ((config.block_size == 0) || (config.block_size > RECORD_MAX_BLOCK_SIZE))
+		throw std::invalid_argument("Recording block size out of range.");
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		ThrowSystemError("Could not create " + path);
+	if (::write(fd, record_file_header, RECORD_FILE_HEADER_SIZE) != RECORD_FILE_HEADER_SIZE) {
+		::close(fd);
+		ThrowSystemError("Could not write " + path);
+	}
+	path_ = path;
+	config_ = config;
+	memset(&stats_, 0, sizeof(stats_));
+	stats_.bytes_written = RECORD_FILE_HEADER_SIZE;
+	block_.data.clear();
+	block_.data.reserve(config_.block_size);
+	queue_.clear();
+	fd_ = fd;
+	writing_ = true;
+	writer_thread_ = boost::thread(&Recorder::WriteBlocks, this);
+}
+
+void Recorder::Close() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if (!writing_)
+			return;
+		SealBlock();
+		writing_ = false;
+		condition_.notify_all();
+	}
+	// the writer drains the queue before it exits
+	writer_thread_.join();
+	::close(fd_);
+	fd_ = -1;
+}
+
+void Recorder::Write(const unsigned char *data, size_t length) {
+	boost::mutex::scoped_lock lock(mutex_);
+	if (!writing_)
+		return;
+	while (length > 0) {
+		if (block_.data.empty()) {
+			block_.timestamp = WallClockMicroseconds();
+			// start the writer's flush latency timer
+			condition_.notify_all();
+		}
+		size_t len = std::min(length, config_.block_size - block_.data.size());
+		block_.data.insert(block_.data.end(), data, data+len);
+		data += len;
+		length -= len;
+		if (block_.data.size() >= config_.block_size)
+			SealBlock();
+	}
+}
+
+void Recorder::SealBlock() {
+	if (block_.data.empty())
+		return;
+	if (queue_.size() >= config_.max_queued_blocks) {
+		// the disk can not keep up, losing new data is better than
+		// holding up the read thread or growing without bound
+		stats_.bytes_dropped += block_.data.size();
+		block_.data.clear();
+		return;
+	}
+	queue_.push_back(Block());
+	queue_.back().data.swap(block_.data);
+	queue_.back().timestamp = block_.timestamp;
+	block_.data.reserve(config_.block_size);
+	condition_.notify_all();
+}
+
+RecorderStats Recorder::stats() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return stats_;
+}
+
+void Recorder::WriteBlocks() {
+	std::vector<unsigned char> buffer;
+	boost::mutex::scoped_lock lock(mutex_);
+	while (writing_ || !queue_.empty()) {
+		if (queue_.empty()) {
+			if (block_.data.empty()) {
+				condition_.wait(lock);
+				continue;
+			}
+			// flush a partial block once its oldest data reaches the latency limit
+			int64_t age_us = WallClockMicroseconds() - block_.timestamp;
+			int64_t wait_us = (int64_t)(config_.max_flush_latency*1e6) - age_us;
+			if (wait_us > 0) {
+				condition_.timed_wait(lock, boost::posix_time::microseconds(wait_us));
+				continue;
+			}
+			SealBlock();
+			continue;
+		}
+		Block block;
+		block.data.swap(queue_.front().data);
+		block.timestamp = queue_.front().timestamp;
+		queue_.pop_front();
+		lock.unlock();
+		WriteBlock(block, buffer);
+		lock.lock();
+	}
+}
+
+void Recorder::WriteBlock(Block &block, std::vector<unsigned char> &buffer) {
+	EncodeBlock(config_.codec, config_.compression_level, block.data, block.timestamp, buffer);
+	size_t written = WriteAll(fd_, buffer);
+	bool synced = (written == buffer.size()) && (fdatasync(fd_) == 0);
+
+	boost::mutex::scoped_lock lock(mutex_);
+	stats_.bytes_written += written;
+	if (synced) {
+		stats_.bytes_recorded += block.data.size();
+		stats_.blocks++;
+	} else {
+		stats_.write_errors++;
+	}
+}
+
+//////////////////////////////////////////////////////
+// RecordingWriter
+//////////////////////////////////////////////////////
+RecordingWriter::RecordingWriter()
+	: fd_(-1), codec_(RECORD_CODEC_NONE), compression_level_(0), bytes_written_(0) {
+}
+
+RecordingWriter::~RecordingWriter() {
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+void RecordingWriter::Open(const std::string &path, RecordCodec codec, int compression_level) {
+	if (fd_ >= 0)
+		::close(fd_);
+	fd_ = -1;
+	if (!RecordCodecAvailable(codec))
+		throw std::invalid_argument("This build does not support the requested recording codec.");
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		ThrowSystemError("Could not create " + path);
+	if (::write(fd, record_file_header, RECORD_FILE_HEADER_SIZE) != RECORD_FILE_HEADER_SIZE) {
+		::close(fd);
+		ThrowSystemError("Could not write " + path);
+	}
+	fd_ = fd;
+	path_ = path;
+	codec_ = codec;
+	compression_level_ = compression_level;
+	bytes_written_ = RECORD_FILE_HEADER_SIZE;
+}
+
+void RecordingWriter::WriteBlock(const unsigned char *data, size_t length, uint64_t timestamp) {
+	if (fd_ < 0)
+		throw std::runtime_error("Recording is not open.");
+	if ((length == 0) || (length > RECORD_MAX_BLOCK_SIZE))
+		throw std::invalid_argument("Recording block size out of range.");
+	data_.assign(data, data+length);
+	EncodeBlock(codec_, compression_level_, data_, timestamp, buffer_);
+	size_t written = WriteAll(fd_, buffer_);
+	bytes_written_ += written;
+	if (written != buffer_.size())
+		ThrowSystemError("Could not write " + path_);
+}
+
+void RecordingWriter::Close() {
+	if (fd_ < 0)
+		return;
+	bool synced = (fdatasync(fd_) == 0);
+	int error = errno;
+	::close(fd_);
+	fd_ = -1;
+	if (!synced) {
+		errno = error;
+		ThrowSystemError("Could not sync " + path_);
+	}
+}
+
+//////////////////////////////////////////////////////
+// RecordingReader
+//////////////////////////////////////////////////////
+RecordingReader::RecordingReader() : file_(NULL), size_(0), position_(0), damaged_blocks_(0) {
+}
+
+RecordingReader::~RecordingReader() {
+	Close();
+}
+
+void RecordingReader::Open(const std::string &path) {
+	Close();
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		ThrowSystemError("Could not open " + path);
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		::close(fd);
+		ThrowSystemError("Could not read size of " + path);
+	}
+	if ((size_t)info.st_size < RECORD_FILE_HEADER_SIZE) {
+		::close(fd);
+		throw std::runtime_error(path + " is not a recording.");
+	}
+	void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+		ThrowSystemError("Could not map " + path);
+	if (memcmp(mapping, record_file_header, RECORD_FILE_HEADER_SIZE) != 0) {
+		munmap(mapping, info.st_size);
+		throw std::runtime_error(path + " is not a recording.");
+	}
+	madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+	path_ = path;
+	file_ = (unsigned char*)mapping;
+	size_ = info.st_size;
+	position_ = RECORD_FILE_HEADER_SIZE;
+	damaged_blocks_ = 0;
+}
+
+void RecordingReader::Close() {
+	if (file_ != NULL)
+		munmap(file_, size_);
+	file_ = NULL;
+}
+
+bool RecordingReader::ReadBlock(std::vector<unsigned char> &data, uint64_t *timestamp) {
+	if (file_ == NULL)
+		return false;
+	while (position_ + RECORD_BLOCK_HEADER_SIZE <= size_) {
+		const unsigned char *header = file_ + position_;
+		if (GetLittleEndian(header, 4) != RECORD_BLOCK_MAGIC) {
+			// resynchronise on the next block after damage
+			position_++;
+			continue;
+		}
+		RecordCodec codec = (RecordCodec)header[4];
+		size_t raw_length = GetLittleEndian(header+8, 4);
+		size_t length = GetLittleEndian(header+12, 4);
+		if ((raw_length == 0) || (raw_length > RECORD_MAX_BLOCK_SIZE) || (length > RECORD_MAX_BLOCK_SIZE)) {
+			damaged_blocks_++;
+			position_++;
+			continue;
+		}
+		if (position_ + RECORD_BLOCK_HEADER_SIZE + length > size_)
+			break;	// cut short, e.g. by a power loss while recording
+		const unsigned char *payload = header + RECORD_BLOCK_HEADER_SIZE;
+		if (!DecompressBlock(codec, payload, length, raw_length, data) ||
+		    (CalculateCrc32(&data[0], raw_length) != GetLittleEndian(header+16, 4))) {
+			damaged_blocks_++;
+			position_++;
+			continue;
+		}
+		if (timestamp)
+			*timestamp = GetLittleEndian(header+20, 8);
+		position_ += RECORD_BLOCK_HEADER_SIZE + length;
+		return true;
+	}
+	position_ = size_;
+	return false;
+}
+
+//////////////////////////////////////////////////////
+// ReplayTransport
+//////////////////////////////////////////////////////
+ReplayTransport::ReplayTransport(std::string path, size_t read_ahead)
+	: path_(path), read_ahead_(read_ahead), reading_(false), finished_(false), position_(0) {
+}
+
+ReplayTransport::~ReplayTransport() {
+	Close();
+}
+
+void ReplayTransport::Open() {
+	Close();
+	reader_.Open(path_);
+	blocks_.clear();
+	current_.clear();
+	position_ = 0;
+	finished_ = false;
+	reading_ = true;
+	reader_thread_ = boost::thread(&ReplayTransport::ReadBlocks, this);
+}
+
+void ReplayTransport::Close() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		reading_ = false;
+		condition_.notify_all();
+	}
+	if (reader_thread_.joinable())
+		reader_thread_.join();
+	reader_thread_ = boost::thread();
+	reader_.Close();
+}
+
+void ReplayTransport::ReadBlocks() {
+	std::vector<unsigned char> block;
+	while (true) {
+		bool more = reader_.ReadBlock(block);
+		boost::mutex::scoped_lock lock(mutex_);
+		if (!more) {
+			finished_ = true;
+			condition_.notify_all();
+			return;
+		}
+		while (reading_ && (blocks_.size() >= read_ahead_))
+			condition_.wait(lock);
+		if (!reading_)
+			return;
+		blocks_.push_back(std::vector<unsigned char>());
+		blocks_.back().swap(block);
+		condition_.notify_all();
+	}
+}
+
+bool ReplayTransport::AtEnd() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return finished_ && blocks_.empty() && (position_ >= current_.size());
+}
+
+size_t ReplayTransport::Read(unsigned char *buffer, size_t size) {
+	struct iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+	return ReadV(&iov, 1);
+}
+
+size_t ReplayTransport::ReadV(const struct iovec *iov, int count) {
+	if (!reader_thread_.joinable())
+		throw std::runtime_error(name() + " is not open.");
+	if (position_ >= current_.size()) {
+		boost::mutex::scoped_lock lock(mutex_);
+		if (blocks_.empty() && !finished_)
+			condition_.timed_wait(lock, boost::posix_time::milliseconds(10));
+		if (blocks_.empty()) {
+			if (finished_) {
+				// behave like a receiver that has stopped sending
+				lock.unlock();
+				boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+			}
+			return 0;
+		}
+		current_.swap(blocks_.front());
+		blocks_.pop_front();
+		position_ = 0;
+		condition_.notify_all();
+	}
+	size_t total = 0;
+	for (int ii=0; (ii<count) && (position_<current_.size()); ii++) {
+		size_t len = std::min(current_.size()-position_, (size_t)iov[ii].iov_len);
+		memcpy(iov[ii].iov_base, &current_[position_], len);
+		position_ += len;
+		total += len;
+	}
+	return total;
+}
+
+size_t ReplayTransport::Write(const unsigned char */*data*/, size_t /*length*/) {
+	throw std::runtime_error(name() + " is read only.");
+}
@@ -0,0 +1,242 @@
+#include "novatel/novatel_restart.h"
+
+#include <sstream>
+#include <time.h>
+
+using namespace novatel;
+
+static uint64_t MonotonicMicroseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+static const char* ResetTypeName(ResetType type) {
+	switch (type) {
+		case RESET_HARDWARE: return "hardware";
+		case RESET_HOT: return "hot";
+		case RESET_WARM: return "warm";
+		case RESET_COLD: return "cold";
+		default: return "external";
+	}
+}
+
+const char* novatel::PositionTypeName(PositionType type) {
+	switch (type) {
+		case FIXEDPOS: return "FIXEDPOS";
+		case FIXEDHEIGHT: return "FIXEDHEIGHT";
+		case FLOATCONV: return "FLOATCONV";
+		case WIDELANE: return "WIDELANE";
+		case NARROWLANE: return "NARROWLANE";
+		case DOPPLER_VELOCITY: return "DOPPLER_VELOCITY";
+		case SINGLE: return "SINGLE";
+		case PSRDIFF: return "PSRDIFF";
+		case WAAS: return "WAAS";
+		case PROPOGATED: return "PROPOGATED";
+		case OMNISTAR: return "OMNISTAR";
+		case L1_FLOAT: return "L1_FLOAT";
+		case IONOFREE_FLOAT: return "IONOFREE_FLOAT";
+		case NARROW_FLOAT: return "NARROW_FLOAT";
+		case L1_INT: return "L1_INT";
+		case WIDE_INT: return "WIDE_INT";
+		case NARROW_INT: return "NARROW_INT";
+		case RTK_DIRECT_INS: return "RTK_DIRECT_INS";
+		case INS: return "INS";
+		case INS_PSRSP: return "INS_PSRSP";
+		case INS_PSRDIFF: return "INS_PSRDIFF";
+		case INS_RTKFLOAT: return "INS_RTKFLOAT";
+		case INS_RTKFIXED: return "INS_RTKFIXED";
+		case OMNISTAR_HP: return "OMNISTAR_HP";
+		case OMNISTAR_XP: return "OMNISTAR_XP";
+		case CDGPS: return "CDGPS";
+		default: return "UNKNOWN";
+	}
+}
+
+static void FormatMilestone(std::stringstream &output, const char *name, double seconds) {
+	output << " " << name << "=";
+	if (seconds < 0)
+		output << "-";
+	else
+		output << seconds;
+}
+
+std::string novatel::FormatRestartReport(const RestartReport &report) {
+	std::stringstream output;
+	if (!report.started)
+		return "reset=none";
+	output.setf(std::ios::fixed);
+	output.precision(2);
+	output << "reset=" << ResetTypeName(report.reset_type) << " elapsed=" << report.elapsed;
+	FormatMilestone(output, "banner", report.banner);
+	FormatMilestone(output, "coarse_time", report.coarse_time);
+	FormatMilestone(output, "fine_time", report.fine_time);
+	FormatMilestone(output, "ins_aligned", report.ins_aligned);
+	for (std::map<PositionType, double>::const_iterator it = report.first_fix.begin();
+	     it != report.first_fix.end(); ++it) {
+		output << " fix." << PositionTypeName(it->first) << "=" << it->second;
+	}
+	return output.str();
+}
+
+RestartTracker::RestartTracker() {
+	active_ = false;
+	awaiting_banner_ = false;
+	start_us_ = 0;
+	report_.reset_type = RESET_EXTERNAL;
+	report_.started = false;
+	report_.elapsed = 0;
+	report_.banner = -1;
+	report_.coarse_time = -1;
+	report_.fine_time = -1;
+	report_.ins_aligned = -1;
+	reached_ = 0;
+	for (size_t ii=0; ii<sizeof(seen_types_)/sizeof(seen_types_[0]); ii++)
+		seen_types_[ii] = false;
+}
+
+void RestartTracker::Start(ResetType type) {
+	boost::mutex::scoped_lock lock(mutex_);
+	start_us_ = MonotonicMicroseconds();
+	report_.reset_type = type;
+	report_.started = true;
+	report_.elapsed = 0;
+	report_.banner = -1;
+	report_.coarse_time = -1;
+	report_.fine_time = -1;
+	report_.ins_aligned = -1;
+	report_.first_fix.clear();
+	reached_ = 0;
+	for (size_t ii=0; ii<sizeof(seen_types_)/sizeof(seen_types_[0]); ii++)
+		seen_types_[ii] = false;
+	// an external reset is only noticed once the receiver is already restarting
+	awaiting_banner_ = (type != RESET_EXTERNAL);
+	active_ = true;
+}
+
+void RestartTracker::Stop() {
+	boost::mutex::scoped_lock lock(mutex_);
+	report_.started = false;
+	active_ = false;
+}
+
+bool RestartTracker::Reach(RestartMilestone milestone, double &seconds, uint64_t now) {
+	if (seconds >= 0)
+		return false;
+	seconds = (double)(now - start_us_)/1e6;
+	reached_ = reached_ | (1u << milestone);
+	return true;
+}
+
+void RestartTracker::Notify(RestartMilestone milestone, PositionType type, double seconds) {
+	if (milestone_callback_)
+		milestone_callback_(milestone, type, seconds);
+}
+
+void RestartTracker::AddBanner() {
+	if (!active())
+		return;
+	double seconds;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		// only the first prompt after the reset is the banner
+		if (!Reach(RESTART_BANNER, report_.banner, MonotonicMicroseconds()))
+			return;
+		seconds = report_.banner;
+		awaiting_banner_ = false;
+	}
+	Notify(RESTART_BANNER, NONE, seconds);
+}
+
+void RestartTracker::AddFrame(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id) {
+	if (!active() || awaiting_banner_.load(boost::memory_order_relaxed))
+		return;
+
+	// time status is only in the long header
+	uint8_t time_status = 0;
+	if ((length >= sizeof(Oem4BinaryHeader)) && (frame[2] == 0x12))
+		time_status = ((const Oem4BinaryHeader*)frame)->time_status;
+
+	bool fix = false;
+	PositionType position_type = NONE;
+	bool aligned = false;
+	switch (message_id) {
+		case BESTPOSB_LOG_TYPE:
+		case PSRPOSB_LOG_TYPE:
+		case RTKPOSB_LOG_TYPE:
+		case BESTGPSPOS_LOG_TYPE:
+			if (length >= sizeof(Position)) {
+				const Position *position = (const Position*)frame;
+				fix = (position->solution_status == SOL_COMPUTED);
+				position_type = position->position_type;
+			}
+			break;
+		case BESTUTMB_LOG_TYPE:
+			if (length >= sizeof(UtmPosition)) {
+				const UtmPosition *position = (const UtmPosition*)frame;
+				fix = (position->solution_status == SOL_COMPUTED);
+				position_type = position->position_type;
+			}
+			break;
+		case INSPVA_LOG_TYPE:
+			if (length >= sizeof(InsPositionVelocityAttitude)) {
+				InsStatus status = ((const InsPositionVelocityAttitude*)frame)->status;
+				aligned = (status == INS_SOLUTION_GOOD) || (status == INS_ALIGNMENT_COMPLETE);
+			}
+			break;
+		case INSPVAS_LOG_TYPE:
+			if (length >= sizeof(InsPositionVelocityAttitudeShort)) {
+				InsStatus status = ((const InsPositionVelocityAttitudeShort*)frame)->status;
+				aligned = (status == INS_SOLUTION_GOOD) || (status == INS_ALIGNMENT_COMPLETE);
+			}
+			break;
+		default:
+			break;
+	}
+	// Start() resets the report from another thread, so it is only read
+	// under the lock; the flags just let frames skip it once reached
+	unsigned int type_index = (unsigned int)position_type & 0xFF;
+	fix = fix && (position_type != NONE) && !seen_types_[type_index];
+
+	uint32_t reached = reached_;
+	bool coarse = (time_status >= GPSTIME_COARSE) && !(reached & (1u << RESTART_COARSE_TIME));
+	bool fine = (time_status >= GPSTIME_FINE) && !(reached & (1u << RESTART_FINE_TIME));
+	aligned = aligned && !(reached & (1u << RESTART_INS_ALIGNED));
+	if (!coarse && !fine && !fix && !aligned)
+		return;
+
+	bool reached_coarse = false, reached_fine = false, reached_fix = false, reached_aligned = false;
+	double coarse_seconds = -1, fine_seconds = -1, fix_seconds = -1, aligned_seconds = -1;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		uint64_t now = MonotonicMicroseconds();
+		if (coarse && (reached_coarse = Reach(RESTART_COARSE_TIME, report_.coarse_time, now)))
+			coarse_seconds = report_.coarse_time;
+		if (fine && (reached_fine = Reach(RESTART_FINE_TIME, report_.fine_time, now)))
+			fine_seconds = report_.fine_time;
+		if (fix && !seen_types_[type_index]) {
+			seen_types_[type_index] = true;
+			fix_seconds = (double)(now - start_us_)/1e6;
+			report_.first_fix[position_type] = fix_seconds;
+			reached_fix = true;
+		}
+		if (aligned && (reached_aligned = Reach(RESTART_INS_ALIGNED, report_.ins_aligned, now)))
+			aligned_seconds = report_.ins_aligned;
+	}
+	if (reached_coarse)
+		Notify(RESTART_COARSE_TIME, NONE, coarse_seconds);
+	if (reached_fine)
+		Notify(RESTART_FINE_TIME, NONE, fine_seconds);
+	if (reached_fix)
+		Notify(RESTART_FIRST_FIX, position_type, fix_seconds);
+	if (reached_aligned)
+		Notify(RESTART_INS_ALIGNED, NONE, aligned_seconds);
+}
+
+RestartReport RestartTracker::Report() {
+	boost::mutex::scoped_lock lock(mutex_);
+	RestartReport report = report_;
+	if (report.started)
+		report.elapsed = (double)(MonotonicMicroseconds() - start_us_)/1e6;
+	return report;
+}
@@ -0,0 +1,67 @@
+#include "novatel/novatel_rtcm.h"
+
+using namespace novatel;
+
+Rtcm3Framer::Rtcm3Framer() {
+	Reset();
+	frame_count_ = 0;
+	crc_error_count_ = 0;
+}
+
+void Rtcm3Framer::AddData(const unsigned char *data, size_t length) {
+	for (size_t ii=0; ii<length; ii++) {
+		AddByte(data[ii]);
+		// bytes handed back by a false preamble come before the next input byte
+		while (pending_index_ < pending_length_)
+			AddByte(pending_[pending_index_++]);
+		pending_index_ = 0;
+		pending_length_ = 0;
+	}
+}
+
+void Rtcm3Framer::AddByte(unsigned char byte) {
+	if (buffer_index_ == 0) {	// looking for the preamble
+		if (byte == RTCM3_PREAMBLE)
+			buffer_[buffer_index_++] = byte;
+		return;
+	}
+
+	buffer_[buffer_index_++] = byte;
+	if (buffer_index_ == RTCM3_HEADER_SIZE) {
+		// the 6 bits after the preamble are reserved and always zero
+		if (buffer_[1] & 0xFC)
+			Resynchronise();
+		else
+			frame_length_ = RTCM3_HEADER_SIZE + Rtcm3PayloadLength(buffer_) + RTCM3_CRC_SIZE;
+	} else if ((frame_length_ > 0) && (buffer_index_ == frame_length_)) {
+		CompleteFrame();
+	}
+}
+
+void Rtcm3Framer::CompleteFrame() {
+	size_t crc_offset = frame_length_ - RTCM3_CRC_SIZE;
+	uint32_t crc = (buffer_[crc_offset] << 16) | (buffer_[crc_offset+1] << 8) | buffer_[crc_offset+2];
+	if (crc == CalculateCrc24q(buffer_, crc_offset)) {
+		frame_count_++;
+		if (frame_callback_)
+			frame_callback_(buffer_, frame_length_);
+		buffer_index_ = 0;
+		frame_length_ = 0;
+		return;
+	}
+	crc_error_count_++;
+	Resynchronise();
+}
+
+void Rtcm3Framer::Resynchronise() {
+	// the buffered bytes were read before anything still pending, so they
+	// go in front of it
+	size_t requeue = buffer_index_ - 1;
+	size_t unread = pending_length_ - pending_index_;
+	memmove(pending_ + requeue, pending_ + pending_index_, unread);
+	memcpy(pending_, buffer_ + 1, requeue);
+	pending_index_ = 0;
+	pending_length_ = requeue + unread;
+	buffer_index_ = 0;
+	frame_length_ = 0;
+}
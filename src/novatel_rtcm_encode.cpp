@@ -0,0 +1,379 @@
+#include "novatel/novatel_rtcm_encode.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace novatel;
+
+#define WGS84_A 6378137.0
+#define WGS84_E2 6.69437999014e-3
+
+//! 2^n for the MSM scale factors
+#define P2(n) ldexp(1.0, n)
+
+//////////////////////////////////////////////////////
+// Rtcm3BitWriter
+//////////////////////////////////////////////////////
+void Rtcm3BitWriter::AddBits(uint64_t value, int length) {
+	for (int ii = length-1; ii >= 0; ii--) {
+		size_t bit = RTCM3_HEADER_SIZE*8 + position_++;
+		if ((value >> ii) & 1)
+			frame_[bit/8] |= 1 << (7 - bit%8);
+	}
+}
+
+void Rtcm3BitWriter::Finish(std::vector<unsigned char> &output) {
+	size_t length = (position_ + 7)/8;
+	frame_[0] = RTCM3_PREAMBLE;
+	frame_[1] = (length >> 8) & 0x03;
+	frame_[2] = length & 0xFF;
+	size_t crc_offset = RTCM3_HEADER_SIZE + length;
+	uint32_t crc = CalculateCrc24q(frame_, crc_offset);
+	frame_[crc_offset] = (crc >> 16) & 0xFF;
+	frame_[crc_offset+1] = (crc >> 8) & 0xFF;
+	frame_[crc_offset+2] = crc & 0xFF;
+	output.insert(output.end(), frame_, frame_ + crc_offset + RTCM3_CRC_SIZE);
+}
+
+//////////////////////////////////////////////////////
+// Constellation numbering
+//////////////////////////////////////////////////////
+uint8_t novatel::MsmSatelliteId(uint8_t satellite_system, uint16_t prn) {
+	int id;
+	switch (satellite_system) {
+		case SATSYS_GPS: id = prn; break;
+		case SATSYS_GLONASS: id = prn - 37; break;      // slot + 37
+		case SATSYS_SBAS: id = prn - 119; break;        // PRN 120 to 158
+		case SATSYS_GALILEO: id = prn; break;
+		case SATSYS_BEIDOU: id = (prn > 140) ? prn - 140 : prn; break;
+		case SATSYS_QZSS: id = prn - 192; break;        // PRN 193 to 202
+		default: return 0;
+	}
+	return ((id >= 1) && (id <= MSM_MAX_SATELLITES)) ? id : 0;
+}
+
+uint16_t novatel::MsmMessageBase(uint8_t satellite_system) {
+	switch (satellite_system) {
+		case SATSYS_GPS: return 1070;
+		case SATSYS_GLONASS: return 1080;
+		case SATSYS_GALILEO: return 1090;
+		case SATSYS_SBAS: return 1100;
+		case SATSYS_QZSS: return 1110;
+		case SATSYS_BEIDOU: return 1120;
+		default: return 0;
+	}
+}
+
+//! DF402 lock time indicator from the lock time [s]
+static uint32_t LockTimeIndicator(double locktime) {
+	uint32_t indicator = 0;
+	double limit = 0.032;
+	while ((indicator < 15) && (locktime >= limit)) {
+		indicator++;
+		limit *= 2;
+	}
+	return indicator;
+}
+
+//! DF407 extended lock time indicator from the lock time [s]
+static uint32_t ExtendedLockTimeIndicator(double locktime) {
+	uint32_t t = (locktime > 0) ? (uint32_t)std::min(locktime*1000, 67108864.0) : 0;
+	if (t < 64)
+		return t;
+	// each range doubles in length and resolution, 32 indicators per range
+	uint32_t range = 0;
+	while ((range < 20) && (t >= (128u << range)))
+		range++;
+	if (range == 20)
+		return 704;
+	return 64 + 32*range + ((t - (64u << range)) >> (range+1));
+}
+
+//////////////////////////////////////////////////////
+// Rtcm3Encoder
+//////////////////////////////////////////////////////
+Rtcm3Encoder::Rtcm3Encoder(uint16_t station_id, MsmType msm_type) {
+	set_station_id(station_id);
+	msm_type_ = msm_type;
+	leap_seconds_ = 18;
+	has_reference_position_ = false;
+	reference_ecef_[0] = reference_ecef_[1] = reference_ecef_[2] = 0;
+	iods_ = 0;
+	unknown_glonass_frequency_count_ = 0;
+	ranges_ = NULL;
+	satellite_count_ = 0;
+	group_count_ = 0;
+}
+
+void Rtcm3Encoder::set_reference_position_ecef(double x, double y, double z) {
+	if (has_reference_position_ && ((x != reference_ecef_[0]) || (y != reference_ecef_[1]) || (z != reference_ecef_[2])))
+		iods_ = (iods_ + 1) & 0x7;
+	reference_ecef_[0] = x;
+	reference_ecef_[1] = y;
+	reference_ecef_[2] = z;
+	has_reference_position_ = true;
+}
+
+void Rtcm3Encoder::set_reference_position(double latitude, double longitude, double height) {
+	double lat = latitude*M_PI/180.0;
+	double lon = longitude*M_PI/180.0;
+	double n = WGS84_A/sqrt(1 - WGS84_E2*sin(lat)*sin(lat));
+	set_reference_position_ecef((n + height)*cos(lat)*cos(lon), (n + height)*cos(lat)*sin(lon),
+	                            (n*(1 - WGS84_E2) + height)*sin(lat));
+}
+
+bool Rtcm3Encoder::EncodeStationPosition(std::vector<unsigned char> &output) {
+	if (!has_reference_position_)
+		return false;
+	writer_.Clear();
+	writer_.AddBits(1005, 12);
+	writer_.AddBits(station_id_, 12);
+	writer_.AddBits(0, 6);      // ITRF realisation year
+	writer_.AddBits(1, 1);      // GPS
+	writer_.AddBits(1, 1);      // GLONASS
+	writer_.AddBits(1, 1);      // Galileo
+	writer_.AddBits(0, 1);      // physical reference station
+	writer_.AddSignedBits(llround(reference_ecef_[0]/0.0001), 38);
+	writer_.AddBits(1, 1);      // single receiver oscillator
+	writer_.AddBits(0, 1);      // reserved
+	writer_.AddSignedBits(llround(reference_ecef_[1]/0.0001), 38);
+	writer_.AddBits(0, 2);      // quarter cycle indicator
+	writer_.AddSignedBits(llround(reference_ecef_[2]/0.0001), 38);
+	writer_.Finish(output);
+	return true;
+}
+
+uint32_t Rtcm3Encoder::EpochTime(uint8_t system, const Oem4BinaryHeader &header) const {
+	const int64_t week_ms = 604800000;
+	int64_t tow = header.gps_millisecs;
+	if (system == SATSYS_GLONASS) {
+		// day of week and time of day in Moscow time, UTC + 3 h
+		tow = (tow - leap_seconds_*1000 + 10800000 + week_ms) % week_ms;
+		return ((uint32_t)(tow/86400000) << 27) | (uint32_t)(tow % 86400000);
+	}
+	if (system == SATSYS_BEIDOU)
+		tow = (tow - 14000 + week_ms) % week_ms;   // BDT is 14 s behind GPS time
+	return (uint32_t)tow;
+}
+
+//! Number of bits set
+static int CountBits(uint32_t value) {
+	int count = 0;
+	for (; value != 0; value &= value - 1)
+		count++;
+	return count;
+}
+
+//! Clears the multiple message bit of an MSM frame, which follows the epoch time
+static void ClearMultipleMessageBit(unsigned char *frame) {
+	size_t bit = RTCM3_HEADER_SIZE*8 + 12 + 12 + 30;
+	frame[bit/8] &= ~(1 << (7 - bit%8));
+	size_t crc_offset = RTCM3_HEADER_SIZE + Rtcm3PayloadLength(frame);
+	uint32_t crc = CalculateCrc24q(frame, crc_offset);
+	frame[crc_offset] = (crc >> 16) & 0xFF;
+	frame[crc_offset+1] = (crc >> 8) & 0xFF;
+	frame[crc_offset+2] = crc & 0xFF;
+}
+
+//! Value rounded to units of scale, or invalid if it is not in a signed field of bits
+static int64_t Scale(double value, double scale, int bits, bool valid = true) {
+	int64_t limit = ((int64_t)1 << (bits-1)) - 1;
+	int64_t scaled = valid ? llround(value/scale) : 0;
+	if (!valid || (scaled > limit) || (scaled < -limit))
+		return -limit - 1;  // the most negative value marks an invalid field
+	return scaled;
+}
+
+size_t Rtcm3Encoder::EncodeObservations(const RangeMeasurements &ranges, std::vector<unsigned char> &output) {
+	static const uint8_t systems[] = {SATSYS_GPS, SATSYS_GLONASS, SATSYS_GALILEO, SATSYS_SBAS, SATSYS_QZSS, SATSYS_BEIDOU};
+	ranges_ = &ranges;
+	unknown_glonass_frequency_count_ = 0;
+	size_t frames = 0;
+	size_t last_frame = 0;
+	for (size_t ii=0; ii<sizeof(systems); ii++) {
+		GroupSatellites(systems[ii]);
+		for (size_t jj=0; jj<group_count_; jj++) {
+			last_frame = output.size();
+			EncodeMsm(groups_[jj], ranges.header, true, output);
+			frames++;
+		}
+	}
+	// the last frame of the epoch is the one without the multiple message bit
+	if (frames > 0)
+		ClearMultipleMessageBit(&output[last_frame]);
+	ranges_ = NULL;
+	return frames;
+}
+
+void Rtcm3Encoder::GroupSatellites(uint8_t system) {
+	memset(cells_, 0xFF, sizeof(cells_));
+	memset(satellite_signals_, 0, sizeof(satellite_signals_));
+	int32_t count = std::min(std::max(ranges_->number_of_observations, 0), MAX_CHAN);
+	for (int32_t ii=0; ii<count; ii++) {
+		const RangeData &observation = ranges_->range_data[ii];
+		if ((observation.channel_status.satellite_sys != system) || (observation.pseudorange == 0))
+			continue;
+		const SignalInfo *signal = LookupSignal(observation.channel_status);
+		uint8_t id = MsmSatelliteId(system, observation.satellite_prn);
+		if (!signal || (signal->msm_signal_id == 0) || (id == 0))
+			continue;
+		if ((system == SATSYS_GLONASS) &&
+		    (observation.glonass_frequency > GLONASS_MAX_FREQUENCY_NUMBER - GLONASS_MIN_FREQUENCY_NUMBER)) {
+			unknown_glonass_frequency_count_++;
+			continue;
+		}
+		cells_[id-1][signal->msm_signal_id-1] = ii;
+		satellite_signals_[id-1] |= 1u << (signal->msm_signal_id-1);
+	}
+
+	satellite_count_ = 0;
+	for (int id=1; id<=MSM_MAX_SATELLITES; id++) {
+		if (satellite_signals_[id-1])
+			satellites_[satellite_count_++] = id;
+	}
+
+	// add satellites to a message until its cells would exceed the limit
+	group_count_ = 0;
+	MsmGroup group = {system, 0, 0, 0};
+	for (uint8_t ii=0; ii<satellite_count_; ii++) {
+		uint32_t signals = group.signal_mask | satellite_signals_[satellites_[ii]-1];
+		if ((group.satellite_count > 0) && ((group.satellite_count+1)*CountBits(signals) > MSM_MAX_CELLS)) {
+			groups_[group_count_++] = group;
+			group.first_satellite = ii;
+			group.satellite_count = 0;
+			signals = satellite_signals_[satellites_[ii]-1];
+		}
+		group.signal_mask = signals;
+		group.satellite_count++;
+	}
+	if (group.satellite_count > 0)
+		groups_[group_count_++] = group;
+}
+
+void Rtcm3Encoder::EncodeMsm(const MsmGroup &group, const Oem4BinaryHeader &header, bool more,
+                             std::vector<unsigned char> &output) {
+	bool msm7 = (msm_type_ == MSM7);
+	const uint8_t *satellites = satellites_ + group.first_satellite;
+	uint8_t signals[MSM_MAX_SIGNALS];
+	int signal_count = 0;
+	for (int id=1; id<=MSM_MAX_SIGNALS; id++) {
+		if (group.signal_mask & (1u << (id-1)))
+			signals[signal_count++] = id;
+	}
+
+	writer_.Clear();
+	writer_.AddBits(MsmMessageBase(group.system) + msm_type_, 12);
+	writer_.AddBits(station_id_, 12);
+	writer_.AddBits(EpochTime(group.system, header), 30);
+	writer_.AddBits(more ? 1 : 0, 1);
+	writer_.AddBits(iods_, 3);
+	writer_.AddBits(0, 7);      // reserved
+	writer_.AddBits((header.time_status == GPSTIME_FINESTEERING) ? 1 : 0, 2);  // clock steering
+	writer_.AddBits(0, 2);      // external clock
+	writer_.AddBits(0, 1);      // divergence free smoothing
+	writer_.AddBits(0, 3);      // smoothing interval
+
+	uint64_t satellite_mask = 0;
+	for (int ii=0; ii<group.satellite_count; ii++)
+		satellite_mask |= (uint64_t)1 << (MSM_MAX_SATELLITES - satellites[ii]);
+	writer_.AddBits(satellite_mask, 64);
+	uint32_t signal_mask = 0;
+	for (int ii=0; ii<signal_count; ii++)
+		signal_mask |= 1u << (MSM_MAX_SIGNALS - signals[ii]);
+	writer_.AddBits(signal_mask, 32);
+
+	// cells in satellite then signal order, with the rough range and rate
+	// of each satellite taken from its first signal
+	int cell_count = 0;
+	double rough_range[MSM_MAX_SATELLITES];    // [ms], negative if invalid
+	int64_t rough_rate[MSM_MAX_SATELLITES];    // [m/s]
+	uint8_t extended_info[MSM_MAX_SATELLITES];
+	for (int ii=0; ii<group.satellite_count; ii++) {
+		rough_range[ii] = -1;
+		rough_rate[ii] = 0;
+		extended_info[ii] = 0;
+		for (int jj=0; jj<signal_count; jj++) {
+			int16_t cell = cells_[satellites[ii]-1][signals[jj]-1];
+			writer_.AddBits(cell >= 0, 1);
+			if (cell < 0)
+				continue;
+			cell_count++;
+			if (rough_range[ii] >= 0)
+				continue;
+			const RangeData &observation = ranges_->range_data[cell];
+			double range = floor(observation.pseudorange/RTCM3_RANGE_MS*1024 + 0.5)/1024;
+			rough_range[ii] = ((range > 0) && (range < 255)) ? range : -2;
+			int glonass_frequency = (int)observation.glonass_frequency + GLONASS_MIN_FREQUENCY_NUMBER;
+			double wavelength = SignalWavelength(*LookupSignal(observation.channel_status), glonass_frequency);
+			rough_rate[ii] = Scale(-observation.doppler*wavelength, 1.0, 14);
+			if (group.system == SATSYS_GLONASS)
+				extended_info[ii] = observation.glonass_frequency & 0xF;
+		}
+	}
+
+	for (int ii=0; ii<group.satellite_count; ii++)
+		writer_.AddBits((rough_range[ii] >= 0) ? (uint32_t)rough_range[ii] : 255, 8);
+	if (msm7) {
+		for (int ii=0; ii<group.satellite_count; ii++)
+			writer_.AddBits(extended_info[ii], 4);
+	}
+	for (int ii=0; ii<group.satellite_count; ii++) {
+		double range = (rough_range[ii] >= 0) ? rough_range[ii] : 0;
+		writer_.AddBits((uint32_t)((range - floor(range))*1024), 10);
+	}
+	if (msm7) {
+		for (int ii=0; ii<group.satellite_count; ii++)
+			writer_.AddSignedBits(rough_rate[ii], 14);
+	}
+
+	// fine values relative to the satellite's rough range and rate
+	int64_t fine_range[MSM_MAX_CELLS], fine_phase[MSM_MAX_CELLS], fine_rate[MSM_MAX_CELLS];
+	uint32_t lock_time[MSM_MAX_CELLS], half_cycle[MSM_MAX_CELLS], cno[MSM_MAX_CELLS];
+	int cell_index = 0;
+	for (int ii=0; ii<group.satellite_count; ii++) {
+		for (int jj=0; jj<signal_count; jj++) {
+			int16_t cell = cells_[satellites[ii]-1][signals[jj]-1];
+			if (cell < 0)
+				continue;
+			const RangeData &observation = ranges_->range_data[cell];
+			int glonass_frequency = (int)observation.glonass_frequency + GLONASS_MIN_FREQUENCY_NUMBER;
+			double wavelength = SignalWavelength(*LookupSignal(observation.channel_status), glonass_frequency);
+			bool valid = (rough_range[ii] >= 0);
+			bool phase_valid = valid && observation.channel_status.phase_lock_flag && (observation.accumulated_doppler != 0);
+			// accumulated Doppler has the opposite sign to the carrier phase
+			double range = observation.pseudorange/RTCM3_RANGE_MS - rough_range[ii];
+			double phase = -observation.accumulated_doppler*wavelength/RTCM3_RANGE_MS - rough_range[ii];
+			double rate = -observation.doppler*wavelength - rough_rate[ii];
+			if (msm7) {
+				fine_range[cell_index] = Scale(range, P2(-29), 20, valid);
+				fine_phase[cell_index] = Scale(phase, P2(-31), 24, phase_valid);
+				fine_rate[cell_index] = Scale(rate, 0.0001, 15, valid && (rough_rate[ii] != -8192));
+				lock_time[cell_index] = ExtendedLockTimeIndicator(observation.locktime);
+				cno[cell_index] = (uint32_t)std::min(std::max(observation.carrier_to_noise*16.0, 0.0), 1023.0);
+			} else {
+				fine_range[cell_index] = Scale(range, P2(-24), 15, valid);
+				fine_phase[cell_index] = Scale(phase, P2(-29), 22, phase_valid);
+				lock_time[cell_index] = LockTimeIndicator(observation.locktime);
+				cno[cell_index] = (uint32_t)std::min(std::max(observation.carrier_to_noise + 0.5, 0.0), 63.0);
+			}
+			half_cycle[cell_index] = observation.channel_status.parity_known_flag ? 0 : 1;
+			cell_index++;
+		}
+	}
+
+	for (int ii=0; ii<cell_count; ii++)
+		writer_.AddSignedBits(fine_range[ii], msm7 ? 20 : 15);
+	for (int ii=0; ii<cell_count; ii++)
+		writer_.AddSignedBits(fine_phase[ii], msm7 ? 24 : 22);
+	for (int ii=0; ii<cell_count; ii++)
+		writer_.AddBits(lock_time[ii], msm7 ? 10 : 4);
+	for (int ii=0; ii<cell_count; ii++)
+		writer_.AddBits(half_cycle[ii], 1);
+	for (int ii=0; ii<cell_count; ii++)
+		writer_.AddBits(cno[ii], msm7 ? 10 : 6);
+	if (msm7) {
+		for (int ii=0; ii<cell_count; ii++)
+			writer_.AddSignedBits(fine_rate[ii], 15);
+	}
+	writer_.Finish(output);
+}
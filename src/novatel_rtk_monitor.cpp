@@ -0,0 +1,188 @@
+#include "novatel/novatel_rtk_monitor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+using namespace novatel;
+
+static const char* rtk_event_names[] = {"FIX_ACQUIRED", "FIX_LOST", "SEARCHER_CHANGED"};
+
+const char* novatel::RtkEventName(RtkEventType type) {
+	if ((type < RTK_FIX_ACQUIRED) || (type > RTK_SEARCHER_CHANGED))
+		return "UNKNOWN";
+	return rtk_event_names[type];
+}
+
+static const char* searcher_names[RTK_SEARCHER_STATES] = {"none", "buffering", "searching", "complete", "handoff"};
+
+static size_t SearcherSlot(SEARCHER_TYPE type) {
+	return ((type >= NONE_REQUESTED) && (type <= HANDOFF_COMPLETE)) ? type : NONE_REQUESTED;
+}
+
+std::string novatel::FormatRtkSummary(const RtkSummary &summary) {
+	std::stringstream output;
+	output.setf(std::ios::fixed);
+	output.precision(1);
+	output << "fixed=" << (summary.fixed ? 1 : 0) << " for=" << summary.state_duration
+	       << " epochs=" << summary.epochs << "/" << summary.fixed_epochs << "/" << summary.float_epochs
+	       << " fixes=" << summary.fix_count << " losses=" << summary.fix_loss_count
+	       << " ttf=" << summary.last_time_to_fix << "/" << summary.mean_time_to_fix << "/" << summary.max_time_to_fix
+	       << " held=" << summary.mean_fix_duration
+	       << " searcher=" << searcher_names[SearcherSlot(summary.searcher_type)]
+	       << " lanes=" << summary.lane_combinations;
+	output.precision(3);
+	output << " res=" << summary.mean_residual_rms << " svs=" << summary.satellites.size();
+	return output.str();
+}
+
+RtkMonitor::RtkMonitor(size_t window) : time_to_fix_(window), fix_duration_(window) {
+	ResetLocked();
+}
+
+void RtkMonitor::Reset() {
+	boost::mutex::scoped_lock lock(mutex_);
+	ResetLocked();
+}
+
+void RtkMonitor::ResetLocked() {
+	epochs_ = 0;
+	fixed_epochs_ = 0;
+	float_epochs_ = 0;
+	fixed_ = false;
+	state_start_ = -1;
+	last_gps_time_ = 0;
+	fix_count_ = 0;
+	fix_loss_count_ = 0;
+	last_time_to_fix_ = -1;
+	time_to_fix_.Clear();
+	fix_duration_.Clear();
+	searcher_type_ = NONE_REQUESTED;
+	searcher_seen_ = false;
+	lane_combinations_ = 0;
+	memset(searcher_transitions_, 0, sizeof(searcher_transitions_));
+	mean_residual_rms_ = 0;
+	memset(satellites_, 0, sizeof(satellites_));
+}
+
+void RtkMonitor::AddRtkData(const rtkdatab_log &data, double timestamp) {
+	RtkEvent events[3];
+	size_t event_count = 0;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		double gps_time = data.hdr.gps_week*604800.0 + data.hdr.gps_millisecs/1000.0;
+		bool fixed = (data.solutionStatus == SOL_COMPUTED) && IsRtkFixed(data.positionType);
+		epochs_++;
+		if (fixed)
+			fixed_epochs_++;
+		else if ((data.solutionStatus == SOL_COMPUTED) &&
+		         ((data.positionType == L1_FLOAT) || (data.positionType == IONOFREE_FLOAT) ||
+		          (data.positionType == NARROW_FLOAT) || (data.positionType == INS_RTKFLOAT)))
+			float_epochs_++;
+
+		// time to fix runs from the first epoch or the last loss of fix
+		if (state_start_ < 0) {
+			state_start_ = gps_time;
+			fixed_ = false;
+		}
+		if (fixed != fixed_) {
+			RtkEvent &event = events[event_count++];
+			event.value = gps_time - state_start_;
+			if (fixed) {
+				event.type = RTK_FIX_ACQUIRED;
+				fix_count_++;
+				last_time_to_fix_ = event.value;
+				time_to_fix_.Add(event.value);
+			} else {
+				event.type = RTK_FIX_LOST;
+				fix_loss_count_++;
+				fix_duration_.Add(event.value);
+			}
+			event.gps_time = gps_time;
+			event.timestamp = timestamp;
+			fixed_ = fixed;
+			state_start_ = gps_time;
+		}
+		last_gps_time_ = gps_time;
+
+		SEARCHER_TYPE searcher = (SEARCHER_TYPE)SearcherSlot(data.header.searcher_type);
+		if (searcher_seen_ && (searcher != searcher_type_)) {
+			searcher_transitions_[searcher_type_][searcher]++;
+			RtkEvent &event = events[event_count++];
+			event.type = RTK_SEARCHER_CHANGED;
+			event.value = searcher;
+			event.gps_time = gps_time;
+			event.timestamp = timestamp;
+		}
+		searcher_type_ = searcher;
+		searcher_seen_ = true;
+		lane_combinations_ = data.header.num_lane_combs;
+
+		int32_t count = std::min(std::max(data.header.num_svs, 0), MAX_NUM_SAT);
+		double rms_total = 0;
+		int32_t rms_count = 0;
+		for (int32_t ii=0; ii<count; ii++) {
+			const rtkdatab_data &sv = data.data[ii];
+			if (sv.prn >= RTK_MAX_PRN)
+				continue;
+			SatelliteState &state = satellites_[sv.prn];
+			double residual = sv.residual;
+			state.epochs++;
+			if (IsIntegerAmbiguity(sv.ambiguity_type))
+				state.integer_epochs++;
+			state.ambiguity_type = sv.ambiguity_type;
+			state.last_residual = residual;
+			double delta = residual - state.mean;
+			state.mean += delta/state.epochs;
+			state.m2 += delta*(residual - state.mean);
+			state.sum_squares += residual*residual;
+			state.max_abs = std::max(state.max_abs, std::fabs(residual));
+			rms_total += std::sqrt(state.sum_squares/state.epochs);
+			rms_count++;
+		}
+		mean_residual_rms_ = rms_count ? rms_total/rms_count : 0;
+	}
+
+	if (event_callback_) {
+		for (size_t ii=0; ii<event_count; ii++)
+			event_callback_(events[ii]);
+	}
+}
+
+RtkSummary RtkMonitor::Summary() {
+	boost::mutex::scoped_lock lock(mutex_);
+	RtkSummary summary;
+	summary.epochs = epochs_;
+	summary.fixed_epochs = fixed_epochs_;
+	summary.float_epochs = float_epochs_;
+	summary.fixed = fixed_;
+	summary.state_duration = (state_start_ < 0) ? 0 : last_gps_time_ - state_start_;
+	summary.fix_count = fix_count_;
+	summary.fix_loss_count = fix_loss_count_;
+	summary.last_time_to_fix = last_time_to_fix_;
+	summary.mean_time_to_fix = time_to_fix_.mean();
+	summary.max_time_to_fix = time_to_fix_.max();
+	summary.mean_fix_duration = fix_duration_.mean();
+	summary.searcher_type = searcher_type_;
+	summary.lane_combinations = lane_combinations_;
+	memcpy(summary.searcher_transitions, searcher_transitions_, sizeof(searcher_transitions_));
+	summary.mean_residual_rms = mean_residual_rms_;
+	for (uint32_t prn=0; prn<RTK_MAX_PRN; prn++) {
+		const SatelliteState &state = satellites_[prn];
+		if (state.epochs == 0)
+			continue;
+		RtkSatelliteStats stats;
+		stats.prn = prn;
+		stats.epochs = state.epochs;
+		stats.integer_epochs = state.integer_epochs;
+		stats.ambiguity_type = state.ambiguity_type;
+		stats.last_residual = state.last_residual;
+		stats.mean_residual = state.mean;
+		stats.stddev_residual = (state.epochs > 1) ? std::sqrt(state.m2/(state.epochs-1)) : 0;
+		stats.rms_residual = std::sqrt(state.sum_squares/state.epochs);
+		stats.max_abs_residual = state.max_abs;
+		summary.satellites.push_back(stats);
+	}
+	return summary;
+}
@@ -0,0 +1,438 @@
+#include "novatel/novatel_smoother.h"
+#include "novatel/novatel_enums.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+using namespace novatel;
+
+#define WGS84_A 6378137.0
+#define WGS84_E2 6.69437999014e-3
+#define SECONDS_IN_WEEK 604800.0
+#define DEG_TO_RAD (M_PI/180.0)
+
+//! Position variance used when the trajectory starts before any INSCOV [m^2]
+#define DEFAULT_INITIAL_VARIANCE 100.0
+
+namespace novatel {
+
+struct SmootherRecord {
+	double time;
+	double predicted_state[3];
+	double predicted_covariance[9];
+	double state[3];
+	double covariance[9];
+	SmoothedEpoch epoch;
+};
+
+struct SmootherSegment {
+	uint32_t index;
+	double end_time;
+	size_t output_count;	//!< records before the overlap
+	bool done;
+	std::vector<SmootherRecord> records;
+};
+
+}
+
+//////////////////////////////////////////////////////
+// 3x3 matrices, row major
+//////////////////////////////////////////////////////
+static void Multiply(const double *a, const double *b, double *out) {
+	for (int ii=0; ii<3; ii++)
+		for (int jj=0; jj<3; jj++)
+			out[ii*3+jj] = a[ii*3]*b[jj] + a[ii*3+1]*b[3+jj] + a[ii*3+2]*b[6+jj];
+}
+
+//! a * b^T
+static void MultiplyTransposed(const double *a, const double *b, double *out) {
+	for (int ii=0; ii<3; ii++)
+		for (int jj=0; jj<3; jj++)
+			out[ii*3+jj] = a[ii*3]*b[jj*3] + a[ii*3+1]*b[jj*3+1] + a[ii*3+2]*b[jj*3+2];
+}
+
+static void MultiplyVector(const double *a, const double *v, double *out) {
+	for (int ii=0; ii<3; ii++)
+		out[ii] = a[ii*3]*v[0] + a[ii*3+1]*v[1] + a[ii*3+2]*v[2];
+}
+
+static bool Invert(const double *a, double *out) {
+	double det = a[0]*(a[4]*a[8] - a[5]*a[7]) - a[1]*(a[3]*a[8] - a[5]*a[6]) + a[2]*(a[3]*a[7] - a[4]*a[6]);
+	if (fabs(det) < 1e-300)
+		return false;
+	out[0] = (a[4]*a[8] - a[5]*a[7])/det;
+	out[1] = (a[2]*a[7] - a[1]*a[8])/det;
+	out[2] = (a[1]*a[5] - a[2]*a[4])/det;
+	out[3] = (a[5]*a[6] - a[3]*a[8])/det;
+	out[4] = (a[0]*a[8] - a[2]*a[6])/det;
+	out[5] = (a[2]*a[3] - a[0]*a[5])/det;
+	out[6] = (a[3]*a[7] - a[4]*a[6])/det;
+	out[7] = (a[1]*a[6] - a[0]*a[7])/det;
+	out[8] = (a[0]*a[4] - a[1]*a[3])/det;
+	return true;
+}
+
+//! a * c * a^T
+static void Transform(const double *a, const double *c, double *out) {
+	double temp[9];
+	Multiply(a, c, temp);
+	MultiplyTransposed(temp, a, out);
+}
+
+//! a^T * c * a
+static void TransformTransposed(const double *a, const double *c, double *out) {
+	double at[9];
+	for (int ii=0; ii<3; ii++)
+		for (int jj=0; jj<3; jj++)
+			at[ii*3+jj] = a[jj*3+ii];
+	Transform(at, c, out);
+}
+
+//////////////////////////////////////////////////////
+// WGS84
+//////////////////////////////////////////////////////
+static void GeodeticToEcef(double latitude, double longitude, double height, double *ecef) {
+	double lat = latitude*DEG_TO_RAD, lon = longitude*DEG_TO_RAD;
+	double n = WGS84_A/sqrt(1 - WGS84_E2*sin(lat)*sin(lat));
+	ecef[0] = (n + height)*cos(lat)*cos(lon);
+	ecef[1] = (n + height)*cos(lat)*sin(lon);
+	ecef[2] = (n*(1 - WGS84_E2) + height)*sin(lat);
+}
+
+static void EcefToGeodetic(const double *ecef, double &latitude, double &longitude, double &height) {
+	double p = sqrt(ecef[0]*ecef[0] + ecef[1]*ecef[1]);
+	double lat = atan2(ecef[2], p*(1 - WGS84_E2));
+	double n = WGS84_A;
+	for (int ii=0; ii<5; ii++) {
+		n = WGS84_A/sqrt(1 - WGS84_E2*sin(lat)*sin(lat));
+		height = p/cos(lat) - n;
+		lat = atan2(ecef[2], p*(1 - WGS84_E2*n/(n + height)));
+	}
+	latitude = lat/DEG_TO_RAD;
+	longitude = atan2(ecef[1], ecef[0])/DEG_TO_RAD;
+}
+
+//! Rotation taking east north up vectors to ECEF
+static void EnuToEcef(double latitude, double longitude, double *rotation) {
+	double sl = sin(latitude*DEG_TO_RAD), cl = cos(latitude*DEG_TO_RAD);
+	double so = sin(longitude*DEG_TO_RAD), co = cos(longitude*DEG_TO_RAD);
+	double r[9] = {-so, -sl*co, cl*co,
+	                co, -sl*so, cl*so,
+	                 0,     cl,    sl};
+	std::copy(r, r+9, rotation);
+}
+
+static double GpsTime(const Oem4BinaryHeader &header) {
+	return header.gps_week*SECONDS_IN_WEEK + header.gps_millisecs/1000.0;
+}
+
+//////////////////////////////////////////////////////
+// TrajectorySmoother
+//////////////////////////////////////////////////////
+TrajectorySmoother::TrajectorySmoother(const SmootherConfig &config)
+	: config_(config), initialised_(false), have_velocity_covariance_(false), have_initial_covariance_(false),
+	  current_(NULL), overlapping_(NULL), segment_count_(0), next_delivery_(0), stopping_(false) {
+	if (config_.segment_length <= 0)
+		throw std::invalid_argument("Smoother segment length must be positive.");
+	config_.overlap = std::max(0.0, std::min(config_.overlap, config_.segment_length));
+	if (config_.threads <= 0)
+		config_.threads = std::max(1u, boost::thread::hardware_concurrency());
+	if (config_.max_segments == 0)
+		config_.max_segments = 2*config_.threads;
+	memset(&stats_, 0, sizeof(stats_));
+	for (int ii=0; ii<config_.threads; ii++)
+		workers_.create_thread(boost::bind(&TrajectorySmoother::Worker, this));
+}
+
+TrajectorySmoother::~TrajectorySmoother() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		stopping_ = true;
+		work_condition_.notify_all();
+	}
+	workers_.join_all();
+	for (std::map<uint32_t, SmootherSegment*>::iterator it = in_flight_.begin(); it != in_flight_.end(); ++it)
+		delete it->second;
+	delete overlapping_;
+	delete current_;
+}
+
+void TrajectorySmoother::AddInsCovariance(const InsCovariance &covariance) {
+	memcpy(velocity_covariance_, covariance.velocity_covariance, sizeof(velocity_covariance_));
+	have_velocity_covariance_ = true;
+	if (!initialised_) {
+		memcpy(initial_covariance_, covariance.position_covariance, sizeof(initial_covariance_));
+		have_initial_covariance_ = true;
+	}
+}
+
+void TrajectorySmoother::AddPosition(const Position &position) {
+	if ((position.solution_status != SOL_COMPUTED) || (position.position_type == NONE)) {
+		stats_.fixes_dropped++;
+		return;
+	}
+	Fix fix;
+	fix.time = GpsTime(position.header);
+	// BESTPOS heights are above the geoid
+	GeodeticToEcef(position.latitude, position.longitude, position.height + position.undulation, fix.position);
+	double sigma[3] = {position.longitude_standard_deviation, position.latitude_standard_deviation,
+	                   position.height_standard_deviation};
+	double enu[9] = {0};
+	for (int ii=0; ii<3; ii++)
+		enu[ii*4] = pow(std::max((double)sigma[ii], config_.min_position_sigma), 2);
+	double rotation[9];
+	EnuToEcef(position.latitude, position.longitude, rotation);
+	Transform(rotation, enu, fix.covariance);
+	fixes_.push_back(fix);
+}
+
+void TrajectorySmoother::AddInsPva(const InsPositionVelocityAttitude &pva) {
+	InsSample sample;
+	sample.time = GpsTime(pva.header);
+	GeodeticToEcef(pva.latitude, pva.longitude, pva.height, sample.position);
+	double rotation[9];
+	EnuToEcef(pva.latitude, pva.longitude, rotation);
+
+	if (!initialised_) {
+		std::copy(sample.position, sample.position+3, state_);
+		if (have_initial_covariance_) {
+			Transform(rotation, initial_covariance_, covariance_);
+		} else {
+			std::fill(covariance_, covariance_+9, 0.0);
+			covariance_[0] = covariance_[4] = covariance_[8] = DEFAULT_INITIAL_VARIANCE;
+		}
+		initialised_ = true;
+	} else {
+		const InsSample &previous = history_.back();
+		double dt = sample.time - previous.time;
+		if (dt <= 0)
+			return;
+		// the INS position increment carries the state, its error grows with the velocity error
+		for (int ii=0; ii<3; ii++)
+			state_[ii] += sample.position[ii] - previous.position[ii];
+		if (have_velocity_covariance_) {
+			double process[9];
+			Transform(rotation, velocity_covariance_, process);
+			for (int ii=0; ii<9; ii++)
+				covariance_[ii] += process[ii]*dt*dt;
+		}
+		for (int ii=0; ii<3; ii++)
+			covariance_[ii*4] += config_.position_noise*dt;
+	}
+	std::copy(state_, state_+3, predicted_state_);
+	std::copy(covariance_, covariance_+9, predicted_covariance_);
+
+	history_.push_back(sample);
+	while (history_.front().time < sample.time - config_.history)
+		history_.pop_front();
+	ApplyFixes(sample);
+	stats_.epochs++;
+
+	SmootherRecord record;
+	record.time = sample.time;
+	std::copy(predicted_state_, predicted_state_+3, record.predicted_state);
+	std::copy(predicted_covariance_, predicted_covariance_+9, record.predicted_covariance);
+	std::copy(state_, state_+3, record.state);
+	std::copy(covariance_, covariance_+9, record.covariance);
+	SmoothedEpoch &epoch = record.epoch;
+	epoch.gps_week = pva.header.gps_week;
+	epoch.gps_seconds = pva.header.gps_millisecs/1000.0;
+	epoch.north_velocity = pva.north_velocity;
+	epoch.east_velocity = pva.east_velocity;
+	epoch.up_velocity = pva.up_velocity;
+	epoch.roll = pva.roll;
+	epoch.pitch = pva.pitch;
+	epoch.azimuth = pva.azimuth;
+	epoch.status = pva.status;
+	AddToSegments(record);
+}
+
+void TrajectorySmoother::ApplyFixes(const InsSample &current) {
+	while (!fixes_.empty() && (fixes_.front().time <= current.time)) {
+		Fix fix = fixes_.front();
+		fixes_.pop_front();
+		if (fix.time < history_.front().time) {
+			stats_.fixes_dropped++;
+			continue;
+		}
+		// move the fix forward by the INS motion since it was taken
+		size_t after = 0;
+		while (history_[after].time < fix.time)
+			after++;
+		double ins[3];
+		if (after == 0) {
+			std::copy(history_[0].position, history_[0].position+3, ins);
+		} else {
+			const InsSample &a = history_[after-1], &b = history_[after];
+			double fraction = (fix.time - a.time)/(b.time - a.time);
+			for (int ii=0; ii<3; ii++)
+				ins[ii] = a.position[ii] + fraction*(b.position[ii] - a.position[ii]);
+		}
+		double innovation[3];
+		for (int ii=0; ii<3; ii++)
+			innovation[ii] = fix.position[ii] + current.position[ii] - ins[ii] - state_[ii];
+
+		double innovation_covariance[9], inverse[9], gain[9];
+		for (int ii=0; ii<9; ii++)
+			innovation_covariance[ii] = covariance_[ii] + fix.covariance[ii];
+		if (!Invert(innovation_covariance, inverse)) {
+			stats_.fixes_dropped++;
+			continue;
+		}
+		Multiply(covariance_, inverse, gain);
+		double correction[3];
+		MultiplyVector(gain, innovation, correction);
+		for (int ii=0; ii<3; ii++)
+			state_[ii] += correction[ii];
+
+		// Joseph form keeps the covariance symmetric and positive
+		double complement[9], first[9], second[9];
+		for (int ii=0; ii<9; ii++)
+			complement[ii] = ((ii % 4) == 0 ? 1.0 : 0.0) - gain[ii];
+		Transform(complement, covariance_, first);
+		Transform(gain, fix.covariance, second);
+		for (int ii=0; ii<9; ii++)
+			covariance_[ii] = first[ii] + second[ii];
+		stats_.fixes++;
+	}
+}
+
+void TrajectorySmoother::AddToSegments(const SmootherRecord &record) {
+	if (overlapping_) {
+		if (record.time >= overlapping_->end_time + config_.overlap) {
+			Submit(overlapping_);
+			overlapping_ = NULL;
+		} else {
+			overlapping_->records.push_back(record);
+		}
+	}
+	if (current_ && (record.time >= current_->end_time)) {
+		current_->output_count = current_->records.size();
+		if (overlapping_)
+			Submit(overlapping_);
+		overlapping_ = current_;
+		current_ = NULL;
+		if (record.time >= overlapping_->end_time + config_.overlap) {
+			Submit(overlapping_);
+			overlapping_ = NULL;
+		} else {
+			overlapping_->records.push_back(record);
+		}
+	}
+	if (!current_) {
+		current_ = new SmootherSegment;
+		current_->index = segment_count_++;
+		current_->end_time = record.time + config_.segment_length;
+		current_->output_count = 0;
+		current_->done = false;
+	}
+	current_->records.push_back(record);
+}
+
+void TrajectorySmoother::Submit(SmootherSegment *segment) {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		in_flight_[segment->index] = segment;
+		queue_.push_back(segment);
+		work_condition_.notify_one();
+	}
+	Deliver(false);
+}
+
+void TrajectorySmoother::Finish() {
+	if (current_)
+		current_->output_count = current_->records.size();
+	if (overlapping_)
+		Submit(overlapping_);
+	overlapping_ = NULL;
+	if (current_)
+		Submit(current_);
+	current_ = NULL;
+	Deliver(true);
+
+	// fixes after the last epoch can not be used
+	stats_.fixes_dropped += fixes_.size();
+	fixes_.clear();
+	history_.clear();
+	initialised_ = false;
+	have_initial_covariance_ = false;
+}
+
+void TrajectorySmoother::Deliver(bool wait_for_all) {
+	boost::mutex::scoped_lock lock(mutex_);
+	while (true) {
+		std::map<uint32_t, SmootherSegment*>::iterator next = in_flight_.find(next_delivery_);
+		if ((next != in_flight_.end()) && next->second->done) {
+			SmootherSegment *segment = next->second;
+			in_flight_.erase(next);
+			next_delivery_++;
+			stats_.segments++;
+			lock.unlock();
+			if (smoothed_epoch_callback_)
+				for (size_t ii=0; ii<segment->output_count; ii++)
+					smoothed_epoch_callback_(segment->records[ii].epoch);
+			delete segment;
+			lock.lock();
+			continue;
+		}
+		if (in_flight_.empty() || (!wait_for_all && (in_flight_.size() < config_.max_segments)))
+			return;
+		done_condition_.wait(lock);
+	}
+}
+
+void TrajectorySmoother::Worker() {
+	boost::mutex::scoped_lock lock(mutex_);
+	while (true) {
+		if (queue_.empty()) {
+			if (stopping_)
+				return;
+			work_condition_.wait(lock);
+			continue;
+		}
+		SmootherSegment *segment = queue_.front();
+		queue_.pop_front();
+		lock.unlock();
+
+		// backward pass from the filtered state at the end of the overlap
+		std::vector<SmootherRecord> &records = segment->records;
+		for (size_t kk=records.size()-1; kk-- > 0;) {
+			SmootherRecord &current = records[kk];
+			const SmootherRecord &next = records[kk+1];
+			double inverse[9], gain[9];
+			if (!Invert(next.predicted_covariance, inverse))
+				continue;
+			Multiply(current.covariance, inverse, gain);
+			double difference[3], correction[3];
+			for (int ii=0; ii<3; ii++)
+				difference[ii] = next.state[ii] - next.predicted_state[ii];
+			MultiplyVector(gain, difference, correction);
+			double covariance_difference[9], covariance_correction[9];
+			for (int ii=0; ii<9; ii++)
+				covariance_difference[ii] = next.covariance[ii] - next.predicted_covariance[ii];
+			Transform(gain, covariance_difference, covariance_correction);
+			for (int ii=0; ii<3; ii++)
+				current.state[ii] += correction[ii];
+			for (int ii=0; ii<9; ii++)
+				current.covariance[ii] += covariance_correction[ii];
+		}
+		for (size_t kk=0; kk<segment->output_count; kk++) {
+			SmootherRecord &record = records[kk];
+			SmoothedEpoch &epoch = record.epoch;
+			EcefToGeodetic(record.state, epoch.latitude, epoch.longitude, epoch.height);
+			double rotation[9];
+			EnuToEcef(epoch.latitude, epoch.longitude, rotation);
+			TransformTransposed(rotation, record.covariance, epoch.covariance);
+		}
+		records.resize(segment->output_count);
+
+		lock.lock();
+		segment->done = true;
+		done_condition_.notify_all();
+	}
+}
@@ -0,0 +1,474 @@
+#include "novatel/novatel_transport.h"
+#include "novatel/novatel_recorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+
+using namespace novatel;
+
+void novatel::ThrowSystemError(const std::string &message) {
+	std::stringstream output;
+	output << message << ": " << strerror(errno);
+	throw std::runtime_error(output.str());
+}
+
+void novatel::SplitHostPort(const std::string &address, std::string &host, std::string &port) {
+	std::string::size_type colon = address.rfind(':');
+	if ((colon == std::string::npos) || (colon+1 >= address.size()))
+		throw std::invalid_argument("Expected host:port in '" + address + "'");
+	host = address.substr(0, colon);
+	port = address.substr(colon+1);
+}
+
+struct addrinfo* novatel::ResolveAddress(const std::string &host, const std::string &port, int socktype, bool passive) {
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = socktype;
+	if (passive)
+		hints.ai_flags = AI_PASSIVE;
+	struct addrinfo *result = NULL;
+	int error = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &result);
+	if (error != 0)
+		throw std::runtime_error("Could not resolve " + host + ":" + port + ": " + gai_strerror(error));
+	return result;
+}
+
+Transport* novatel::CreateTransport(const std::string &url, int baudrate) {
+	std::string::size_type separator = url.find("://");
+	if (separator == std::string::npos)
+		return new SerialTransport(url, baudrate);
+
+	std::string scheme = url.substr(0, separator);
+	std::string address = url.substr(separator+3);
+	std::string host, port;
+	if (scheme == "serial") {
+		return new SerialTransport(address, baudrate);
+	} else if (scheme == "tcp") {
+		SplitHostPort(address, host, port);
+		return new TcpTransport(host, port);
+	} else if (scheme == "udp") {
+		SplitHostPort(address, host, port);
+		return new UdpTransport(host, port);
+	} else if (scheme == "file") {
+		return new FileTransport(address);
+	} else if (scheme == "replay") {
+		return new ReplayTransport(address);
+	} else if (scheme == "pty") {
+		return new PtyTransport();
+	}
+	throw std::invalid_argument("Unknown transport '" + scheme + "' in " + url);
+}
+
+bool novatel::IsSerialUrl(const std::string &url) {
+	return (url.find("://") == std::string::npos) || (url.compare(0, 9, "serial://") == 0);
+}
+
+//////////////////////////////////////////////////////
+// Transport
+//////////////////////////////////////////////////////
+size_t Transport::ReadV(const struct iovec *iov, int count) {
+	for (int ii=0; ii<count; ii++) {
+		if (iov[ii].iov_len > 0)
+			return Read((unsigned char*)iov[ii].iov_base, iov[ii].iov_len);
+	}
+	return 0;
+}
+
+std::string Transport::ReadString(size_t max_length) {
+	std::string result;
+	unsigned char buffer[1024];
+	while (result.size() < max_length) {
+		size_t len = Read(buffer, std::min(sizeof(buffer), max_length-result.size()));
+		if (len == 0)
+			break;
+		result.append((char*)buffer, len);
+	}
+	return result;
+}
+
+//////////////////////////////////////////////////////
+// SerialTransport
+//////////////////////////////////////////////////////
+SerialTransport::SerialTransport(std::string port, int baudrate)
+	: port_(port), baudrate_(baudrate), serial_port_(NULL) {
+}
+
+SerialTransport::~SerialTransport() {
+	delete serial_port_;
+}
+
+void SerialTransport::Open() {
+	// keep the same object when reopening so a writer on another thread
+	// never sees a dangling pointer
+	if (serial_port_ == NULL)
+		serial_port_ = new serial::Serial(port_,baudrate_,serial::Timeout::simpleTimeout(10));
+	else if (!serial_port_->isOpen())
+		serial_port_->open();
+	if (!serial_port_->isOpen())
+		throw std::runtime_error("Serial port " + port_ + " failed to open.");
+}
+
+void SerialTransport::Close() {
+	if (serial_port_ != NULL)
+		serial_port_->close();
+}
+
+bool SerialTransport::IsOpen() {
+	return (serial_port_ != NULL) && serial_port_->isOpen();
+}
+
+size_t SerialTransport::Read(unsigned char *buffer, size_t size) {
+	if (serial_port_ == NULL)
+		throw std::runtime_error("Serial port " + port_ + " is not open.");
+	return serial_port_->read(buffer, size);
+}
+
+size_t SerialTransport::Write(const unsigned char *data, size_t length) {
+	if (serial_port_ == NULL)
+		throw std::runtime_error("Serial port " + port_ + " is not open.");
+	return serial_port_->write(data, length);
+}
+
+void SerialTransport::Flush() {
+	if (serial_port_ != NULL)
+		serial_port_->flush();
+}
+
+//////////////////////////////////////////////////////
+// FdTransport
+//////////////////////////////////////////////////////
+FdTransport::FdTransport() : fd_(-1), read_timeout_ms_(10), eof_is_error_(true), wakeup_us_(0) {
+}
+
+FdTransport::~FdTransport() {
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+void FdTransport::Close() {
+	if (fd_ >= 0)
+		::close(fd_);
+	fd_ = -1;
+}
+
+bool FdTransport::WaitReadable() {
+	if (fd_ < 0)
+		throw std::runtime_error(name() + " is not open.");
+	struct pollfd pfd;
+	pfd.fd = fd_;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	int result = poll(&pfd, 1, read_timeout_ms_);
+	if ((result < 0) && (errno != EINTR))
+		ThrowSystemError("Error waiting for data on " + name());
+	if (result > 0) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		wakeup_us_ = (uint64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+	}
+	return result > 0;
+}
+
+size_t FdTransport::CheckRead(ssize_t result) {
+	if (result < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+			return 0;
+		ThrowSystemError("Error reading from " + name());
+	}
+	if ((result == 0) && eof_is_error_)
+		throw std::runtime_error(name() + " closed by the remote end.");
+	return (size_t)result;
+}
+
+size_t FdTransport::Read(unsigned char *buffer, size_t size) {
+	if (!WaitReadable())
+		return 0;
+	return CheckRead(::read(fd_, buffer, size));
+}
+
+size_t FdTransport::ReadV(const struct iovec *iov, int count) {
+	if (!WaitReadable())
+		return 0;
+	return CheckRead(::readv(fd_, iov, count));
+}
+
+size_t FdTransport::Write(const unsigned char *data, size_t length) {
+	if (fd_ < 0)
+		throw std::runtime_error(name() + " is not open.");
+	size_t written = 0;
+	while (written < length) {
+		ssize_t result = ::write(fd_, data+written, length-written);
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				struct pollfd pfd;
+				pfd.fd = fd_;
+				pfd.events = POLLOUT;
+				pfd.revents = 0;
+				poll(&pfd, 1, 100);
+				continue;
+			}
+			ThrowSystemError("Error writing to " + name());
+		}
+		written += result;
+	}
+	return written;
+}
+
+//////////////////////////////////////////////////////
+// TcpTransport
+//////////////////////////////////////////////////////
+TcpTransport::TcpTransport(std::string host, std::string port)
+	: host_(host), port_(port) {
+}
+
+void TcpTransport::Open() {
+	Close();
+	struct addrinfo *addresses = ResolveAddress(host_, port_, SOCK_STREAM, false);
+	int error = 0;
+	for (struct addrinfo *address = addresses; address != NULL; address = address->ai_next) {
+		fd_ = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+		if (fd_ < 0) {
+			error = errno;
+			continue;
+		}
+		if (connect(fd_, address->ai_addr, address->ai_addrlen) == 0)
+			break;
+		error = errno;
+		::close(fd_);
+		fd_ = -1;
+	}
+	freeaddrinfo(addresses);
+	if (fd_ < 0) {
+		errno = error;
+		ThrowSystemError("Could not connect to " + name());
+	}
+	// logs are small and frequent, send commands without delay
+	int flag = 1;
+	setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+//////////////////////////////////////////////////////
+// UdpTransport
+//////////////////////////////////////////////////////
+UdpTransport::UdpTransport(std::string host, std::string port)
+	: host_(host), port_(port), peer_length_(0) {
+	memset(&peer_, 0, sizeof(peer_));
+	// an empty datagram is not the end of the stream
+	eof_is_error_ = false;
+}
+
+void UdpTransport::Open() {
+	Close();
+	bool listening = host_.empty();
+	struct addrinfo *addresses = ResolveAddress(host_, port_, SOCK_DGRAM, listening);
+	int error = 0;
+	for (struct addrinfo *address = addresses; address != NULL; address = address->ai_next) {
+		fd_ = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+		if (fd_ < 0) {
+			error = errno;
+			continue;
+		}
+		int result;
+		if (listening)
+			result = bind(fd_, address->ai_addr, address->ai_addrlen);
+		else
+			result = connect(fd_, address->ai_addr, address->ai_addrlen);
+		if (result == 0)
+			break;
+		error = errno;
+		::close(fd_);
+		fd_ = -1;
+	}
+	freeaddrinfo(addresses);
+	if (fd_ < 0) {
+		errno = error;
+		ThrowSystemError("Could not open " + name());
+	}
+	peer_length_ = 0;
+}
+
+size_t UdpTransport::Receive(struct iovec *iov, int count) {
+	if (!WaitReadable())
+		return 0;
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = iov;
+	message.msg_iovlen = count;
+	// remember who is sending so commands can be returned to them
+	struct sockaddr_storage sender;
+	if (host_.empty()) {
+		message.msg_name = &sender;
+		message.msg_namelen = sizeof(sender);
+	}
+	size_t len = CheckRead(recvmsg(fd_, &message, 0));
+	if (host_.empty() && (message.msg_namelen > 0)) {
+		memcpy(&peer_, &sender, message.msg_namelen);
+		peer_length_ = message.msg_namelen;
+	}
+	return len;
+}
+
+size_t UdpTransport::Read(unsigned char *buffer, size_t size) {
+	struct iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+	return Receive(&iov, 1);
+}
+
+size_t UdpTransport::ReadV(const struct iovec *iov, int count) {
+	return Receive(const_cast<struct iovec*>(iov), count);
+}
+
+size_t UdpTransport::Write(const unsigned char *data, size_t length) {
+	if (fd_ < 0)
+		throw std::runtime_error(name() + " is not open.");
+	ssize_t result;
+	if (!host_.empty())
+		result = send(fd_, data, length, 0);
+	else if (peer_length_ > 0)
+		result = sendto(fd_, data, length, 0, (struct sockaddr*)&peer_, peer_length_);
+	else
+		throw std::runtime_error(name() + " has not received data from a receiver to reply to.");
+	if (result < 0)
+		ThrowSystemError("Error writing to " + name());
+	return (size_t)result;
+}
+
+//////////////////////////////////////////////////////
+// FileTransport
+//////////////////////////////////////////////////////
+FileTransport::FileTransport(std::string path, size_t chunk_size)
+	: path_(path), chunk_size_(chunk_size), data_(NULL), size_(0), position_(0) {
+}
+
+FileTransport::~FileTransport() {
+	Close();
+}
+
+void FileTransport::Open() {
+	Close();
+	int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		ThrowSystemError("Could not open " + path_);
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		::close(fd);
+		ThrowSystemError("Could not read size of " + path_);
+	}
+	size_ = info.st_size;
+	position_ = 0;
+	if (size_ == 0) {
+		// mmap does not accept empty files
+		::close(fd);
+		throw std::runtime_error(path_ + " is empty.");
+	}
+	void *mapping = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+		ThrowSystemError("Could not map " + path_);
+	madvise(mapping, size_, MADV_SEQUENTIAL);
+	data_ = (unsigned char*)mapping;
+}
+
+void FileTransport::Close() {
+	if (data_ != NULL)
+		munmap(data_, size_);
+	data_ = NULL;
+}
+
+size_t FileTransport::Read(unsigned char *buffer, size_t size) {
+	struct iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+	return ReadV(&iov, 1);
+}
+
+size_t FileTransport::ReadV(const struct iovec *iov, int count) {
+	if (data_ == NULL)
+		throw std::runtime_error(name() + " is not open.");
+	if (position_ >= size_) {
+		// behave like a receiver that has stopped sending
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+		return 0;
+	}
+	size_t remaining = std::min(chunk_size_, size_-position_);
+	size_t total = 0;
+	for (int ii=0; (ii<count) && (remaining>0); ii++) {
+		size_t len = std::min(remaining, (size_t)iov[ii].iov_len);
+		memcpy(iov[ii].iov_base, data_+position_, len);
+		position_ += len;
+		remaining -= len;
+		total += len;
+	}
+	return total;
+}
+
+size_t FileTransport::Write(const unsigned char */*data*/, size_t /*length*/) {
+	throw std::runtime_error(name() + " is read only.");
+}
+
+//////////////////////////////////////////////////////
+// PtyTransport
+//////////////////////////////////////////////////////
+PtyTransport::PtyTransport() : slave_fd_(-1) {
+	// writers come and go on the slave side, that is not the end of the stream
+	eof_is_error_ = false;
+}
+
+PtyTransport::~PtyTransport() {
+	Close();
+}
+
+void PtyTransport::Open() {
+	Close();
+	fd_ = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (fd_ < 0)
+		ThrowSystemError("Could not create pseudo terminal");
+	if ((grantpt(fd_) != 0) || (unlockpt(fd_) != 0)) {
+		Close();
+		ThrowSystemError("Could not unlock pseudo terminal");
+	}
+	char *name = ptsname(fd_);
+	if (name == NULL) {
+		Close();
+		ThrowSystemError("Could not get pseudo terminal name");
+	}
+	slave_name_ = name;
+
+	// binary data must pass through the line discipline untouched
+	slave_fd_ = ::open(slave_name_.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (slave_fd_ < 0) {
+		Close();
+		ThrowSystemError("Could not open " + slave_name_);
+	}
+	struct termios settings;
+	if (tcgetattr(slave_fd_, &settings) == 0) {
+		cfmakeraw(&settings);
+		tcsetattr(slave_fd_, TCSANOW, &settings);
+	}
+}
+
+void PtyTransport::Close() {
+	if (slave_fd_ >= 0)
+		::close(slave_fd_);
+	slave_fd_ = -1;
+	FdTransport::Close();
+}
@@ -0,0 +1,173 @@
+#include "novatel/novatel_waiters.h"
+
+#include <time.h>
+
+using namespace novatel;
+
+static uint64_t MonotonicMicroseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+uint64_t WaiterList::AddFrameWaiter(BINARY_LOG_TYPE message_id, FrameFilter filter,
+                                    WaitCompletion completion, double timeout) {
+	Waiter waiter;
+	waiter.acknowledgement = false;
+	waiter.message_id = message_id;
+	waiter.filter = filter;
+	waiter.completion = completion;
+	return Add(waiter, timeout);
+}
+
+uint64_t WaiterList::AddAckWaiter(WaitCompletion completion, double timeout) {
+	Waiter waiter;
+	waiter.acknowledgement = true;
+	waiter.message_id = BINARY_LOG_TYPE(0);
+	waiter.completion = completion;
+	return Add(waiter, timeout);
+}
+
+uint64_t WaiterList::Add(Waiter &waiter, double timeout) {
+	waiter.deadline_us = (timeout > 0) ? MonotonicMicroseconds() + (uint64_t)(timeout*1e6) : 0;
+	boost::mutex::scoped_lock lock(mutex_);
+	waiter.id = next_id_++;
+	waiters_.push_back(waiter);
+	count_.store(waiters_.size(), boost::memory_order_relaxed);
+	return waiter.id;
+}
+
+void WaiterList::Take(std::list<Waiter>::iterator waiter, std::list<Waiter> &taken) {
+	taken.splice(taken.end(), waiters_, waiter);
+	count_.store(waiters_.size(), boost::memory_order_relaxed);
+}
+
+void WaiterList::Complete(std::list<Waiter> &taken, WaitResult result,
+                          const unsigned char *frame, size_t length, double timestamp) {
+	for (std::list<Waiter>::iterator it = taken.begin(); it != taken.end(); ++it)
+		if (it->completion)
+			it->completion(result, frame, length, timestamp);
+}
+
+bool WaiterList::Take(uint64_t waiter_id, std::list<Waiter> &taken) {
+	boost::mutex::scoped_lock lock(mutex_);
+	for (std::list<Waiter>::iterator it = waiters_.begin(); it != waiters_.end(); ++it) {
+		if (it->id == waiter_id) {
+			Take(it, taken);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool WaiterList::Cancel(uint64_t waiter_id) {
+	std::list<Waiter> taken;
+	if (!Take(waiter_id, taken))
+		return false;
+	Complete(taken, WAIT_CANCELLED, NULL, 0, 0);
+	return true;
+}
+
+bool WaiterList::Remove(uint64_t waiter_id) {
+	std::list<Waiter> taken;
+	return Take(waiter_id, taken);
+}
+
+void WaiterList::CancelAll() {
+	std::list<Waiter> taken;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		taken.swap(waiters_);
+		count_.store(0, boost::memory_order_relaxed);
+	}
+	Complete(taken, WAIT_CANCELLED, NULL, 0, 0);
+}
+
+void WaiterList::OnFrame(const unsigned char *frame, size_t length, BINARY_LOG_TYPE message_id,
+                         double timestamp) {
+	if (empty())
+		return;
+	std::list<Waiter> taken;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		std::list<Waiter>::iterator it = waiters_.begin();
+		while (it != waiters_.end()) {
+			std::list<Waiter>::iterator waiter = it++;
+			if (waiter->acknowledgement || (waiter->message_id != message_id))
+				continue;
+			if (!waiter->filter || waiter->filter(frame, length))
+				Take(waiter, taken);
+		}
+	}
+	Complete(taken, WAIT_MATCHED, frame, length, timestamp);
+}
+
+void WaiterList::OnAcknowledgement(double timestamp) {
+	CompleteAck(WAIT_MATCHED, NULL, 0, timestamp);
+}
+
+void WaiterList::OnCommandError(const char *reply, size_t length, double timestamp) {
+	CompleteAck(WAIT_REJECTED, (const unsigned char*)reply, length, timestamp);
+}
+
+void WaiterList::CompleteAck(WaitResult result, const unsigned char *reply, size_t length,
+                             double timestamp) {
+	if (empty())
+		return;
+	std::list<Waiter> taken;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		for (std::list<Waiter>::iterator it = waiters_.begin(); it != waiters_.end(); ++it) {
+			if (it->acknowledgement) {
+				Take(it, taken);
+				break;
+			}
+		}
+	}
+	Complete(taken, result, reply, length, timestamp);
+}
+
+void WaiterList::Expire() {
+	if (empty())
+		return;
+	uint64_t now = MonotonicMicroseconds();
+	std::list<Waiter> taken;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		std::list<Waiter>::iterator it = waiters_.begin();
+		while (it != waiters_.end()) {
+			std::list<Waiter>::iterator waiter = it++;
+			if ((waiter->deadline_us != 0) && (waiter->deadline_us <= now))
+				Take(waiter, taken);
+		}
+	}
+	Complete(taken, WAIT_TIMED_OUT, NULL, 0, 0);
+}
+
+WaitResult BlockingWait::Wait(WaiterList &waiters, uint64_t waiter_id, double timeout) {
+	boost::mutex::scoped_lock lock(mutex_);
+	boost::system_time const deadline = boost::get_system_time() +
+		boost::posix_time::microseconds((int64_t)(timeout*1e6));
+	while (!done_ && condition_.timed_wait(lock, deadline))
+		;
+	if (done_)
+		return result_;
+	lock.unlock();
+	if (waiters.Remove(waiter_id))
+		return WAIT_TIMED_OUT;
+	// the read thread took the waiter just now and is about to complete it
+	lock.lock();
+	while (!done_)
+		condition_.wait(lock);
+	return result_;
+}
+
+void BlockingWait::Complete(WaitResult result, const unsigned char *frame, size_t length,
+                            double /*timestamp*/) {
+	boost::lock_guard<boost::mutex> lock(mutex_);
+	result_ = result;
+	if ((result == WAIT_REJECTED) && frame)
+		reply_.assign((const char*)frame, length);
+	done_ = true;
+	condition_.notify_all();
+}
@@ -0,0 +1,211 @@
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "novatel/novatel.h"
+#include "novatel/novatel_rtk_monitor.h"
+using namespace novatel;
+
+// Counts heap allocations made by the counting thread.  Lives in its own
+// test program because it replaces the global operator new.
+static __thread bool counting = false;
+static __thread size_t allocations = 0;
+
+__attribute__((noinline)) static void* Allocate(std::size_t size) {
+    if (counting)
+        allocations++;
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+__attribute__((noinline)) static void Release(void *memory) {free(memory);}
+
+void* operator new(std::size_t size) {return Allocate(size);}
+void* operator new[](std::size_t size) {return Allocate(size);}
+void operator delete(void *memory) throw() {Release(memory);}
+void operator delete[](void *memory) throw() {Release(memory);}
+void operator delete(void *memory, std::size_t) throw() {Release(memory);}
+void operator delete[](void *memory, std::size_t) throw() {Release(memory);}
+
+template <class T>
+void IgnoreLog(T &log, double &timestamp) {}
+void IgnoreText(const std::string &text, double &timestamp) {}
+void IgnoreMessage(const std::string &msg) {}
+void IgnoreBatch(const FrameBatch &batch) {}
+
+enum DispatchMode {PER_LOG, BATCHED, PRIORITIES, LOW_PRIORITY, EXECUTOR, SERVICES};
+
+static const char *stream_path = "/tmp/novatel_allocation_test.sock";
+
+//! Connects a client that never reads, so every frame is queued for it
+static int ConnectStreamClient() {
+    int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, stream_path, sizeof(address.sun_path)-1);
+    if (connect(client, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(client);
+        return -1;
+    }
+    return client;
+}
+
+static std::vector<std::string> RecordedFiles() {
+    std::vector<std::string> files;
+    DIR *dir = opendir("./test_data");
+    if (!dir)
+        return files;
+    while (struct dirent *entry = readdir(dir)) {
+        std::string name(entry->d_name);
+        if ((name.size() > 4) && ((name.substr(name.size()-4) == ".GPS") || (name.substr(name.size()-4) == ".ASC")))
+            files.push_back("./test_data/" + name);
+    }
+    closedir(dir);
+    return files;
+}
+
+// replays a file twice, in serial port sized reads, and returns the
+// allocations made during the second pass
+static size_t SteadyStateAllocations(const std::string &file, DispatchMode mode) {
+    std::ifstream test_datafile(file.c_str(), std::ios::in|std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+
+    Novatel my_gps;
+    my_gps.setLogInfoCallback(IgnoreMessage);
+    my_gps.setLogWarningCallback(IgnoreMessage);
+    my_gps.set_best_position_callback(IgnoreLog<Position>);
+    my_gps.set_best_utm_position_callback(IgnoreLog<UtmPosition>);
+    my_gps.set_best_velocity_callback(IgnoreLog<Velocity>);
+    my_gps.set_raw_ephemeris_callback(IgnoreLog<RawEphemeris>);
+    my_gps.set_gps_ephemeris_callback(IgnoreLog<GpsEphemeris>);
+    my_gps.set_range_measurements_callback(IgnoreLog<RangeMeasurements>);
+    my_gps.set_tracking_status_callback(IgnoreLog<TrackStatus>);
+    my_gps.set_nmea_callback(IgnoreText);
+    my_gps.set_ascii_log_callback(IgnoreText);
+    if (mode == BATCHED)
+        my_gps.set_batch_callback(IgnoreBatch);
+    else if (mode == PRIORITIES)
+        my_gps.set_log_priority(BESTPOSB_LOG_TYPE, LOG_PRIORITY_HIGH);
+    else if (mode == LOW_PRIORITY)
+        my_gps.set_log_priority(RANGEB_LOG_TYPE, LOG_PRIORITY_LOW);
+    else if (mode == EXECUTOR)
+        my_gps.StartCallbackExecutor(2);
+    int client = -1;
+    if (mode == SERVICES) {
+        StreamServerConfig stream_config;
+        stream_config.ring_size = 1<<24;
+        my_gps.StartStreamServer(std::vector<std::string>(1, std::string("unix://") + stream_path), stream_config);
+        client = ConnectStreamClient();
+        for (int ii=0; (ii<200) && (my_gps.GetStreamServerStats().clients == 0); ii++)
+            usleep(5000);
+        FlightRecorderConfig flight_config;
+        flight_config.directory = "/tmp";
+        flight_config.trigger_solution_none = false;
+        flight_config.trigger_ins_degraded = false;
+        flight_config.crc_storm_errors = 0;
+        my_gps.StartFlightRecorder(flight_config);
+        my_gps.TrackRestart();
+    }
+
+    size_t counted = 0;
+    for (int pass=0; pass<2; pass++) {
+        allocations = 0;
+        counting = true;
+        for (size_t ii=0; ii<data.size(); ii+=100) {
+            my_gps.ReadFromFile((unsigned char*)data.data()+ii, std::min((size_t)100, data.size()-ii));
+            // the background queues grow to their busiest burst, so hand
+            // them one read at a time to keep the bursts the same each pass
+            if ((mode == LOW_PRIORITY) || (mode == EXECUTOR))
+                my_gps.WaitForDeferredLogs();
+        }
+        counting = false;
+        counted = allocations;
+        // let the background threads catch up, so both passes start alike
+        my_gps.WaitForDeferredLogs();
+    }
+    if (mode == SERVICES) {
+        EXPECT_EQ(1u, my_gps.GetStreamServerStats().clients) << file;
+        EXPECT_LT(0u, my_gps.GetFlightRecorderStats().reads_buffered) << file;
+        my_gps.StopStreamServer();
+        close(client);
+    }
+    return counted;
+}
+
+TEST(AllocationFree, PerLogDispatch) {
+    std::vector<std::string> files = RecordedFiles();
+    ASSERT_FALSE(files.empty());
+    for (size_t ii=0; ii<files.size(); ii++)
+        EXPECT_EQ(0u, SteadyStateAllocations(files[ii], PER_LOG)) << files[ii];
+}
+
+TEST(AllocationFree, BatchedDispatch) {
+    std::vector<std::string> files = RecordedFiles();
+    ASSERT_FALSE(files.empty());
+    for (size_t ii=0; ii<files.size(); ii++)
+        EXPECT_EQ(0u, SteadyStateAllocations(files[ii], BATCHED)) << files[ii];
+}
+
+TEST(AllocationFree, PriorityDispatch) {
+    std::vector<std::string> files = RecordedFiles();
+    ASSERT_FALSE(files.empty());
+    for (size_t ii=0; ii<files.size(); ii++)
+        EXPECT_EQ(0u, SteadyStateAllocations(files[ii], PRIORITIES)) << files[ii];
+}
+
+TEST(AllocationFree, LowPriorityDispatch) {
+    std::vector<std::string> files = RecordedFiles();
+    ASSERT_FALSE(files.empty());
+    for (size_t ii=0; ii<files.size(); ii++)
+        EXPECT_EQ(0u, SteadyStateAllocations(files[ii], LOW_PRIORITY)) << files[ii];
+}
+
+TEST(AllocationFree, ExecutorDispatch) {
+    std::vector<std::string> files = RecordedFiles();
+    ASSERT_FALSE(files.empty());
+    for (size_t ii=0; ii<files.size(); ii++)
+        EXPECT_EQ(0u, SteadyStateAllocations(files[ii], EXECUTOR)) << files[ii];
+}
+
+// stream server, flight recorder and restart tracker all fed on the read thread
+TEST(AllocationFree, ReadThreadServices) {
+    std::vector<std::string> files = RecordedFiles();
+    ASSERT_FALSE(files.empty());
+    for (size_t ii=0; ii<files.size(); ii++)
+        EXPECT_EQ(0u, SteadyStateAllocations(files[ii], SERVICES)) << files[ii];
+}
+
+TEST(AllocationFree, RtkMonitor) {
+    rtkdatab_log data;
+    memset(&data, 0, sizeof(data));
+    data.solutionStatus = SOL_COMPUTED;
+    data.header.num_svs = 8;
+    for (int ii=0; ii<8; ii++)
+        data.data[ii].prn = ii+1;
+    RtkMonitor monitor;
+    size_t counted = 0;
+    for (int pass=0; pass<2; pass++) {
+        allocations = 0;
+        counting = true;
+        // fixes gained and lost fill the time to fix windows
+        for (int ii=0; ii<1000; ii++) {
+            data.hdr.gps_millisecs = (pass*1000 + ii)*1000;
+            data.positionType = (ii % 10 < 5) ? NARROW_INT : NARROW_FLOAT;
+            data.header.searcher_type = (ii % 7) ? SEARCHING : COMPLETE;
+            monitor.AddRtkData(data, 0);
+        }
+        counting = false;
+        counted = allocations;
+    }
+    EXPECT_EQ(0u, counted);
+}
@@ -1,5 +1,11 @@
 #include <iostream>
 #include <fstream>
+#include <cmath>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 // #include <ifstream>
 #include "gtest/gtest.h"
 #include "novatel/novatel_enums.h"
@@ -11,6 +17,13 @@
 #define protected public
 
 #include "novatel/novatel.h"
+#include "novatel/novatel_static.h"
+#include "novatel/novatel_ephemeris.h"
+#include "novatel/novatel_fanout.h"
+#include "novatel/novatel_health.h"
+#include "novatel/novatel_rtcm_encode.h"
+#include "novatel/novatel_rtk_monitor.h"
+#include "novatel/novatel_smoother.h"
 using namespace novatel;
 
 extern void Tokenize(const std::string&, std::vector<std::string>&, const std::string&);
@@ -67,6 +80,8 @@ TEST(StructureSizeTest, GPSMessageStructures) {
     ASSERT_EQ(HEADER_SIZE+16+68*MAX_CHAN, sizeof(SatellitePositions));
     ASSERT_EQ(HEADER_SIZE+48, sizeof(TimeOffset));
     ASSERT_EQ(HEADER_SIZE+44, sizeof(ReceiverHardwareStatus));
+    ASSERT_EQ(100, sizeof(rtkdatab_header));
+    ASSERT_EQ(12, sizeof(rtkdatab_data));
 
 }
 
@@ -207,6 +222,1728 @@ TEST(DataParsing, BinaryDataSet1) {
     }
 }
 
+TEST(DataParsing, CrcCheckAndActiveLogs) {
+    std::ifstream test_datafile;
+    test_datafile.open("./"
+            "test_data/OneEach.GPS",std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+
+    // every frame in the file has a valid crc
+    Novatel my_gps;
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    ASSERT_EQ(0u, my_gps.crc_error_count());
+    ASSERT_EQ(8u, my_gps.GetActiveLogs().size());
+    ASSERT_TRUE(my_gps.IsLogActive("BESTUTMB ONTIME 0.05"));
+    ASSERT_TRUE(my_gps.IsLogActive("bestposb"));
+    ASSERT_FALSE(my_gps.IsLogActive("INSPVAB ONTIME 0.01"));
+
+    // corrupt the body of the first message, it should be dropped
+    size_t first_frame = file_contents.find("\xAA\x44\x12");
+    ASSERT_NE(std::string::npos, first_frame);
+    file_contents[first_frame+HEADER_SIZE+2] ^= 0xFF;
+    Novatel corrupted_gps;
+    corrupted_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    ASSERT_EQ(1u, corrupted_gps.crc_error_count());
+    ASSERT_EQ(7u, corrupted_gps.GetActiveLogs().size());
+}
+
+TEST(DataParsing, AttachFileTransport) {
+    // small chunks so frames are split across reads and completed by the
+    // scatter read into the framing buffer
+    FileTransport *file = new FileTransport("./test_data/OneEach.GPS", 100);
+    Novatel my_gps;
+    ASSERT_TRUE(my_gps.Attach(file));
+    for (int ii=0; (ii<200) && !file->AtEnd(); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    ASSERT_TRUE(file->AtEnd());
+    ASSERT_EQ(0u, my_gps.crc_error_count());
+    ASSERT_EQ(8u, my_gps.GetActiveLogs().size());
+    my_gps.Disconnect();
+}
+
+/*!
+ * Replays a log file while a device node exists, as a USB adapter would:
+ * reads fail once the node is removed and opens fail until it is back.
+ */
+class DeviceNodeTransport : public Transport {
+public:
+    DeviceNodeTransport(const std::string &path, const std::string &data, boost::atomic<int> *open_attempts)
+        : path_(path), data_(data), position_(0), open_(false), open_attempts_(open_attempts) {}
+    void Open() {
+        (*open_attempts_)++;
+        if (access(path_.c_str(), F_OK) != 0)
+            throw std::runtime_error(path_ + " does not exist");
+        open_ = true;
+    }
+    void Close() {open_ = false;}
+    bool IsOpen() {return open_;}
+    size_t Read(unsigned char *buffer, size_t size) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+        if (access(path_.c_str(), F_OK) != 0)
+            throw std::runtime_error(path_ + " was removed");
+        size = std::min(size, std::min((size_t)256, data_.size() - position_));
+        memcpy(buffer, data_.data() + position_, size);
+        position_ = (position_ + size) % data_.size();
+        return size;
+    }
+    size_t Write(const unsigned char *data, size_t length) {return length;}
+    std::string name() {return path_;}
+    std::string device_path() {return path_;}
+private:
+    std::string path_;
+    std::string data_;
+    size_t position_;
+    bool open_;
+    boost::atomic<int> *open_attempts_;
+};
+
+static void SaveResult(boost::atomic<int> *result, WaitResult wait_result, const unsigned char *frame,
+                       size_t length, double timestamp) {
+    *result = wait_result;
+}
+
+static boost::atomic<double> device_gap(-1);
+static void SaveDeviceGap(double gap) {
+    device_gap = gap;
+}
+
+TEST(DataParsing, DeviceLossBackoffAndReattach) {
+    std::ifstream file("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const std::string dir = "/tmp/novatel_device_test";
+    const std::string device = dir + "/ttyNOVATEL0";
+    mkdir(dir.c_str(), 0755);
+    std::ofstream(device.c_str()).close();
+
+    boost::atomic<int> open_attempts(0);
+    Novatel my_gps;
+    my_gps.set_device_gap_callback(&SaveDeviceGap);
+    ASSERT_TRUE(my_gps.Attach(new DeviceNodeTransport(device, data, &open_attempts)));
+    ASSERT_EQ(0u, my_gps.reconnect_count());
+
+    // unplugged: reopening backs off 100, 200, 400 ms... and other devices
+    // appearing in the directory do not cut the wait short
+    boost::system_time unplugged = boost::get_system_time();
+    unlink(device.c_str());
+    for (int ii=0; ii<45; ii++) {
+        std::stringstream other;
+        other << dir << "/ttyOTHER" << ii;
+        std::ofstream(other.str().c_str()).close();
+        unlink(other.str().c_str());
+        boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    }
+    // first attempt, then at 100, 300 and 700 ms
+    ASSERT_GE(open_attempts, 4);
+    ASSERT_LE(open_attempts, 5);
+    ASSERT_EQ(0u, my_gps.reconnect_count());
+
+    // plugged back in well before the next attempt at 1.5 s, which is made straight away
+    std::ofstream(device.c_str()).close();
+    for (int ii=0; (ii<300) && (my_gps.reconnect_count() == 0); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    ASSERT_EQ(1u, my_gps.reconnect_count());
+    // the gap callback comes just after the count
+    for (int ii=0; (ii<100) && (device_gap < 0); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    double gap = (double)(boost::get_system_time() - unplugged).total_milliseconds()/1000.0;
+    ASSERT_LT(gap, 1.4);
+    ASSERT_GT(my_gps.last_gap_duration(), 0.8);
+    ASSERT_DOUBLE_EQ(my_gps.last_gap_duration(), device_gap.load());
+
+    // streaming again after the gap
+    uint32_t frames = my_gps.GetDemuxCounters().novatel_binary.frames;
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    ASSERT_GT(my_gps.GetDemuxCounters().novatel_binary.frames, frames);
+    my_gps.Disconnect();
+    unlink(device.c_str());
+    rmdir(dir.c_str());
+}
+
+/*!
+ * A receiver that power cycles while its device node is gone: once
+ * reopened it is silent until a log is requested.  Commands are
+ * acknowledged and kept for the test.
+ */
+class PowerCycledTransport : public Transport {
+public:
+    PowerCycledTransport(const std::string &path, const std::string &data)
+        : path_(path), data_(data), position_(0), open_(false), opened_(false), silent_(false) {}
+    void Open() {
+        if (access(path_.c_str(), F_OK) != 0)
+            throw std::runtime_error(path_ + " does not exist");
+        boost::mutex::scoped_lock lock(mutex_);
+        silent_ = opened_;
+        open_ = opened_ = true;
+    }
+    void Close() {open_ = false;}
+    bool IsOpen() {return open_;}
+    size_t Read(unsigned char *buffer, size_t size) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+        if (access(path_.c_str(), F_OK) != 0)
+            throw std::runtime_error(path_ + " was removed");
+        boost::mutex::scoped_lock lock(mutex_);
+        if (!replies_.empty()) {
+            size = std::min(size, replies_.size());
+            memcpy(buffer, replies_.data(), size);
+            replies_.erase(0, size);
+            return size;
+        }
+        if (silent_)
+            return 0;
+        size = std::min(size, std::min((size_t)256, data_.size() - position_));
+        memcpy(buffer, data_.data() + position_, size);
+        position_ = (position_ + size) % data_.size();
+        return size;
+    }
+    size_t Write(const unsigned char *data, size_t length) {
+        boost::mutex::scoped_lock lock(mutex_);
+        std::string command((const char*)data, length);
+        commands_.push_back(command.substr(0, command.find_first_of("\r\n")));
+        if (command.compare(0, 4, "LOG ") == 0)
+            silent_ = false;
+        replies_ += "<OK\r\n";
+        return length;
+    }
+    std::string name() {return path_;}
+    std::string device_path() {return path_;}
+    std::vector<std::string> TakeCommands() {
+        boost::mutex::scoped_lock lock(mutex_);
+        std::vector<std::string> commands;
+        commands.swap(commands_);
+        return commands;
+    }
+private:
+    std::string path_;
+    std::string data_;
+    size_t position_;
+    bool open_;
+    bool opened_;
+    bool silent_;
+    std::string replies_;
+    std::vector<std::string> commands_;
+    boost::mutex mutex_;
+};
+
+//! Moves the time tag of every binary frame on by milliseconds
+static std::string ShiftTimeTags(std::string data, uint32_t milliseconds) {
+    for (size_t start = data.find("\xAA\x44\x12"); start != std::string::npos;
+         start = data.find("\xAA\x44\x12", start + 3)) {
+        unsigned char *frame = (unsigned char*)&data[start];
+        Oem4BinaryHeader header;
+        memcpy(&header, frame, sizeof(header));
+        size_t length = header.header_length + header.message_length;
+        if (start + length + 4 > data.size())
+            break;
+        header.gps_millisecs += milliseconds;
+        memcpy(frame, &header, sizeof(header));
+        uint32_t crc = CalculateCrc32(frame, length);
+        memcpy(frame + length, &crc, sizeof(crc));
+    }
+    return data;
+}
+
+TEST(DataParsing, RestoreConfiguredLogsAfterPowerCycle) {
+    // GPSEPHEMB is logged ONCHANGED, but repeats with later time tags on the stream
+    std::ifstream file("./test_data/OnceEachAgain.GPS", std::ios::in|std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    data += ShiftTimeTags(data, 1000);
+    const std::string dir = "/tmp/novatel_restore_test";
+    const std::string device = dir + "/ttyNOVATEL0";
+    mkdir(dir.c_str(), 0755);
+    std::ofstream(device.c_str()).close();
+
+    PowerCycledTransport *receiver = new PowerCycledTransport(device, data);
+    Novatel my_gps;
+    ASSERT_TRUE(my_gps.Attach(receiver));
+    my_gps.ConfigureLogs("BESTPOSB ONTIME 1;RAWEPHEMB ONCHANGED");
+    double ephemeris_period = 0;
+    for (int ii=0; (ii<400) && (ephemeris_period == 0); ii++) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+        std::vector<LogActivity> active = my_gps.GetActiveLogs();
+        for (size_t jj=0; jj<active.size(); jj++) {
+            if (active[jj].message_id == GPSEPHEMB_LOG_TYPE)
+                ephemeris_period = active[jj].period;
+        }
+    }
+    ASSERT_GT(ephemeris_period, 0);
+    ASSERT_EQ(2u, receiver->TakeCommands().size());
+
+    unlink(device.c_str());
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    std::ofstream(device.c_str()).close();
+    for (int ii=0; (ii<600) && (my_gps.reconnect_count() == 0); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    ASSERT_EQ(1u, my_gps.reconnect_count());
+
+    // only what was requested comes back, with its own trigger
+    std::vector<std::string> commands = receiver->TakeCommands();
+    ASSERT_EQ(2u, commands.size());
+    ASSERT_EQ("LOG BESTPOSB ONTIME 1", commands[0]);
+    ASSERT_EQ("LOG RAWEPHEMB ONCHANGED", commands[1]);
+    my_gps.Disconnect();
+    unlink(device.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(DataParsing, WaitsEndWhileDeviceLost) {
+    std::ifstream file("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const std::string dir = "/tmp/novatel_wait_test";
+    const std::string device = dir + "/ttyNOVATEL0";
+    mkdir(dir.c_str(), 0755);
+    std::ofstream(device.c_str()).close();
+
+    boost::atomic<int> open_attempts(0);
+    Novatel my_gps;
+    ASSERT_TRUE(my_gps.Attach(new DeviceNodeTransport(device, data, &open_attempts)));
+    unlink(device.c_str());
+    for (int ii=0; (ii<100) && (open_attempts < 2); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    ASSERT_GE(open_attempts, 2);
+
+    // the read thread is parked, so no read ends to time these out
+    boost::atomic<int> timed_out(-1), cancelled(-1);
+    my_gps.AsyncSendCommand("LOG BESTPOSB ONTIME 1", boost::bind(SaveResult, &timed_out, _1, _2, _3, _4), 0.1);
+    my_gps.AsyncWaitForLog(PSRPOSB_LOG_TYPE, FrameFilter(), boost::bind(SaveResult, &cancelled, _1, _2, _3, _4));
+    for (int ii=0; (ii<100) && (timed_out == -1); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    ASSERT_EQ(WAIT_TIMED_OUT, timed_out);
+    ASSERT_EQ(-1, cancelled);
+
+    // and one without a timeout does not outlive the connection
+    my_gps.Disconnect();
+    ASSERT_EQ(WAIT_CANCELLED, cancelled);
+    ASSERT_TRUE(my_gps.waiters_.empty());
+    rmdir(dir.c_str());
+}
+
+static void TimedPositionHandler(Position &position, double &timestamp) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(3));
+}
+
+static void WriteToPty(std::string path, std::string data) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    int fd = open(path.c_str(), O_WRONLY | O_NOCTTY);
+    if (fd < 0)
+        return;
+    ssize_t written = write(fd, data.data(), data.size());
+    (void)written;
+    close(fd);
+}
+
+TEST(DataParsing, DispatchLatency) {
+    std::ifstream file("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    PtyTransport *pty = new PtyTransport();
+    pty->Open();
+    Novatel my_gps;
+    ThreadSchedulingConfig scheduling;
+    scheduling.measure_latency = true;
+    my_gps.set_thread_scheduling(scheduling);
+    my_gps.set_best_position_callback(&TimedPositionHandler);
+    ASSERT_EQ(0u, my_gps.GetDispatchLatency().samples);
+
+    boost::thread writer(&WriteToPty, pty->slave_name(), data);
+    ASSERT_TRUE(my_gps.Attach(pty));
+    writer.join();
+    uint32_t frames = 0;
+    for (int ii=0; (ii<100) && ((frames == 0) || (my_gps.GetDispatchLatency().samples < frames)); ii++) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+        frames = my_gps.GetDemuxCounters().novatel_binary.frames;
+    }
+
+    // every frame is measured, up to its callback returning, and the idle
+    // time before the data arrived is not counted
+    DispatchLatency latency = my_gps.GetDispatchLatency();
+    ASSERT_EQ(8u, frames);
+    ASSERT_EQ(frames, latency.samples);
+    ASSERT_GE(latency.max_us, 3000);
+    ASSERT_LT(latency.max_us, 40000);
+    ASSERT_LE(latency.mean_us, latency.max_us);
+    my_gps.ResetDispatchLatency();
+    ASSERT_EQ(0u, my_gps.GetDispatchLatency().samples);
+    my_gps.Disconnect();
+}
+
+TEST(DataParsing, RecordAndReplay) {
+    std::ifstream file("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_GT(data.size(), 1000u);
+
+    RecorderConfig config;
+    config.block_size = 256;
+    Recorder recorder;
+    recorder.Open("/tmp/novatel_record_test.nvrec", config);
+    // uneven writes so blocks are filled across several of them
+    for (size_t ii=0; ii<data.size(); ii+=100)
+        recorder.Write(&data[ii], std::min((size_t)100, data.size()-ii));
+    recorder.Close();
+    RecorderStats stats = recorder.stats();
+    ASSERT_EQ(data.size(), stats.bytes_recorded);
+    ASSERT_EQ((data.size()+255)/256, stats.blocks);
+    ASSERT_EQ(0u, stats.write_errors);
+
+    // a recording cut short still reads up to its last complete block
+    std::vector<unsigned char> recorded;
+    {
+        std::ifstream in("/tmp/novatel_record_test.nvrec", std::ios::in|std::ios::binary);
+        recorded.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        std::ofstream out("/tmp/novatel_record_test_cut.nvrec", std::ios::out|std::ios::binary);
+        out.write((const char*)&recorded[0], recorded.size()-10);
+    }
+    RecordingReader reader;
+    reader.Open("/tmp/novatel_record_test_cut.nvrec");
+    std::vector<unsigned char> block, replayed;
+    while (reader.ReadBlock(block))
+        replayed.insert(replayed.end(), block.begin(), block.end());
+    ASSERT_EQ(0u, reader.damaged_blocks());
+    ASSERT_EQ((stats.blocks-1)*256, replayed.size());
+    ASSERT_TRUE(std::equal(replayed.begin(), replayed.end(), data.begin()));
+
+    ReplayTransport *replay = new ReplayTransport("/tmp/novatel_record_test.nvrec");
+    Novatel my_gps;
+    ASSERT_TRUE(my_gps.Attach(replay));
+    for (int ii=0; (ii<200) && !replay->AtEnd(); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    ASSERT_TRUE(replay->AtEnd());
+    ASSERT_EQ(0u, my_gps.crc_error_count());
+    ASSERT_EQ(8u, my_gps.GetActiveLogs().size());
+    my_gps.Disconnect();
+}
+
+TEST(DataParsing, RecorderFlushLatency) {
+    RecorderConfig config;
+    config.max_flush_latency = 0.2;
+    Recorder recorder;
+    recorder.Open("/tmp/novatel_record_latency.nvrec", config);
+    // let the writer go idle first
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    unsigned char data[100];
+    for (size_t ii=0; ii<sizeof(data); ii++)
+        data[ii] = ii;
+    recorder.Write(data, sizeof(data));
+
+    // a partial block reaches the disk once it is max_flush_latency old, not at Close()
+    for (int ii=0; (ii<100) && (recorder.stats().blocks == 0); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    ASSERT_EQ(1u, recorder.stats().blocks);
+    RecordingReader reader;
+    reader.Open("/tmp/novatel_record_latency.nvrec");
+    std::vector<unsigned char> block;
+    ASSERT_TRUE(reader.ReadBlock(block));
+    ASSERT_EQ(sizeof(data), block.size());
+    ASSERT_TRUE(std::equal(block.begin(), block.end(), data));
+    ASSERT_TRUE(recorder.IsOpen());
+    recorder.Close();
+}
+
+static std::vector<size_t> rtcm_frame_lengths;
+static void SaveRtcmFrameLength(const unsigned char *frame, size_t length) {
+    rtcm_frame_lengths.push_back(length);
+}
+
+TEST(DataParsing, Rtcm3Framing) {
+    // RTCM 1005 reference station message
+    const unsigned char frame[] = {0xD3, 0x00, 0x13, 0x3E, 0xD7, 0xD3, 0x02, 0x02,
+        0x98, 0x0E, 0xDE, 0xEF, 0x34, 0xB4, 0xBD, 0x62, 0xAC, 0x09, 0x41, 0x98,
+        0x6F, 0x33, 0x36, 0x0B, 0x98};
+    ASSERT_EQ(0x360B98u, CalculateCrc24q(frame, sizeof(frame)-RTCM3_CRC_SIZE));
+    ASSERT_EQ(1005, Rtcm3MessageNumber(frame));
+
+    // garbage, then a corrupted copy followed by good frames, fed one byte
+    // at a time.  The corrupted frame contains a false preamble with a 514
+    // byte length, so the good frames are only recovered once enough data
+    // has arrived to reject it and rescan what it swallowed.
+    std::string stream("\x01\xD3\xFF", 3);
+    std::string corrupted((const char*)frame, sizeof(frame));
+    corrupted[10] ^= 0x01;
+    stream += corrupted;
+    for (int ii=0; ii<30; ii++)
+        stream.append((const char*)frame, sizeof(frame));
+
+    rtcm_frame_lengths.clear();
+    Rtcm3Framer framer;
+    framer.set_frame_callback(SaveRtcmFrameLength);
+    for (size_t ii=0; ii<stream.size(); ii++)
+        framer.AddData((const unsigned char*)stream.data()+ii, 1);
+    ASSERT_EQ(30u, rtcm_frame_lengths.size());
+    ASSERT_EQ(sizeof(frame), rtcm_frame_lengths[0]);
+    ASSERT_EQ(2u, framer.crc_error_count());
+
+    // whole frames in one call
+    framer.AddData(frame, sizeof(frame));
+    ASSERT_EQ(31u, framer.frame_count());
+}
+
+/*!
+ * Receiver port for the correction tests: replays a log file so Attach()
+ * sees valid frames, and keeps what is written to it.  Each write takes
+ * 5 ms, like a slow serial port.
+ */
+class CorrectionSinkTransport : public FileTransport {
+public:
+    CorrectionSinkTransport(const std::string &path) : FileTransport(path) {}
+    size_t Write(const unsigned char *data, size_t length) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+        boost::mutex::scoped_lock lock(mutex_);
+        written_.append((const char*)data, length);
+        return length;
+    }
+    std::string written() {
+        boost::mutex::scoped_lock lock(mutex_);
+        return written_;
+    }
+private:
+    boost::mutex mutex_;
+    std::string written_;
+};
+
+TEST(DataParsing, CorrectionForwarding) {
+    const unsigned char frame[] = {0xD3, 0x00, 0x13, 0x3E, 0xD7, 0xD3, 0x02, 0x02,
+        0x98, 0x0E, 0xDE, 0xEF, 0x34, 0xB4, 0xBD, 0x62, 0xAC, 0x09, 0x41, 0x98,
+        0x6F, 0x33, 0x36, 0x0B, 0x98};
+    std::string good((const char*)frame, sizeof(frame));
+    // without the second 0xD3, which would start a long false frame
+    std::string corrupted(good);
+    corrupted[5] = 0x00;
+
+    CorrectionSinkTransport *port = new CorrectionSinkTransport("./test_data/OneEach.GPS");
+    Novatel my_gps;
+    ASSERT_TRUE(my_gps.Attach(port));
+    CorrectionStats stats = my_gps.GetCorrectionStats();
+    ASSERT_EQ(0u, stats.frames_forwarded);
+    ASSERT_EQ(-1, stats.last_frame_age);
+
+    // injected in pieces, with a corrupted frame that is not forwarded
+    std::string injected = "\x01\x02" + good + corrupted + good + good;
+    for (size_t ii=0; ii<injected.size(); ii+=7)
+        my_gps.InjectCorrections((const unsigned char*)injected.data()+ii, std::min((size_t)7, injected.size()-ii));
+
+    // and from a correction source
+    std::string source_path = "/tmp/novatel_corrections_test.rtcm3";
+    std::ofstream source(source_path.c_str(), std::ios::out|std::ios::binary);
+    source << good << good;
+    source.close();
+    for (int ii=0; (ii<200) && (my_gps.GetCorrectionStats().frames_forwarded < 3); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    ASSERT_TRUE(my_gps.StartCorrectionSource("file://" + source_path));
+    for (int ii=0; (ii<200) && (my_gps.GetCorrectionStats().frames_forwarded < 5); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    my_gps.StopCorrectionSource();
+    unlink(source_path.c_str());
+
+    // every good frame reaches the receiver port whole and in order, and
+    // the latency includes the slow write
+    ASSERT_EQ(good + good + good + good + good, port->written());
+    stats = my_gps.GetCorrectionStats();
+    ASSERT_EQ(5u, stats.frames_forwarded);
+    ASSERT_EQ(5*sizeof(frame), stats.bytes_forwarded);
+    ASSERT_EQ(0u, stats.frames_dropped);
+    ASSERT_EQ(1u, stats.crc_errors);
+    ASSERT_GE(stats.mean_latency_us, 5000);
+    ASSERT_GE(stats.max_latency_us, stats.mean_latency_us);
+    ASSERT_LT(stats.max_latency_us, 1e6);
+    ASSERT_GE(stats.last_frame_age, 0);
+    ASSERT_LT(stats.last_frame_age, 1.0);
+    my_gps.Disconnect();
+}
+
+static std::vector<std::string> nmea_sentences;
+static void SaveNmeaSentence(const std::string &sentence, double &timestamp) {
+    nmea_sentences.push_back(sentence);
+}
+
+TEST(DataParsing, MixedProtocolDemux) {
+    std::ifstream test_datafile;
+    test_datafile.open("./"
+            "test_data/OneEach.GPS",std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string binary((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+
+    const unsigned char rtcm[] = {0xD3, 0x00, 0x13, 0x3E, 0xD7, 0xD3, 0x02, 0x02,
+        0x98, 0x0E, 0xDE, 0xEF, 0x34, 0xB4, 0xBD, 0x62, 0xAC, 0x09, 0x41, 0x98,
+        0x6F, 0x33, 0x36, 0x0B, 0x98};
+    std::string gga("$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47");
+    std::string ascii_body("BESTPOSA,COM1,0,78.5,FINESTEERING,1419,340033.000,00000040,4ca6,2724;"
+            "SOL_COMPUTED,SINGLE,51.11636418888,-114.03832502118,1064.9520,-16.2712,WGS84,1.6961,1.3636,3.6449,\"\",0.000,0.000,9,9,9,9,0,06,0,03");
+    Novatel crc_gps;
+    char crc[9];
+    sprintf(crc, "%08lx", crc_gps.CalculateBlockCRC32(ascii_body.size(), (unsigned char*)ascii_body.data()));
+    std::string ascii = "#" + ascii_body + "*" + crc;
+
+    // the file already has some ASCII replies and logs of its own
+    Novatel plain_gps;
+    plain_gps.BufferIncomingData((unsigned char*)binary.data(), binary.size());
+    DemuxCounters plain = plain_gps.GetDemuxCounters();
+
+    // text and RTCM3 between the first two binary frames, including a
+    // truncated sentence and one with a bad checksum
+    std::string mixed = "\r\n" + gga + "\r\n<OK\r\n<ERROR:Invalid Message. Field = 1\r\n"
+            + std::string((const char*)rtcm, sizeof(rtcm))
+            + "$GPGSA,A,3,04,0" + ascii + "\r\n" + gga.substr(0, gga.size()-1) + "8\r\n" + gga + "\r\n";
+    size_t second_frame = binary.find("\xAA\x44\x12", binary.find("\xAA\x44\x12")+1);
+    ASSERT_NE(std::string::npos, second_frame);
+    binary.insert(second_frame, mixed);
+
+    nmea_sentences.clear();
+    rtcm_frame_lengths.clear();
+    Novatel my_gps;
+    my_gps.set_nmea_callback(SaveNmeaSentence);
+    my_gps.set_rtcm3_output_callback(SaveRtcmFrameLength);
+    for (size_t ii=0; ii<binary.size(); ii+=7)
+        my_gps.BufferIncomingData((unsigned char*)binary.data()+ii, std::min((size_t)7, binary.size()-ii));
+
+    DemuxCounters counters = my_gps.GetDemuxCounters();
+    ASSERT_EQ(8u, counters.novatel_binary.frames);
+    ASSERT_EQ(0u, counters.novatel_binary.errors);
+    ASSERT_EQ(8u, my_gps.GetActiveLogs().size());
+    ASSERT_EQ(plain.novatel_ascii.frames+1, counters.novatel_ascii.frames);
+    ASSERT_EQ(plain.nmea.frames+2, counters.nmea.frames);
+    ASSERT_EQ(plain.nmea.errors+1, counters.nmea.errors);
+    ASSERT_EQ(plain.rtcm3.frames+1, counters.rtcm3.frames);
+    ASSERT_EQ(plain.acknowledgements+1, counters.acknowledgements);
+    ASSERT_EQ(plain.command_errors+1, counters.command_errors);
+    ASSERT_EQ(2u, nmea_sentences.size());
+    ASSERT_EQ(gga, nmea_sentences[0]);
+    ASSERT_EQ(1u, rtcm_frame_lengths.size());
+    ASSERT_EQ(sizeof(rtcm), rtcm_frame_lengths[0]);
+}
+
+struct StaticLogCounter {
+    StaticLogCounter() : logs(0), utm_logs(0) {}
+    template <BINARY_LOG_TYPE Id, class Log>
+    void OnLog(BinaryLogTag<Id>, const Log &log, double timestamp) {
+        logs++;
+    }
+    void OnLog(BinaryLogTag<BESTUTMB_LOG_TYPE>, const UtmPosition &log, double timestamp) {
+        utm_logs++;
+        utm = log;
+    }
+    int logs;
+    int utm_logs;
+    UtmPosition utm;
+};
+
+struct StaticNmeaCounter {
+    StaticNmeaCounter() : sentences(0) {}
+    void OnNmea(const char *sentence, size_t length, double timestamp) {
+        sentences++;
+    }
+    int sentences;
+};
+
+static UtmPosition dynamic_utm;
+static void SaveUtmPosition(UtmPosition &utm, double &timestamp) {
+    dynamic_utm = utm;
+}
+
+TEST(DataParsing, StaticDispatch) {
+    std::ifstream test_datafile;
+    test_datafile.open("./"
+            "test_data/OneEach.GPS",std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+    file_contents += "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n";
+
+    StaticLogCounter log_counter;
+    StaticNmeaCounter nmea_counter;
+    BasicNovatel<StaticLogCounter, StaticNmeaCounter> static_gps(log_counter, nmea_counter);
+    static_gps.AddData((const unsigned char*)file_contents.data(), file_contents.size());
+    ASSERT_EQ(8u, static_gps.counters().novatel_binary.frames);
+    ASSERT_EQ(1, nmea_counter.sentences);
+    ASSERT_EQ(1, log_counter.utm_logs);
+    ASSERT_GT(log_counter.logs, 0);
+
+    // the same log as decoded by Novatel
+    Novatel my_gps;
+    my_gps.set_best_utm_position_callback(SaveUtmPosition);
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    ASSERT_EQ(dynamic_utm.northing, log_counter.utm.northing);
+    ASSERT_EQ(dynamic_utm.easting, log_counter.utm.easting);
+}
+
+static std::vector<size_t> batch_sizes;
+static UtmPosition batch_utm;
+static void SaveBatch(const FrameBatch &batch) {
+    batch_sizes.push_back(batch.size());
+    for (size_t ii=0; ii<batch.size(); ii++)
+        if (batch.id(ii) == BESTUTMB_LOG_TYPE)
+            batch.Decode(ii, batch_utm);
+}
+
+TEST(DataParsing, BatchedDispatch) {
+    std::ifstream test_datafile("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+
+    Novatel reference_gps;
+    reference_gps.set_best_utm_position_callback(SaveUtmPosition);
+    reference_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    double reference_northing = dynamic_utm.northing;
+    ASSERT_NE(0.0, reference_northing);
+
+    // one read holding every frame gives one batch, and the per log
+    // callbacks are not used
+    batch_sizes.clear();
+    memset(&dynamic_utm, 0, sizeof(dynamic_utm));
+    Novatel my_gps;
+    my_gps.set_best_utm_position_callback(SaveUtmPosition);
+    my_gps.set_batch_callback(SaveBatch);
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    ASSERT_EQ(1u, batch_sizes.size());
+    ASSERT_EQ(8u, batch_sizes[0]);
+    ASSERT_EQ(0.0, dynamic_utm.northing);
+    ASSERT_EQ(reference_gps.GetActiveLogs().size(), my_gps.GetActiveLogs().size());
+    ASSERT_EQ(reference_northing, batch_utm.northing);
+
+    // a long window collects frames across reads
+    batch_sizes.clear();
+    Novatel windowed_gps;
+    windowed_gps.set_batch_callback(SaveBatch, 10000000);
+    for (size_t ii=0; ii<file_contents.size(); ii+=100)
+        windowed_gps.ReadFromFile((unsigned char*)file_contents.data()+ii,
+                                  std::min((size_t)100, file_contents.size()-ii));
+    ASSERT_EQ(0u, batch_sizes.size());
+    ASSERT_EQ(8u, windowed_gps.batch_.size());
+}
+
+static std::vector<std::string> dispatch_order;
+static boost::thread::id hardware_status_thread;
+static void RecordUtmOrder(UtmPosition &utm, double &timestamp) {
+    dispatch_order.push_back("BESTUTMB");
+}
+static void RecordPositionOrder(Position &position, double &timestamp) {
+    dispatch_order.push_back("BESTPOSB");
+}
+static void RecordHardwareStatusThread(ReceiverHardwareStatus &status, double &timestamp) {
+    hardware_status_thread = boost::this_thread::get_id();
+}
+
+TEST(DataParsing, PriorityLanes) {
+    std::ifstream test_datafile("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+    ASSERT_LT(file_contents.find("\xAA\x44\x12\x1C\x2A\x00"), file_contents.find("\xAA\x44\x12\x1C\xD6\x02"));
+
+    dispatch_order.clear();
+    hardware_status_thread = boost::thread::id();
+    Novatel my_gps;
+    my_gps.set_best_utm_position_callback(RecordUtmOrder);
+    my_gps.set_best_position_callback(RecordPositionOrder);
+    my_gps.set_receiver_hardware_status_callback(RecordHardwareStatusThread);
+    my_gps.set_log_priority(BESTUTMB_LOG_TYPE, LOG_PRIORITY_HIGH);
+    my_gps.set_log_priority(RXHWLEVELSB_LOG_TYPE, LOG_PRIORITY_LOW);
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    my_gps.WaitForDeferredLogs();
+
+    // BESTPOSB comes first in the file but waits for the high priority log
+    ASSERT_EQ(2u, dispatch_order.size());
+    ASSERT_EQ("BESTUTMB", dispatch_order[0]);
+    ASSERT_EQ("BESTPOSB", dispatch_order[1]);
+    ASSERT_NE(boost::thread::id(), hardware_status_thread);
+    ASSERT_NE(boost::this_thread::get_id(), hardware_status_thread);
+    ASSERT_EQ(0u, my_gps.deferred_dropped_count());
+}
+
+static boost::mutex executor_mutex;
+static std::vector<std::string> executor_order;
+static void SlowPositionHandler(Position &position, double &timestamp) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    boost::mutex::scoped_lock lock(executor_mutex);
+    executor_order.push_back("BESTPOSB");
+}
+static void FastUtmHandler(UtmPosition &utm, double &timestamp) {
+    boost::mutex::scoped_lock lock(executor_mutex);
+    executor_order.push_back("BESTUTMB");
+}
+
+TEST(DataParsing, CallbackExecutor) {
+    std::ifstream test_datafile("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+
+    executor_order.clear();
+    Novatel my_gps;
+    my_gps.set_best_position_callback(SlowPositionHandler);
+    my_gps.set_best_utm_position_callback(FastUtmHandler);
+    my_gps.StartCallbackExecutor(2);
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    my_gps.WaitForDeferredLogs();
+
+    // the slow handler does not hold up the other log type
+    ASSERT_EQ(4u, executor_order.size());
+    ASSERT_EQ("BESTUTMB", executor_order[0]);
+    ASSERT_EQ("BESTUTMB", executor_order[1]);
+    std::vector<ExecutorStats> stats = my_gps.GetExecutorStats();
+    ASSERT_EQ(8u, stats.size());
+    for (size_t ii=0; ii<stats.size(); ii++) {
+        ASSERT_EQ(2u, stats[ii].executed);
+        ASSERT_EQ(0u, stats[ii].queued);
+        if (stats[ii].message_id == BESTPOSB_LOG_TYPE) {
+            ASSERT_GE(stats[ii].mean_us, 100000.0);
+            ASSERT_EQ(2u, stats[ii].max_queued);
+        }
+    }
+}
+
+static boost::atomic<uint32_t> executor_positions(0);
+static void CountingPositionHandler(Position &position, double &timestamp) {
+    executor_positions++;
+}
+
+static void FeedFile(Novatel *gps, std::string data, int count) {
+    for (int ii=0; ii<count; ii++)
+        gps->ReadFromFile((unsigned char*)data.data(), data.size());
+}
+
+TEST(DataParsing, CallbackExecutorStopWhileReading) {
+    std::ifstream test_datafile("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+
+    // the executor comes and goes under the feeding thread; every position
+    // is dispatched exactly once, on the executor or on the feeding thread
+    executor_positions = 0;
+    Novatel my_gps;
+    my_gps.set_best_position_callback(CountingPositionHandler);
+    my_gps.StartCallbackExecutor(2, 100000);
+    boost::thread feeder(&FeedFile, &my_gps, file_contents, 2000);
+    for (int ii=0; ii<50; ii++) {
+        my_gps.StopCallbackExecutor();
+        my_gps.StartCallbackExecutor(2, 100000);
+    }
+    feeder.join();
+    my_gps.StopCallbackExecutor();
+    ASSERT_EQ(2000u, executor_positions);
+}
+
+static SeqLockValue<Position> torn_read_value;
+static void WritePositions(int count) {
+    Position position;
+    memset(&position, 0, sizeof(position));
+    for (int ii=1; ii<=count; ii++) {
+        position.latitude = position.longitude = position.height = ii;
+        torn_read_value.StoreFrame((const unsigned char*)&position, sizeof(position), ii, 0);
+    }
+}
+
+TEST(DataParsing, LatestLogCache) {
+    std::ifstream test_datafile("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+
+    Novatel my_gps;
+    my_gps.set_best_utm_position_callback(SaveUtmPosition);
+    UtmPosition utm;
+    Position position;
+    ASSERT_FALSE(my_gps.GetLatest<BESTUTMB_LOG_TYPE>(utm));
+    ASSERT_TRUE(my_gps.EnableLatest(BESTPOSB_LOG_TYPE));
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    double age = -1;
+    ASSERT_TRUE(my_gps.GetLatest<BESTUTMB_LOG_TYPE>(utm, &age));
+    ASSERT_EQ(dynamic_utm.northing, utm.northing);
+    ASSERT_GE(age, 0.0);
+    ASSERT_LT(age, 10.0);
+    ASSERT_TRUE(my_gps.GetLatest<BESTPOSB_LOG_TYPE>(position));
+    // never enabled, so never stored
+    ASSERT_FALSE(my_gps.GetLatest<PSRPOSB_LOG_TYPE>(position));
+
+    // readers never see a value that is half written
+    torn_read_value.Enable();
+    boost::thread writer(boost::bind(WritePositions, 200000));
+    int reads = 0;
+    while (reads < 100000) {
+        if (!torn_read_value.Load(position))
+            continue;
+        ASSERT_EQ(position.latitude, position.longitude);
+        ASSERT_EQ(position.latitude, position.height);
+        reads++;
+    }
+    writer.join();
+}
+
+struct WaitRecord {
+    WaitRecord() : calls(0), result(WAIT_CANCELLED), message_id(0) {}
+    int calls;
+    WaitResult result;
+    uint16_t message_id;
+};
+
+static void SaveWait(WaitRecord *record, WaitResult result, const unsigned char *frame,
+                     size_t length, double timestamp) {
+    record->calls++;
+    record->result = result;
+    record->message_id = frame ? (frame[5] << 8) + frame[4] : 0;
+}
+
+static bool RejectFrame(const unsigned char *frame, size_t length) {
+    return false;
+}
+
+// waits again from inside the completion, as a resumed coroutine would
+static void WaitAgain(Novatel *gps, WaitRecord *record, WaitRecord *next, WaitResult result,
+                      const unsigned char *frame, size_t length, double timestamp) {
+    SaveWait(record, result, frame, length, timestamp);
+    gps->AsyncWaitForLog(BESTUTMB_LOG_TYPE, FrameFilter(), boost::bind(SaveWait, next, _1, _2, _3, _4));
+}
+
+TEST(DataParsing, AsyncWaits) {
+    std::ifstream test_datafile("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(test_datafile)),
+            std::istreambuf_iterator<char>());
+
+    Novatel my_gps;
+    WaitRecord position, utm, rejected, ack, timed_out, cancelled;
+    my_gps.AsyncWaitForLog(BESTPOSB_LOG_TYPE, FrameFilter(),
+            boost::bind(WaitAgain, &my_gps, &position, &utm, _1, _2, _3, _4));
+    my_gps.AsyncWaitForLog(BESTVELB_LOG_TYPE, RejectFrame, boost::bind(SaveWait, &rejected, _1, _2, _3, _4));
+    my_gps.waiters_.AddAckWaiter(boost::bind(SaveWait, &ack, _1, _2, _3, _4), 0);
+    my_gps.AsyncWaitForLog(PSRPOSB_LOG_TYPE, FrameFilter(),
+            boost::bind(SaveWait, &timed_out, _1, _2, _3, _4), 0.001);
+    uint64_t waiter = my_gps.AsyncWaitForLog(PSRPOSB_LOG_TYPE, FrameFilter(),
+            boost::bind(SaveWait, &cancelled, _1, _2, _3, _4));
+
+    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    my_gps.ReadFromFile((unsigned char*)"<OK\r\n", 5);
+    ASSERT_EQ(1, position.calls);
+    ASSERT_EQ(WAIT_MATCHED, position.result);
+    ASSERT_EQ(BESTPOSB_LOG_TYPE, position.message_id);
+    // BESTUTMB comes after BESTPOSB in the file
+    ASSERT_EQ(1, utm.calls);
+    ASSERT_EQ(BESTUTMB_LOG_TYPE, utm.message_id);
+    ASSERT_EQ(0, rejected.calls);
+    ASSERT_EQ(1, ack.calls);
+    ASSERT_EQ(WAIT_MATCHED, ack.result);
+    ASSERT_EQ(1, timed_out.calls);
+    ASSERT_EQ(WAIT_TIMED_OUT, timed_out.result);
+
+    ASSERT_TRUE(my_gps.CancelWait(waiter));
+    ASSERT_FALSE(my_gps.CancelWait(waiter));
+    ASSERT_EQ(1, cancelled.calls);
+    ASSERT_EQ(WAIT_CANCELLED, cancelled.result);
+    // still waiting on a frame that never passes its filter
+    ASSERT_FALSE(my_gps.waiters_.empty());
+}
+
+static void SaveReply(std::string *reply, WaitResult result, const unsigned char *frame,
+                      size_t length, double timestamp) {
+    *reply = frame ? std::string((const char*)frame, length) : "";
+}
+
+static void SendCommandInThread(Novatel *gps, std::string command, boost::atomic<int> *result) {
+    *result = gps->SendCommand(command) ? 1 : 0;
+}
+
+TEST(DataParsing, CommandReplies) {
+    std::ifstream file("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    PtyTransport *pty = new PtyTransport();
+    pty->Open();
+    int replies = open(pty->slave_name().c_str(), O_RDWR | O_NOCTTY);
+    ASSERT_GE(replies, 0);
+    ASSERT_EQ((ssize_t)data.size(), write(replies, data.data(), data.size()));
+    Novatel my_gps;
+    ASSERT_TRUE(my_gps.Attach(pty));
+    // the file has replies of its own
+    uint32_t errors = my_gps.GetDemuxCounters().command_errors;
+
+    // an asynchronous command, then a synchronous one sent while it waits
+    WaitRecord first;
+    std::string first_reply;
+    ASSERT_NE(0u, my_gps.AsyncSendCommand("LOG BESTPOSB ONTIME 1",
+            boost::bind(SaveWait, &first, _1, _2, _3, _4)));
+    boost::atomic<int> second(-1);
+    boost::thread sender(&SendCommandInThread, &my_gps, std::string("LOG FOOB ONCE"), &second);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+    // the first acknowledgement answers the first command only
+    ASSERT_EQ(5, write(replies, "<OK\r\n", 5));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    ASSERT_EQ(1, first.calls);
+    ASSERT_EQ(WAIT_MATCHED, first.result);
+    ASSERT_EQ(-1, second);
+
+    // an error fails the second at once rather than after the timeout
+    boost::system_time sent = boost::get_system_time();
+    std::string error("<ERROR:Invalid Message ID\r\n");
+    ASSERT_EQ((ssize_t)error.size(), write(replies, error.data(), error.size()));
+    sender.join();
+    ASSERT_EQ(0, second);
+    ASSERT_LT((boost::get_system_time() - sent).total_milliseconds(), 1000);
+
+    std::string third_reply;
+    my_gps.AsyncSendCommand("LOG FOOB ONCE", boost::bind(SaveReply, &third_reply, _1, _2, _3, _4));
+    ASSERT_EQ((ssize_t)error.size(), write(replies, error.data(), error.size()));
+    for (int ii=0; (ii<100) && third_reply.empty(); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    ASSERT_EQ("<ERROR:Invalid Message ID", third_reply);
+    ASSERT_EQ(errors+2, my_gps.GetDemuxCounters().command_errors);
+    ASSERT_TRUE(my_gps.waiters_.empty());
+    close(replies);
+    my_gps.Disconnect();
+}
+
+static std::vector<std::string> logged_messages;
+static void SaveLogMessage(const std::string &msg) {
+    logged_messages.push_back(msg);
+}
+
+// counts how often a log statement was formatted
+struct FormatCounter {
+    mutable int count;
+};
+static std::ostream& operator<<(std::ostream &os, const FormatCounter &counter) {
+    counter.count++;
+    return os << "formatted";
+}
+
+TEST(Logging, LevelsThrottleAndAsync) {
+    Logger logger;
+    logger.set_sink(LOG_LEVEL_DEBUG, SaveLogMessage);
+    logger.set_sink(LOG_LEVEL_WARNING, SaveLogMessage);
+    LogChannel<LOG_LEVEL_DEBUG> log_debug(logger);
+    LogChannel<LOG_LEVEL_WARNING> log_warning(logger);
+    FormatCounter counter = {0};
+    logged_messages.clear();
+
+    // debug is below the default level, so it is never formatted
+    NOVATEL_LOG(log_debug, counter);
+    ASSERT_EQ(0, counter.count);
+    logger.set_level(LOG_LEVEL_DEBUG);
+    NOVATEL_LOG(log_debug, counter << " " << 1);
+    ASSERT_EQ(1, counter.count);
+    ASSERT_EQ(1u, logged_messages.size());
+    ASSERT_EQ("formatted 1", logged_messages[0]);
+
+    for (int ii=0; ii<5; ii++)
+        NOVATEL_LOG_THROTTLE(log_warning, 60.0, "noisy " << counter);
+    ASSERT_EQ(2, counter.count);
+    ASSERT_EQ(2u, logged_messages.size());
+
+    logged_messages.clear();
+    logger.StartAsync(2);
+    logger.set_level(LOG_LEVEL_WARNING);
+    for (int ii=0; ii<100; ii++)
+        log_warning("queued");
+    logger.StopAsync();
+    ASSERT_EQ(100u, logged_messages.size() + logger.dropped_count());
+    ASSERT_GE(logged_messages.size(), 1u);
+    ASSERT_THROW(LogLevelFromString("verbose"), std::invalid_argument);
+}
+
+static Almanac decoded_almanac;
+static void SaveAlmanac(Almanac &almanac, double &timestamp) {
+    decoded_almanac = almanac;
+}
+
+static Position saved_position;
+static void SaveBestPosition(Position &position, double &timestamp) {
+    saved_position = position;
+}
+
+TEST(DataParsing, SignalRegistry) {
+    // looked up at compile time as well as run time
+    static_assert(FindSignal(SATSYS_GPS, 17)->band == BAND_L2, "GPS L2C registered");
+    static_assert(FindSignal(SATSYS_GPS, 31) == NULL, "unknown signal");
+    ASSERT_NEAR(0.1902936728, SignalWavelength(*FindSignal(SATSYS_GPS, 0)), 1e-9);
+    ASSERT_NEAR(0.2442102134, SignalWavelength(*FindSignal(SATSYS_GPS, 17)), 1e-9);
+    const SignalInfo &glonass_l1 = *FindSignal(SATSYS_GLONASS, 0);
+    ASSERT_DOUBLE_EQ(1598.0625e6, SignalFrequency(glonass_l1, -7));
+    ASSERT_DOUBLE_EQ(1605.375e6, SignalFrequency(glonass_l1, 6));
+    ASSERT_EQ(BAND_E5B, FindSignal(SATSYS_BEIDOU, 1)->band);
+
+    // a GLONASS ADR about one and a half roll overs from zero, restored
+    // only with the satellite's own wavelength
+    CompressedRangeData cmp;
+    memset(&cmp, 0, sizeof(cmp));
+    cmp.channel_status.satellite_sys = SATSYS_GLONASS;
+    cmp.channel_status.signal_type = 0;
+    cmp.range_record.satellite_prn = 45;
+    ASSERT_EQ(&glonass_l1, LookupSignal(cmp.channel_status));
+    double wavelength = SignalWavelength(glonass_l1, -7);
+    double adr = -1.5*CMP_MAX_VALUE + 1234.5;
+    double pseudorange = -adr*wavelength;
+    double rolled = std::fmod(adr, CMP_MAX_VALUE);
+    cmp.range_record.accumulated_doppler = (int32_t)(rolled*256);
+    ASSERT_NEAR(adr, UnpackCompressedAdr(cmp, pseudorange, -7), 1e-3);
+
+    // the frequency number for RANGECMP is learnt from RANGE
+    Novatel my_gps;
+    ASSERT_EQ(0, my_gps.glonass_frequency(45));
+    ASSERT_FALSE(my_gps.glonass_frequency_known(45));
+    RangeMeasurements ranges;
+    memset(&ranges, 0, sizeof(ranges));
+    ranges.number_of_observations = 1;
+    ranges.range_data[0].satellite_prn = 45;
+    ranges.range_data[0].glonass_frequency = 0;  // -7 offset by 7
+    ranges.range_data[0].channel_status.satellite_sys = SATSYS_GLONASS;
+    BinaryEncoder encoder;
+    encoder.Add<RANGEB_LOG_TYPE>(ranges);
+    my_gps.ReadFromFile((unsigned char*)encoder.data(), encoder.size());
+    ASSERT_EQ(-7, my_gps.glonass_frequency(45));
+    ASSERT_TRUE(my_gps.glonass_frequency_known(45));
+}
+
+static std::vector<std::string> encoded_rtcm_frames;
+static void SaveRtcmFrame(const unsigned char *frame, size_t length) {
+    encoded_rtcm_frames.push_back(std::string((const char*)frame, length));
+}
+
+TEST(DataParsing, Rtcm3MsmEncoding) {
+    // GPS L1CA and L2P on one satellite and GLONASS L1CA on another
+    RangeMeasurements ranges;
+    memset(&ranges, 0, sizeof(ranges));
+    ranges.header.gps_millisecs = 345600000;
+    ranges.number_of_observations = 3;
+    const uint8_t systems[] = {SATSYS_GPS, SATSYS_GPS, SATSYS_GLONASS};
+    const uint8_t signals[] = {0, 5, 0};
+    const uint16_t prns[] = {12, 12, 40};
+    for (int ii=0; ii<3; ii++) {
+        RangeData &range = ranges.range_data[ii];
+        range.satellite_prn = prns[ii];
+        range.channel_status.satellite_sys = systems[ii];
+        range.channel_status.signal_type = signals[ii];
+        range.channel_status.phase_lock_flag = 1;
+        range.channel_status.parity_known_flag = 1;
+        range.glonass_frequency = 8;   // +1 offset by 7
+        range.pseudorange = 21345678.9 + ii*3.1;
+        double wavelength = SignalWavelength(*LookupSignal(range.channel_status), 1);
+        range.accumulated_doppler = -(range.pseudorange + 0.25)/wavelength;
+        range.doppler = -1234.5;
+        range.carrier_to_noise = 45;
+        range.locktime = 100;
+    }
+
+    Rtcm3Encoder encoder(42, MSM4);
+    encoder.set_reference_position_ecef(-2694892.4600, -4297557.4700, 3854813.4200);
+    std::vector<unsigned char> output;
+    ASSERT_TRUE(encoder.EncodeStationPosition(output));
+    ASSERT_EQ(2u, encoder.EncodeObservations(ranges, output));
+
+    encoded_rtcm_frames.clear();
+    Rtcm3Framer framer;
+    framer.set_frame_callback(SaveRtcmFrame);
+    framer.AddData(&output[0], output.size());
+    ASSERT_EQ(0u, framer.crc_error_count());
+    ASSERT_EQ(3u, encoded_rtcm_frames.size());
+    const unsigned char *station = (const unsigned char*)encoded_rtcm_frames[0].data();
+    const unsigned char *gps = (const unsigned char*)encoded_rtcm_frames[1].data();
+    const unsigned char *glonass = (const unsigned char*)encoded_rtcm_frames[2].data();
+    ASSERT_EQ(1005, Rtcm3MessageNumber(station));
+    ASSERT_EQ(1074, Rtcm3MessageNumber(gps));
+    ASSERT_EQ(1084, Rtcm3MessageNumber(glonass));
+    ASSERT_EQ(42u, Rtcm3GetBits(station, 36, 12));
+    int64_t x = (int64_t)Rtcm3GetSignedBits(station, 58, 32)*64 + Rtcm3GetBits(station, 90, 6);
+    ASSERT_EQ(-26948924600ll, x);
+
+    // only the last message of the epoch clears the multiple message bit
+    ASSERT_EQ(1u, Rtcm3GetBits(gps, 24+54, 1));
+    ASSERT_EQ(0u, Rtcm3GetBits(glonass, 24+54, 1));
+    ASSERT_EQ(345600000u, Rtcm3GetBits(gps, 24+24, 30));
+
+    // one satellite with two signals: the pseudoranges are the rough range
+    // plus each cell's fine range
+    size_t position = 24 + 169;
+    ASSERT_EQ(3u, Rtcm3GetBits(gps, position, 2));
+    position += 2;
+    double rough = Rtcm3GetBits(gps, position, 8) + Rtcm3GetBits(gps, position+8, 10)/1024.0;
+    position += 18;
+    for (int ii=0; ii<2; ii++) {
+        double pseudorange = (rough + Rtcm3GetSignedBits(gps, position + 15*ii, 15)*ldexp(1.0, -24))*RTCM3_RANGE_MS;
+        ASSERT_NEAR(ranges.range_data[ii].pseudorange, pseudorange, 0.01);
+        double phase = (rough + Rtcm3GetSignedBits(gps, position + 30 + 22*ii, 22)*ldexp(1.0, -29))*RTCM3_RANGE_MS;
+        ASSERT_NEAR(ranges.range_data[ii].pseudorange + 0.25, phase, 0.001);
+    }
+
+    // GLONASS in MSM7 carries the frequency number and uses its wavelength
+    Rtcm3Encoder msm7_encoder(42, MSM7);
+    std::vector<unsigned char> msm7_output;
+    ASSERT_EQ(2u, msm7_encoder.EncodeObservations(ranges, msm7_output));
+    ASSERT_EQ(0u, msm7_encoder.unknown_glonass_frequency_count());
+    encoded_rtcm_frames.clear();
+    framer.AddData(&msm7_output[0], msm7_output.size());
+    ASSERT_EQ(2u, encoded_rtcm_frames.size());
+    glonass = (const unsigned char*)encoded_rtcm_frames[1].data();
+    ASSERT_EQ(1087, Rtcm3MessageNumber(glonass));
+    position = 24 + 169 + 1;
+    ASSERT_EQ(8u, Rtcm3GetBits(glonass, position+8, 4));
+    rough = Rtcm3GetBits(glonass, position, 8) + Rtcm3GetBits(glonass, position+12, 10)/1024.0;
+    double wavelength = SignalWavelength(*LookupSignal(ranges.range_data[2].channel_status), 1);
+    ASSERT_NEAR(1234.5*wavelength, Rtcm3GetSignedBits(glonass, position+22, 14), 1.0);
+    position += 36;
+    double glonass_phase = (rough + Rtcm3GetSignedBits(glonass, position+20, 24)*ldexp(1.0, -31))*RTCM3_RANGE_MS;
+    ASSERT_NEAR(ranges.range_data[2].pseudorange + 0.25, glonass_phase, 0.001);
+
+    // without a frequency number GLONASS is left out rather than encoded with k=0
+    ranges.range_data[2].glonass_frequency = GLONASS_FREQUENCY_UNKNOWN;
+    msm7_output.clear();
+    ASSERT_EQ(1u, msm7_encoder.EncodeObservations(ranges, msm7_output));
+    ASSERT_EQ(1u, msm7_encoder.unknown_glonass_frequency_count());
+    ASSERT_EQ(1077, Rtcm3MessageNumber(&msm7_output[0]));
+    ASSERT_EQ(0u, Rtcm3GetBits(&msm7_output[0], 24+54, 1));
+
+    // served to a TCP client from the fan-out ring
+    int probe = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    ASSERT_EQ(0, bind(probe, (struct sockaddr*)&address, sizeof(address)));
+    getsockname(probe, (struct sockaddr*)&address, &length);
+    close(probe);
+    std::stringstream url;
+    url << "tcp://127.0.0.1:" << ntohs(address.sin_port);
+    FanoutServer server(4096);
+    server.AddEndpoint(url.str());
+    server.Start();
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(0, connect(client, (struct sockaddr*)&address, sizeof(address)));
+    for (int ii=0; (ii<200) && (server.Stats().clients == 0); ii++)
+        usleep(5000);
+    ASSERT_EQ(1u, server.Stats().clients);
+    server.Publish(&output[0], output.size());
+    std::vector<unsigned char> received(output.size());
+    size_t count = 0;
+    while (count < received.size()) {
+        ssize_t result = recv(client, &received[count], received.size() - count, 0);
+        ASSERT_GT(result, 0);
+        count += result;
+    }
+    ASSERT_TRUE(received == output);
+
+    // a client that stops reading is dropped once it is a ring behind
+    std::vector<unsigned char> filler(1024, 0x55);
+    for (int ii=0; (ii<10000) && (server.Stats().dropped_clients == 0); ii++) {
+        server.Publish(&filler[0], filler.size());
+        usleep(100);
+    }
+    ASSERT_EQ(1u, server.Stats().dropped_clients);
+    server.Stop();
+    close(client);
+}
+
+TEST(DataParsing, BinaryEncoderRoundTrip) {
+    Almanac almanac;
+    memset(&almanac, 0, sizeof(almanac));
+    almanac.number_of_prns = 2;
+    almanac.data[0].prn = 5;
+    almanac.data[1].prn = 17;
+    almanac.data[1].eccentricity = 0.0125;
+    Position position;
+    memset(&position, 0, sizeof(position));
+    position.latitude = 51.1;
+
+    BinaryEncoder encoder;
+    encoder.Add<ALMANACB_LOG_TYPE>(almanac);
+    encoder.Add<BESTPOSB_LOG_TYPE>(position);
+    ASSERT_EQ(2u, encoder.messages());
+    // only the records in use are sent
+    size_t almanac_length = HEADER_SIZE + 4 + 2*sizeof(AlmanacData) + CHECKSUM_SIZE;
+    ASSERT_EQ(almanac_length + sizeof(Position), encoder.size());
+
+    Novatel my_gps;
+    memset(&decoded_almanac, 0, sizeof(decoded_almanac));
+    my_gps.set_almanac_callback(SaveAlmanac);
+    my_gps.set_best_position_callback(SaveBestPosition);
+    my_gps.ReadFromFile((unsigned char*)encoder.data(), encoder.size());
+    DemuxCounters counters = my_gps.GetDemuxCounters();
+    ASSERT_EQ(2u, counters.novatel_binary.frames);
+    ASSERT_EQ(0u, counters.novatel_binary.errors);
+    ASSERT_EQ(2, decoded_almanac.number_of_prns);
+    ASSERT_EQ(17u, decoded_almanac.data[1].prn);
+    ASSERT_EQ(0.0125, decoded_almanac.data[1].eccentricity);
+    ASSERT_EQ(51.1, saved_position.latitude);
+
+    encoder.Clear();
+    ASSERT_TRUE(encoder.empty());
+    ASSERT_EQ(0u, encoder.size());
+    // not connected, so nothing can be sent
+    ASSERT_FALSE(my_gps.InjectAlmanac(almanac));
+}
+
+TEST(DataParsing, StreamServerFilter) {
+    Almanac almanac;
+    memset(&almanac, 0, sizeof(almanac));
+    almanac.number_of_prns = 1;
+    Position position;
+    memset(&position, 0, sizeof(position));
+    position.latitude = 51.1;
+    BinaryEncoder encoder;
+    encoder.Add<ALMANACB_LOG_TYPE>(almanac);
+    encoder.Add<BESTPOSB_LOG_TYPE>(position);
+
+    // only the selected frames reach a client on the unix socket
+    std::string path = "/tmp/novatel_stream_test.sock";
+    Novatel my_gps;
+    StreamServerConfig config;
+    config.message_ids.insert(BESTPOSB_LOG_TYPE);
+    ASSERT_TRUE(my_gps.StartStreamServer(std::vector<std::string>(1, "unix://" + path), config));
+    int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+    ASSERT_EQ(0, connect(client, (struct sockaddr*)&address, sizeof(address)));
+    for (int ii=0; (ii<200) && (my_gps.GetStreamServerStats().clients == 0); ii++)
+        usleep(5000);
+    ASSERT_EQ(1u, my_gps.GetStreamServerStats().clients);
+
+    my_gps.ReadFromFile((unsigned char*)encoder.data(), encoder.size());
+    std::vector<unsigned char> received(sizeof(Position));
+    size_t count = 0;
+    while (count < received.size()) {
+        ssize_t result = recv(client, &received[count], received.size() - count, 0);
+        ASSERT_GT(result, 0);
+        count += result;
+    }
+    Position served;
+    memcpy(&served, &received[0], sizeof(served));
+    ASSERT_EQ(BESTPOSB_LOG_TYPE, served.header.message_id);
+    ASSERT_EQ(51.1, served.latitude);
+    FanoutStats stats = my_gps.GetStreamServerStats();
+    ASSERT_EQ(1u, stats.messages);
+    ASSERT_EQ(sizeof(Position), stats.bytes);
+
+    my_gps.StopStreamServer();
+    close(client);
+    ASSERT_NE(0, access(path.c_str(), F_OK));
+}
+
+TEST(DataParsing, FlightRecorderDump) {
+    Position position;
+    memset(&position, 0, sizeof(position));
+    position.position_type = SINGLE;
+    BinaryEncoder encoder;
+    for (int ii=0; ii<5; ii++) {
+        position.latitude = ii;
+        encoder.Add<BESTPOSB_LOG_TYPE>(position);
+    }
+
+    FlightRecorderConfig config;
+    config.directory = "/tmp";
+    config.post_trigger = 0;
+    Novatel my_gps;
+    ASSERT_TRUE(my_gps.StartFlightRecorder(config));
+    my_gps.ReadFromFile((unsigned char*)encoder.data(), encoder.size());
+    ASSERT_EQ(0u, my_gps.GetFlightRecorderStats().triggers);
+
+    // the solution dropping to NONE dumps everything before it, once
+    encoder.Clear();
+    position.position_type = NONE;
+    encoder.Add<BESTPOSB_LOG_TYPE>(position);
+    my_gps.ReadFromFile((unsigned char*)encoder.data(), encoder.size());
+    for (int ii=0; (ii<200) && (my_gps.GetFlightRecorderStats().dumps == 0); ii++)
+        usleep(5000);
+    FlightRecorderStats stats = my_gps.GetFlightRecorderStats();
+    ASSERT_EQ(1u, stats.dumps);
+    ASSERT_EQ(2u, stats.reads_buffered);
+    ASSERT_EQ(6u, stats.frames);
+    ASSERT_FALSE(my_gps.TriggerFlightRecorder());
+    ASSERT_EQ(1u, my_gps.GetFlightRecorderStats().suppressed);
+    my_gps.StopFlightRecorder();
+
+    // and the dump replays as the frames that were received
+    RecordingReader reader;
+    reader.Open(stats.last_dump);
+    std::vector<unsigned char> block, replayed;
+    while (reader.ReadBlock(block))
+        replayed.insert(replayed.end(), block.begin(), block.end());
+    ASSERT_EQ(6*sizeof(Position), replayed.size());
+    Novatel replay_gps;
+    replay_gps.set_best_position_callback(SaveBestPosition);
+    replay_gps.ReadFromFile(&replayed[0], replayed.size());
+    ASSERT_EQ(6u, replay_gps.GetDemuxCounters().novatel_binary.frames);
+    ASSERT_EQ(NONE, saved_position.position_type);
+    unlink(stats.last_dump.c_str());
+
+    // a CRC storm dump holds the corrupt frames as they were read
+    encoder.Clear();
+    position.position_type = SINGLE;
+    encoder.Add<BESTPOSB_LOG_TYPE>(position);
+    std::string good((const char*)encoder.data(), encoder.size());
+    std::string corrupt(good);
+    corrupt[corrupt.size()-1] ^= 0xFF;
+    config.crc_storm_errors = 3;
+    Novatel storm_gps;
+    ASSERT_TRUE(storm_gps.StartFlightRecorder(config));
+    storm_gps.ReadFromFile((unsigned char*)good.data(), good.size());
+    std::string storm = corrupt + corrupt + corrupt;
+    storm_gps.ReadFromFile((unsigned char*)storm.data(), storm.size());
+    for (int ii=0; (ii<200) && (storm_gps.GetFlightRecorderStats().dumps == 0); ii++)
+        usleep(5000);
+    stats = storm_gps.GetFlightRecorderStats();
+    ASSERT_EQ(1u, stats.dumps);
+    ASSERT_NE(std::string::npos, stats.last_dump.find("crc_storm"));
+    storm_gps.StopFlightRecorder();
+    reader.Open(stats.last_dump);
+    replayed.clear();
+    while (reader.ReadBlock(block))
+        replayed.insert(replayed.end(), block.begin(), block.end());
+    ASSERT_EQ(good + storm, std::string(replayed.begin(), replayed.end()));
+    unlink(stats.last_dump.c_str());
+}
+
+TEST(EphemerisStore, ChangeDetection) {
+    GpsEphemeris ephemeris;
+    memset(&ephemeris, 0, sizeof(ephemeris));
+    ephemeris.prn = 5;
+    ephemeris.issue_of_ephemeris_1 = 10;
+    ephemeris.time_of_ephemeris = 345600;
+
+    EphemerisStore store;
+    ASSERT_TRUE(store.Update(ephemeris));
+    // repeated by the receiver, nothing new
+    ephemeris.time_of_week = 1000;
+    ASSERT_FALSE(store.Update(ephemeris));
+    // new upload
+    ephemeris.issue_of_ephemeris_1 = 11;
+    ephemeris.time_of_ephemeris = 352800;
+    ASSERT_TRUE(store.Update(ephemeris));
+    ephemeris.prn = 7;
+    ASSERT_TRUE(store.Update(ephemeris));
+
+    ASSERT_EQ(2u, store.size());
+    ASSERT_EQ(4u, store.update_count());
+    ASSERT_EQ(3u, store.version());
+    GpsEphemeris stored;
+    ASSERT_TRUE(store.Get(5, stored));
+    ASSERT_EQ(11u, stored.issue_of_ephemeris_1);
+    ASSERT_FALSE(store.Get(6, stored));
+    ASSERT_EQ(7u, store.Snapshot()[1].prn);
+}
+
+static std::vector<HealthEvent> health_events;
+static void SaveHealthEvent(const HealthEvent &event) {
+    health_events.push_back(event);
+}
+
+TEST(HealthMonitor, WindowsAndEvents) {
+    SlidingWindow window(3);
+    double values[] = {5, 1, 3, 4, 2};
+    for (int ii=0; ii<5; ii++)
+        window.Add(values[ii]);
+    ASSERT_EQ(3u, window.count());
+    ASSERT_DOUBLE_EQ(3.0, window.mean());
+    ASSERT_DOUBLE_EQ(2.0, window.min());
+    ASSERT_DOUBLE_EQ(4.0, window.max());
+
+    HealthThresholds thresholds;
+    thresholds.window_size = 2;
+    HealthMonitor monitor(thresholds);
+    monitor.set_event_callback(SaveHealthEvent);
+    health_events.clear();
+
+    ReceiverHardwareStatus levels;
+    memset(&levels, 0, sizeof(levels));
+    levels.board_temperature = 40;
+    levels.supply_voltage = 12;
+    levels.antenna_current = 0.05;
+    monitor.AddHardwareLevels(levels, 1.0);
+    ASSERT_EQ(0u, health_events.size());
+    // antenna unplugged, the window mean drops below the limit on the second log
+    levels.antenna_current = 0;
+    monitor.AddHardwareLevels(levels, 2.0);
+    ASSERT_EQ(0u, health_events.size());
+    monitor.AddHardwareLevels(levels, 3.0);
+    ASSERT_EQ(1u, health_events.size());
+    ASSERT_EQ(HEALTH_ANTENNA_CURRENT, health_events[0].type);
+    ASSERT_TRUE(health_events[0].active);
+    levels.antenna_current = 0.05;
+    monitor.AddHardwareLevels(levels, 4.0);
+    monitor.AddHardwareLevels(levels, 5.0);
+    ASSERT_EQ(2u, health_events.size());
+    ASSERT_FALSE(health_events[1].active);
+
+    // every satellite weak and rejected, as when jammed
+    TrackStatus track;
+    memset(&track, 0, sizeof(track));
+    track.number_of_channels = 4;
+    for (int ii=0; ii<4; ii++) {
+        track.data[ii].prn = ii+1;
+        track.data[ii].cno_ratio = 20 + ii;
+        track.data[ii].range_reject_code = LOWPOWER;
+    }
+    monitor.AddTrackStatus(track, 6.0);
+    ASSERT_TRUE(monitor.IsActive(HEALTH_LOW_CNO));
+    ASSERT_TRUE(monitor.IsActive(HEALTH_RANGE_REJECTS));
+    HealthSummary summary = monitor.Summary();
+    ASSERT_EQ(4u, summary.tracked_channels);
+    ASSERT_DOUBLE_EQ(20.0, summary.min_channel_cno);
+    ASSERT_EQ(4u, summary.reject_counts[LOWPOWER]);
+    ASSERT_NE(std::string::npos, FormatHealthSummary(summary).find("LOW_CNO"));
+}
+
+static std::vector<RtkEvent> rtk_events;
+static void SaveRtkEvent(const RtkEvent &event) {
+    rtk_events.push_back(event);
+}
+
+static rtkdatab_log decoded_rtk_data;
+static void SaveRtkData(rtkdatab_log &data, double &timestamp) {
+    decoded_rtk_data = data;
+}
+
+TEST(RtkMonitor, DecodeAndAnalytics) {
+    rtkdatab_log data;
+    memset(&data, 0, sizeof(data));
+    data.solutionStatus = SOL_COMPUTED;
+    data.positionType = NARROW_FLOAT;
+    data.header.searcher_type = SEARCHING;
+    data.header.num_lane_combs = 12;
+    data.header.num_svs = 2;
+    data.data[0].prn = 5;
+    data.data[0].ambiguity_type = FLOAT_NARROW;
+    data.data[0].residual = 0.01f;
+    data.data[1].prn = 12;
+    data.data[1].ambiguity_type = FLOAT_NARROW;
+    data.data[1].residual = -0.03f;
+
+    // only the satellites in use are sent and decoded
+    BinaryEncoder encoder;
+    encoder.Add<RTKDATAB_LOG_TYPE>(data);
+    ASSERT_EQ(HEADER_SIZE + RTKDATA_RECORDS_OFFSET + 2*sizeof(rtkdatab_data) + CHECKSUM_SIZE, encoder.size());
+    Novatel my_gps;
+    memset(&decoded_rtk_data, 0, sizeof(decoded_rtk_data));
+    my_gps.set_rtk_data_callback(SaveRtkData);
+    my_gps.ReadFromFile((unsigned char*)encoder.data(), encoder.size());
+    ASSERT_EQ(2, decoded_rtk_data.header.num_svs);
+    ASSERT_EQ(SEARCHING, decoded_rtk_data.header.searcher_type);
+    ASSERT_EQ(12u, decoded_rtk_data.data[1].prn);
+    ASSERT_FLOAT_EQ(-0.03f, decoded_rtk_data.data[1].residual);
+
+    // float for 30 s, fixed for 60 s, then float again
+    RtkMonitor monitor;
+    monitor.set_event_callback(SaveRtkEvent);
+    rtk_events.clear();
+    data.hdr.gps_week = 1800;
+    for (int ii=0; ii<=100; ii++) {
+        data.hdr.gps_millisecs = 1000*ii;
+        bool fixed = (ii >= 30) && (ii < 90);
+        data.positionType = fixed ? NARROW_INT : NARROW_FLOAT;
+        data.header.searcher_type = fixed ? HANDOFF_COMPLETE : SEARCHING;
+        data.data[0].ambiguity_type = fixed ? INT_NARROW : FLOAT_NARROW;
+        monitor.AddRtkData(data, ii);
+    }
+    RtkSummary summary = monitor.Summary();
+    ASSERT_EQ(101u, summary.epochs);
+    ASSERT_EQ(60u, summary.fixed_epochs);
+    ASSERT_EQ(41u, summary.float_epochs);
+    ASSERT_FALSE(summary.fixed);
+    ASSERT_DOUBLE_EQ(10.0, summary.state_duration);
+    ASSERT_EQ(1u, summary.fix_count);
+    ASSERT_EQ(1u, summary.fix_loss_count);
+    ASSERT_DOUBLE_EQ(30.0, summary.last_time_to_fix);
+    ASSERT_DOUBLE_EQ(60.0, summary.mean_fix_duration);
+    ASSERT_EQ(1u, summary.searcher_transitions[SEARCHING][HANDOFF_COMPLETE]);
+    ASSERT_EQ(1u, summary.searcher_transitions[HANDOFF_COMPLETE][SEARCHING]);
+
+    ASSERT_EQ(4u, rtk_events.size());
+    ASSERT_EQ(RTK_FIX_ACQUIRED, rtk_events[0].type);
+    ASSERT_DOUBLE_EQ(30.0, rtk_events[0].value);
+    ASSERT_EQ(RTK_FIX_LOST, rtk_events[2].type);
+    ASSERT_DOUBLE_EQ(60.0, rtk_events[2].value);
+
+    ASSERT_EQ(2u, summary.satellites.size());
+    ASSERT_EQ(5u, summary.satellites[0].prn);
+    ASSERT_EQ(60u, summary.satellites[0].integer_epochs);
+    ASSERT_NEAR(0.03, summary.satellites[1].rms_residual, 1e-6);
+    ASSERT_NEAR(0.0, summary.satellites[1].stddev_residual, 1e-6);
+    ASSERT_NE(std::string::npos, FormatRtkSummary(summary).find("fixes=1 losses=1"));
+
+    monitor.Reset();
+    ASSERT_EQ(0u, monitor.Summary().epochs);
+}
+
+TEST(RestartTracker, MilestonesFromLogs) {
+    std::ifstream file("./test_data/OneEach.GPS", std::ios::in|std::ios::binary);
+    ASSERT_TRUE(file.is_open());
+    std::string file_contents((std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+
+    Novatel my_gps;
+    ASSERT_FALSE(my_gps.GetRestartReport().started);
+    ASSERT_EQ("reset=none", FormatRestartReport(my_gps.GetRestartReport()));
+
+    // nothing is timed until a restart starts
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    ASSERT_TRUE(my_gps.GetRestartReport().first_fix.empty());
+
+    my_gps.TrackRestart();
+    std::string banner("[COM1]");
+    my_gps.ReadFromFile((unsigned char*)banner.data(), banner.size());
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    RestartReport report = my_gps.GetRestartReport();
+    ASSERT_TRUE(report.started);
+    ASSERT_EQ(RESET_EXTERNAL, report.reset_type);
+    ASSERT_GE(report.banner, 0);
+    ASSERT_GE(report.coarse_time, report.banner);
+    ASSERT_FALSE(report.first_fix.empty());
+    ASSERT_LT(report.ins_aligned, 0);
+    ASSERT_GE(report.elapsed, report.coarse_time);
+    ASSERT_LT(report.FirstFix(INS_RTKFIXED), 0);
+
+    // replaying the logs reaches nothing new
+    my_gps.ReadFromFile((unsigned char*)file_contents.data(), file_contents.size());
+    RestartReport again = my_gps.GetRestartReport();
+    ASSERT_EQ(report.coarse_time, again.coarse_time);
+    ASSERT_EQ(report.first_fix, again.first_fix);
+    ASSERT_NE(std::string::npos, FormatRestartReport(again).find("reset=external"));
+    ASSERT_NE(std::string::npos, FormatRestartReport(again).find(" fix."));
+}
+
+TEST(RestartTracker, IgnoresFramesBeforeBanner) {
+    Position position;
+    memset(&position, 0, sizeof(position));
+    position.header.sync1 = NOVATEL_SYNC_BYTE_1;
+    position.header.sync2 = NOVATEL_SYNC_BYTE_2;
+    position.header.sync3 = NOVATEL_SYNC_BYTE_3;
+    position.header.time_status = GPSTIME_FINESTEERING;
+    position.solution_status = SOL_COMPUTED;
+    position.position_type = SINGLE;
+
+    // logs from before a driver sent reset are still arriving
+    RestartTracker tracker;
+    tracker.Start(RESET_COLD);
+    tracker.AddFrame((unsigned char*)&position, sizeof(position), BESTPOSB_LOG_TYPE);
+    RestartReport report = tracker.Report();
+    ASSERT_LT(report.coarse_time, 0);
+    ASSERT_LT(report.fine_time, 0);
+    ASSERT_TRUE(report.first_fix.empty());
+
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    tracker.AddBanner();
+    tracker.AddFrame((unsigned char*)&position, sizeof(position), BESTPOSB_LOG_TYPE);
+    report = tracker.Report();
+    ASSERT_GE(report.banner, 0.02);
+    ASSERT_GE(report.fine_time, report.banner);
+    ASSERT_GE(report.FirstFix(SINGLE), report.banner);
+}
+
+static void CollectSmoothedEpoch(std::vector<SmoothedEpoch> *epochs, const SmoothedEpoch &epoch) {
+    epochs->push_back(epoch);
+}
+
+//! Replays a straight drive east with a drifting INS and noisy fixes through a smoother
+static void SmoothDrive(const SmootherConfig &config, std::vector<SmoothedEpoch> &epochs, SmootherStats &stats) {
+    TrajectorySmoother smoother(config);
+    epochs.clear();
+    smoother.set_smoothed_epoch_callback(boost::bind(&CollectSmoothedEpoch, &epochs, _1));
+    const double metres_to_longitude = 180/(M_PI*6378137.0*cos(40*M_PI/180));
+
+    InsCovariance cov;
+    memset(&cov, 0, sizeof(cov));
+    cov.position_covariance[0] = cov.position_covariance[4] = cov.position_covariance[8] = 1;
+    cov.velocity_covariance[0] = cov.velocity_covariance[4] = cov.velocity_covariance[8] = 1e-4;
+    smoother.AddInsCovariance(cov);
+
+    uint32_t seed = 12345;
+    for (int ii=0; ii<=1200; ii++) {
+        double t = ii*0.1;
+        InsPositionVelocityAttitude pva;
+        memset(&pva, 0, sizeof(pva));
+        pva.header.gps_week = 1800;
+        pva.header.gps_millisecs = 345600000 + ii*100;
+        pva.latitude = 40;
+        // 2 cm/s of drift east and 1 cm/s up
+        pva.longitude = -86 + (10*t + 0.02*t)*metres_to_longitude;
+        pva.height = 200 + 0.01*t;
+        pva.east_velocity = 10;
+        pva.status = INS_SOLUTION_GOOD;
+        smoother.AddInsPva(pva);
+
+        if (ii % 10 == 0) {
+            double noise[3];
+            for (int jj=0; jj<3; jj++) {
+                noise[jj] = 0;
+                for (int kk=0; kk<4; kk++) {
+                    seed = seed*1103515245 + 12345;
+                    noise[jj] += ((seed >> 8) & 0xFFFF)/65536.0 - 0.5;
+                }
+                noise[jj] *= 0.5;
+            }
+            Position pos;
+            memset(&pos, 0, sizeof(pos));
+            pos.header = pva.header;
+            pos.solution_status = SOL_COMPUTED;
+            pos.position_type = (ii == 600) ? NONE : SINGLE;
+            pos.latitude = 40 + noise[1]*180/(M_PI*6378137.0);
+            pos.longitude = -86 + (10*t + noise[0])*metres_to_longitude;
+            pos.undulation = -30;
+            pos.height = 230 + noise[2];
+            pos.latitude_standard_deviation = pos.longitude_standard_deviation = pos.height_standard_deviation = 0.3;
+            smoother.AddPosition(pos);
+        }
+    }
+    smoother.Finish();
+    stats = smoother.stats();
+}
+
+TEST(DataParsing, TrajectorySmoother) {
+    SmootherConfig single;
+    single.segment_length = 1000;
+    single.threads = 1;
+    std::vector<SmoothedEpoch> reference;
+    SmootherStats stats;
+    SmoothDrive(single, reference, stats);
+    ASSERT_EQ(1201u, reference.size());
+    ASSERT_EQ(1201u, stats.epochs);
+    // the fix without a solution and the one after the last epoch are unused
+    ASSERT_EQ(119u, stats.fixes);
+    ASSERT_EQ(2u, stats.fixes_dropped);
+    ASSERT_EQ(1u, stats.segments);
+
+    const double longitude_to_metres = M_PI*6378137.0*cos(40*M_PI/180)/180;
+    double drift = 0, error = 0;
+    for (size_t ii=0; ii<reference.size(); ii++) {
+        double t = ii*0.1;
+        ASSERT_NEAR(345600 + t, reference[ii].gps_seconds, 1e-6);
+        double east = (reference[ii].longitude + 86)*longitude_to_metres - 10*t;
+        double up = reference[ii].height - 200;
+        error += east*east + up*up;
+        drift += pow(0.02*t, 2) + pow(0.01*t, 2);
+        ASSERT_LT(reference[ii].covariance[0], 1.0);
+    }
+    error = sqrt(error/reference.size());
+    drift = sqrt(drift/reference.size());
+    // better than both the INS and the fixes
+    ASSERT_LT(error, 0.5*drift);
+    ASSERT_LT(error, 0.2);
+
+    // overlapping segments smoothed in parallel give the same trajectory
+    SmootherConfig parallel;
+    parallel.segment_length = 30;
+    parallel.overlap = 30;
+    parallel.threads = 4;
+    parallel.max_segments = 2;
+    std::vector<SmoothedEpoch> segmented;
+    SmoothDrive(parallel, segmented, stats);
+    ASSERT_EQ(reference.size(), segmented.size());
+    ASSERT_EQ(5u, stats.segments);
+    for (size_t ii=0; ii<reference.size(); ii++) {
+        ASSERT_EQ(reference[ii].gps_seconds, segmented[ii].gps_seconds);
+        ASSERT_NEAR(reference[ii].longitude, segmented[ii].longitude, 0.005/longitude_to_metres);
+        ASSERT_NEAR(reference[ii].latitude, segmented[ii].latitude, 0.005/longitude_to_metres);
+        ASSERT_NEAR(reference[ii].height, segmented[ii].height, 0.005);
+    }
+}
+
 
 int main(int argc, char **argv) {
   try {